@@ -30,8 +30,11 @@
 #include <unistd.h>
 #include <zlib.h>
 
+#include <algorithm>
 #include <fstream>
 #include <memory>
+#include <thread>
+#include <vector>
 
 #include <binder/IBinder.h>
 #include <binder/IServiceManager.h>
@@ -50,6 +53,7 @@
 #include <android-base/macros.h>
 #include <android-base/properties.h>
 #include <android-base/stringprintf.h>
+#include <android-base/unique_fd.h>
 
 using namespace android;
 using pdx::default_transport::ServiceUtility;
@@ -270,6 +274,7 @@ static int g_traceDurationSeconds = 5;
 static bool g_traceOverwrite = false;
 static int g_traceBufferSizeKB = 2048;
 static bool g_compress = false;
+static int g_compressLevel = Z_DEFAULT_COMPRESSION;
 static bool g_nohup = false;
 static int g_initialSleepSecs = 0;
 static const char* g_categoriesFile = nullptr;
@@ -894,20 +899,15 @@ static void stopTrace()
     setTracingEnabled(false);
 }
 
-// Read data from the tracing pipe and forward to stdout
-static void streamTrace()
+// Copy the tracing pipe to stdout with read()/write().
+static void streamTraceCopy(int traceFD)
 {
-    char trace_data[4096];
-    int traceFD = open((g_traceFolder + k_traceStreamPath).c_str(), O_RDWR);
-    if (traceFD == -1) {
-        fprintf(stderr, "error opening %s: %s (%d)\n", k_traceStreamPath,
-                strerror(errno), errno);
-        return;
-    }
+    constexpr size_t bufSize = 64*1024;
+    std::unique_ptr<char[]> trace_data(new char[bufSize]);
     while (!g_traceAborted) {
-        ssize_t bytes_read = read(traceFD, trace_data, 4096);
+        ssize_t bytes_read = read(traceFD, trace_data.get(), bufSize);
         if (bytes_read > 0) {
-            write(STDOUT_FILENO, trace_data, bytes_read);
+            write(STDOUT_FILENO, trace_data.get(), bytes_read);
             fflush(stdout);
         } else {
             if (!g_traceAborted) {
@@ -919,93 +919,241 @@ static void streamTrace()
     }
 }
 
-// Read the current kernel trace and write it to stdout.
-static void dumpTrace(int outFd)
+// Write out whatever is left in the intermediate pipe with read()/write().
+static void drainTracePipe(int pipeFD, size_t bytes)
 {
-    ALOGI("Dumping trace");
-    int traceFD = open((g_traceFolder + k_tracePath).c_str(), O_RDWR);
-    if (traceFD == -1) {
-        fprintf(stderr, "error opening %s: %s (%d)\n", k_tracePath,
-                strerror(errno), errno);
-        return;
+    char buf[4096];
+    while (bytes > 0) {
+        ssize_t rc = TEMP_FAILURE_RETRY(read(pipeFD, buf, std::min(bytes, sizeof(buf))));
+        if (rc <= 0 || !android::base::WriteFully(STDOUT_FILENO, buf, rc)) {
+            fprintf(stderr, "error writing trace: %s (%d)\n", strerror(errno), errno);
+            return;
+        }
+        bytes -= rc;
     }
+}
 
-    if (g_compress) {
-        z_stream zs;
-        memset(&zs, 0, sizeof(zs));
+// Move the tracing pipe to stdout through an intermediate pipe with splice(),
+// so that the trace data never gets copied to userspace. Returns false if
+// nothing could be spliced, in which case the caller falls back to copying.
+static bool streamTraceSplice(int traceFD)
+{
+    int pipeFds[2];
+    if (pipe2(pipeFds, O_CLOEXEC) == -1) {
+        return false;
+    }
+    android::base::unique_fd pipeRead(pipeFds[0]);
+    android::base::unique_fd pipeWrite(pipeFds[1]);
 
-        int result = deflateInit(&zs, Z_DEFAULT_COMPRESSION);
-        if (result != Z_OK) {
-            fprintf(stderr, "error initializing zlib: %d\n", result);
-            close(traceFD);
-            return;
+    constexpr size_t chunkSize = 64*1024;
+    // Set once data has reached stdout through splice(), which proves that
+    // stdout supports it.
+    bool spliced = false;
+    while (!g_traceAborted) {
+        ssize_t bytes_in = splice(traceFD, nullptr, pipeWrite, nullptr, chunkSize,
+                                  SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (bytes_in <= 0) {
+            if (bytes_in == -1 && errno == EINTR) {
+                continue;
+            }
+            if (!spliced && bytes_in == -1 && errno == EINVAL) {
+                return false;
+            }
+            if (!g_traceAborted) {
+                fprintf(stderr, "splice returned %zd bytes err %d (%s)\n",
+                        bytes_in, errno, strerror(errno));
+            }
+            break;
         }
-
-        constexpr size_t bufSize = 64*1024;
-        std::unique_ptr<uint8_t> in(new uint8_t[bufSize]);
-        std::unique_ptr<uint8_t> out(new uint8_t[bufSize]);
-        if (!in || !out) {
-            fprintf(stderr, "couldn't allocate buffers\n");
-            close(traceFD);
-            return;
+        while (bytes_in > 0) {
+            ssize_t bytes_out = splice(pipeRead, nullptr, STDOUT_FILENO, nullptr, bytes_in,
+                                       SPLICE_F_MOVE | SPLICE_F_MORE);
+            if (bytes_out == -1 && errno == EINTR) {
+                continue;
+            }
+            if (bytes_out <= 0) {
+                if (!spliced) {
+                    // stdout does not take splice() (e.g. a tty or an O_APPEND
+                    // file); hand over the data already pulled from the
+                    // tracing pipe before the caller starts copying.
+                    drainTracePipe(pipeRead, bytes_in);
+                    return false;
+                }
+                fprintf(stderr, "error writing trace: %s (%d)\n", strerror(errno), errno);
+                return true;
+            }
+            spliced = true;
+            bytes_in -= bytes_out;
         }
+    }
+    return true;
+}
 
-        int flush = Z_NO_FLUSH;
+// Read data from the tracing pipe and forward to stdout
+static void streamTrace()
+{
+    int traceFD = open((g_traceFolder + k_traceStreamPath).c_str(), O_RDWR);
+    if (traceFD == -1) {
+        fprintf(stderr, "error opening %s: %s (%d)\n", k_traceStreamPath,
+                strerror(errno), errno);
+        return;
+    }
+    fflush(stdout);
+    // splice() needs a pipe on one end; stdout may not support it (e.g. a tty).
+    if (!streamTraceSplice(traceFD)) {
+        streamTraceCopy(traceFD);
+    }
+    close(traceFD);
+}
 
-        zs.next_out = reinterpret_cast<Bytef*>(out.get());
-        zs.avail_out = bufSize;
+// The trace is compressed in independent blocks of this size, which are
+// deflated concurrently and stitched into a single zlib stream.
+static constexpr size_t k_compressBlockSize = 512*1024;
+static constexpr size_t k_compressWindowSize = 32*1024;
+static constexpr size_t k_maxCompressThreads = 4;
+
+struct CompressBlock {
+    std::vector<uint8_t> in;
+    std::vector<uint8_t> out;
+    uLong adler;
+    bool ok;
+};
 
-        do {
+// Deflate |block| as raw deflate data ending on a byte boundary, primed with
+// the last window of the preceding input (if any) so that splitting the
+// input costs almost nothing in compression ratio.
+static void compressBlock(CompressBlock* block, const uint8_t* dict, size_t dictSize)
+{
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    block->ok = false;
+    block->adler = adler32(0L, Z_NULL, 0);
+    block->adler = adler32(block->adler, block->in.data(), block->in.size());
+    if (deflateInit2(&zs, g_compressLevel, Z_DEFLATED, -MAX_WBITS, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+        return;
+    }
+    if (dictSize > 0) {
+        deflateSetDictionary(&zs, dict, dictSize);
+    }
+    block->out.resize(deflateBound(&zs, block->in.size()) + 16);
+    zs.next_in = block->in.data();
+    zs.avail_in = block->in.size();
+    zs.next_out = block->out.data();
+    zs.avail_out = block->out.size();
+    int result = deflate(&zs, Z_SYNC_FLUSH);
+    block->ok = (result == Z_OK || result == Z_BUF_ERROR) && zs.avail_in == 0;
+    block->out.resize(block->out.size() - zs.avail_out);
+    deflateEnd(&zs);
+}
 
-            if (zs.avail_in == 0) {
-                // More input is needed.
-                result = read(traceFD, in.get(), bufSize);
-                if (result < 0) {
-                    fprintf(stderr, "error reading trace: %s (%d)\n",
-                            strerror(errno), errno);
-                    result = Z_STREAM_END;
-                    break;
-                } else if (result == 0) {
-                    flush = Z_FINISH;
-                } else {
-                    zs.next_in = reinterpret_cast<Bytef*>(in.get());
-                    zs.avail_in = result;
-                }
-            }
+// Read the trace from |traceFD| and write it to |outFd| as a zlib stream,
+// compressing up to k_maxCompressThreads blocks at the same time.
+static void compressTrace(int traceFD, int outFd)
+{
+    size_t threadCount = std::clamp<size_t>(std::thread::hardware_concurrency(), 1,
+                                            k_maxCompressThreads);
+    std::vector<CompressBlock> blocks(threadCount);
+    std::vector<uint8_t> window;
+    uLong adler = adler32(0L, Z_NULL, 0);
+
+    // zlib header: deflate with a 32K window, no preset dictionary.
+    const uint8_t header[2] = {0x78, static_cast<uint8_t>(g_compressLevel == 1 ? 0x01 : 0x9c)};
+    if (!android::base::WriteFully(outFd, header, sizeof(header))) {
+        fprintf(stderr, "error writing deflated trace: %s (%d)\n", strerror(errno), errno);
+        return;
+    }
 
-            if (zs.avail_out == 0) {
-                // Need to write the output.
-                result = write(outFd, out.get(), bufSize);
-                if ((size_t)result < bufSize) {
-                    fprintf(stderr, "error writing deflated trace: %s (%d)\n",
-                            strerror(errno), errno);
-                    result = Z_STREAM_END; // skip deflate error message
-                    zs.avail_out = bufSize; // skip the final write
+    bool done = false;
+    while (!done) {
+        // Read the next round of blocks.
+        size_t count = 0;
+        for (; count < blocks.size() && !done; count++) {
+            CompressBlock& block = blocks[count];
+            block.in.resize(k_compressBlockSize);
+            size_t filled = 0;
+            while (filled < block.in.size()) {
+                ssize_t rc = TEMP_FAILURE_RETRY(read(traceFD, block.in.data() + filled,
+                                                     block.in.size() - filled));
+                if (rc < 0) {
+                    fprintf(stderr, "error reading trace: %s (%d)\n", strerror(errno), errno);
+                    done = true;
+                    break;
+                } else if (rc == 0) {
+                    done = true;
                     break;
                 }
-                zs.next_out = reinterpret_cast<Bytef*>(out.get());
-                zs.avail_out = bufSize;
+                filled += rc;
             }
+            block.in.resize(filled);
+            if (filled == 0) {
+                break;
+            }
+        }
 
-        } while ((result = deflate(&zs, flush)) == Z_OK);
-
-        if (result != Z_STREAM_END) {
-            fprintf(stderr, "error deflating trace: %s\n", zs.msg);
+        // Compress them concurrently; each block is primed with the tail of
+        // the one before it.
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < count; i++) {
+            const std::vector<uint8_t>& prev = i == 0 ? window : blocks[i - 1].in;
+            size_t dictSize = std::min(prev.size(), k_compressWindowSize);
+            const uint8_t* dict = prev.data() + prev.size() - dictSize;
+            if (i + 1 == count) {
+                compressBlock(&blocks[i], dict, dictSize);
+            } else {
+                threads.emplace_back(compressBlock, &blocks[i], dict, dictSize);
+            }
+        }
+        for (auto& thread : threads) {
+            thread.join();
         }
 
-        if (zs.avail_out < bufSize) {
-            size_t bytes = bufSize - zs.avail_out;
-            result = write(outFd, out.get(), bytes);
-            if ((size_t)result < bytes) {
+        // Write them in order.
+        for (size_t i = 0; i < count; i++) {
+            CompressBlock& block = blocks[i];
+            if (!block.ok) {
+                fprintf(stderr, "error deflating trace\n");
+                return;
+            }
+            if (!android::base::WriteFully(outFd, block.out.data(), block.out.size())) {
                 fprintf(stderr, "error writing deflated trace: %s (%d)\n",
                         strerror(errno), errno);
+                return;
             }
+            adler = adler32_combine(adler, block.adler, block.in.size());
         }
-
-        result = deflateEnd(&zs);
-        if (result != Z_OK) {
-            fprintf(stderr, "error cleaning up zlib: %d\n", result);
+        if (count > 0) {
+            const std::vector<uint8_t>& last = blocks[count - 1].in;
+            size_t keep = std::min(last.size(), k_compressWindowSize);
+            window.assign(last.end() - keep, last.end());
         }
+    }
+
+    // An empty final fixed-Huffman block ends the deflate data, followed by
+    // the big-endian Adler-32 of the whole trace.
+    const uint8_t trailer[6] = {
+        0x03, 0x00,
+        static_cast<uint8_t>(adler >> 24), static_cast<uint8_t>(adler >> 16),
+        static_cast<uint8_t>(adler >> 8), static_cast<uint8_t>(adler),
+    };
+    if (!android::base::WriteFully(outFd, trailer, sizeof(trailer))) {
+        fprintf(stderr, "error writing deflated trace: %s (%d)\n", strerror(errno), errno);
+    }
+}
+
+// Read the current kernel trace and write it to stdout.
+static void dumpTrace(int outFd)
+{
+    ALOGI("Dumping trace");
+    int traceFD = open((g_traceFolder + k_tracePath).c_str(), O_RDWR);
+    if (traceFD == -1) {
+        fprintf(stderr, "error opening %s: %s (%d)\n", k_tracePath,
+                strerror(errno), errno);
+        return;
+    }
+
+    if (g_compress) {
+        compressTrace(traceFD, outFd);
     } else {
         char buf[4096];
         ssize_t rc;
@@ -1071,6 +1219,7 @@ static void showHelp(const char *cmd)
                     "  -s N            sleep for N seconds before tracing [default 0]\n"
                     "  -t N            trace for N seconds [default 5]\n"
                     "  -z              compress the trace dump\n"
+                    "  --fast_compress compress the trace dump favoring speed over size\n"
                     "  --async_start   start circular trace and return immediately\n"
                     "  --async_dump    dump the current contents of circular trace buffer\n"
                     "  --async_stop    stop tracing and dump the current contents of circular\n"
@@ -1213,6 +1362,7 @@ int main(int argc, char **argv)
             {"only_userspace",    no_argument, nullptr,  0 },
             {"list_categories",   no_argument, nullptr,  0 },
             {"stream",            no_argument, nullptr,  0 },
+            {"fast_compress",     no_argument, nullptr,  0 },
             {nullptr,                       0, nullptr,  0 }
         };
 
@@ -1288,6 +1438,9 @@ int main(int argc, char **argv)
                 } else if (!strcmp(long_options[option_index].name, "stream")) {
                     traceStream = true;
                     traceDump = false;
+                } else if (!strcmp(long_options[option_index].name, "fast_compress")) {
+                    g_compress = true;
+                    g_compressLevel = Z_BEST_SPEED;
                 } else if (!strcmp(long_options[option_index].name, "list_categories")) {
                     listSupportedCategories();
                     exit(0);
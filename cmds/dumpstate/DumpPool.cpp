@@ -18,9 +18,15 @@
 
 #include "DumpPool.h"
 
+#include <algorithm>
 #include <array>
+#include <functional>
+#include <regex>
+#include <set>
 #include <thread>
 
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
 #include <log/log.h>
 
 #include "dumpstate.h"
@@ -32,6 +38,10 @@ namespace os {
 namespace dumpstate {
 
 const std::string DumpPool::PREFIX_TMPFILE_NAME = "dump-tmp.";
+const std::string DumpPool::DURATION_HISTORY_FILE_NAME = "dump-pool-durations.txt";
+
+// Default number of concurrently running tasks of the non-CPU resource classes.
+static const int DEFAULT_RESOURCE_LIMIT = 2;
 
 DumpPool::DumpPool(const std::string& tmp_root) : tmp_root_(tmp_root), shutdown_(false),
         log_duration_(true) {
@@ -51,6 +61,15 @@ void DumpPool::start(int thread_counts) {
     }
     MYLOGI("Start thread pool:%d", thread_counts);
     shutdown_ = false;
+    std::map<std::string, std::chrono::milliseconds> history = loadDurationHistory();
+    {
+        std::unique_lock lock(lock_);
+        history_ = std::move(history);
+        // The pool may be restarted with a different number of threads.
+        resource_limits_.insert_or_assign(ResourceClass::CPU, thread_counts);
+        resource_limits_.try_emplace(ResourceClass::IO, DEFAULT_RESOURCE_LIMIT);
+        resource_limits_.try_emplace(ResourceClass::BINDER, DEFAULT_RESOURCE_LIMIT);
+    }
     for (int i = 0; i < thread_counts; i++) {
         threads_.emplace_back(std::thread([=]() {
             setThreadName(pthread_self(), i + 1);
@@ -65,7 +84,7 @@ void DumpPool::shutdown() {
         return;
     }
     futures_map_.clear();
-    while (!tasks_.empty()) tasks_.pop();
+    tasks_.clear();
 
     shutdown_ = true;
     condition_variable_.notify_all();
@@ -76,9 +95,231 @@ void DumpPool::shutdown() {
     }
     threads_.clear();
     deleteTempFiles(tmp_root_);
+    // Dry runs skip the actual work, so their durations would corrupt the history.
+    if (!PropertiesHelper::IsDryRun()) {
+        saveDurationHistory();
+    }
     MYLOGI("shutdown thread pool");
 }
 
+void DumpPool::setResourceLimit(ResourceClass resource_class, int limit) {
+    assert(limit > 0);
+    std::unique_lock lock(lock_);
+    resource_limits_[resource_class] = limit;
+    condition_variable_.notify_all();
+}
+
+DumpPool::TaskSpec DumpPool::checkDependencies(const std::string& task_name,
+        const TaskSpec& spec) {
+    // Reject dependencies that lead back to |task_name| through the pending tasks, since those
+    // tasks would never become runnable.
+    TaskSpec checked = spec;
+    checked.dependencies.clear();
+    for (const auto& dependency : spec.dependencies) {
+        std::set<std::string> visited;
+        std::function<bool(const std::string&)> reaches_task = [&](const std::string& name) {
+            if (name == task_name) {
+                return true;
+            }
+            if (!visited.insert(name).second) {
+                return false;
+            }
+            for (const auto& task : tasks_) {
+                if (task.name != name) {
+                    continue;
+                }
+                for (const auto& next : task.spec.dependencies) {
+                    if (reaches_task(next)) {
+                        return true;
+                    }
+                }
+            }
+            return false;
+        };
+        if (reaches_task(dependency)) {
+            MYLOGE("Ignoring dependency of task %s on %s: cycle\n", task_name.c_str(),
+                   dependency.c_str());
+            continue;
+        }
+        checked.dependencies.push_back(dependency);
+    }
+    return checked;
+}
+
+std::list<DumpPool::PendingTask>::iterator DumpPool::nextRunnableTask() {
+    // Remaining work of each pending task: its cost plus the most expensive chain of pending
+    // tasks depending on it. Starting the task heading the longest chain first shortens the
+    // total wall time.
+    std::map<std::string, std::chrono::milliseconds> remaining;
+    std::function<std::chrono::milliseconds(const PendingTask&)> remaining_work =
+            [&](const PendingTask& task) {
+        auto it = remaining.find(task.name);
+        if (it != remaining.end()) {
+            return it->second;
+        }
+        std::chrono::milliseconds longest_dependent(0);
+        for (const auto& other : tasks_) {
+            const auto& deps = other.spec.dependencies;
+            if (std::find(deps.begin(), deps.end(), task.name) != deps.end()) {
+                longest_dependent = std::max(longest_dependent, remaining_work(other));
+            }
+        }
+        return remaining[task.name] = costOf(task.name, task.spec) + longest_dependent;
+    };
+
+    std::map<ResourceClass, int> running_per_class;
+    for (const auto& [name, resource_class] : running_tasks_) {
+        running_per_class[resource_class]++;
+    }
+
+    auto best = tasks_.end();
+    for (auto it = tasks_.begin(); it != tasks_.end(); ++it) {
+        auto limit = resource_limits_.find(it->spec.resource_class);
+        if (limit != resource_limits_.end() &&
+                running_per_class[it->spec.resource_class] >= limit->second) {
+            continue;
+        }
+        bool blocked = false;
+        for (const auto& dependency : it->spec.dependencies) {
+            bool pending = std::any_of(tasks_.begin(), tasks_.end(), [&](const PendingTask& task) {
+                return task.name == dependency;
+            });
+            if (pending || running_tasks_.count(dependency) != 0) {
+                blocked = true;
+                break;
+            }
+        }
+        if (blocked) {
+            continue;
+        }
+        if (best == tasks_.end() || remaining_work(*it) > remaining_work(*best)) {
+            best = it;
+        }
+    }
+    return best;
+}
+
+std::chrono::milliseconds DumpPool::costOf(const std::string& task_name, const TaskSpec& spec) {
+    auto it = history_.find(task_name);
+    return it != history_.end() ? it->second : spec.expected_cost;
+}
+
+void DumpPool::recordDuration(const std::string& title, std::chrono::milliseconds duration) {
+    std::unique_lock lock(lock_);
+    durations_[title] = duration;
+}
+
+std::map<std::string, std::chrono::milliseconds> DumpPool::loadDurationHistory() {
+    std::string history;
+    if (!android::base::ReadFileToString(tmp_root_ + "/" + DURATION_HISTORY_FILE_NAME,
+            &history)) {
+        return {};
+    }
+    return ParseDurations(history);
+}
+
+void DumpPool::saveDurationHistory() {
+    std::map<std::string, std::chrono::milliseconds> history = loadDurationHistory();
+    {
+        std::unique_lock lock(lock_);
+        if (durations_.empty()) {
+            return;
+        }
+        for (const auto& [name, duration] : durations_) {
+            history[name] = duration;
+        }
+        durations_.clear();
+    }
+    std::string content;
+    for (const auto& [name, duration] : history) {
+        content += android::base::StringPrintf("------ %.3fs was the duration of '%s' ------\n",
+                duration.count() / 1000.0f, name.c_str());
+    }
+    std::string path = tmp_root_ + "/" + DURATION_HISTORY_FILE_NAME;
+    if (!android::base::WriteStringToFile(content, path)) {
+        MYLOGE("Failed to write %s: %s\n", path.c_str(), strerror(errno));
+    }
+}
+
+std::map<std::string, std::chrono::milliseconds> DumpPool::ParseDurations(
+        const std::string& text) {
+    static const std::regex duration_regex(
+            "------ ([0-9]+\\.[0-9]+)s was the duration of '(.*)' ------");
+    std::map<std::string, std::chrono::milliseconds> durations;
+    for (std::sregex_iterator it(text.begin(), text.end(), duration_regex), end; it != end;
+            ++it) {
+        durations[(*it)[2]] = std::chrono::milliseconds(
+                static_cast<int64_t>(std::stod((*it)[1]) * 1000));
+    }
+    return durations;
+}
+
+void DumpPool::printCriticalPath(int out_fd) {
+    std::map<std::string, std::chrono::milliseconds> history;
+    std::map<std::string, TaskSpec> specs;
+    {
+        std::unique_lock lock(lock_);
+        history = history_;
+        specs = task_specs_;
+    }
+
+    auto cost_of = [&](const std::string& name) {
+        auto it = history.find(name);
+        return it != history.end() ? it->second : specs[name].expected_cost;
+    };
+
+    // Longest chain of dependencies ending at each task.
+    std::map<std::string, std::chrono::milliseconds> finish;
+    std::map<std::string, std::string> predecessor;
+    std::set<std::string> visiting;
+    std::function<std::chrono::milliseconds(const std::string&)> finish_time =
+            [&](const std::string& name) {
+        auto it = finish.find(name);
+        if (it != finish.end()) {
+            return it->second;
+        }
+        std::chrono::milliseconds start(0);
+        visiting.insert(name);
+        for (const auto& dependency : specs[name].dependencies) {
+            if (specs.count(dependency) == 0 || visiting.count(dependency) != 0) {
+                continue;
+            }
+            std::chrono::milliseconds dependency_finish = finish_time(dependency);
+            if (dependency_finish > start) {
+                start = dependency_finish;
+                predecessor[name] = dependency;
+            }
+        }
+        visiting.erase(name);
+        return finish[name] = start + cost_of(name);
+    };
+
+    std::string last;
+    std::chrono::milliseconds total(0);
+    std::chrono::milliseconds serial(0);
+    for (const auto& [name, spec] : specs) {
+        serial += cost_of(name);
+        if (finish_time(name) > total || last.empty()) {
+            total = finish_time(name);
+            last = name;
+        }
+    }
+
+    std::vector<std::string> path;
+    for (std::string name = last; !name.empty();) {
+        path.insert(path.begin(), name);
+        auto it = predecessor.find(name);
+        name = it != predecessor.end() ? it->second : "";
+    }
+
+    dprintf(out_fd, "------ DUMP POOL CRITICAL PATH (%zu tasks, %.3fs serial, %.3fs critical) "
+            "------\n", specs.size(), serial.count() / 1000.0f, total.count() / 1000.0f);
+    for (const auto& name : path) {
+        dprintf(out_fd, "%.3fs %s%s\n", cost_of(name).count() / 1000.0f, name.c_str(),
+                history.count(name) != 0 ? "" : " (expected)");
+    }
+}
+
 void DumpPool::waitForTask(const std::string& task_name, const std::string& title,
         int out_fd) {
     DurationReporter duration_reporter("Wait for " + task_name, true);
@@ -178,15 +419,21 @@ void DumpPool::setThreadName(const pthread_t thread, int id) {
 void DumpPool::loop() {
     std::unique_lock lock(lock_);
     while (!shutdown_) {
-        if (tasks_.empty()) {
+        auto next = nextRunnableTask();
+        if (next == tasks_.end()) {
             condition_variable_.wait(lock);
             continue;
         } else {
-            std::packaged_task<std::string()> task = std::move(tasks_.front());
-            tasks_.pop();
+            std::string name = next->name;
+            std::packaged_task<std::string()> task = std::move(next->task);
+            running_tasks_.emplace(name, next->spec.resource_class);
+            tasks_.erase(next);
             lock.unlock();
             std::invoke(task);
             lock.lock();
+            running_tasks_.erase(name);
+            // Finishing a task may unblock its dependents or free a resource slot.
+            condition_variable_.notify_all();
         }
     }
 }
@@ -17,10 +17,12 @@
 #ifndef FRAMEWORK_NATIVE_CMD_DUMPPOOL_H_
 #define FRAMEWORK_NATIVE_CMD_DUMPPOOL_H_
 
+#include <chrono>
 #include <future>
+#include <list>
 #include <map>
-#include <queue>
 #include <string>
+#include <vector>
 
 #include <android-base/file.h>
 #include <android-base/macros.h>
@@ -51,11 +53,51 @@ class DumpPoolTest;
  * DumpFoo is a callable function included a out_fd parameter. Using the
  * enqueueTaskWithFd method in DumpPool to enqueue the task to the pool. The
  * std::placeholders::_1 is a placeholder for DumpPool to pass a fd argument.
+ *
+ * Tasks may also be enqueued with a TaskSpec, which declares the tasks they
+ * depend on, their expected cost and the resource they mostly use. Such a task
+ * only starts once its dependencies have finished, the number of running tasks
+ * per resource class is bounded, and among the runnable tasks the one heading
+ * the longest remaining chain of work is started first. The cost of a task is
+ * the duration recorded for it by a previous run, if any (see recordDuration()),
+ * so a task should be named after the DurationReporter section it replaces:
+ *
+ * pool.enqueueGraphTaskWithFd("TaskA", {DumpPool::ResourceClass::BINDER, 2s, {}},
+ *         &DumpA, std::placeholders::_1);
+ * pool.enqueueGraphTaskWithFd("TaskB", {DumpPool::ResourceClass::IO, 500ms, {"TaskA"}},
+ *         &DumpB, std::placeholders::_1);
  */
 class DumpPool {
   friend class android::os::dumpstate::DumpPoolTest;
 
   public:
+    /*
+     * The resource a task mostly consumes. The pool bounds the number of
+     * concurrently running tasks of each class, see setResourceLimit().
+     */
+    enum class ResourceClass {
+        CPU = 0,
+        IO,
+        BINDER,
+    };
+
+    /*
+     * Scheduling information of a task.
+     *
+     * |resource_class| the resource the task mostly consumes.
+     * |expected_cost| how long the task is expected to run, used when no
+     * duration was recorded for it by a previous run.
+     * |dependencies| names of the tasks that must finish before this one
+     * starts. Tasks which are not pending or running when this one is about
+     * to start are ignored, so a task must be enqueued after the tasks it
+     * depends on.
+     */
+    struct TaskSpec {
+        ResourceClass resource_class = ResourceClass::CPU;
+        std::chrono::milliseconds expected_cost = std::chrono::milliseconds(0);
+        std::vector<std::string> dependencies;
+    };
+
     /*
      * Creates a thread pool.
      *
@@ -66,9 +108,11 @@ class DumpPool {
     ~DumpPool();
 
     /*
-     * Starts the threads in the pool.
+     * Starts the threads in the pool, and loads the durations recorded by
+     * previous runs.
      *
-     * |thread_counts| the number of threads to start.
+     * |thread_counts| the number of threads to start, which is also the
+     * resource limit of CPU tasks.
      */
     void start(int thread_counts = MAX_THREAD_COUNT);
 
@@ -89,9 +133,17 @@ class DumpPool {
      */
     template<class F, class... Args> void enqueueTask(const std::string& task_name, F&& f,
             Args&&... args) {
+        enqueueGraphTask(task_name, TaskSpec(), std::forward<F>(f), std::forward<Args>(args)...);
+    }
+
+    /*
+     * Same as enqueueTask, with the scheduling information of the task.
+     */
+    template<class F, class... Args> void enqueueGraphTask(const std::string& task_name,
+            const TaskSpec& spec, F&& f, Args&&... args) {
         std::function<void(void)> func = std::bind(std::forward<F>(f),
                 std::forward<Args>(args)...);
-        futures_map_[task_name] = post(task_name, func);
+        futures_map_[task_name] = post(task_name, spec, func);
         if (threads_.empty()) {
             start();
         }
@@ -109,14 +161,47 @@ class DumpPool {
      */
     template<class F, class... Args> void enqueueTaskWithFd(const std::string& task_name, F&& f,
             Args&&... args) {
+        enqueueGraphTaskWithFd(task_name, TaskSpec(), std::forward<F>(f),
+                std::forward<Args>(args)...);
+    }
+
+    /*
+     * Same as enqueueTaskWithFd, with the scheduling information of the task.
+     */
+    template<class F, class... Args> void enqueueGraphTaskWithFd(const std::string& task_name,
+            const TaskSpec& spec, F&& f, Args&&... args) {
         std::function<void(int)> func = std::bind(std::forward<F>(f),
                 std::forward<Args>(args)...);
-        futures_map_[task_name] = post(task_name, func);
+        futures_map_[task_name] = post(task_name, spec, func);
         if (threads_.empty()) {
             start();
         }
     }
 
+    /*
+     * Sets the maximum number of tasks of |resource_class| running at the same
+     * time. Defaults to the number of threads for CPU and 2 for the other
+     * classes.
+     */
+    void setResourceLimit(ResourceClass resource_class, int limit);
+
+    /*
+     * Records how long the section or task |title| took in this run. Durations
+     * are kept across runs (see DURATION_HISTORY_FILE_NAME) when the pool is
+     * shut down, except in dry-run mode. Tasks are recorded by the pool, and
+     * every DurationReporter section of dumpstate while the pool exists.
+     */
+    void recordDuration(const std::string& title, std::chrono::milliseconds duration);
+
+    /*
+     * Prints the critical path through every task enqueued so far to |out_fd|,
+     * i.e. the chain of dependent tasks bounding the wall time of the pool.
+     * Task costs come from the durations recorded by previous runs, falling
+     * back to TaskSpec::expected_cost. Used in dry-run mode to see what limits
+     * the parallel run.
+     */
+    void printCriticalPath(int out_fd);
+
     /*
      * Waits until the task is finished. Dumps the task results to the STDOUT_FILENO.
      */
@@ -139,28 +224,50 @@ class DumpPool {
      */
     void deleteTempFiles();
 
+    /*
+     * Parses durations printed by DurationReporter, e.g.
+     * "------ 0.123s was the duration of 'TITLE' ------", from |text|.
+     */
+    static std::map<std::string, std::chrono::milliseconds> ParseDurations(
+            const std::string& text);
+
     static const std::string PREFIX_TMPFILE_NAME;
 
+    // File in tmp_root where the durations of finished tasks are kept across runs.
+    static const std::string DURATION_HISTORY_FILE_NAME;
+
   private:
     using Task = std::packaged_task<std::string()>;
     using Future = std::shared_future<std::string>;
 
+    struct PendingTask {
+        std::string name;
+        TaskSpec spec;
+        Task task;
+    };
+
     template<class T> void invokeTask(T dump_func, const std::string& duration_title, int out_fd);
 
-    template<class T> Future post(const std::string& task_name, T dump_func) {
+    template<class T> Future post(const std::string& task_name, const TaskSpec& spec,
+            T dump_func) {
         Task packaged_task([=]() {
             std::unique_ptr<TmpFile> tmp_file_ptr = createTempFile();
             if (!tmp_file_ptr) {
                 return std::string("");
             }
+            auto start = std::chrono::steady_clock::now();
             invokeTask(dump_func, task_name, tmp_file_ptr->fd.get());
+            recordDuration(task_name, std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::steady_clock::now() - start));
             fsync(tmp_file_ptr->fd.get());
             return std::string(tmp_file_ptr->path);
         });
         std::unique_lock lock(lock_);
         auto future = packaged_task.get_future().share();
-        tasks_.push(std::move(packaged_task));
-        condition_variable_.notify_one();
+        tasks_.push_back({task_name, checkDependencies(task_name, spec),
+                std::move(packaged_task)});
+        task_specs_[task_name] = tasks_.back().spec;
+        condition_variable_.notify_all();
         return future;
     }
 
@@ -174,6 +281,27 @@ class DumpPool {
     void setThreadName(const pthread_t thread, int id);
     void loop();
 
+    /*
+     * Returns |spec| without the dependencies that would create a cycle. Must
+     * hold lock_.
+     */
+    TaskSpec checkDependencies(const std::string& task_name, const TaskSpec& spec);
+
+    /*
+     * Returns the next pending task allowed to run, or tasks_.end(). Must hold
+     * lock_.
+     */
+    std::list<PendingTask>::iterator nextRunnableTask();
+
+    /*
+     * Returns the duration recorded for the task by a previous run, or its
+     * expected cost. Must hold lock_.
+     */
+    std::chrono::milliseconds costOf(const std::string& task_name, const TaskSpec& spec);
+
+    std::map<std::string, std::chrono::milliseconds> loadDurationHistory();
+    void saveDurationHistory();
+
     /*
      * For test purpose only. Enables or disables logging duration of the task.
      *
@@ -193,9 +321,19 @@ class DumpPool {
     std::condition_variable condition_variable_;
 
     std::vector<std::thread> threads_;
-    std::queue<Task> tasks_;
+    std::list<PendingTask> tasks_;
     std::map<std::string, Future> futures_map_;
 
+    // Scheduling state, guarded by lock_.
+    std::map<std::string, TaskSpec> task_specs_;
+    std::map<std::string, ResourceClass> running_tasks_;
+    std::map<ResourceClass, int> resource_limits_;
+
+    // Durations recorded by previous runs, loaded by start(), and of the
+    // sections and tasks finished in this run. Guarded by lock_.
+    std::map<std::string, std::chrono::milliseconds> history_;
+    std::map<std::string, std::chrono::milliseconds> durations_;
+
     DISALLOW_COPY_AND_ASSIGN(DumpPool);
 };
 
@@ -16,6 +16,8 @@
 
 #include "TaskQueue.h"
 
+#include <pthread.h>
+
 namespace android {
 namespace os {
 namespace dumpstate {
@@ -24,8 +26,49 @@ TaskQueue::~TaskQueue() {
     run(/* do_cancel = */true);
 }
 
+void TaskQueue::start() {
+    std::unique_lock lock(lock_);
+    if (thread_.joinable()) {
+        return;
+    }
+    stopping_ = false;
+    cancelled_ = false;
+    thread_ = std::thread([this]() {
+        pthread_setname_np(pthread_self(), "dumpstate_zip");
+        loop();
+    });
+}
+
+void TaskQueue::loop() {
+    std::unique_lock lock(lock_);
+    while (true) {
+        condition_variable_.wait(lock, [this]() { return stopping_ || !tasks_.empty(); });
+        if (tasks_.empty()) {
+            return;
+        }
+        auto task = tasks_.front();
+        tasks_.pop();
+        bool cancelled = cancelled_;
+        lock.unlock();
+        std::invoke(task, cancelled);
+        lock.lock();
+    }
+}
+
 void TaskQueue::run(bool do_cancel) {
     std::unique_lock lock(lock_);
+    if (thread_.joinable() || stopping_) {
+        // Let the background thread drain the queue; pending tasks are cancelled if requested.
+        stopping_ = true;
+        cancelled_ = cancelled_ || do_cancel;
+        condition_variable_.notify_one();
+        std::thread thread = std::move(thread_);
+        lock.unlock();
+        if (thread.joinable()) {
+            thread.join();
+        }
+        lock.lock();
+    }
     while (!tasks_.empty()) {
         auto task = tasks_.front();
         tasks_.pop();
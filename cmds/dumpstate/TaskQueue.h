@@ -17,8 +17,11 @@
 #ifndef FRAMEWORK_NATIVE_CMD_TASKQUEUE_H_
 #define FRAMEWORK_NATIVE_CMD_TASKQUEUE_H_
 
+#include <condition_variable>
+#include <functional>
 #include <mutex>
 #include <queue>
+#include <thread>
 
 #include <android-base/macros.h>
 
@@ -31,6 +34,11 @@ namespace dumpstate {
  * which are needed to run in a single thread. The task is a callable function
  * included a cancel task boolean parameter. The TaskQueue could
  * cancel the task in the destructor if the task has never been called.
+ *
+ * By default tasks are only invoked by run(). After start(), a background
+ * thread invokes the tasks in order as soon as they are added, so that e.g.
+ * zip compression overlaps with the remaining dumps instead of running at the
+ * end of the bugreport.
  */
 class TaskQueue {
   public:
@@ -51,10 +59,18 @@ class TaskQueue {
         tasks_.emplace([=](bool cancelled) {
             std::invoke(func, cancelled);
         });
+        condition_variable_.notify_one();
     }
 
     /*
-     * Invokes all tasks in the task queue.
+     * Starts a background thread which invokes the tasks in the order they are
+     * added. Does nothing if the thread is already running.
+     */
+    void start();
+
+    /*
+     * Invokes all tasks in the task queue. If the background thread is
+     * running, waits until it has processed every task and stops it.
      *
      * |do_cancel| true to cancel all tasks in the queue.
      */
@@ -63,8 +79,14 @@ class TaskQueue {
   private:
     using Task = std::function<void(bool)>;
 
+    void loop();
+
     std::mutex lock_;
+    std::condition_variable condition_variable_;
     std::queue<Task> tasks_;
+    std::thread thread_;
+    bool stopping_ = false;
+    bool cancelled_ = false;
 
     DISALLOW_COPY_AND_ASSIGN(TaskQueue);
 };
@@ -229,6 +229,11 @@ static const std::string DUMP_INCIDENT_REPORT_TASK = "INCIDENT REPORT";
 static const std::string DUMP_HALS_TASK = "DUMP HALS";
 static const std::string DUMP_BOARD_TASK = "dumpstate_board()";
 static const std::string DUMP_CHECKINS_TASK = "DUMP CHECKINS";
+static const std::string DUMP_MEMORY_FILES_TASK = "DUMP MEMORY FILES";
+static const std::string DUMP_PROCRANK_TASK = "DUMP PROCRANK";
+static const std::string DUMP_LIBRANK_TASK = "DUMP LIBRANK";
+static const std::string DUMP_BINDER_LOGS_TASK = "DUMP BINDER LOGS";
+static const std::string DUMP_APP_INFOS_TASK = "DUMP APP INFOS";
 
 namespace android {
 namespace os {
@@ -345,8 +350,9 @@ static void RunDumpsys(const std::string& title, const std::vector<std::string>&
                        int out_fd) {
     return ds.RunDumpsys(title, dumpsysArgs, Dumpstate::DEFAULT_DUMPSYS, 0, out_fd);
 }
-static int DumpFile(const std::string& title, const std::string& path) {
-    return ds.DumpFile(title, path);
+static int DumpFile(const std::string& title, const std::string& path,
+                    int out_fd = STDOUT_FILENO) {
+    return ds.DumpFile(title, path, out_fd);
 }
 
 // Relative directory (inside the zip) for all files copied as-is into the bugreport.
@@ -825,6 +831,7 @@ status_t Dumpstate::AddZipEntryFromFd(const std::string& entry_name, int fd,
                entry_name.c_str());
         return INVALID_OPERATION;
     }
+    std::lock_guard<std::mutex> lock(zip_writer_lock_);
     std::string valid_name = entry_name;
 
     // Rename extension if necessary.
@@ -905,9 +912,54 @@ status_t Dumpstate::AddZipEntryFromFd(const std::string& entry_name, int fd,
         return UNKNOWN_ERROR;
     }
 
+    ZipWriter::FileEntry file_entry;
+    if (zip_writer_->GetLastEntry(&file_entry) == 0) {
+        zip_entry_durations_.push_back({valid_name,
+                std::chrono::duration_cast<std::chrono::milliseconds>(
+                        std::chrono::steady_clock::now() - start),
+                file_entry.uncompressed_size, file_entry.compressed_size});
+    }
+
     return OK;
 }
 
+// Entries that took less than this to be added to the zip are not reported individually.
+static const std::chrono::milliseconds kMinReportedZipEntryDuration = 10ms;
+
+void Dumpstate::PrintZipEntryDurations() {
+    android::base::unique_fd fd(
+        TEMP_FAILURE_RETRY(open(tmp_path_.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC)));
+    if (fd == -1) {
+        MYLOGE("open(%s): %s\n", tmp_path_.c_str(), strerror(errno));
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(zip_writer_lock_);
+    std::chrono::milliseconds total(0);
+    uint64_t total_uncompressed = 0;
+    uint64_t total_compressed = 0;
+    dprintf(fd.get(), "------ ZIP ENTRY COMPRESSION ------\n");
+    for (const auto& entry : zip_entry_durations_) {
+        total += entry.duration;
+        total_uncompressed += entry.uncompressed_size;
+        total_compressed += entry.compressed_size;
+        if (entry.duration < kMinReportedZipEntryDuration) {
+            continue;
+        }
+        // Same format as DurationReporter, so that tools parsing durations pick these up.
+        dprintf(fd.get(),
+                "------ %.3fs was the duration of 'ZIP %s (%" PRIu64 " -> %" PRIu64 " bytes)' "
+                "------\n",
+                entry.duration.count() / 1000.0f, entry.name.c_str(), entry.uncompressed_size,
+                entry.compressed_size);
+    }
+    dprintf(fd.get(),
+            "------ %.3fs was the duration of 'ZIP %zu entries (%" PRIu64 " -> %" PRIu64
+            " bytes)' ------\n",
+            total.count() / 1000.0f, zip_entry_durations_.size(), total_uncompressed,
+            total_compressed);
+}
+
 bool Dumpstate::AddZipEntry(const std::string& entry_name, const std::string& entry_path) {
     android::base::unique_fd fd(
         TEMP_FAILURE_RETRY(open(entry_path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC)));
@@ -941,6 +993,7 @@ bool Dumpstate::AddTextZipEntry(const std::string& entry_name, const std::string
         return false;
     }
     MYLOGD("Adding zip text entry %s\n", entry_name.c_str());
+    std::lock_guard<std::mutex> lock(zip_writer_lock_);
     int32_t err = zip_writer_->StartEntryWithTime(entry_name.c_str(), ZipWriter::kCompress, ds.now_);
     if (err != 0) {
         MYLOGE("zip_writer_->StartEntryWithTime(%s): %s\n", entry_name.c_str(),
@@ -1321,9 +1374,6 @@ static Dumpstate::RunStatus RunDumpsysProto(const std::string& title, int priori
             bool dumpTerminated = (status == OK);
             dumpsys.stopDumpThread(dumpTerminated);
         }
-        ZipWriter::FileEntry file_entry;
-        ds.zip_writer_->GetLastEntry(&file_entry);
-
         auto elapsed_duration = std::chrono::duration_cast<std::chrono::milliseconds>(
             std::chrono::steady_clock::now() - start);
         if (elapsed_duration > timeout) {
@@ -1584,6 +1634,56 @@ static void DumpAppInfos(int out_fd = STDOUT_FILENO) {
             DUMPSYS_COMPONENTS_OPTIONS, 0, out_fd);
 }
 
+/*
+ * |out_fd| A fd to support the DumpPool to output results to a temporary file.
+ * Dumpstate can pick up later and output to the bugreport. Using STDOUT_FILENO
+ * if it's not running in the parallel task.
+ */
+static void DumpMemoryFiles(int out_fd = STDOUT_FILENO) {
+    DumpFile("VIRTUAL MEMORY STATS", "/proc/vmstat", out_fd);
+    DumpFile("VMALLOC INFO", "/proc/vmallocinfo", out_fd);
+    DumpFile("SLAB INFO", "/proc/slabinfo", out_fd);
+    DumpFile("ZONEINFO", "/proc/zoneinfo", out_fd);
+    DumpFile("PAGETYPEINFO", "/proc/pagetypeinfo", out_fd);
+    DumpFile("BUDDYINFO", "/proc/buddyinfo", out_fd);
+}
+
+/*
+ * |out_fd| A fd to support the DumpPool to output results to a temporary file.
+ * Dumpstate can pick up later and output to the bugreport. Using STDOUT_FILENO
+ * if it's not running in the parallel task.
+ */
+static void DumpProcrank(int out_fd = STDOUT_FILENO) {
+    RunCommand("PROCRANK", {"procrank"}, AS_ROOT_20, false, out_fd);
+}
+
+/*
+ * |out_fd| A fd to support the DumpPool to output results to a temporary file.
+ * Dumpstate can pick up later and output to the bugreport. Using STDOUT_FILENO
+ * if it's not running in the parallel task.
+ */
+static void DumpLibrank(int out_fd = STDOUT_FILENO) {
+    RunCommand("LIBRANK", {"librank"}, CommandOptions::AS_ROOT, false, out_fd);
+}
+
+/*
+ * |out_fd| A fd to support the DumpPool to output results to a temporary file.
+ * Dumpstate can pick up later and output to the bugreport. Using STDOUT_FILENO
+ * if it's not running in the parallel task.
+ */
+static void DumpBinderLogs(int out_fd = STDOUT_FILENO) {
+    /* Binder state is expensive to look at as it uses a lot of memory. */
+    std::string binder_logs_dir = access("/dev/binderfs/binder_logs", R_OK) ?
+            "/sys/kernel/debug/binder" : "/dev/binderfs/binder_logs";
+
+    DumpFile("BINDER FAILED TRANSACTION LOG", binder_logs_dir + "/failed_transaction_log",
+             out_fd);
+    DumpFile("BINDER TRANSACTION LOG", binder_logs_dir + "/transaction_log", out_fd);
+    DumpFile("BINDER TRANSACTIONS", binder_logs_dir + "/transactions", out_fd);
+    DumpFile("BINDER STATS", binder_logs_dir + "/stats", out_fd);
+    DumpFile("BINDER STATE", binder_logs_dir + "/state", out_fd);
+}
+
 // Dumps various things. Returns early with status USER_CONSENT_DENIED if user denies consent
 // via the consent they are shown. Ignores other errors that occur while running various
 // commands. The consent checking is currently done around long running tasks, which happen to
@@ -1594,13 +1694,37 @@ static Dumpstate::RunStatus dumpstate() {
     // Enqueue slow functions into the thread pool, if the parallel run is enabled.
     if (ds.dump_pool_) {
         // Pool was shutdown in DumpstateDefaultAfterCritical method in order to
-        // drop root user. Restarts it with two threads for the parallel run.
-        ds.dump_pool_->start(/* thread_counts = */2);
-
-        ds.dump_pool_->enqueueTaskWithFd(DUMP_HALS_TASK, &DumpHals, _1);
-        ds.dump_pool_->enqueueTask(DUMP_INCIDENT_REPORT_TASK, &DumpIncidentReport);
-        ds.dump_pool_->enqueueTaskWithFd(DUMP_BOARD_TASK, &Dumpstate::DumpstateBoard, &ds, _1);
-        ds.dump_pool_->enqueueTaskWithFd(DUMP_CHECKINS_TASK, &DumpCheckins, _1);
+        // drop root user. Restarts it for the parallel run, with enough threads
+        // for the CPU and I/O tasks to run while binder tasks use their share.
+        ds.dump_pool_->start(/* thread_counts = */4);
+
+        // The expected costs only matter until a run has recorded the actual durations.
+        ds.dump_pool_->enqueueGraphTaskWithFd(DUMP_HALS_TASK,
+                {DumpPool::ResourceClass::BINDER, 10s, {}}, &DumpHals, _1);
+        ds.dump_pool_->enqueueGraphTask(DUMP_INCIDENT_REPORT_TASK,
+                {DumpPool::ResourceClass::BINDER, 5s, {}}, &DumpIncidentReport);
+        ds.dump_pool_->enqueueGraphTaskWithFd(DUMP_BOARD_TASK,
+                {DumpPool::ResourceClass::BINDER, 10s, {}}, &Dumpstate::DumpstateBoard, &ds, _1);
+        ds.dump_pool_->enqueueGraphTaskWithFd(DUMP_CHECKINS_TASK,
+                {DumpPool::ResourceClass::BINDER, 5s, {}}, &DumpCheckins, _1);
+        // Both dump activity and package state out of system_server, so running them
+        // together only makes them contend for its locks.
+        ds.dump_pool_->enqueueGraphTaskWithFd(DUMP_APP_INFOS_TASK,
+                {DumpPool::ResourceClass::BINDER, 10s, {DUMP_CHECKINS_TASK}}, &DumpAppInfos, _1);
+        ds.dump_pool_->enqueueGraphTaskWithFd(DUMP_MEMORY_FILES_TASK,
+                {DumpPool::ResourceClass::IO, 1s, {}}, &DumpMemoryFiles, _1);
+        // Both walk the page maps of every process; running them together doubles the
+        // memory pressure they report on.
+        ds.dump_pool_->enqueueGraphTaskWithFd(DUMP_PROCRANK_TASK,
+                {DumpPool::ResourceClass::CPU, 5s, {}}, &DumpProcrank, _1);
+        ds.dump_pool_->enqueueGraphTaskWithFd(DUMP_LIBRANK_TASK,
+                {DumpPool::ResourceClass::CPU, 10s, {DUMP_PROCRANK_TASK}}, &DumpLibrank, _1);
+        // As in the sequential run, the binder logs include the transactions of the HAL dumps.
+        ds.dump_pool_->enqueueGraphTaskWithFd(DUMP_BINDER_LOGS_TASK,
+                {DumpPool::ResourceClass::IO, 2s, {DUMP_HALS_TASK}}, &DumpBinderLogs, _1);
+        if (PropertiesHelper::IsDryRun()) {
+            ds.dump_pool_->printCriticalPath(STDOUT_FILENO);
+        }
     }
 
     // Dump various things. Note that anything that takes "long" (i.e. several seconds) should
@@ -1613,16 +1737,19 @@ static Dumpstate::RunStatus dumpstate() {
     RunCommand("CPU INFO", {"top", "-b", "-n", "1", "-H", "-s", "6", "-o",
                             "pid,tid,user,pr,ni,%cpu,s,virt,res,pcy,cmd,name"});
 
-    RUN_SLOW_FUNCTION_WITH_CONSENT_CHECK(RunCommand, "PROCRANK", {"procrank"}, AS_ROOT_20);
+    if (ds.dump_pool_) {
+        WAIT_TASK_WITH_CONSENT_CHECK(DUMP_PROCRANK_TASK, ds.dump_pool_);
+    } else {
+        RUN_SLOW_FUNCTION_WITH_CONSENT_CHECK(DumpProcrank);
+    }
 
     RUN_SLOW_FUNCTION_WITH_CONSENT_CHECK(DumpVisibleWindowViews);
 
-    DumpFile("VIRTUAL MEMORY STATS", "/proc/vmstat");
-    DumpFile("VMALLOC INFO", "/proc/vmallocinfo");
-    DumpFile("SLAB INFO", "/proc/slabinfo");
-    DumpFile("ZONEINFO", "/proc/zoneinfo");
-    DumpFile("PAGETYPEINFO", "/proc/pagetypeinfo");
-    DumpFile("BUDDYINFO", "/proc/buddyinfo");
+    if (ds.dump_pool_) {
+        WAIT_TASK_WITH_CONSENT_CHECK(DUMP_MEMORY_FILES_TASK, ds.dump_pool_);
+    } else {
+        DumpMemoryFiles();
+    }
     DumpExternalFragmentationInfo();
 
     DumpFile("KERNEL WAKE SOURCES", "/d/wakeup_sources");
@@ -1631,8 +1758,11 @@ static Dumpstate::RunStatus dumpstate() {
     RunCommand("PROCESSES AND THREADS",
                {"ps", "-A", "-T", "-Z", "-O", "pri,nice,rtprio,sched,pcy,time"});
 
-    RUN_SLOW_FUNCTION_WITH_CONSENT_CHECK(RunCommand, "LIBRANK", {"librank"},
-                                         CommandOptions::AS_ROOT);
+    if (ds.dump_pool_) {
+        WAIT_TASK_WITH_CONSENT_CHECK(DUMP_LIBRANK_TASK, ds.dump_pool_);
+    } else {
+        RUN_SLOW_FUNCTION_WITH_CONSENT_CHECK(DumpLibrank);
+    }
 
     if (ds.dump_pool_) {
         WAIT_TASK_WITH_CONSENT_CHECK(DUMP_HALS_TASK, ds.dump_pool_);
@@ -1714,15 +1844,11 @@ static Dumpstate::RunStatus dumpstate() {
 
     RunCommand("FILESYSTEMS & FREE SPACE", {"df"});
 
-    /* Binder state is expensive to look at as it uses a lot of memory. */
-    std::string binder_logs_dir = access("/dev/binderfs/binder_logs", R_OK) ?
-            "/sys/kernel/debug/binder" : "/dev/binderfs/binder_logs";
-
-    DumpFile("BINDER FAILED TRANSACTION LOG", binder_logs_dir + "/failed_transaction_log");
-    DumpFile("BINDER TRANSACTION LOG", binder_logs_dir + "/transaction_log");
-    DumpFile("BINDER TRANSACTIONS", binder_logs_dir + "/transactions");
-    DumpFile("BINDER STATS", binder_logs_dir + "/stats");
-    DumpFile("BINDER STATE", binder_logs_dir + "/state");
+    if (ds.dump_pool_) {
+        WAIT_TASK_WITH_CONSENT_CHECK(DUMP_BINDER_LOGS_TASK, ds.dump_pool_);
+    } else {
+        DumpBinderLogs();
+    }
 
     /* Add window and surface trace files. */
     if (!PropertiesHelper::IsUserBuild()) {
@@ -1766,7 +1892,11 @@ static Dumpstate::RunStatus dumpstate() {
         RUN_SLOW_FUNCTION_WITH_CONSENT_CHECK_AND_LOG(DUMP_CHECKINS_TASK, DumpCheckins);
     }
 
-    RUN_SLOW_FUNCTION_WITH_CONSENT_CHECK(DumpAppInfos);
+    if (ds.dump_pool_) {
+        WAIT_TASK_WITH_CONSENT_CHECK(DUMP_APP_INFOS_TASK, ds.dump_pool_);
+    } else {
+        RUN_SLOW_FUNCTION_WITH_CONSENT_CHECK(DumpAppInfos);
+    }
 
     printf("========================================================\n");
     printf("== Dropbox crashes\n");
@@ -2370,6 +2500,7 @@ bool Dumpstate::FinishZipFile() {
     if (zip_entry_tasks_) {
         zip_entry_tasks_->run(/* do_cancel = */false);
     }
+    PrintZipEntryDurations();
 
     std::string entry_name = base_name_ + "-" + name_ + ".txt";
     MYLOGD("Adding main entry (%s) from %s to .zip bugreport\n", entry_name.c_str(),
@@ -2403,7 +2534,9 @@ bool Dumpstate::FinishZipFile() {
     }
     fprintf(stderr, "\n");
 
+    std::unique_lock<std::mutex> lock(zip_writer_lock_);
     int32_t err = zip_writer_->Finish();
+    lock.unlock();
     if (err != 0) {
         MYLOGE("zip_writer_->Finish(): %s\n", ZipWriter::ErrorCodeString(err));
         return false;
@@ -3113,6 +3246,9 @@ void Dumpstate::EnableParallelRunIfNeeded() {
     }
     dump_pool_ = std::make_unique<DumpPool>(bugreport_internal_dir_);
     zip_entry_tasks_ = std::make_unique<TaskQueue>();
+    // Compress the dumps produced by the pool while the remaining sections are still running,
+    // rather than all at once when finishing the zip file.
+    zip_entry_tasks_->start();
 }
 
 void Dumpstate::ShutdownDumpPool() {
@@ -3272,7 +3408,13 @@ DurationReporter::DurationReporter(const std::string& title, bool logcat_only, b
 
 DurationReporter::~DurationReporter() {
     if (!title_.empty()) {
-        float elapsed = (float)(Nanotime() - started_) / NANOS_PER_SEC;
+        uint64_t elapsed_ns = Nanotime() - started_;
+        float elapsed = (float)elapsed_ns / NANOS_PER_SEC;
+        // The durations of sections feed the scheduling of later parallel runs.
+        if (ds.dump_pool_) {
+            ds.dump_pool_->recordDuration(title_,
+                    std::chrono::milliseconds(elapsed_ns / NANOS_PER_MILLI));
+        }
         if (elapsed >= .5f || verbose_) {
             MYLOGD("Duration of '%s': %.2fs\n", title_.c_str(), elapsed);
         }
@@ -3745,10 +3887,11 @@ void do_showmap(int pid, const char *name) {
     RunCommand(title, {"showmap", "-q", arg}, CommandOptions::AS_ROOT);
 }
 
-int Dumpstate::DumpFile(const std::string& title, const std::string& path) {
-    DurationReporter duration_reporter(title);
+int Dumpstate::DumpFile(const std::string& title, const std::string& path, int out_fd) {
+    DurationReporter duration_reporter(title, false /* logcat_only */, false /* verbose */,
+                                       out_fd);
 
-    int status = DumpFileToFd(STDOUT_FILENO, title, path);
+    int status = DumpFileToFd(out_fd, title, path);
 
     UpdateProgress(WEIGHT_FILE);
 
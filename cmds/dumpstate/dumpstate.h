@@ -22,6 +22,8 @@
 #include <stdbool.h>
 #include <stdio.h>
 
+#include <chrono>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -264,8 +266,10 @@ class Dumpstate {
      * |title| description of the command printed on `stdout` (or empty to skip
      * description).
      * |path| location of the file to be dumped.
+     * |out_fd| A fd to support the DumpPool to output results to a temporary file.
      */
-    int DumpFile(const std::string& title, const std::string& path);
+    int DumpFile(const std::string& title, const std::string& path,
+                 int out_fd = STDOUT_FILENO);
 
     /*
      * Adds a new entry to the existing zip file.
@@ -283,6 +287,11 @@ class Dumpstate {
     android::status_t AddZipEntryFromFd(const std::string& entry_name, int fd,
                                         std::chrono::milliseconds timeout);
 
+    /*
+     * Appends how long adding each zip entry took to the main bugreport entry.
+     */
+    void PrintZipEntryDurations();
+
     /*
      * Adds a text entry to the existing zip file.
      */
@@ -504,6 +513,20 @@ class Dumpstate {
     // Pointer to the zip structure.
     std::unique_ptr<ZipWriter> zip_writer_;
 
+    // Guards zip_writer_ and zip_entry_durations_, since zip entries may be added from the
+    // zip_entry_tasks_ thread while the main thread is dumping.
+    std::mutex zip_writer_lock_;
+
+    struct ZipEntryDuration {
+        std::string name;
+        std::chrono::milliseconds duration;
+        uint64_t uncompressed_size;
+        uint64_t compressed_size;
+    };
+
+    // How long adding each entry to the zip file took, in the order they were added.
+    std::vector<ZipEntryDuration> zip_entry_durations_;
+
     // Binder object listening to progress.
     android::sp<android::os::IDumpstateListener> listener_;
 
@@ -31,6 +31,8 @@
 #include <signal.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <atomic>
+#include <future>
 #include <thread>
 
 #include <android-base/file.h>
@@ -48,6 +50,8 @@ namespace os {
 namespace dumpstate {
 
 using ::android::hardware::dumpstate::V1_1::DumpstateMode;
+using namespace std::chrono_literals;
+using ::testing::ElementsAre;
 using ::testing::EndsWith;
 using ::testing::Eq;
 using ::testing::HasSubstr;
@@ -1674,6 +1678,11 @@ class DumpPoolTest : public DumpstateBaseTest {
         CreateOutputFile();
     }
 
+    void TearDown() {
+        dump_pool_->shutdown();
+        unlink((kTestDataPath + DumpPool::DURATION_HISTORY_FILE_NAME).c_str());
+    }
+
     void CreateOutputFile() {
         out_path_ = kTestDataPath + "out.txt";
         out_fd_.reset(TEMP_FAILURE_RETRY(open(out_path_.c_str(),
@@ -1783,6 +1792,209 @@ TEST_F(DumpPoolTest, Shutdown_withoutCrash) {
     EXPECT_THAT(getTempFileCounts(kTestDataPath), Eq(0));
 }
 
+TEST_F(DumpPoolTest, EnqueueGraphTask_respectsDependencies) {
+    std::vector<std::string> order;
+    std::mutex order_lock;
+    auto dump_func = [&](const std::string& name) {
+        usleep(100000);
+        std::lock_guard<std::mutex> lock(order_lock);
+        order.push_back(name);
+    };
+    setLogDuration(/* log_duration = */false);
+    dump_pool_->start(/* thread_counts = */3);
+    dump_pool_->enqueueGraphTask("A", {DumpPool::ResourceClass::CPU, 10ms, {}}, dump_func, "A");
+    dump_pool_->enqueueGraphTask("B", {DumpPool::ResourceClass::CPU, 10ms, {"A"}},
+            dump_func, "B");
+    dump_pool_->enqueueGraphTask("C", {DumpPool::ResourceClass::CPU, 10ms, {"A", "B"}},
+            dump_func, "C");
+
+    dump_pool_->waitForTask("A", "", out_fd_.get());
+    dump_pool_->waitForTask("B", "", out_fd_.get());
+    dump_pool_->waitForTask("C", "", out_fd_.get());
+    dump_pool_->shutdown();
+
+    EXPECT_THAT(order, ElementsAre("A", "B", "C"));
+}
+
+TEST_F(DumpPoolTest, EnqueueGraphTask_ignoresUnknownDependencies) {
+    bool run_1 = false;
+    setLogDuration(/* log_duration = */false);
+    dump_pool_->start(/* thread_counts = */1);
+    dump_pool_->enqueueGraphTask("1", {DumpPool::ResourceClass::CPU, 10ms, {"unknown"}},
+            [&]() { run_1 = true; });
+    dump_pool_->waitForTask("1", "", out_fd_.get());
+    dump_pool_->shutdown();
+
+    EXPECT_TRUE(run_1);
+}
+
+TEST_F(DumpPoolTest, EnqueueGraphTask_respectsResourceLimit) {
+    std::atomic<int> running = 0;
+    std::atomic<int> max_running = 0;
+    auto dump_func = [&]() {
+        int now = ++running;
+        int max = max_running;
+        while (now > max && !max_running.compare_exchange_weak(max, now)) {
+        }
+        usleep(100000);
+        running--;
+    };
+    setLogDuration(/* log_duration = */false);
+    dump_pool_->start(/* thread_counts = */4);
+    dump_pool_->setResourceLimit(DumpPool::ResourceClass::IO, 1);
+    for (int i = 0; i < 4; i++) {
+        dump_pool_->enqueueGraphTask(std::to_string(i), {DumpPool::ResourceClass::IO, 10ms, {}},
+                dump_func);
+    }
+    for (int i = 0; i < 4; i++) {
+        dump_pool_->waitForTask(std::to_string(i), "", out_fd_.get());
+    }
+    dump_pool_->shutdown();
+
+    EXPECT_EQ(max_running, 1);
+}
+
+TEST_F(DumpPoolTest, EnqueueGraphTask_ignoresCycles) {
+    bool run_1 = false;
+    bool run_2 = false;
+    setLogDuration(/* log_duration = */false);
+    dump_pool_->start(/* thread_counts = */1);
+    dump_pool_->enqueueGraphTask("1", {DumpPool::ResourceClass::CPU, 10ms, {"2"}},
+            [&]() { run_1 = true; });
+    dump_pool_->enqueueGraphTask("2", {DumpPool::ResourceClass::CPU, 10ms, {"1"}},
+            [&]() { run_2 = true; });
+    dump_pool_->waitForTask("1", "", out_fd_.get());
+    dump_pool_->waitForTask("2", "", out_fd_.get());
+    dump_pool_->shutdown();
+
+    EXPECT_TRUE(run_1);
+    EXPECT_TRUE(run_2);
+}
+
+TEST_F(DumpPoolTest, PrintCriticalPath) {
+    std::string history_path = kTestDataPath + DumpPool::DURATION_HISTORY_FILE_NAME;
+    ASSERT_TRUE(android::base::WriteStringToFile(
+            "------ 3.000s was the duration of 'B' ------\n", history_path));
+    auto dump_func = []() {};
+    setLogDuration(/* log_duration = */false);
+    dump_pool_->start(/* thread_counts = */1);
+    dump_pool_->enqueueGraphTask("A", {DumpPool::ResourceClass::CPU, 1s, {}}, dump_func);
+    dump_pool_->enqueueGraphTask("B", {DumpPool::ResourceClass::BINDER, 1s, {"A"}}, dump_func);
+    dump_pool_->enqueueGraphTask("C", {DumpPool::ResourceClass::IO, 2s, {"A"}}, dump_func);
+    dump_pool_->printCriticalPath(out_fd_.get());
+    dump_pool_->waitForTask("A", "", out_fd_.get());
+    dump_pool_->waitForTask("B", "", out_fd_.get());
+    dump_pool_->waitForTask("C", "", out_fd_.get());
+    dump_pool_->shutdown();
+
+    std::string result;
+    ReadFileToString(out_path_, &result);
+    EXPECT_THAT(result, StrEq(
+            "------ DUMP POOL CRITICAL PATH (3 tasks, 6.000s serial, 4.000s critical) ------\n"
+            "1.000s A (expected)\n"
+            "3.000s B\n"));
+}
+
+TEST_F(DumpPoolTest, Shutdown_savesDurationHistory) {
+    std::string history_path = kTestDataPath + DumpPool::DURATION_HISTORY_FILE_NAME;
+    setLogDuration(/* log_duration = */false);
+    dump_pool_->start(/* thread_counts = */1);
+    dump_pool_->enqueueTask("1", []() {});
+    dump_pool_->waitForTask("1", "", out_fd_.get());
+    dump_pool_->shutdown();
+
+    std::string history;
+    EXPECT_TRUE(ReadFileToString(history_path, &history));
+    EXPECT_EQ(DumpPool::ParseDurations(history).count("1"), 1u);
+}
+
+TEST_F(DumpPoolTest, Shutdown_dryRunKeepsDurationHistory) {
+    std::string history_path = kTestDataPath + DumpPool::DURATION_HISTORY_FILE_NAME;
+    ASSERT_TRUE(android::base::WriteStringToFile(
+            "------ 3.000s was the duration of '1' ------\n", history_path));
+    SetDryRun(true);
+    setLogDuration(/* log_duration = */false);
+    dump_pool_->start(/* thread_counts = */1);
+    dump_pool_->enqueueTask("1", []() {});
+    dump_pool_->waitForTask("1", "", out_fd_.get());
+    dump_pool_->shutdown();
+
+    std::string history;
+    ReadFileToString(history_path, &history);
+    EXPECT_THAT(history, StrEq("------ 3.000s was the duration of '1' ------\n"));
+}
+
+TEST_F(DumpPoolTest, Start_restartUpdatesCpuLimit) {
+    std::atomic<int> running = 0;
+    std::atomic<int> max_running = 0;
+    auto dump_func = [&]() {
+        int now = ++running;
+        int max = max_running;
+        while (now > max && !max_running.compare_exchange_weak(max, now)) {
+        }
+        usleep(100000);
+        running--;
+    };
+    setLogDuration(/* log_duration = */false);
+    dump_pool_->start(/* thread_counts = */1);
+    dump_pool_->shutdown();
+    dump_pool_->start(/* thread_counts = */3);
+    for (int i = 0; i < 3; i++) {
+        dump_pool_->enqueueGraphTask(std::to_string(i), {DumpPool::ResourceClass::CPU, 10ms, {}},
+                dump_func);
+    }
+    for (int i = 0; i < 3; i++) {
+        dump_pool_->waitForTask(std::to_string(i), "", out_fd_.get());
+    }
+    dump_pool_->shutdown();
+
+    EXPECT_EQ(max_running, 3);
+}
+
+TEST_F(DumpPoolTest, EnqueueGraphTask_prefersLongestRecordedDuration) {
+    std::string history_path = kTestDataPath + DumpPool::DURATION_HISTORY_FILE_NAME;
+    ASSERT_TRUE(android::base::WriteStringToFile(
+            "------ 5.000s was the duration of 'B' ------\n", history_path));
+    std::vector<std::string> order;
+    auto dump_func = [&](const std::string& name) { order.push_back(name); };
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    setLogDuration(/* log_duration = */false);
+    dump_pool_->start(/* thread_counts = */1);
+    // Keeps the only thread busy until both tasks are pending.
+    dump_pool_->enqueueTask("blocker", [released]() { released.wait(); });
+    dump_pool_->enqueueGraphTask("A", {DumpPool::ResourceClass::CPU, 1s, {}}, dump_func, "A");
+    dump_pool_->enqueueGraphTask("B", {DumpPool::ResourceClass::CPU, 1s, {}}, dump_func, "B");
+    release.set_value();
+    dump_pool_->waitForTask("blocker", "", out_fd_.get());
+    dump_pool_->waitForTask("A", "", out_fd_.get());
+    dump_pool_->waitForTask("B", "", out_fd_.get());
+    dump_pool_->shutdown();
+
+    EXPECT_THAT(order, ElementsAre("B", "A"));
+}
+
+TEST_F(DumpPoolTest, Shutdown_savesRecordedSectionDurations) {
+    std::string history_path = kTestDataPath + DumpPool::DURATION_HISTORY_FILE_NAME;
+    dump_pool_->start(/* thread_counts = */1);
+    dump_pool_->recordDuration("SECTION", 2s);
+    dump_pool_->shutdown();
+
+    std::string history;
+    EXPECT_TRUE(ReadFileToString(history_path, &history));
+    EXPECT_EQ(DumpPool::ParseDurations(history)["SECTION"], 2s);
+}
+
+TEST_F(DumpPoolTest, ParseDurations) {
+    auto durations = DumpPool::ParseDurations(
+            "------ 0.123s was the duration of 'DUMPSYS' ------\n"
+            "some output\n"
+            "------ 12.000s was the duration of 'Dump HALs' ------\n");
+    EXPECT_EQ(durations.size(), 2u);
+    EXPECT_EQ(durations["DUMPSYS"], 123ms);
+    EXPECT_EQ(durations["Dump HALs"], 12000ms);
+}
+
 class TaskQueueTest : public DumpstateBaseTest {
 public:
     void SetUp() {
@@ -1834,6 +2046,56 @@ TEST_F(TaskQueueTest, runTask_withCancelled) {
     EXPECT_TRUE(is_task2_cancelled);
 }
 
+TEST_F(TaskQueueTest, runTask_inBackground) {
+    std::vector<int> order;
+    std::mutex order_lock;
+    auto task = [&](int id, bool task_cancelled) {
+        if (task_cancelled) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(order_lock);
+        order.push_back(id);
+    };
+    task_queue_.start();
+    task_queue_.add(task, 1, std::placeholders::_1);
+    task_queue_.add(task, 2, std::placeholders::_1);
+    task_queue_.add(task, 3, std::placeholders::_1);
+
+    // The background thread picks the tasks up without an explicit run().
+    for (int i = 0; i < 100; i++) {
+        {
+            std::lock_guard<std::mutex> lock(order_lock);
+            if (order.size() == 3) {
+                break;
+            }
+        }
+        usleep(10000);
+    }
+
+    task_queue_.run(/* do_cancel = */false);
+
+    EXPECT_THAT(order, ElementsAre(1, 2, 3));
+}
+
+TEST_F(TaskQueueTest, runTask_inBackgroundWithCancelled) {
+    bool is_task2_cancelled = false;
+    auto task_1 = [&](bool task_cancelled) {
+        if (!task_cancelled) {
+            sleep(1);
+        }
+    };
+    auto task_2 = [&](bool task_cancelled) {
+        is_task2_cancelled = task_cancelled;
+    };
+    task_queue_.start();
+    task_queue_.add(task_1, std::placeholders::_1);
+    task_queue_.add(task_2, std::placeholders::_1);
+
+    task_queue_.run(/* do_cancel = */true);
+
+    EXPECT_TRUE(is_task2_cancelled);
+}
+
 
 }  // namespace dumpstate
 }  // namespace os
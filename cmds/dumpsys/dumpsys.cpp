@@ -15,8 +15,11 @@
  */
 
 #include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <iomanip>
+#include <mutex>
 #include <thread>
 
 #include <android-base/file.h>
@@ -39,6 +42,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/poll.h>
 #include <sys/socket.h>
 #include <sys/time.h>
@@ -65,7 +69,8 @@ static void usage() {
         "usage: dumpsys\n"
         "         To dump all services.\n"
         "or:\n"
-        "       dumpsys [-t TIMEOUT] [--priority LEVEL] [--clients] [--dump] [--pid] [--thread] "
+        "       dumpsys [-t TIMEOUT] [--priority LEVEL] [--parallel JOBS] [--clients] [--dump] "
+        "[--pid] [--thread] "
         "[--help | "
         "-l | --skip SERVICES "
         "| SERVICE [ARGS]]\n"
@@ -75,6 +80,8 @@ static void usage() {
         "         -T TIMEOUT_MS: TIMEOUT to use in milliseconds instead of default 10 seconds\n"
         "         --clients: dump client PIDs instead of usual dump\n"
         "         --dump: ask the service to dump itself (this is the default)\n"
+        "         --parallel JOBS: dump up to JOBS services at the same time. Output order\n"
+        "               is unchanged; TIMEOUT applies to each service separately.\n"
         "         --pid: dump PID instead of usual dump\n"
         "         --proto: filter services that support dumping data in proto format. Dumps\n"
         "               will be in proto format.\n"
@@ -135,13 +142,15 @@ int Dumpsys::main(int argc, char* const argv[]) {
     bool asProto = false;
     int dumpTypeFlags = 0;
     int timeoutArgMs = 10000;
+    int parallelDumps = 1;
     int priorityFlags = IServiceManager::DUMP_FLAG_PRIORITY_ALL;
     static struct option longOptions[] = {
         {"help", no_argument, 0, 0},           {"clients", no_argument, 0, 0},
         {"dump", no_argument, 0, 0},           {"pid", no_argument, 0, 0},
         {"priority", required_argument, 0, 0}, {"proto", no_argument, 0, 0},
         {"skip", no_argument, 0, 0},           {"stability", no_argument, 0, 0},
-        {"thread", no_argument, 0, 0},         {0, 0, 0, 0}};
+        {"thread", no_argument, 0, 0},         {"parallel", required_argument, 0, 0},
+        {0, 0, 0, 0}};
 
     // Must reset optind, otherwise subsequent calls will fail (wouldn't happen on main.cpp, but
     // happens on test cases).
@@ -172,6 +181,13 @@ int Dumpsys::main(int argc, char* const argv[]) {
                     usage();
                     return -1;
                 }
+            } else if (!strcmp(longOptions[optionIndex].name, "parallel")) {
+                char* endptr;
+                parallelDumps = strtol(optarg, &endptr, 10);
+                if (*endptr != '\0' || parallelDumps <= 0) {
+                    fprintf(stderr, "Error: invalid number of parallel dumps: '%s'\n", optarg);
+                    return -1;
+                }
             } else if (!strcmp(longOptions[optionIndex].name, "dump")) {
                 dumpTypeFlags |= TYPE_DUMP;
             } else if (!strcmp(longOptions[optionIndex].name, "pid")) {
@@ -271,6 +287,14 @@ int Dumpsys::main(int argc, char* const argv[]) {
         return 0;
     }
 
+    if (N > 1 && parallelDumps > 1) {
+        std::cout.flush();
+        dumpServicesInParallel(STDOUT_FILENO, services, skippedServices, dumpTypeFlags, args,
+                               priorityFlags, std::chrono::milliseconds(timeoutArgMs), asProto,
+                               parallelDumps);
+        return 0;
+    }
+
     for (size_t i = 0; i < N; i++) {
         const String16& serviceName = services[i];
         if (IsSkipped(skippedServices, serviceName)) continue;
@@ -565,3 +589,124 @@ void Dumpsys::writeDumpFooter(int fd, const String16& serviceName,
                      elapsedDuration.count(), String8(serviceName).string(), oss.str().c_str());
     WriteStringToFd(msg, fd);
 }
+
+
+namespace {
+
+// State of one service dumped by Dumpsys::dumpServicesInParallel().
+struct ParallelDump {
+    unique_fd output;
+    bool started = false;
+    bool done = false;
+    status_t status = OK;
+    std::chrono::duration<double> elapsedDuration{0};
+    size_t bytesWritten = 0;
+};
+
+}  // namespace
+
+void Dumpsys::dumpServicesInParallel(int fd, const Vector<String16>& services,
+                                     const Vector<String16>& skippedServices, int dumpTypeFlags,
+                                     const Vector<String16>& args, int priorityFlags,
+                                     std::chrono::milliseconds timeout, bool asProto,
+                                     size_t maxParallelDumps) const {
+    const size_t N = services.size();
+    std::vector<ParallelDump> dumps(N);
+    std::mutex lock;
+    std::condition_variable cv;
+    std::atomic_size_t next(0);
+    auto start = std::chrono::steady_clock::now();
+
+    auto worker = [&]() {
+        for (size_t i = next++; i < N; i = next++) {
+            const String16& serviceName = services[i];
+            ParallelDump result;
+            if (!IsSkipped(skippedServices, serviceName)) {
+                result.output.reset(memfd_create("dumpsys", MFD_CLOEXEC));
+                if (!result.output.ok()) {
+                    std::cerr << "Failed to create buffer to dump service " << serviceName << ": "
+                              << strerror(errno) << std::endl;
+                } else {
+                    // Each dump needs its own pipe and dump thread.
+                    Dumpsys dumper(sm_);
+                    if (dumper.startDumpThread(dumpTypeFlags, serviceName, args) == OK) {
+                        int out = result.output.get();
+                        result.started = true;
+                        writeDumpHeader(out, serviceName, priorityFlags);
+                        result.status = dumper.writeDump(out, serviceName, timeout, asProto,
+                                                         result.elapsedDuration,
+                                                         result.bytesWritten);
+                        writeDumpFooter(out, serviceName, result.elapsedDuration);
+                        dumper.stopDumpThread(result.status == OK);
+                    }
+                }
+            }
+            std::lock_guard<std::mutex> guard(lock);
+            dumps[i] = std::move(result);
+            dumps[i].done = true;
+            cv.notify_all();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < std::min(maxParallelDumps, N); i++) {
+        threads.emplace_back(worker);
+    }
+
+    // Write out the dumps in order, as soon as each of them is done.
+    for (size_t i = 0; i < N; i++) {
+        unique_fd output;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            cv.wait(guard, [&]() { return dumps[i].done; });
+            output = std::move(dumps[i].output);
+        }
+        if (!dumps[i].started) {
+            continue;
+        }
+        if (lseek(output.get(), 0, SEEK_SET) == -1) {
+            std::cerr << "Failed to rewind dump of service " << services[i] << ": "
+                      << strerror(errno) << std::endl;
+            continue;
+        }
+        char buf[4096];
+        ssize_t rc;
+        while ((rc = TEMP_FAILURE_RETRY(read(output.get(), buf, sizeof(buf)))) > 0) {
+            if (!WriteFully(fd, buf, rc)) {
+                std::cerr << "Failed to write while dumping service " << services[i] << ": "
+                          << strerror(errno) << std::endl;
+                break;
+            }
+        }
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    if (asProto) {
+        return;
+    }
+    std::chrono::duration<double> elapsedDuration = std::chrono::steady_clock::now() - start;
+    std::chrono::duration<double> totalServiceDuration{0};
+    std::string msg(
+        "----------------------------------------"
+        "---------------------------------------\n"
+        "DUMPSYS PARALLEL SUMMARY:\n");
+    for (size_t i = 0; i < N; i++) {
+        const ParallelDump& dump = dumps[i];
+        if (!dump.started) {
+            continue;
+        }
+        totalServiceDuration += dump.elapsedDuration;
+        StringAppendF(&msg, "  %-40s %8.3fs %10zu bytes%s\n", String8(services[i]).c_str(),
+                      dump.elapsedDuration.count(), dump.bytesWritten,
+                      dump.status == TIMED_OUT ? " (timed out)"
+                                               : (dump.status != OK ? " (error)" : ""));
+    }
+    StringAppendF(&msg,
+                  "--------- %.3fs was the duration of dumpsys with %zu parallel dumps "
+                  "(%.3fs of service dumps)\n",
+                  elapsedDuration.count(), maxParallelDumps, totalServiceDuration.count());
+    WriteStringToFd(msg, fd);
+}
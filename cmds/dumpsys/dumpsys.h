@@ -17,6 +17,7 @@
 #ifndef FRAMEWORK_NATIVE_CMD_DUMPSYS_H_
 #define FRAMEWORK_NATIVE_CMD_DUMPSYS_H_
 
+#include <chrono>
 #include <thread>
 
 #include <android-base/unique_fd.h>
@@ -117,6 +118,28 @@ class Dumpsys {
      */
     void stopDumpThread(bool dumpComplete);
 
+    /**
+     * Dumps {@code services} on up to {@code maxParallelDumps} threads at a time. Each dump,
+     * including its header and footer, is buffered in an anonymous memory file and copied to
+     * {@code fd} in the order of {@code services}, as soon as it and all preceding dumps are
+     * done. Each service gets its own {@code timeout}, counted from the start of its dump.
+     * Unless {@code asProto} is set, a summary of the per-service latencies is written last.
+     * @param fd file descriptor to write data
+     * @param services services to dump, in output order
+     * @param skippedServices services in {@code services} which are not dumped
+     * @param dumpTypeFlags operations to perform
+     * @param args list of arguments to pass to service dump method.
+     * @param priorityFlags dump priority specified
+     * @param timeout timeout of each dump
+     * @param asProto used to supress additional output to the fd
+     * @param maxParallelDumps maximum number of services dumped at the same time
+     */
+    void dumpServicesInParallel(int fd, const Vector<String16>& services,
+                                const Vector<String16>& skippedServices, int dumpTypeFlags,
+                                const Vector<String16>& args, int priorityFlags,
+                                std::chrono::milliseconds timeout, bool asProto,
+                                size_t maxParallelDumps) const;
+
     /**
      * Returns file descriptor of the pipe used to dump service data. This assumes
      * {@code startDumpThread} was called successfully.
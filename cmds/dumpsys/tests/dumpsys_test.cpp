@@ -447,6 +447,49 @@ TEST_F(DumpsysTest, DumpMultipleServices) {
     AssertDumped("running3", "dump3");
 }
 
+// Tests 'dumpsys --parallel 2', which should keep the services in order
+TEST_F(DumpsysTest, DumpMultipleServicesInParallel) {
+    ExpectListServices({"running1", "stopped2", "running3", "running4"});
+    ExpectDump("running1", "dump1");
+    ExpectCheckService("stopped2", false);
+    ExpectDump("running3", "dump3");
+    ExpectDump("running4", "dump4");
+
+    CallMain({"--parallel", "2"});
+
+    AssertRunningServices({"running1", "running3", "running4"});
+    AssertDumped("running1", "dump1");
+    AssertStopped("stopped2");
+    AssertDumped("running3", "dump3");
+    AssertDumped("running4", "dump4");
+    AssertOutputFormat(
+            "(.|\n)*DUMP OF SERVICE running1:\ndump1(.|\n)*"
+            "DUMP OF SERVICE running3:\ndump3(.|\n)*"
+            "DUMP OF SERVICE running4:\ndump4(.|\n)*"
+            "DUMPSYS PARALLEL SUMMARY:\n(.|\n)*running1(.|\n)*running3(.|\n)*running4(.|\n)*"
+            "was the duration of dumpsys with 2 parallel dumps(.|\n)*");
+}
+
+// Tests 'dumpsys -T 500 --parallel 2' with a service that hangs, which should not hold back
+// the services dumped next to it
+TEST_F(DumpsysTest, DumpInParallelWithTimeout) {
+    ExpectListServices({"hanging1", "running2", "running3"});
+    sp<BinderMock> binder_mock = ExpectDumpAndHang("hanging1", 2, "dump1");
+    ExpectDump("running2", "dump2");
+    ExpectDump("running3", "dump3");
+
+    CallMain({"-T", "500", "--parallel", "2"});
+
+    AssertOutputContains("SERVICE 'hanging1' DUMP TIMEOUT (500ms) EXPIRED");
+    AssertNotDumped("dump1");
+    AssertDumped("running2", "dump2");
+    AssertDumped("running3", "dump3");
+    AssertOutputContains("(timed out)");
+
+    // TODO(b/65056227): BinderMock is not destructed because thread is detached on dumpsys.cpp
+    Mock::AllowLeak(binder_mock.get());
+}
+
 // Tests 'dumpsys --skip skipped3 skipped5', which should skip these services
 TEST_F(DumpsysTest, DumpWithSkip) {
     ExpectListServices({"running1", "stopped2", "skipped3", "running4", "skipped5"});
@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "installd"
+#define ATRACE_TAG ATRACE_TAG_PACKAGE_MANAGER
+
+#include "DexoptJobQueue.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <set>
+#include <thread>
+
+#include <android-base/logging.h>
+#include <android-base/properties.h>
+#include <utils/Trace.h>
+
+using android::base::GetIntProperty;
+
+namespace android {
+namespace installd {
+
+// By default leave half of the cores for the rest of the system; every dex2oat invocation is
+// itself multi-threaded (dalvik.vm.dex2oat-threads).
+static constexpr size_t kDefaultMaxParallelJobs = 4;
+// By default allow at most a quarter of physical memory to be used by concurrent jobs.
+static constexpr int64_t kDefaultMemoryBudgetDivisor = 4;
+
+DexoptJobQueue::Limits DexoptJobQueue::getDefaultLimits() {
+    size_t cpus = std::max(1u, std::thread::hardware_concurrency());
+    size_t default_jobs = std::clamp<size_t>(cpus / 2, 1, kDefaultMaxParallelJobs);
+
+    Limits limits;
+    limits.maxParallelJobs = static_cast<size_t>(
+            GetIntProperty("dalvik.vm.dexopt-parallel-jobs", static_cast<int>(default_jobs), 1,
+                           static_cast<int>(cpus)));
+    limits.maxBackgroundJobs = static_cast<size_t>(
+            GetIntProperty("dalvik.vm.dexopt-parallel-background-jobs", 1, 1,
+                           static_cast<int>(limits.maxParallelJobs)));
+
+    int64_t phys_kb = static_cast<int64_t>(sysconf(_SC_PHYS_PAGES)) * (sysconf(_SC_PAGESIZE) / 1024);
+    int64_t budget_mb = GetIntProperty<int64_t>("dalvik.vm.dexopt-parallel-memory-mb",
+            phys_kb / kDefaultMemoryBudgetDivisor / 1024, 0);
+    limits.memoryBudgetKb = budget_mb * 1024;
+    return limits;
+}
+
+DexoptJobQueue::DexoptJobQueue(const Limits& limits) : mLimits(limits) {
+    mLimits.maxParallelJobs = std::max<size_t>(mLimits.maxParallelJobs, 1);
+    mLimits.maxBackgroundJobs = std::max<size_t>(mLimits.maxBackgroundJobs, 1);
+}
+
+void DexoptJobQueue::runAll(std::vector<DexoptJob> jobs, const ResultCallback& on_result) {
+    if (jobs.empty()) {
+        return;
+    }
+    ATRACE_NAME("DexoptJobQueue::runAll");
+
+    // Foreground jobs go first; otherwise keep the submission order.
+    std::list<DexoptJob> pending;
+    for (auto& job : jobs) {
+        if (!job.background) {
+            pending.push_back(std::move(job));
+        }
+    }
+    for (auto& job : jobs) {
+        if (job.background) {
+            pending.push_back(std::move(job));
+        }
+    }
+
+    std::mutex lock;
+    std::condition_variable cv;
+    std::set<std::string> running_packages;
+    size_t running_jobs = 0;
+    size_t running_background_jobs = 0;
+    int64_t running_memory_kb = 0;
+    std::mutex result_lock;
+
+    // Returns the first pending job that may start now, or pending.end(). Must hold lock.
+    // When nothing is running every job is runnable, so this can never stall the queue.
+    auto find_runnable = [&]() {
+        return std::find_if(pending.begin(), pending.end(), [&](const DexoptJob& job) {
+            if (running_packages.count(job.packageName) != 0) {
+                return false;
+            }
+            if (job.background && running_background_jobs >= mLimits.maxBackgroundJobs) {
+                return false;
+            }
+            return running_jobs == 0 ||
+                    running_memory_kb + job.memoryEstimateKb <= mLimits.memoryBudgetKb;
+        });
+    };
+
+    auto worker = [&]() {
+        std::unique_lock<std::mutex> l(lock);
+        while (true) {
+            auto it = pending.end();
+            cv.wait(l, [&]() {
+                return pending.empty() || (it = find_runnable()) != pending.end();
+            });
+            if (pending.empty()) {
+                return;
+            }
+
+            DexoptJob job = std::move(*it);
+            pending.erase(it);
+            running_packages.insert(job.packageName);
+            running_jobs++;
+            running_background_jobs += job.background ? 1 : 0;
+            running_memory_kb += job.memoryEstimateKb;
+            l.unlock();
+
+            DexoptJobResult result;
+            result.id = job.id;
+            auto start = std::chrono::steady_clock::now();
+            result.status = job.run(&result.errorMessage);
+            result.wallTimeMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::steady_clock::now() - start).count();
+            if (result.status != 0) {
+                LOG(WARNING) << "dexopt job " << job.id << " for " << job.packageName
+                        << " failed with " << result.status << ": " << result.errorMessage;
+            }
+            {
+                std::lock_guard<std::mutex> rl(result_lock);
+                on_result(result);
+            }
+
+            l.lock();
+            running_packages.erase(job.packageName);
+            running_jobs--;
+            running_background_jobs -= job.background ? 1 : 0;
+            running_memory_kb -= job.memoryEstimateKb;
+            cv.notify_all();
+        }
+    };
+
+    // The calling thread is one of the workers.
+    size_t worker_count = std::min(mLimits.maxParallelJobs, pending.size());
+    std::vector<std::thread> threads;
+    threads.reserve(worker_count - 1);
+    for (size_t i = 1; i < worker_count; i++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+}  // namespace installd
+}  // namespace android
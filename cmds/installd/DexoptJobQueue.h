@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_INSTALLD_DEXOPT_JOB_QUEUE_H
+#define ANDROID_INSTALLD_DEXOPT_JOB_QUEUE_H
+
+#include <stdint.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <android-base/macros.h>
+
+namespace android {
+namespace installd {
+
+/**
+ * A single unit of work for the DexoptJobQueue, typically one dexopt invocation.
+ */
+struct DexoptJob {
+    int32_t id = 0;
+    // Jobs for the same package are never run concurrently, since they share profiles and
+    // output directories.
+    std::string packageName;
+    // Background jobs are scheduled after all foreground jobs and are subject to
+    // Limits::maxBackgroundJobs.
+    bool background = false;
+    // Estimated peak memory use of the job. Used to keep the sum of running jobs under
+    // Limits::memoryBudgetKb.
+    int64_t memoryEstimateKb = 0;
+    // Runs the job. Returns 0 on success, or an error code with error_msg filled in.
+    std::function<int(std::string* error_msg)> run;
+};
+
+struct DexoptJobResult {
+    int32_t id;
+    int status;
+    std::string errorMessage;
+    int64_t wallTimeMs;
+};
+
+/**
+ * Runs batches of dexopt jobs on a bounded set of worker threads. Scheduling respects
+ * per-package exclusion, a cap on concurrent background jobs and a memory budget.
+ */
+class DexoptJobQueue {
+public:
+    struct Limits {
+        // Maximum number of jobs running at the same time.
+        size_t maxParallelJobs;
+        // Maximum number of background jobs running at the same time.
+        size_t maxBackgroundJobs;
+        // Upper bound on the sum of memoryEstimateKb of running jobs. A job that exceeds the
+        // budget on its own is still run, but only when nothing else is running.
+        int64_t memoryBudgetKb;
+    };
+
+    // Limits derived from the CPU count, physical memory and the
+    // dalvik.vm.dexopt-parallel-* properties.
+    static Limits getDefaultLimits();
+
+    using ResultCallback = std::function<void(const DexoptJobResult&)>;
+
+    explicit DexoptJobQueue(const Limits& limits);
+
+    // Runs all jobs and blocks until every one of them has finished. on_result is invoked once
+    // per job as it completes, from a worker thread; invocations are serialized.
+    void runAll(std::vector<DexoptJob> jobs, const ResultCallback& on_result);
+
+private:
+    Limits mLimits;
+
+    DISALLOW_COPY_AND_ASSIGN(DexoptJobQueue);
+};
+
+}  // namespace installd
+}  // namespace android
+
+#endif  // ANDROID_INSTALLD_DEXOPT_JOB_QUEUE_H
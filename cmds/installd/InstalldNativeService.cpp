@@ -69,6 +69,7 @@
 
 #include "CacheTracker.h"
 #include "CrateManager.h"
+#include "DexoptJobQueue.h"
 #include "MatchExtensionGen.h"
 #include "QuotaUtils.h"
 
@@ -581,6 +582,7 @@ binder::Status InstalldNativeService::clearAppProfiles(const std::string& packag
         const std::string& profileName) {
     ENFORCE_UID(AID_SYSTEM);
     CHECK_ARGUMENT_PACKAGE_NAME(packageName);
+    auto packageLock = mPackageLocks.lockPackage(packageName);
     std::lock_guard<std::recursive_mutex> lock(mLock);
 
     binder::Status res = ok();
@@ -698,6 +700,7 @@ static int destroy_app_current_profiles(const std::string& pkgname, userid_t use
 binder::Status InstalldNativeService::destroyAppProfiles(const std::string& packageName) {
     ENFORCE_UID(AID_SYSTEM);
     CHECK_ARGUMENT_PACKAGE_NAME(packageName);
+    auto packageLock = mPackageLocks.lockPackage(packageName);
     std::lock_guard<std::recursive_mutex> lock(mLock);
 
     binder::Status res = ok();
@@ -718,6 +721,7 @@ binder::Status InstalldNativeService::destroyAppData(const std::optional<std::st
     ENFORCE_UID(AID_SYSTEM);
     CHECK_ARGUMENT_UUID(uuid);
     CHECK_ARGUMENT_PACKAGE_NAME(packageName);
+    auto packageLock = mPackageLocks.lockPackage(packageName);
     std::lock_guard<std::recursive_mutex> lock(mLock);
 
     const char* uuid_ = uuid ? uuid->c_str() : nullptr;
@@ -1185,6 +1189,8 @@ binder::Status InstalldNativeService::moveCompleteApp(const std::optional<std::s
     CHECK_ARGUMENT_UUID(fromUuid);
     CHECK_ARGUMENT_UUID(toUuid);
     CHECK_ARGUMENT_PACKAGE_NAME(packageName);
+    auto packageLock = mPackageLocks.lockPackage(packageName);
+    auto codeLock = mPackageLocks.lockCodeDir(fromCodePath);
     std::lock_guard<std::recursive_mutex> lock(mLock);
 
     const char* from_uuid = fromUuid ? fromUuid->c_str() : nullptr;
@@ -1513,6 +1519,7 @@ binder::Status InstalldNativeService::rmdex(const std::string& codePath,
         const std::string& instructionSet) {
     ENFORCE_UID(AID_SYSTEM);
     CHECK_ARGUMENT_PATH(codePath);
+    auto codeLock = mPackageLocks.lockCodePath(codePath);
     std::lock_guard<std::recursive_mutex> lock(mLock);
 
     char dex_path[PKG_PATH_MAX];
@@ -2408,6 +2415,8 @@ binder::Status InstalldNativeService::dexopt(const std::string& apkPath, int32_t
     }
     CHECK_ARGUMENT_PATH(outputPath);
     CHECK_ARGUMENT_PATH(dexMetadataPath);
+    auto packageLock = mPackageLocks.lockPackage(packageName.value_or("*"));
+    auto codeLock = mPackageLocks.lockCodePath(apkPath);
     std::lock_guard<std::recursive_mutex> lock(mLock);
 
     const char* oat_dir = getCStr(outputPath);
@@ -2433,6 +2442,73 @@ binder::Status InstalldNativeService::dexopt(const std::string& apkPath, int32_t
     return res ? error(res, error_msg) : ok();
 }
 
+// Rough estimate of the peak memory dex2oat needs to compile apk_path, used to keep parallel
+// dexopt within the memory budget. dex2oat memory use grows with the amount of dex code.
+static int64_t estimate_dexopt_memory_kb(const std::string& apk_path) {
+    static constexpr int64_t kBaseMemoryKb = 64 * 1024;
+    static constexpr int64_t kMemoryPerApkByte = 4;
+    struct stat st;
+    if (stat(apk_path.c_str(), &st) != 0) {
+        return kBaseMemoryKb;
+    }
+    return kBaseMemoryKb + st.st_size * kMemoryPerApkByte / 1024;
+}
+
+binder::Status InstalldNativeService::dexoptBatch(
+        const std::vector<android::os::DexoptRequest>& requests,
+        const sp<android::os::IDexoptJobCallback>& callback) {
+    ENFORCE_UID(AID_SYSTEM);
+    if (callback == nullptr) {
+        return exception(binder::Status::EX_ILLEGAL_ARGUMENT, "Missing callback");
+    }
+    for (const auto& request : requests) {
+        CHECK_ARGUMENT_UUID(request.uuid);
+        CHECK_ARGUMENT_PATH(request.apkPath);
+        if (request.packageName && *request.packageName != "*") {
+            CHECK_ARGUMENT_PACKAGE_NAME(*request.packageName);
+        }
+        CHECK_ARGUMENT_PATH(request.outputPath);
+        CHECK_ARGUMENT_PATH(request.dexMetadataPath);
+    }
+    std::vector<android::installd::DexoptJob> jobs;
+    jobs.reserve(requests.size());
+    for (const auto& request : requests) {
+        android::installd::DexoptJob job;
+        job.id = request.jobId;
+        job.packageName = request.packageName.value_or("*");
+        job.background = (request.dexFlags & DEXOPT_IDLE_BACKGROUND_JOB) != 0;
+        job.memoryEstimateKb = estimate_dexopt_memory_kb(request.apkPath);
+        job.run = [this, &request](std::string* error_msg) {
+            // mLock is taken per job, by createOatDir, rather than for the whole batch so that
+            // other calls can get in between jobs. dex2oat runs without it, since holding it
+            // would serialize the batch; the package and code locks keep out dexopt() and the
+            // calls that move or delete the same package's files instead.
+            auto packageLock = mPackageLocks.lockPackage(request.packageName.value_or("*"));
+            auto codeLock = mPackageLocks.lockCodePath(request.apkPath);
+            std::optional<std::string> outputPath = request.outputPath;
+            if (outputPath && !createOatDir(*outputPath, request.instructionSet).isOk()) {
+                // Can't create oat dir - let dexopt use cache dir.
+                outputPath.reset();
+            }
+            return android::installd::dexopt(request.apkPath.c_str(), request.uid,
+                    getCStr(request.packageName, "*"), request.instructionSet.c_str(),
+                    request.dexoptNeeded, getCStr(outputPath), request.dexFlags,
+                    request.compilerFilter.c_str(), getCStr(request.uuid),
+                    getCStr(request.sharedLibraries), getCStr(request.seInfo), request.downgrade,
+                    request.targetSdkVersion, getCStr(request.profileName),
+                    getCStr(request.dexMetadataPath), getCStr(request.compilationReason),
+                    error_msg);
+        };
+        jobs.push_back(std::move(job));
+    }
+
+    android::installd::DexoptJobQueue queue(android::installd::DexoptJobQueue::getDefaultLimits());
+    queue.runAll(std::move(jobs), [&callback](const android::installd::DexoptJobResult& result) {
+        callback->onJobFinished(result.id, result.status, result.errorMessage, result.wallTimeMs);
+    });
+    return ok();
+}
+
 binder::Status InstalldNativeService::compileLayouts(const std::string& apkPath,
                                                      const std::string& packageName,
                                                      const std ::string& outDexFile, int uid,
@@ -2572,6 +2648,7 @@ binder::Status InstalldNativeService::createOatDir(const std::string& oatDir,
         const std::string& instructionSet) {
     ENFORCE_UID(AID_SYSTEM);
     CHECK_ARGUMENT_PATH(oatDir);
+    auto codeLock = mPackageLocks.lockCodePath(oatDir);
     std::lock_guard<std::recursive_mutex> lock(mLock);
 
     const char* oat_dir = oatDir.c_str();
@@ -2597,6 +2674,7 @@ binder::Status InstalldNativeService::createOatDir(const std::string& oatDir,
 binder::Status InstalldNativeService::rmPackageDir(const std::string& packageDir) {
     ENFORCE_UID(AID_SYSTEM);
     CHECK_ARGUMENT_PATH(packageDir);
+    auto codeLock = mPackageLocks.lockCodeDir(packageDir);
     std::lock_guard<std::recursive_mutex> lock(mLock);
 
     if (validate_apk_path(packageDir.c_str())) {
@@ -2643,6 +2721,7 @@ binder::Status InstalldNativeService::moveAb(const std::string& apkPath,
     ENFORCE_UID(AID_SYSTEM);
     CHECK_ARGUMENT_PATH(apkPath);
     CHECK_ARGUMENT_PATH(outputPath);
+    auto codeLock = mPackageLocks.lockCodePath(apkPath);
     std::lock_guard<std::recursive_mutex> lock(mLock);
 
     const char* apk_path = apkPath.c_str();
@@ -2659,6 +2738,7 @@ binder::Status InstalldNativeService::deleteOdex(const std::string& apkPath,
     ENFORCE_UID(AID_SYSTEM);
     CHECK_ARGUMENT_PATH(apkPath);
     CHECK_ARGUMENT_PATH(outputPath);
+    auto codeLock = mPackageLocks.lockCodePath(apkPath);
     std::lock_guard<std::recursive_mutex> lock(mLock);
 
     const char* apk_path = apkPath.c_str();
@@ -2837,6 +2917,36 @@ binder::Status InstalldNativeService::hashSecondaryDexFile(
     return result ? ok() : error();
 }
 
+binder::Status InstalldNativeService::hashSecondaryDexFiles(
+        const std::vector<std::string>& dexPaths, const std::string& packageName, int32_t uid,
+        const std::optional<std::string>& volumeUuid, int32_t storageFlag,
+        std::vector<android::os::SecondaryDexHash>* _aidl_return) {
+    ENFORCE_UID(AID_SYSTEM);
+    CHECK_ARGUMENT_UUID(volumeUuid);
+    CHECK_ARGUMENT_PACKAGE_NAME(packageName);
+    for (const auto& dexPath : dexPaths) {
+        CHECK_ARGUMENT_PATH(dexPath);
+    }
+
+    // As with hashSecondaryDexFile, mLock is not taken since the file system is never modified.
+    std::vector<std::vector<uint8_t>> hashes;
+    bool result = android::installd::hash_secondary_dex_files(
+        dexPaths, packageName, uid, volumeUuid, storageFlag, &hashes);
+    if (!result) {
+        return error();
+    }
+
+    _aidl_return->clear();
+    _aidl_return->reserve(dexPaths.size());
+    for (size_t i = 0; i < dexPaths.size(); i++) {
+        android::os::SecondaryDexHash entry;
+        entry.dexPath = dexPaths[i];
+        entry.hash = std::move(hashes[i]);
+        _aidl_return->push_back(std::move(entry));
+    }
+    return ok();
+}
+
 binder::Status InstalldNativeService::invalidateMounts() {
     ENFORCE_UID(AID_SYSTEM);
     std::lock_guard<std::recursive_mutex> lock(mMountsLock);
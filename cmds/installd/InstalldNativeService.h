@@ -30,6 +30,7 @@
 
 #include "android/os/BnInstalld.h"
 #include "installd_constants.h"
+#include "PackageLocks.h"
 
 namespace android {
 namespace installd {
@@ -115,6 +116,8 @@ public:
             int32_t targetSdkVersion, const std::optional<std::string>& profileName,
             const std::optional<std::string>& dexMetadataPath,
             const std::optional<std::string>& compilationReason);
+    binder::Status dexoptBatch(const std::vector<android::os::DexoptRequest>& requests,
+            const sp<android::os::IDexoptJobCallback>& callback);
 
     binder::Status compileLayouts(const std::string& apkPath, const std::string& packageName,
                                   const std::string& outDexFile, int uid, bool* _aidl_return);
@@ -158,6 +161,9 @@ public:
     binder::Status hashSecondaryDexFile(const std::string& dexPath,
         const std::string& packageName, int32_t uid, const std::optional<std::string>& volumeUuid,
         int32_t storageFlag, std::vector<uint8_t>* _aidl_return);
+    binder::Status hashSecondaryDexFiles(const std::vector<std::string>& dexPaths,
+        const std::string& packageName, int32_t uid, const std::optional<std::string>& volumeUuid,
+        int32_t storageFlag, std::vector<android::os::SecondaryDexHash>* _aidl_return);
 
     binder::Status invalidateMounts();
     binder::Status isQuotaSupported(const std::optional<std::string>& volumeUuid,
@@ -174,6 +180,9 @@ public:
 
 private:
     std::recursive_mutex mLock;
+    // Taken before mLock by calls that touch a package's code or oat files, so that dex2oat can
+    // run without mLock and still be kept apart from other calls for the same package.
+    PackageLocks mPackageLocks;
 
     std::recursive_mutex mMountsLock;
     std::recursive_mutex mQuotasLock;
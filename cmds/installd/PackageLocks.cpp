@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "PackageLocks.h"
+
+#include <utility>
+
+namespace android {
+namespace installd {
+
+PackageLocks::Guard::Guard(PackageLocks* locks, std::string key, Entry* entry)
+      : mLocks(locks), mKey(std::move(key)), mEntry(entry) {}
+
+PackageLocks::Guard::Guard(Guard&& other) noexcept
+      : mLocks(std::exchange(other.mLocks, nullptr)),
+        mKey(std::move(other.mKey)),
+        mEntry(std::exchange(other.mEntry, nullptr)) {}
+
+PackageLocks::Guard& PackageLocks::Guard::operator=(Guard&& other) noexcept {
+    if (this != &other) {
+        release();
+        mLocks = std::exchange(other.mLocks, nullptr);
+        mKey = std::move(other.mKey);
+        mEntry = std::exchange(other.mEntry, nullptr);
+    }
+    return *this;
+}
+
+PackageLocks::Guard::~Guard() {
+    release();
+}
+
+void PackageLocks::Guard::release() {
+    if (mEntry == nullptr) {
+        return;
+    }
+    mEntry->mutex.unlock();
+    std::lock_guard<std::mutex> lock(mLocks->mLock);
+    if (--mEntry->users == 0) {
+        mLocks->mEntries.erase(mKey);
+    }
+    mLocks = nullptr;
+    mEntry = nullptr;
+}
+
+PackageLocks::Guard PackageLocks::lockPackage(const std::string& packageName) {
+    if (packageName.empty() || packageName == "*") {
+        return Guard();
+    }
+    return lock(packageName);
+}
+
+PackageLocks::Guard PackageLocks::lockCodePath(const std::string& codePath) {
+    size_t end = codePath.find_last_of('/');
+    if (end == std::string::npos) {
+        return Guard();
+    }
+    return lockCodeDir(codePath.substr(0, end));
+}
+
+PackageLocks::Guard PackageLocks::lockCodeDir(const std::string& codeDir) {
+    // Paths always start with '/', so they never collide with package names.
+    size_t end = codeDir.find_last_not_of('/');
+    if (end == std::string::npos) {
+        return Guard();
+    }
+    return lock(codeDir.substr(0, end + 1));
+}
+
+PackageLocks::Guard PackageLocks::lock(std::string key) {
+    Entry* entry;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        std::unique_ptr<Entry>& slot = mEntries[key];
+        if (slot == nullptr) {
+            slot = std::make_unique<Entry>();
+        }
+        entry = slot.get();
+        entry->users++;
+    }
+    entry->mutex.lock();
+    return Guard(this, std::move(key), entry);
+}
+
+}  // namespace installd
+}  // namespace android
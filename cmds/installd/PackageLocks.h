@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_INSTALLD_PACKAGE_LOCKS_H
+#define ANDROID_INSTALLD_PACKAGE_LOCKS_H
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <android-base/macros.h>
+
+namespace android {
+namespace installd {
+
+/**
+ * Locks that keep operations on one package apart without serializing unrelated packages, so
+ * that dex2oat can run without holding the service-wide lock.
+ *
+ * Packages are locked by name, and code by the directory holding it (an APK's directory, which
+ * also holds its oat directory), for operations that only know paths. Locks are recursive.
+ * To avoid deadlocks, take the package lock before the code directory lock, and both before
+ * InstalldNativeService::mLock.
+ */
+class PackageLocks {
+private:
+    struct Entry {
+        std::recursive_mutex mutex;
+        // Threads holding or waiting for mutex. Guarded by PackageLocks::mLock.
+        size_t users = 0;
+    };
+
+public:
+    // Holds one lock until destroyed.
+    class Guard {
+    public:
+        Guard() = default;
+        Guard(Guard&& other) noexcept;
+        Guard& operator=(Guard&& other) noexcept;
+        ~Guard();
+
+    private:
+        friend class PackageLocks;
+        Guard(PackageLocks* locks, std::string key, Entry* entry);
+        void release();
+
+        PackageLocks* mLocks = nullptr;
+        std::string mKey;
+        Entry* mEntry = nullptr;
+
+        DISALLOW_COPY_AND_ASSIGN(Guard);
+    };
+
+    PackageLocks() = default;
+
+    // Locks packageName. Does nothing for "*" or an empty name, which stand for no package.
+    Guard lockPackage(const std::string& packageName);
+    // Locks the directory holding codePath, e.g. an APK.
+    Guard lockCodePath(const std::string& codePath);
+    // Locks codeDir itself, e.g. a package's code directory.
+    Guard lockCodeDir(const std::string& codeDir);
+
+private:
+    Guard lock(std::string key);
+
+    std::mutex mLock;
+    // Entries are only kept while some thread holds or waits for them.
+    std::unordered_map<std::string, std::unique_ptr<Entry>> mEntries;
+
+    DISALLOW_COPY_AND_ASSIGN(PackageLocks);
+};
+
+}  // namespace installd
+}  // namespace android
+
+#endif  // ANDROID_INSTALLD_PACKAGE_LOCKS_H
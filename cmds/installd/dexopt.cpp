@@ -21,6 +21,7 @@
 #include <string.h>
 #include <sys/capability.h>
 #include <sys/file.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
@@ -28,7 +29,10 @@
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
 #include <iomanip>
+#include <thread>
 
 #include <android-base/file.h>
 #include <android-base/logging.h>
@@ -2049,6 +2053,50 @@ bool reconcile_secondary_dex_file(const std::string& dex_path,
     }
 }
 
+// Files at least this large are hashed through a read-only mapping instead of a read() loop, which
+// saves copying every page into a userspace buffer before it is fed to SHA-256.
+static constexpr off_t kMinMmapHashSize = 64 * 1024;
+
+// Upper bound on the number of secondary dex files hashed concurrently by
+// hash_secondary_dex_files. Every worker forks a child, so keep this small.
+static constexpr size_t kMaxHashWorkers = 4;
+
+// Compute the SHA-256 of everything readable from fd into out_hash. Uses mmap for regular files
+// and falls back to streaming reads if the file cannot be mapped.
+static bool sha256_fd(int fd, uint8_t* out_hash) {
+    SHA256_CTX ctx;
+    SHA256_Init(&ctx);
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size >= kMinMmapHashSize) {
+        size_t size = static_cast<size_t>(st.st_size);
+        void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            madvise(data, size, MADV_SEQUENTIAL);
+            SHA256_Update(&ctx, data, size);
+            munmap(data, size);
+            SHA256_Final(out_hash, &ctx);
+            return true;
+        }
+        // Could not map (e.g. a file system without mmap support). Stream the file instead.
+    }
+
+    std::vector<uint8_t> buffer(65536);
+    while (true) {
+        ssize_t bytes_read = TEMP_FAILURE_RETRY(read(fd, buffer.data(), buffer.size()));
+        if (bytes_read == 0) {
+            break;
+        } else if (bytes_read == -1) {
+            return false;
+        }
+
+        SHA256_Update(&ctx, buffer.data(), bytes_read);
+    }
+
+    SHA256_Final(out_hash, &ctx);
+    return true;
+}
+
 // Compute and return the hash (SHA-256) of the secondary dex file at dex_path.
 // Returns true if all parameters are valid and the hash successfully computed and stored in
 // out_secondary_dex_hash.
@@ -2101,25 +2149,12 @@ bool hash_secondary_dex_file(const std::string& dex_path, const std::string& pkg
             _exit(DexoptReturnCodes::kHashOpenPath);
         }
 
-        SHA256_CTX ctx;
-        SHA256_Init(&ctx);
-
-        std::vector<uint8_t> buffer(65536);
-        while (true) {
-            ssize_t bytes_read = TEMP_FAILURE_RETRY(read(fd, buffer.data(), buffer.size()));
-            if (bytes_read == 0) {
-                break;
-            } else if (bytes_read == -1) {
-                async_safe_format_log(ANDROID_LOG_ERROR, LOG_TAG,
-                        "Failed to read secondary dex %s: %d", dex_path.c_str(), errno);
-                _exit(DexoptReturnCodes::kHashReadDex);
-            }
-
-            SHA256_Update(&ctx, buffer.data(), bytes_read);
-        }
-
         std::array<uint8_t, SHA256_DIGEST_LENGTH> hash;
-        SHA256_Final(hash.data(), &ctx);
+        if (!sha256_fd(fd, hash.data())) {
+            async_safe_format_log(ANDROID_LOG_ERROR, LOG_TAG,
+                    "Failed to read secondary dex %s: %d", dex_path.c_str(), errno);
+            _exit(DexoptReturnCodes::kHashReadDex);
+        }
         if (!WriteFully(pipe_write, hash.data(), hash.size())) {
             _exit(DexoptReturnCodes::kHashWrite);
         }
@@ -2137,6 +2172,46 @@ bool hash_secondary_dex_file(const std::string& dex_path, const std::string& pkg
     return wait_child(pid) == 0;
 }
 
+// Batch version of hash_secondary_dex_file. Hashes every file in dex_paths using a bounded pool of
+// worker threads, so that I/O and hashing of independent files overlap.
+// out_secondary_dex_hashes has one entry per element of dex_paths, in the same order, with the
+// same semantics as the single-file output. Returns false if hashing any of the files failed.
+bool hash_secondary_dex_files(const std::vector<std::string>& dex_paths,
+        const std::string& pkgname, int uid, const std::optional<std::string>& volume_uuid,
+        int storage_flag, std::vector<std::vector<uint8_t>>* out_secondary_dex_hashes) {
+    out_secondary_dex_hashes->clear();
+    out_secondary_dex_hashes->resize(dex_paths.size());
+    if (dex_paths.empty()) {
+        return true;
+    }
+
+    std::atomic<size_t> next_index(0);
+    std::atomic<bool> result(true);
+    auto worker = [&]() {
+        for (size_t i = next_index++; i < dex_paths.size(); i = next_index++) {
+            if (!hash_secondary_dex_file(dex_paths[i], pkgname, uid, volume_uuid, storage_flag,
+                    &(*out_secondary_dex_hashes)[i])) {
+                result = false;
+            }
+        }
+    };
+
+    size_t hardware_threads = std::max(1u, std::thread::hardware_concurrency());
+    size_t worker_count = std::min({kMaxHashWorkers, hardware_threads, dex_paths.size()});
+
+    // The calling thread is one of the workers.
+    std::vector<std::thread> threads;
+    threads.reserve(worker_count - 1);
+    for (size_t i = 1; i < worker_count; i++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    return result;
+}
+
 // Helper for move_ab, so that we can have common failure-case cleanup.
 static bool unlink_and_rename(const char* from, const char* to) {
     // Check whether "from" exists, and if so whether it's regular. If it is, unlink. Otherwise,
@@ -0,0 +1,210 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "DexoptJobQueue.h"
+
+namespace android {
+namespace installd {
+
+using namespace std::chrono_literals;
+
+// Stands in for a dex2oat invocation: tracks how many jobs run at the same time and which
+// packages are being compiled concurrently.
+class FakeDex2oat {
+  public:
+    int run(const DexoptJob& job) {
+        {
+            std::lock_guard<std::mutex> l(mLock);
+            EXPECT_EQ(mRunningPackages.count(job.packageName), 0u)
+                    << "two jobs for " << job.packageName << " ran concurrently";
+            mRunningPackages.insert(job.packageName);
+            mRunning++;
+            mMaxRunning = std::max(mMaxRunning, mRunning);
+            mRunningIds.insert(job.id);
+            for (int32_t id : mRunningIds) {
+                mMaxRunningWith[id] = std::max(mMaxRunningWith[id], mRunning);
+            }
+            if (job.background) {
+                mRunningBackground++;
+                mMaxRunningBackground = std::max(mMaxRunningBackground, mRunningBackground);
+            }
+            mMemoryKb += job.memoryEstimateKb;
+            mMaxMemoryKb = std::max(mMaxMemoryKb, mMemoryKb);
+            mOrder.push_back(job.id);
+        }
+        std::this_thread::sleep_for(20ms);
+        {
+            std::lock_guard<std::mutex> l(mLock);
+            mRunningPackages.erase(job.packageName);
+            mRunning--;
+            mRunningIds.erase(job.id);
+            if (job.background) {
+                mRunningBackground--;
+            }
+            mMemoryKb -= job.memoryEstimateKb;
+        }
+        return job.id % 5 == 4 ? 1 : 0;
+    }
+
+    std::vector<DexoptJob> makeJobs(size_t count, size_t packages, bool background,
+                                    int64_t memory_kb, int32_t first_id = 0) {
+        std::vector<DexoptJob> jobs;
+        for (size_t i = 0; i < count; i++) {
+            DexoptJob job;
+            job.id = first_id + static_cast<int32_t>(i);
+            job.packageName = "com.example.app" + std::to_string(i % packages);
+            job.background = background;
+            job.memoryEstimateKb = memory_kb;
+            job.run = [this, job_copy = job](std::string* error_msg) {
+                int status = run(job_copy);
+                if (status != 0) {
+                    *error_msg = "fake failure";
+                }
+                return status;
+            };
+            jobs.push_back(std::move(job));
+        }
+        return jobs;
+    }
+
+    std::mutex mLock;
+    std::set<std::string> mRunningPackages;
+    size_t mRunning = 0;
+    size_t mMaxRunning = 0;
+    size_t mRunningBackground = 0;
+    size_t mMaxRunningBackground = 0;
+    int64_t mMemoryKb = 0;
+    int64_t mMaxMemoryKb = 0;
+    std::vector<int32_t> mOrder;
+    std::set<int32_t> mRunningIds;
+    // Highest number of jobs that ran at any point while the given job was running.
+    std::map<int32_t, size_t> mMaxRunningWith;
+};
+
+static std::map<int32_t, DexoptJobResult> runQueue(const DexoptJobQueue::Limits& limits,
+                                                  std::vector<DexoptJob> jobs) {
+    std::map<int32_t, DexoptJobResult> results;
+    DexoptJobQueue queue(limits);
+    queue.runAll(std::move(jobs), [&results](const DexoptJobResult& result) {
+        EXPECT_EQ(results.count(result.id), 0u);
+        results[result.id] = result;
+    });
+    return results;
+}
+
+TEST(DexoptJobQueueTest, RunsEveryJobAndReportsResults) {
+    FakeDex2oat dex2oat;
+    auto results = runQueue({4, 4, 1 << 30}, dex2oat.makeJobs(20, 20, false, 1));
+
+    ASSERT_EQ(results.size(), 20u);
+    for (const auto& [id, result] : results) {
+        EXPECT_EQ(result.status, id % 5 == 4 ? 1 : 0);
+        EXPECT_EQ(result.errorMessage.empty(), result.status == 0);
+        EXPECT_GE(result.wallTimeMs, 0);
+    }
+    EXPECT_GT(dex2oat.mMaxRunning, 1u);
+    EXPECT_LE(dex2oat.mMaxRunning, 4u);
+}
+
+TEST(DexoptJobQueueTest, EmptyBatch) {
+    auto results = runQueue({4, 4, 1 << 30}, {});
+    EXPECT_TRUE(results.empty());
+}
+
+TEST(DexoptJobQueueTest, SerializesJobsOfTheSamePackage) {
+    FakeDex2oat dex2oat;
+    auto results = runQueue({8, 8, 1 << 30}, dex2oat.makeJobs(12, 2, false, 1));
+
+    EXPECT_EQ(results.size(), 12u);
+    EXPECT_LE(dex2oat.mMaxRunning, 2u);
+}
+
+TEST(DexoptJobQueueTest, RespectsMemoryBudget) {
+    FakeDex2oat dex2oat;
+    auto results = runQueue({8, 8, 300}, dex2oat.makeJobs(12, 12, false, 100));
+
+    EXPECT_EQ(results.size(), 12u);
+    EXPECT_LE(dex2oat.mMaxMemoryKb, 300);
+    EXPECT_LE(dex2oat.mMaxRunning, 3u);
+}
+
+TEST(DexoptJobQueueTest, RunsOversizedJobAlone) {
+    FakeDex2oat dex2oat;
+    std::vector<DexoptJob> jobs = dex2oat.makeJobs(1, 1, false, 1000);
+    for (auto& job : dex2oat.makeJobs(4, 4, false, 10, 1)) {
+        jobs.push_back(std::move(job));
+    }
+    auto results = runQueue({4, 4, 100}, std::move(jobs));
+
+    EXPECT_EQ(results.size(), 5u);
+    EXPECT_EQ(dex2oat.mMaxRunningWith[0], 1u);
+    // The small jobs still run in parallel with each other.
+    EXPECT_GT(dex2oat.mMaxRunning, 1u);
+}
+
+TEST(DexoptJobQueueTest, LimitsBackgroundJobsAndRunsThemLast) {
+    FakeDex2oat dex2oat;
+    std::vector<DexoptJob> jobs = dex2oat.makeJobs(6, 6, true, 1, 100);
+    for (auto& job : dex2oat.makeJobs(6, 6, false, 1, 0)) {
+        jobs.push_back(std::move(job));
+    }
+    auto results = runQueue({4, 1, 1 << 30}, std::move(jobs));
+
+    EXPECT_EQ(results.size(), 12u);
+    EXPECT_EQ(dex2oat.mMaxRunningBackground, 1u);
+    // All foreground jobs start before any background job.
+    ASSERT_EQ(dex2oat.mOrder.size(), 12u);
+    for (size_t i = 0; i < 6; i++) {
+        EXPECT_LT(dex2oat.mOrder[i], 100);
+    }
+}
+
+TEST(DexoptJobQueueTest, ParallelIsFasterThanSerial) {
+    FakeDex2oat serial_dex2oat;
+    auto start = std::chrono::steady_clock::now();
+    runQueue({1, 1, 1 << 30}, serial_dex2oat.makeJobs(8, 8, false, 1));
+    auto serial_time = std::chrono::steady_clock::now() - start;
+
+    FakeDex2oat parallel_dex2oat;
+    start = std::chrono::steady_clock::now();
+    runQueue({4, 4, 1 << 30}, parallel_dex2oat.makeJobs(8, 8, false, 1));
+    auto parallel_time = std::chrono::steady_clock::now() - start;
+
+    EXPECT_EQ(serial_dex2oat.mMaxRunning, 1u);
+    EXPECT_LT(parallel_time, serial_time);
+}
+
+TEST(DexoptJobQueueTest, DefaultLimitsAreSane) {
+    DexoptJobQueue::Limits limits = DexoptJobQueue::getDefaultLimits();
+    EXPECT_GE(limits.maxParallelJobs, 1u);
+    EXPECT_GE(limits.maxBackgroundJobs, 1u);
+    EXPECT_LE(limits.maxBackgroundJobs, limits.maxParallelJobs);
+    EXPECT_GT(limits.memoryBudgetKb, 0);
+}
+
+}  // namespace installd
+}  // namespace android
@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "PackageLocks.h"
+
+namespace android {
+namespace installd {
+
+using namespace std::chrono_literals;
+
+// Returns whether another thread has to wait for held to take the lock returned by lockFn.
+// Releases held.
+template <typename F>
+static bool waitsFor(PackageLocks::Guard held, F lockFn) {
+    auto other = std::async(std::launch::async, [&] { auto guard = lockFn(); });
+    bool waited = other.wait_for(100ms) == std::future_status::timeout;
+    held = PackageLocks::Guard();
+    other.get();
+    return waited;
+}
+
+TEST(PackageLocksTest, SamePackageIsExclusive) {
+    PackageLocks locks;
+    EXPECT_TRUE(waitsFor(locks.lockPackage("com.example.a"),
+                         [&] { return locks.lockPackage("com.example.a"); }));
+}
+
+TEST(PackageLocksTest, DifferentPackagesRunInParallel) {
+    PackageLocks locks;
+    EXPECT_FALSE(waitsFor(locks.lockPackage("com.example.a"),
+                          [&] { return locks.lockPackage("com.example.b"); }));
+}
+
+TEST(PackageLocksTest, Recursive) {
+    PackageLocks locks;
+    auto outer = locks.lockPackage("com.example.a");
+    {
+        auto inner = locks.lockPackage("com.example.a");
+    }
+    EXPECT_TRUE(waitsFor(std::move(outer), [&] { return locks.lockPackage("com.example.a"); }));
+}
+
+TEST(PackageLocksTest, WildcardPackageIsNotLocked) {
+    PackageLocks locks;
+    EXPECT_FALSE(waitsFor(locks.lockPackage("*"), [&] { return locks.lockPackage("*"); }));
+}
+
+TEST(PackageLocksTest, CodePathsShareTheirDirectory) {
+    PackageLocks locks;
+    const std::string apk = "/data/app/com.example.a-1/base.apk";
+    EXPECT_TRUE(waitsFor(locks.lockCodePath(apk),
+                         [&] { return locks.lockCodePath("/data/app/com.example.a-1/oat"); }));
+    EXPECT_TRUE(waitsFor(locks.lockCodePath(apk),
+                         [&] { return locks.lockCodeDir("/data/app/com.example.a-1/"); }));
+    EXPECT_FALSE(waitsFor(locks.lockCodePath(apk), [&] {
+        return locks.lockCodePath("/data/app/com.example.b-1/base.apk");
+    }));
+}
+
+TEST(PackageLocksTest, MovedGuardKeepsTheLock) {
+    PackageLocks locks;
+    PackageLocks::Guard guard;
+    {
+        auto inner = locks.lockPackage("com.example.a");
+        guard = std::move(inner);
+    }
+    EXPECT_TRUE(waitsFor(std::move(guard), [&] { return locks.lockPackage("com.example.a"); }));
+    // Both guards are gone, so the lock is free again.
+    EXPECT_FALSE(waitsFor(PackageLocks::Guard(),
+                          [&] { return locks.lockPackage("com.example.a"); }));
+}
+
+TEST(PackageLocksTest, ManyThreadsOnOnePackage) {
+    PackageLocks locks;
+    int counter = 0;
+    std::atomic<int> inside = 0;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 8; i++) {
+        threads.emplace_back([&] {
+            for (int j = 0; j < 1000; j++) {
+                auto guard = locks.lockPackage("com.example.a");
+                EXPECT_EQ(1, ++inside);
+                counter++;
+                inside--;
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    EXPECT_EQ(8000, counter);
+}
+
+}  // namespace installd
+}  // namespace android
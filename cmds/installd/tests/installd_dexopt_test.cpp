@@ -32,6 +32,10 @@
 
 #include <gtest/gtest.h>
 
+#include <map>
+#include <mutex>
+#include <thread>
+
 #include <selinux/android.h>
 #include <selinux/avc.h>
 
@@ -44,6 +48,8 @@
 #include "utils.h"
 #include "ziparchive/zip_writer.h"
 
+#include "android/os/BnDexoptJobCallback.h"
+
 using android::base::ReadFully;
 using android::base::unique_fd;
 
@@ -750,6 +756,77 @@ TEST_F(DexoptTest, DexoptPrimaryBackgroundOk) {
                         empty_dm_file_.c_str());
 }
 
+// Records the status of every job reported by dexoptBatch.
+class RecordingDexoptJobCallback : public android::os::BnDexoptJobCallback {
+public:
+    binder::Status onJobFinished(int32_t jobId, int32_t status, const std::string& errorMessage,
+                                 int64_t /* wallTimeMillis */) override {
+        std::lock_guard<std::mutex> lock(mLock);
+        mStatuses[jobId] = status;
+        if (status != 0) {
+            LOG(ERROR) << "Job " << jobId << " failed: " << errorMessage;
+        }
+        return binder::Status::ok();
+    }
+
+    std::map<int32_t, int32_t> statuses() {
+        std::lock_guard<std::mutex> lock(mLock);
+        return mStatuses;
+    }
+
+private:
+    std::mutex mLock;
+    std::map<int32_t, int32_t> mStatuses;
+};
+
+TEST_F(DexoptTest, DexoptBatchOverlapsDexoptForSamePackage) {
+    LOG(INFO) << "DexoptBatchOverlapsDexoptForSamePackage";
+    // Batch jobs run dex2oat without mLock, so only the package lock keeps them from writing the
+    // same oat files as a concurrent dexopt call.
+    constexpr int32_t kJobs = 3;
+    std::vector<android::os::DexoptRequest> requests(kJobs);
+    for (int32_t i = 0; i < kJobs; i++) {
+        android::os::DexoptRequest& request = requests[i];
+        request.jobId = i;
+        request.apkPath = apk_path_;
+        request.uid = kTestAppGid;
+        request.packageName = package_name_;
+        request.instructionSet = kRuntimeIsa;
+        request.dexoptNeeded = DEX2OAT_FROM_SCRATCH;
+        request.outputPath = app_oat_dir_;
+        request.dexFlags = DEXOPT_BOOTCOMPLETE | DEXOPT_PUBLIC;
+        request.compilerFilter = "verify";
+        request.uuid = volume_uuid_;
+        request.sharedLibraries = "PCL[]";
+        request.seInfo = se_info_;
+        request.profileName = "primary.prof";
+        request.compilationReason = "test-reason";
+    }
+    sp<RecordingDexoptJobCallback> callback = new RecordingDexoptJobCallback();
+
+    std::thread batch(
+            [&] { EXPECT_BINDER_SUCCESS(service_->dexoptBatch(requests, callback)); });
+    CompilePrimaryDexOk("verify",
+                        DEXOPT_BOOTCOMPLETE | DEXOPT_PUBLIC,
+                        app_oat_dir_.c_str(),
+                        kTestAppGid,
+                        DEX2OAT_FROM_SCRATCH);
+    batch.join();
+
+    std::map<int32_t, int32_t> expected;
+    for (int32_t i = 0; i < kJobs; i++) {
+        expected[i] = 0;
+    }
+    EXPECT_EQ(expected, callback->statuses());
+
+    // Whichever compile finished last left complete artifacts behind.
+    mode_t mode = S_IFREG | 0644;
+    CheckFileAccess(GetPrimaryDexArtifact(app_oat_dir_.c_str(), apk_path_, "odex"), kSystemUid,
+                    kTestAppGid, mode);
+    CheckFileAccess(GetPrimaryDexArtifact(app_oat_dir_.c_str(), apk_path_, "vdex"), kSystemUid,
+                    kTestAppGid, mode);
+}
+
 TEST_F(DexoptTest, DeleteDexoptArtifactsData) {
     LOG(INFO) << "DeleteDexoptArtifactsData";
     TestDeleteOdex(/*in_dalvik_cache=*/ false);
@@ -224,6 +224,53 @@ TEST_F(ServiceTest, HashSecondaryDex_WrongApp) {
         dexPath, "com.wrong", 10000, testUuid, FLAG_STORAGE_CE, &result));
 }
 
+TEST_F(ServiceTest, HashSecondaryDexFiles) {
+    LOG(INFO) << "HashSecondaryDexFiles";
+
+    mkdir("com.example", 10000, 10000, 0700);
+    mkdir("com.example/foo", 10000, 10000, 0700);
+    touch("com.example/foo/file", 10000, 20000, 0700);
+    touch("com.example/foo/unreadable", 10000, 20000, 0300);
+
+    std::vector<std::string> dexPaths = {
+        get_full_path("com.example/foo/file"),
+        get_full_path("com.example/foo/missing"),
+        get_full_path("com.example/foo/unreadable"),
+        get_full_path("com.example/foo/file"),
+    };
+    std::vector<android::os::SecondaryDexHash> result;
+    EXPECT_BINDER_SUCCESS(service->hashSecondaryDexFiles(
+        dexPaths, "com.example", 10000, testUuid, FLAG_STORAGE_CE, &result));
+
+    ASSERT_EQ(result.size(), dexPaths.size());
+    for (size_t i = 0; i < result.size(); i++) {
+        EXPECT_EQ(result[i].dexPath, dexPaths[i]);
+    }
+    EXPECT_EQ(result[0].hash.size(), 32U);
+    EXPECT_EQ(result[1].hash.size(), 0U);
+    EXPECT_EQ(result[2].hash.size(), 0U);
+    EXPECT_EQ(result[3].hash, result[0].hash);
+
+    // The batch API must agree with the single-file one.
+    std::vector<uint8_t> single;
+    EXPECT_BINDER_SUCCESS(service->hashSecondaryDexFile(
+        dexPaths[0], "com.example", 10000, testUuid, FLAG_STORAGE_CE, &single));
+    EXPECT_EQ(result[0].hash, single);
+}
+
+TEST_F(ServiceTest, HashSecondaryDexFiles_WrongApp) {
+    LOG(INFO) << "HashSecondaryDexFiles_WrongApp";
+
+    mkdir("com.example", 10000, 10000, 0700);
+    mkdir("com.example/foo", 10000, 10000, 0700);
+    touch("com.example/foo/file", 10000, 20000, 0700);
+
+    std::vector<android::os::SecondaryDexHash> result;
+    std::vector<std::string> dexPaths = { get_full_path("com.example/foo/file") };
+    EXPECT_BINDER_FAIL(service->hashSecondaryDexFiles(
+        dexPaths, "com.wrong", 10000, testUuid, FLAG_STORAGE_CE, &result));
+}
+
 TEST_F(ServiceTest, CalculateOat) {
     char buf[PKG_PATH_MAX];
 
@@ -22,10 +22,13 @@
 #include <fstream>
 #include <functional>
 #include <iomanip>
+#include <atomic>
 #include <iostream>
+#include <list>
 #include <map>
 #include <regex>
 #include <sstream>
+#include <thread>
 
 #include <android-base/file.h>
 #include <android-base/hex.h>
@@ -210,13 +213,13 @@ bool ListCommand::getPidInfo(
 }
 
 const BinderPidInfo* ListCommand::getPidInfoCached(pid_t serverPid) {
-    auto pair = mCachedPidInfos.insert({serverPid, BinderPidInfo{}});
-    if (pair.second /* did insertion take place? */) {
-        if (!getPidInfo(serverPid, &pair.first->second)) {
-            return nullptr;
-        }
-    }
-    return &pair.first->second;
+    std::unique_lock<std::mutex> lock(mCachedPidInfosLock);
+    CachedPidInfo& cached = mCachedPidInfos[serverPid];
+    lock.unlock();
+    // Entries are never erased, so cached stays valid. Other threads asking for the same PID
+    // wait here instead of parsing its binder logs again.
+    std::call_once(cached.fetched, [&] { cached.valid = getPidInfo(serverPid, &cached.info); });
+    return cached.valid ? &cached.info : nullptr;
 }
 
 bool ListCommand::shouldFetchHalType(const HalType &type) const {
@@ -508,7 +511,8 @@ void ListCommand::putEntry(HalType type, TableEntry &&entry) {
     tableForType(type)->add(std::forward<TableEntry>(entry));
 }
 
-Status ListCommand::fetchAllLibraries(const sp<IServiceManager> &manager) {
+Status ListCommand::fetchAllLibraries(const sp<IServiceManager> &manager,
+                                      const NullableOStream<std::ostream>& err) {
     if (!shouldFetchHalType(HalType::PASSTHROUGH_LIBRARIES)) { return OK; }
 
     using namespace ::android::hardware;
@@ -531,14 +535,15 @@ Status ListCommand::fetchAllLibraries(const sp<IServiceManager> &manager) {
         }
     });
     if (!ret.isOk()) {
-        err() << "Error: Failed to call list on getPassthroughServiceManager(): "
-             << ret.description() << std::endl;
+        err << "Error: Failed to call list on getPassthroughServiceManager(): "
+           << ret.description() << std::endl;
         return DUMP_ALL_LIBS_ERROR;
     }
     return OK;
 }
 
-Status ListCommand::fetchPassthrough(const sp<IServiceManager> &manager) {
+Status ListCommand::fetchPassthrough(const sp<IServiceManager> &manager,
+                                     const NullableOStream<std::ostream>& err) {
     if (!shouldFetchHalType(HalType::PASSTHROUGH_CLIENTS)) { return OK; }
 
     using namespace ::android::hardware;
@@ -562,14 +567,15 @@ Status ListCommand::fetchPassthrough(const sp<IServiceManager> &manager) {
         }
     });
     if (!ret.isOk()) {
-        err() << "Error: Failed to call debugDump on defaultServiceManager(): "
-             << ret.description() << std::endl;
+        err << "Error: Failed to call debugDump on defaultServiceManager(): "
+           << ret.description() << std::endl;
         return DUMP_PASSTHROUGH_ERROR;
     }
     return OK;
 }
 
-Status ListCommand::fetchBinderized(const sp<IServiceManager> &manager) {
+Status ListCommand::fetchBinderized(const sp<IServiceManager> &manager,
+                                    const NullableOStream<std::ostream>& err) {
     using vintf::operator<<;
 
     if (!shouldFetchHalType(HalType::BINDERIZED_SERVICES)) { return OK; }
@@ -581,12 +587,11 @@ Status ListCommand::fetchBinderized(const sp<IServiceManager> &manager) {
         fqInstanceNames = names;
     });
     if (!listRet.isOk()) {
-        err() << "Error: Failed to list services for " << mode << ": "
-             << listRet.description() << std::endl;
+        err << "Error: Failed to list services for " << mode << ": "
+           << listRet.description() << std::endl;
         return DUMP_BINDERIZED_ERROR;
     }
 
-    Status status = OK;
     std::map<std::string, TableEntry> allTableEntries;
     for (const auto &fqInstanceName : fqInstanceNames) {
         // create entry and default assign all fields.
@@ -594,8 +599,42 @@ Status ListCommand::fetchBinderized(const sp<IServiceManager> &manager) {
         entry.interfaceName = fqInstanceName;
         entry.transport = mode;
         entry.serviceStatus = ServiceStatus::NON_RESPONSIVE;
+    }
 
-        status |= fetchBinderizedEntry(manager, &entry);
+    // Each entry needs several IPCs, most of which are spent waiting on the server, so fetch
+    // them from a pool of threads. Errors are buffered per entry so that they are emitted in the
+    // same order as when fetching sequentially.
+    struct Fetch {
+        TableEntry* entry;
+        std::stringstream err;
+        Status status = OK;
+    };
+    std::vector<Fetch> fetches(allTableEntries.size());
+    size_t i = 0;
+    for (auto& pair : allTableEntries) {
+        fetches[i++].entry = &pair.second;
+    }
+    std::atomic<size_t> nextFetch = 0;
+    const auto fetchEntries = [&] {
+        for (size_t index; (index = nextFetch++) < fetches.size();) {
+            Fetch& fetch = fetches[index];
+            fetch.status = fetchBinderizedEntry(manager, fetch.entry,
+                                                NullableOStream<std::ostream>(fetch.err));
+        }
+    };
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < std::min(kMaxFetchThreads, fetches.size()); ++t) {
+        threads.emplace_back(fetchEntries);
+    }
+    fetchEntries();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    Status status = OK;
+    for (const auto& fetch : fetches) {
+        err << fetch.err.str();
+        status |= fetch.status;
     }
 
     for (auto& pair : allTableEntries) {
@@ -605,10 +644,11 @@ Status ListCommand::fetchBinderized(const sp<IServiceManager> &manager) {
 }
 
 Status ListCommand::fetchBinderizedEntry(const sp<IServiceManager> &manager,
-                                         TableEntry *entry) {
+                                         TableEntry *entry,
+                                         const NullableOStream<std::ostream>& err) {
     Status status = OK;
     const auto handleError = [&](Status additionalError, const std::string& msg) {
-        err() << "Warning: Skipping \"" << entry->interfaceName << "\": " << msg << std::endl;
+        err << "Warning: Skipping \"" << entry->interfaceName << "\": " << msg << std::endl;
         status |= DUMP_BINDERIZED_ERROR | additionalError;
     };
 
@@ -792,27 +832,71 @@ bool ListCommand::hasPassthroughEntry(const TableEntry& entry) const {
     return false;
 }
 
+Status ListCommand::timeStage(const std::string& name, const std::function<Status()>& f,
+                              const NullableOStream<std::ostream>& out) const {
+    const auto start = std::chrono::steady_clock::now();
+    Status status = f();
+    if (mEmitTiming) {
+        const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - start);
+        out << "Timing: " << name << " took " << elapsed.count() << "ms" << std::endl;
+    }
+    return status;
+}
+
 Status ListCommand::fetch() {
     Status status = OK;
     auto bManager = mLshal.serviceManager();
     if (bManager == nullptr) {
         err() << "Failed to get defaultServiceManager()!" << std::endl;
         status |= NO_BINDERIZED_MANAGER;
-    } else {
-        status |= fetchBinderized(bManager);
-        // Passthrough PIDs are registered to the binderized manager as well.
-        status |= fetchPassthrough(bManager);
     }
-
     auto pManager = mLshal.passthroughManager();
     if (pManager == nullptr) {
         err() << "Failed to get getPassthroughServiceManager()!" << std::endl;
         status |= NO_PASSTHROUGH_MANAGER;
-    } else {
-        status |= fetchAllLibraries(pManager);
     }
-    status |= fetchManifestHals();
-    status |= fetchLazyHals();
+
+    // These stages only read from the service managers and each fill their own table, so run
+    // them concurrently and emit their errors and timing afterwards, in order.
+    struct Stage {
+        std::string name;
+        std::function<Status(const NullableOStream<std::ostream>&)> fetch;
+        std::stringstream err;
+        Status status = OK;
+    };
+    std::list<Stage> stages;
+    if (bManager != nullptr) {
+        stages.push_back({.name = "fetch binderized", .fetch = [&](const auto& err) {
+                              return fetchBinderized(bManager, err);
+                          }});
+        // Passthrough PIDs are registered to the binderized manager as well.
+        stages.push_back({.name = "fetch passthrough clients", .fetch = [&](const auto& err) {
+                              return fetchPassthrough(bManager, err);
+                          }});
+    }
+    if (pManager != nullptr) {
+        stages.push_back({.name = "fetch passthrough libraries", .fetch = [&](const auto& err) {
+                              return fetchAllLibraries(pManager, err);
+                          }});
+    }
+    std::vector<std::thread> threads;
+    for (auto& stage : stages) {
+        threads.emplace_back([this, &stage] {
+            NullableOStream<std::ostream> err(stage.err);
+            stage.status = timeStage(stage.name, [&] { return stage.fetch(err); }, err);
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (const auto& stage : stages) {
+        err() << stage.err.str();
+        status |= stage.status;
+    }
+
+    status |= timeStage("fetch manifest HALs", [this] { return fetchManifestHals(); }, err());
+    status |= timeStage("fetch lazy HALs", [this] { return fetchLazyHals(); }, err());
     return status;
 }
 
@@ -956,6 +1040,10 @@ void ListCommand::registerAllOptions() {
         thiz->mNeat = true;
         return OK;
     }, "output is machine parsable (no explanatory text).\nCannot be used with --debug."});
+    mOptions.push_back({'\0', "timing", no_argument, v++, [](ListCommand* thiz, const char*) {
+        thiz->mEmitTiming = true;
+        return OK;
+    }, "print the time taken by each stage to stderr."});
     mOptions.push_back(
             {'\0', "types", required_argument, v++,
              [](ListCommand* thiz, const char* arg) {
@@ -1135,9 +1223,12 @@ Status ListCommand::main(const Arg &arg) {
     if (status != OK) {
         return status;
     }
-    status = fetch();
-    postprocess();
-    status |= dump();
+    status = timeStage("fetch", [this] { return fetch(); }, err());
+    timeStage("postprocess", [this] {
+        postprocess();
+        return OK;
+    }, err());
+    status |= timeStage("dump", [this] { return dump(); }, err());
     return status;
 }
 
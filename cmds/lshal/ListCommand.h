@@ -19,7 +19,10 @@
 #include <getopt.h>
 #include <stdint.h>
 
+#include <chrono>
 #include <fstream>
+#include <functional>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -85,6 +88,9 @@ public:
 
     static std::string INIT_VINTF_NOTES;
 
+    // Maximum number of binderized HALs that are fetched concurrently.
+    static constexpr size_t kMaxFetchThreads = 16;
+
 protected:
     Status parseArgs(const Arg &arg);
     // Retrieve first-hand information
@@ -93,20 +99,30 @@ protected:
     virtual void postprocess();
     Status dump();
     void putEntry(HalType type, TableEntry &&entry);
-    Status fetchPassthrough(const sp<::android::hidl::manager::V1_0::IServiceManager> &manager);
-    Status fetchBinderized(const sp<::android::hidl::manager::V1_0::IServiceManager> &manager);
-    Status fetchAllLibraries(const sp<::android::hidl::manager::V1_0::IServiceManager> &manager);
+    // The following fetch functions may run concurrently with each other, so they write errors
+    // to err instead of err(); fetch() emits them in a fixed order.
+    Status fetchPassthrough(const sp<::android::hidl::manager::V1_0::IServiceManager> &manager,
+                            const NullableOStream<std::ostream>& err);
+    Status fetchBinderized(const sp<::android::hidl::manager::V1_0::IServiceManager> &manager,
+                           const NullableOStream<std::ostream>& err);
+    Status fetchAllLibraries(const sp<::android::hidl::manager::V1_0::IServiceManager> &manager,
+                             const NullableOStream<std::ostream>& err);
     Status fetchManifestHals();
     Status fetchLazyHals();
 
     Status fetchBinderizedEntry(const sp<::android::hidl::manager::V1_0::IServiceManager> &manager,
-                                TableEntry *entry);
+                                TableEntry *entry, const NullableOStream<std::ostream>& err);
+
+    // Run f and, if --timing is set, write how long it took to out.
+    Status timeStage(const std::string& name, const std::function<Status()>& f,
+                     const NullableOStream<std::ostream>& out) const;
 
     // Get relevant information for a PID by parsing files under
     // /dev/binderfs/binder_logs or /d/binder.
     // It is a virtual member function so that it can be mocked.
     virtual bool getPidInfo(pid_t serverPid, BinderPidInfo *info) const;
-    // Retrieve from mCachedPidInfos and call getPidInfo if necessary.
+    // Retrieve from mCachedPidInfos and call getPidInfo if necessary. Thread-safe; getPidInfo is
+    // called at most once per PID.
     const BinderPidInfo* getPidInfoCached(pid_t serverPid);
 
     void dumpTable(const NullableOStream<std::ostream>& out) const;
@@ -175,6 +191,9 @@ protected:
     // If true, explanatory text are not emitted.
     bool mNeat = false;
 
+    // If true, the time taken by each stage is written to err().
+    bool mEmitTiming = false;
+
     // Type(s) of HAL associations to list.
     std::vector<HalType> mListTypes{};
     // Type(s) of HAL associations to fetch.
@@ -186,7 +205,13 @@ protected:
     std::map<pid_t, std::string> mCmdlines;
 
     // Cache for getPidInfo.
-    std::map<pid_t, BinderPidInfo> mCachedPidInfos;
+    struct CachedPidInfo {
+        std::once_flag fetched;
+        bool valid = false;
+        BinderPidInfo info;
+    };
+    std::mutex mCachedPidInfosLock;
+    std::map<pid_t, CachedPidInfo> mCachedPidInfos;
 
     // Cache for getPartition.
     std::map<pid_t, Partition> mPartitions;
@@ -435,6 +435,25 @@ TEST_F(ListTest, GetPidInfoCached) {
     EXPECT_NE(nullptr, mockList->getPidInfoCached(5));
 }
 
+TEST_F(ListTest, GetPidInfoCachedConcurrently) {
+    EXPECT_CALL(*mockList, getPidInfo(5, _)).Times(1);
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 8; ++i) {
+        threads.emplace_back([&] { EXPECT_NE(nullptr, mockList->getPidInfoCached(5)); });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+TEST_F(ListTest, Timing) {
+    optind = 1; // mimic Lshal::parseArg()
+    EXPECT_EQ(0u, mockList->main(createArg({"lshal", "--timing"})));
+    EXPECT_THAT(err.str(), HasSubstr("Timing: fetch binderized took"));
+    EXPECT_THAT(err.str(), HasSubstr("Timing: dump took"));
+}
+
 TEST_F(ListTest, Fetch) {
     optind = 1; // mimic Lshal::parseArg()
     ASSERT_EQ(0u, mockList->parseArgs(createArg({"lshal"})));
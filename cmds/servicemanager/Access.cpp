@@ -122,6 +122,10 @@ bool Access::canList(const CallingContext& ctx) {
     return actionAllowed(ctx, mThisProcessContext, "list", "service_manager");
 }
 
+bool Access::canReadRegistrationTable(const CallingContext& ctx) {
+    return actionAllowed(ctx, mThisProcessContext, "read_registration_table", "service_manager");
+}
+
 bool Access::actionAllowed(const CallingContext& sctx, const char* tctx, const char* perm,
         const std::string& tname) {
     const char* tclass = "service_manager";
@@ -43,6 +43,9 @@ public:
     virtual bool canFind(const CallingContext& ctx, const std::string& name);
     virtual bool canAdd(const CallingContext& ctx, const std::string& name);
     virtual bool canList(const CallingContext& ctx);
+    // The registration table tells which names are registered without a per-name canFind check,
+    // so it has its own permission rather than piggybacking on canList.
+    virtual bool canReadRegistrationTable(const CallingContext& ctx);
 
 private:
     bool actionAllowed(const CallingContext& sctx, const char* tctx, const char* perm,
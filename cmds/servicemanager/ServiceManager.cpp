@@ -18,12 +18,14 @@
 
 #include <android-base/logging.h>
 #include <android-base/properties.h>
+#include <android/os/BnServiceRegistrationTable.h>
 #include <binder/BpBinder.h>
 #include <binder/IPCThreadState.h>
 #include <binder/ProcessState.h>
 #include <binder/Stability.h>
 #include <cutils/android_filesystem_config.h>
 #include <cutils/multiuser.h>
+#include <fcntl.h>
 #include <thread>
 
 #ifndef VENDORSERVICEMANAGER
@@ -149,7 +151,35 @@ static bool meetsDeclarationRequirements(const sp<IBinder>& binder, const std::s
 }
 #endif  // !VENDORSERVICEMANAGER
 
-ServiceManager::ServiceManager(std::unique_ptr<Access>&& access) : mAccess(std::move(access)) {
+// Hands out the registration table of a ServiceManager. This is a separate binder, rather than
+// part of IServiceManager, because framework.jar implements IServiceManager too.
+class RegistrationTableService : public os::BnServiceRegistrationTable {
+public:
+    explicit RegistrationTableService(const wp<ServiceManager>& manager) : mManager(manager) {}
+
+    Status getTable(std::optional<os::ParcelFileDescriptor>* outReturn) override {
+        sp<ServiceManager> manager = mManager.promote();
+        if (manager == nullptr) {
+            return Status::fromExceptionCode(Status::EX_ILLEGAL_STATE);
+        }
+        return manager->getServiceRegistrationTable(outReturn);
+    }
+
+private:
+    wp<ServiceManager> mManager;
+};
+
+// Room for the names in mRegistrationTable. Devices typically register a few hundred services;
+// beyond this, lookups of unregistered names fall back to binder transactions.
+static constexpr size_t kRegistrationTableCapacity = 1024;
+
+ServiceManager::ServiceManager(std::unique_ptr<Access>&& access)
+      : mAccess(std::move(access)),
+        mRegistrationTable(ServiceRegistrationTable::create(kRegistrationTableCapacity)) {
+    if (mRegistrationTable == nullptr) {
+        LOG(WARNING) << "Could not create service registration table";
+    }
+
 // TODO(b/151696835): reenable performance hack when we solve bug, since with
 //     this hack and other fixes, it is unlikely we will see even an ephemeral
 //     failure when the manifest parse fails. The goal is that the manifest will
@@ -165,6 +195,11 @@ ServiceManager::ServiceManager(std::unique_ptr<Access>&& access) : mAccess(std::
 //     }).detach();
 // #endif  // !VENDORSERVICEMANAGER
 }
+
+void ServiceManager::onFirstRef() {
+    setExtension(sp<RegistrationTableService>::make(wp<ServiceManager>::fromExisting(this)));
+}
+
 ServiceManager::~ServiceManager() {
     // this should only happen in tests
 
@@ -278,6 +313,10 @@ Status ServiceManager::addService(const std::string& name, const sp<IBinder>& bi
         return Status::fromExceptionCode(Status::EX_ILLEGAL_STATE);
     }
 
+    if (mRegistrationTable != nullptr && mNameToService.count(name) == 0) {
+        mRegistrationTable->add(name);
+    }
+
     // Overwrite the old service if it exists
     mNameToService[name] = Service {
         .binder = binder,
@@ -461,7 +500,7 @@ void ServiceManager::removeRegistrationCallback(const wp<IBinder>& who,
 void ServiceManager::binderDied(const wp<IBinder>& who) {
     for (auto it = mNameToService.begin(); it != mNameToService.end();) {
         if (who == it->second.binder) {
-            it = mNameToService.erase(it);
+            it = removeService(it);
         } else {
             ++it;
         }
@@ -676,11 +715,18 @@ Status ServiceManager::tryUnregisterService(const std::string& name, const sp<IB
         return Status::fromExceptionCode(Status::EX_ILLEGAL_STATE);
     }
 
-    mNameToService.erase(name);
+    removeService(serviceIt);
 
     return Status::ok();
 }
 
+ServiceManager::ServiceMap::iterator ServiceManager::removeService(ServiceMap::iterator it) {
+    if (mRegistrationTable != nullptr) {
+        mRegistrationTable->remove(it->first);
+    }
+    return mNameToService.erase(it);
+}
+
 Status ServiceManager::getServiceDebugInfo(std::vector<ServiceDebugInfo>* outReturn) {
     if (!mAccess->canList(mAccess->getCallingContext())) {
         return Status::fromExceptionCode(Status::EX_SECURITY);
@@ -698,4 +744,24 @@ Status ServiceManager::getServiceDebugInfo(std::vector<ServiceDebugInfo>* outRet
     return Status::ok();
 }
 
+Status ServiceManager::getServiceRegistrationTable(
+        std::optional<os::ParcelFileDescriptor>* outReturn) {
+    // The table reveals which services are registered, including ones the caller can't find.
+    // Callers also need to be allowed to use servicemanager's fds to map it.
+    if (!mAccess->canReadRegistrationTable(mAccess->getCallingContext())) {
+        return Status::fromExceptionCode(Status::EX_SECURITY);
+    }
+
+    *outReturn = std::nullopt;
+    if (mRegistrationTable == nullptr) return Status::ok();
+
+    base::unique_fd fd(fcntl(mRegistrationTable->fd().get(), F_DUPFD_CLOEXEC, 0));
+    if (!fd.ok()) {
+        PLOG(ERROR) << "Could not dup service registration table";
+        return Status::fromExceptionCode(Status::EX_ILLEGAL_STATE);
+    }
+    *outReturn = os::ParcelFileDescriptor(std::move(fd));
+    return Status::ok();
+}
+
 }  // namespace android
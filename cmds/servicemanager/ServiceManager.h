@@ -19,6 +19,7 @@
 #include <android/os/BnServiceManager.h>
 #include <android/os/IClientCallback.h>
 #include <android/os/IServiceCallback.h>
+#include <binder/ServiceRegistrationTable.h>
 
 #include "Access.h"
 
@@ -52,11 +53,15 @@ public:
                                           const sp<IClientCallback>& cb) override;
     binder::Status tryUnregisterService(const std::string& name, const sp<IBinder>& binder) override;
     binder::Status getServiceDebugInfo(std::vector<ServiceDebugInfo>* outReturn) override;
+    // implements IServiceRegistrationTable.getTable for the extension set up in onFirstRef
+    binder::Status getServiceRegistrationTable(std::optional<os::ParcelFileDescriptor>* outReturn);
     void binderDied(const wp<IBinder>& who) override;
     void handleClientCallbacks();
 
 protected:
     virtual void tryStartService(const std::string& name);
+    // publishes mRegistrationTable as this binder's extension
+    void onFirstRef() override;
 
 private:
     struct Service {
@@ -88,12 +93,17 @@ private:
     void removeClientCallback(const wp<IBinder>& who, ClientCallbackMap::iterator* it);
 
     sp<IBinder> tryGetService(const std::string& name, bool startIfNotFound);
+    // erases a service from mNameToService, updating mRegistrationTable
+    ServiceMap::iterator removeService(ServiceMap::iterator it);
 
     ServiceMap mNameToService;
     ServiceCallbackMap mNameToRegistrationCallback;
     ClientCallbackMap mNameToClientCallback;
 
     std::unique_ptr<Access> mAccess;
+
+    // shared with clients, so that they can skip lookups of unregistered names. May be null.
+    std::unique_ptr<ServiceRegistrationTable> mRegistrationTable;
 };
 
 }  // namespace android
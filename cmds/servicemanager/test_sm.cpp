@@ -15,9 +15,11 @@
  */
 
 #include <android/os/BnServiceCallback.h>
+#include <android/os/IServiceRegistrationTable.h>
 #include <binder/Binder.h>
 #include <binder/ProcessState.h>
 #include <binder/IServiceManager.h>
+#include <binder/ServiceRegistrationTable.h>
 #include <cutils/android_filesystem_config.h>
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
@@ -30,9 +32,11 @@ using android::Access;
 using android::BBinder;
 using android::IBinder;
 using android::ServiceManager;
+using android::ServiceRegistrationTable;
 using android::binder::Status;
 using android::os::BnServiceCallback;
 using android::os::IServiceManager;
+using android::os::IServiceRegistrationTable;
 using testing::_;
 using testing::ElementsAre;
 using testing::NiceMock;
@@ -55,6 +59,7 @@ public:
     MOCK_METHOD2(canAdd, bool(const CallingContext&, const std::string& name));
     MOCK_METHOD2(canFind, bool(const CallingContext&, const std::string& name));
     MOCK_METHOD1(canList, bool(const CallingContext&));
+    MOCK_METHOD1(canReadRegistrationTable, bool(const CallingContext&));
 };
 
 class MockServiceManager : public ServiceManager {
@@ -70,6 +75,7 @@ static sp<ServiceManager> getPermissiveServiceManager() {
     ON_CALL(*access, canAdd(_, _)).WillByDefault(Return(true));
     ON_CALL(*access, canFind(_, _)).WillByDefault(Return(true));
     ON_CALL(*access, canList(_)).WillByDefault(Return(true));
+    ON_CALL(*access, canReadRegistrationTable(_)).WillByDefault(Return(true));
 
     sp<ServiceManager> sm = sp<NiceMock<MockServiceManager>>::make(std::move(access));
     return sm;
@@ -306,6 +312,84 @@ TEST(ListServices, CriticalServices) {
     EXPECT_THAT(out, ElementsAre("sa"));
 }
 
+// the table is served by servicemanager's extension, not by IServiceManager
+static sp<IServiceRegistrationTable> getRegistrationTableService(const sp<ServiceManager>& sm) {
+    return android::interface_cast<IServiceRegistrationTable>(sm->getExtension());
+}
+
+static std::unique_ptr<ServiceRegistrationTable> getRegistrationTable(const sp<ServiceManager>& sm) {
+    sp<IServiceRegistrationTable> service = getRegistrationTableService(sm);
+    if (service == nullptr) return nullptr;
+    std::optional<android::os::ParcelFileDescriptor> pfd;
+    if (!service->getTable(&pfd).isOk() || !pfd.has_value()) return nullptr;
+    return ServiceRegistrationTable::fromFd(pfd->release());
+}
+
+TEST(RegistrationTable, NoPermissions) {
+    std::unique_ptr<MockAccess> access = std::make_unique<NiceMock<MockAccess>>();
+
+    // being allowed to list services is not enough
+    EXPECT_CALL(*access, getCallingContext()).WillOnce(Return(Access::CallingContext{}));
+    ON_CALL(*access, canList(_)).WillByDefault(Return(true));
+    EXPECT_CALL(*access, canReadRegistrationTable(_)).WillOnce(Return(false));
+
+    sp<ServiceManager> sm = sp<NiceMock<MockServiceManager>>::make(std::move(access));
+    sp<IServiceRegistrationTable> service = getRegistrationTableService(sm);
+    ASSERT_NE(service, nullptr);
+
+    std::optional<android::os::ParcelFileDescriptor> pfd;
+    EXPECT_FALSE(service->getTable(&pfd).isOk());
+    EXPECT_FALSE(pfd.has_value());
+}
+
+TEST(RegistrationTable, TracksRegistrations) {
+    auto sm = getPermissiveServiceManager();
+
+    auto table = getRegistrationTable(sm);
+    ASSERT_NE(table, nullptr);
+
+    auto registration = table->lookup("foo");
+    ASSERT_TRUE(registration.has_value());
+    EXPECT_FALSE(registration->maybeRegistered);
+
+    sp<IBinder> service = getBinder();
+    EXPECT_TRUE(sm->addService("foo", service, false /*allowIsolated*/,
+        IServiceManager::DUMP_FLAG_PRIORITY_DEFAULT).isOk());
+    registration = table->lookup("foo");
+    ASSERT_TRUE(registration.has_value());
+    EXPECT_TRUE(registration->maybeRegistered);
+    const uint32_t generation = registration->generation;
+
+    // overwriting a service doesn't change whether the name is registered
+    EXPECT_TRUE(sm->addService("foo", getBinder(), false /*allowIsolated*/,
+        IServiceManager::DUMP_FLAG_PRIORITY_DEFAULT).isOk());
+    registration = table->lookup("foo");
+    ASSERT_TRUE(registration.has_value());
+    EXPECT_TRUE(registration->maybeRegistered);
+    EXPECT_EQ(generation, registration->generation);
+
+    registration = table->lookup("bar");
+    ASSERT_TRUE(registration.has_value());
+    EXPECT_FALSE(registration->maybeRegistered);
+}
+
+TEST(RegistrationTable, RemovedOnDeath) {
+    auto sm = getPermissiveServiceManager();
+
+    auto table = getRegistrationTable(sm);
+    ASSERT_NE(table, nullptr);
+
+    sp<IBinder> service = getBinder();
+    EXPECT_TRUE(sm->addService("foo", service, false /*allowIsolated*/,
+        IServiceManager::DUMP_FLAG_PRIORITY_DEFAULT).isOk());
+    sm->binderDied(service);
+
+    auto registration = table->lookup("foo");
+    ASSERT_TRUE(registration.has_value());
+    EXPECT_FALSE(registration->maybeRegistered);
+    EXPECT_EQ(2u, registration->generation);
+}
+
 class CallbackHistorian : public BnServiceCallback {
     Status onRegistration(const std::string& name, const sp<IBinder>& binder) override {
         registrations.push_back(name);
@@ -19,6 +19,11 @@
 
 #include <android/native_window.h>
 #include <gui/Surface.h>
+#include <ui/GraphicBuffer.h>
+
+#include <string.h>
+
+#include <thread>
 
 using namespace android;
 
@@ -32,36 +37,81 @@ void BufferQueueScheduler::startScheduling() {
     if (mSurfaceControl == nullptr) {
         mCondition.wait(lock, [&] { return (mSurfaceControl != nullptr); });
     }
+    sp<Surface> surface = mSurfaceControl->getSurface();
+    lock.unlock();
+
+    // Fill buffers from the CPU like Surface::lock does, but allow several to be dequeued at once
+    native_window_api_connect(surface.get(), NATIVE_WINDOW_API_CPU);
+    native_window_set_usage(surface.get(),
+            GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_SW_WRITE_OFTEN);
+    surface->setMaxDequeuedBufferCount(PREFETCH_BUFFERS);
+
+    std::thread poster(&BufferQueueScheduler::postBuffers, this, surface);
+
+    lock.lock();
+    while (true) {
+        mCondition.wait(lock, [&] {
+            return !mContinueScheduling ||
+                    (!mBufferEvents.empty() && mPreparedBuffers.size() < PREFETCH_BUFFERS);
+        });
+        if (!mContinueScheduling) {
+            break;
+        }
 
-    while (mContinueScheduling) {
-        while (true) {
-            if (mBufferEvents.empty()) {
-                break;
-            }
+        BufferEvent event = mBufferEvents.front();
+        mBufferEvents.pop();
+        lock.unlock();
 
-            BufferEvent event = mBufferEvents.front();
-            lock.unlock();
+        PreparedBuffer prepared;
+        prepared.event = event.event;
+        prepareBuffer(surface, event.dimensions, &prepared);
+        mColor.modulate();
 
-            bufferUpdate(event.dimensions);
-            fillSurface(event.event);
-            mColor.modulate();
-            lock.lock();
-            mBufferEvents.pop();
+        lock.lock();
+        mPreparedBuffers.push(prepared);
+        mCondition.notify_all();
+    }
+    lock.unlock();
+
+    poster.join();
+    native_window_api_disconnect(surface.get(), NATIVE_WINDOW_API_CPU);
+}
+
+void BufferQueueScheduler::postBuffers(const sp<Surface>& surface) {
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (true) {
+        mCondition.wait(lock, [&] { return !mContinueScheduling || !mPreparedBuffers.empty(); });
+        if (mPreparedBuffers.empty()) {
+            break;
         }
-        mCondition.wait(lock);
+
+        PreparedBuffer prepared = mPreparedBuffers.front();
+        lock.unlock();
+
+        prepared.event->readyToExecute();
+
+        if (prepared.buffer != nullptr) {
+            ANativeWindow* window = surface.get();
+            status_t status = window->queueBuffer(window, prepared.buffer, prepared.fenceFd);
+            ALOGE_IF(status != NO_ERROR, "postBuffers: failed to post buffer, (%d)", status);
+        }
+
+        lock.lock();
+        mPreparedBuffers.pop();
+        mCondition.notify_all();
     }
 }
 
 void BufferQueueScheduler::addEvent(const BufferEvent& event) {
     std::lock_guard<std::mutex> lock(mMutex);
     mBufferEvents.push(event);
-    mCondition.notify_one();
+    mCondition.notify_all();
 }
 
 void BufferQueueScheduler::stopScheduling() {
     std::lock_guard<std::mutex> lock(mMutex);
     mContinueScheduling = false;
-    mCondition.notify_one();
+    mCondition.notify_all();
 }
 
 void BufferQueueScheduler::setSurfaceControl(
@@ -69,41 +119,52 @@ void BufferQueueScheduler::setSurfaceControl(
     std::lock_guard<std::mutex> lock(mMutex);
     mSurfaceControl = surfaceControl;
     mColor = color;
-    mCondition.notify_one();
+    mCondition.notify_all();
 }
 
-void BufferQueueScheduler::bufferUpdate(const Dimensions& dimensions) {
-    sp<Surface> s = mSurfaceControl->getSurface();
-    s->setBuffersDimensions(dimensions.width, dimensions.height);
-}
+bool BufferQueueScheduler::prepareBuffer(const sp<Surface>& surface,
+        const Dimensions& dimensions, PreparedBuffer* prepared) {
+    ANativeWindow* window = surface.get();
+    native_window_set_buffers_dimensions(window, dimensions.width, dimensions.height);
 
-void BufferQueueScheduler::fillSurface(const std::shared_ptr<Event>& event) {
-    ANativeWindow_Buffer outBuffer;
-    sp<Surface> s = mSurfaceControl->getSurface();
-
-    status_t status = s->lock(&outBuffer, nullptr);
+    ANativeWindowBuffer* buffer;
+    int fenceFd;
+    status_t status = window->dequeueBuffer(window, &buffer, &fenceFd);
+    if (status != NO_ERROR) {
+        ALOGE("prepareBuffer: failed to dequeue buffer, (%d)", status);
+        return false;
+    }
 
+    sp<GraphicBuffer> graphicBuffer = GraphicBuffer::from(buffer);
+    void* bits;
+    // lockAsync waits for and closes the fence
+    status = graphicBuffer->lockAsync(GRALLOC_USAGE_SW_WRITE_OFTEN, &bits, fenceFd);
     if (status != NO_ERROR) {
-        ALOGE("fillSurface: failed to lock buffer, (%d)", status);
-        return;
+        ALOGE("prepareBuffer: failed to lock buffer, (%d)", status);
+        window->cancelBuffer(window, buffer, -1);
+        return false;
     }
 
+    // Fill the first row, then copy it to the others
     auto color = mColor.getRGB();
-
-    auto img = reinterpret_cast<uint8_t*>(outBuffer.bits);
-    for (int y = 0; y < outBuffer.height; y++) {
-        for (int x = 0; x < outBuffer.width; x++) {
-            uint8_t* pixel = img + (4 * (y * outBuffer.stride + x));
-            pixel[0] = color.r;
-            pixel[1] = color.g;
-            pixel[2] = color.b;
-            pixel[3] = LAYER_ALPHA;
-        }
+    auto img = reinterpret_cast<uint8_t*>(bits);
+    const int width = graphicBuffer->getWidth();
+    const int height = graphicBuffer->getHeight();
+    const size_t rowSize = 4 * graphicBuffer->getStride();
+    for (int x = 0; x < width; x++) {
+        uint8_t* pixel = img + 4 * x;
+        pixel[0] = color.r;
+        pixel[1] = color.g;
+        pixel[2] = color.b;
+        pixel[3] = LAYER_ALPHA;
+    }
+    for (int y = 1; y < height; y++) {
+        memcpy(img + y * rowSize, img, 4 * width);
     }
 
-    event->readyToExecute();
-
-    status = s->unlockAndPost();
+    status = graphicBuffer->unlockAsync(&prepared->fenceFd);
+    ALOGE_IF(status != NO_ERROR, "prepareBuffer: failed to unlock buffer, (%d)", status);
 
-    ALOGE_IF(status != NO_ERROR, "fillSurface: failed to unlock and post buffer, (%d)", status);
+    prepared->buffer = buffer;
+    return true;
 }
@@ -20,6 +20,7 @@
 #include "Color.h"
 #include "Event.h"
 
+#include <gui/Surface.h>
 #include <gui/SurfaceControl.h>
 
 #include <utils/StrongPointer.h>
@@ -33,6 +34,8 @@
 namespace android {
 
 auto constexpr LAYER_ALPHA = 190;
+// Number of buffers per layer that may be filled ahead of their events
+auto constexpr PREFETCH_BUFFERS = 2;
 
 struct Dimensions {
     Dimensions() = default;
@@ -61,11 +64,20 @@ class BufferQueueScheduler {
     void setSurfaceControl(const sp<SurfaceControl>& surfaceControl, const HSV& color);
 
   private:
-    void bufferUpdate(const Dimensions& dimensions);
+    struct PreparedBuffer {
+        std::shared_ptr<Event> event;
+        // nullptr if the buffer couldn't be prepared
+        ANativeWindowBuffer* buffer = nullptr;
+        int fenceFd = -1;
+    };
 
-    // Lock and fill the surface, block until the event is signaled by the main loop,
-    // then unlock and post the buffer.
-    void fillSurface(const std::shared_ptr<Event>& event);
+    // Dequeue a buffer of the given dimensions and fill it.
+    bool prepareBuffer(const sp<Surface>& surface, const Dimensions& dimensions,
+            PreparedBuffer* prepared);
+
+    // Block until the event of each prepared buffer is signaled by the main loop, then post it.
+    // Runs on its own thread so that the following buffers can be prepared in the meantime.
+    void postBuffers(const sp<Surface>& surface);
 
     sp<SurfaceControl> mSurfaceControl;
     HSV mColor;
@@ -74,6 +86,8 @@ class BufferQueueScheduler {
     bool mContinueScheduling;
 
     std::queue<BufferEvent> mBufferEvents;
+    // At most PREFETCH_BUFFERS
+    std::queue<PreparedBuffer> mPreparedBuffers;
     std::mutex mMutex;
     std::condition_variable mCondition;
 };
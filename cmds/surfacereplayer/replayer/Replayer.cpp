@@ -33,6 +33,7 @@
 #include <utils/String8.h>
 #include <utils/Trace.h>
 
+#include <algorithm>
 #include <chrono>
 #include <cmath>
 #include <condition_variable>
@@ -52,29 +53,18 @@ std::atomic_bool Replayer::sReplayingManually(false);
 
 Replayer::Replayer(const std::string& filename, bool replayManually, int numThreads, bool wait,
         nsecs_t stopHere)
-      : mTrace(),
-        mLoaded(false),
-        mIncrementIndex(0),
+      : mTraceReader(TraceReader::open(filename)),
         mCurrentTime(0),
         mNumThreads(numThreads),
         mWaitForTimeStamps(wait),
         mStopTimeStamp(stopHere) {
     srand(RAND_COLOR_SEED);
 
-    std::string input;
-    if (!android::base::ReadFileToString(filename, &input, true)) {
+    if (mTraceReader == nullptr) {
         std::cerr << "Trace did not load. Does " << filename << " exist?" << std::endl;
         abort();
     }
 
-    mLoaded = mTrace.ParseFromString(input);
-    if (!mLoaded) {
-        std::cerr << "Trace did not load." << std::endl;
-        abort();
-    }
-
-    mCurrentTime = mTrace.increment(0).time_stamp();
-
     sReplayingManually.store(replayManually);
 
     if (stopHere < 0) {
@@ -83,15 +73,12 @@ Replayer::Replayer(const std::string& filename, bool replayManually, int numThre
 }
 
 Replayer::Replayer(const Trace& t, bool replayManually, int numThreads, bool wait, nsecs_t stopHere)
-      : mTrace(t),
-        mLoaded(true),
-        mIncrementIndex(0),
+      : mTraceReader(std::make_unique<TraceReader>(t)),
         mCurrentTime(0),
         mNumThreads(numThreads),
         mWaitForTimeStamps(wait),
         mStopTimeStamp(stopHere) {
     srand(RAND_COLOR_SEED);
-    mCurrentTime = mTrace.increment(0).time_stamp();
 
     sReplayingManually.store(replayManually);
 
@@ -103,8 +90,6 @@ Replayer::Replayer(const Trace& t, bool replayManually, int numThreads, bool wai
 status_t Replayer::replay() {
     signal(SIGINT, Replayer::stopAutoReplayHandler); //for manual control
 
-    ALOGV("There are %d increments.", mTrace.increment_size());
-
     status_t status = loadSurfaceComposerClient();
 
     if (status != NO_ERROR) {
@@ -116,9 +101,13 @@ status_t Replayer::replay() {
 
     initReplay();
 
+    mReplayAnchored = false;
+    mTimingErrors.clear();
+
     ALOGV("Starting actual Replay!");
     while (!mPendingIncrements.empty()) {
-        mCurrentIncrement = mTrace.increment(mIncrementIndex);
+        mCurrentIncrement = std::move(mDispatchedIncrements.front());
+        mDispatchedIncrements.pop_front();
 
         if (mHasStopped == false && mCurrentIncrement.time_stamp() >= mStopTimeStamp) {
             mHasStopped = true;
@@ -127,8 +116,10 @@ status_t Replayer::replay() {
 
         waitForConsoleCommmand();
 
+        const bool timed = mWaitForTimeStamps && !sReplayingManually;
+        std::chrono::steady_clock::time_point target;
         if (mWaitForTimeStamps) {
-            waitUntilTimestamp(mCurrentIncrement.time_stamp());
+            target = waitUntilTimestamp(mCurrentIncrement.time_stamp());
         }
 
         auto event = mPendingIncrements.front();
@@ -136,31 +127,42 @@ status_t Replayer::replay() {
 
         event->complete();
 
+        if (timed) {
+            mTimingErrors.push_back(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            std::chrono::steady_clock::now() - target)
+                            .count());
+        }
+
         if (event->getIncrementType() == Increment::kVsyncEvent) {
             mWaitingForNextVSync = false;
         }
 
-        if (mIncrementIndex + mNumThreads < mTrace.increment_size()) {
-            status = dispatchEvent(mIncrementIndex + mNumThreads);
+        status = dispatchNextEvent();
 
-            if (status != NO_ERROR) {
-                SurfaceComposerClient::enableVSyncInjections(false);
-                return status;
-            }
+        if (status != NO_ERROR) {
+            SurfaceComposerClient::enableVSyncInjections(false);
+            return status;
         }
 
-        mIncrementIndex++;
         mCurrentTime = mCurrentIncrement.time_stamp();
     }
 
     SurfaceComposerClient::enableVSyncInjections(false);
 
+    reportTimingErrors();
+
+    if (mTraceReader->hasError()) {
+        ALOGE("Trace is truncated or corrupt, stopped replaying early");
+        return BAD_VALUE;
+    }
+
     return status;
 }
 
 status_t Replayer::initReplay() {
-    for (int i = 0; i < mNumThreads && i < mTrace.increment_size(); i++) {
-        status_t status = dispatchEvent(i);
+    for (int i = 0; i < mNumThreads; i++) {
+        status_t status = dispatchNextEvent();
 
         if (status != NO_ERROR) {
             ALOGE("Unable to dispatch event (%d)", status);
@@ -168,6 +170,10 @@ status_t Replayer::initReplay() {
         }
     }
 
+    if (!mDispatchedIncrements.empty()) {
+        mCurrentTime = mDispatchedIncrements.front().time_stamp();
+    }
+
     return NO_ERROR;
 }
 
@@ -200,6 +206,9 @@ void Replayer::waitForConsoleCommmand() {
         return;
     }
 
+    // Timestamps are measured from the point where replay resumes
+    mReplayAnchored = false;
+
     while (true) {
         std::string input = "";
         std::cout << "> ";
@@ -272,8 +281,12 @@ void Replayer::waitForConsoleCommmand() {
     }
 }
 
-status_t Replayer::dispatchEvent(int index) {
-    auto increment = mTrace.increment(index);
+status_t Replayer::dispatchNextEvent() {
+    Increment increment;
+    if (!mTraceReader->next(&increment)) {
+        return NO_ERROR;
+    }
+
     std::shared_ptr<Event> event = std::make_shared<Event>(increment.increment_case());
     mPendingIncrements.push(event);
 
@@ -328,6 +341,7 @@ status_t Replayer::dispatchEvent(int index) {
             break;
     }
 
+    mDispatchedIncrements.push_back(std::move(increment));
     return status;
 }
 
@@ -687,9 +701,44 @@ void Replayer::updatePowerMode(const PowerModeUpdate& pmu, const std::shared_ptr
     SurfaceComposerClient::setDisplayPowerMode(mDisplays[pmu.id()], pmu.mode());
 }
 
-void Replayer::waitUntilTimestamp(int64_t timestamp) {
-    ALOGV("Waiting for %lld nanoseconds...", static_cast<int64_t>(timestamp - mCurrentTime));
-    std::this_thread::sleep_for(std::chrono::nanoseconds(timestamp - mCurrentTime));
+std::chrono::steady_clock::time_point Replayer::waitUntilTimestamp(int64_t timestamp) {
+    if (!mReplayAnchored) {
+        mReplayAnchorTime = std::chrono::steady_clock::now();
+        mTraceAnchorTime = mCurrentTime;
+        mReplayAnchored = true;
+    }
+    auto target = mReplayAnchorTime + std::chrono::nanoseconds(timestamp - mTraceAnchorTime);
+    ALOGV("Waiting until %lld nanoseconds into the replay...",
+            static_cast<long long>(timestamp - mTraceAnchorTime));
+    std::this_thread::sleep_until(target);
+    return target;
+}
+
+void Replayer::reportTimingErrors() {
+    if (mTimingErrors.empty()) {
+        return;
+    }
+
+    std::vector<int64_t> errors = mTimingErrors;
+    std::sort(errors.begin(), errors.end());
+    auto percentile = [&](int p) { return errors[(errors.size() - 1) * p / 100] / 1000; };
+
+    int64_t total = 0;
+    size_t missedFrames = 0;
+    for (int64_t error : errors) {
+        total += error;
+        if (error > FRAME_DURATION_NS) {
+            missedFrames++;
+        }
+    }
+
+    std::stringstream report;
+    report << "Replayed " << errors.size() << " increments, lateness (us): mean "
+           << total / static_cast<int64_t>(errors.size()) / 1000 << ", p50 " << percentile(50)
+           << ", p90 " << percentile(90) << ", p99 " << percentile(99) << ", max "
+           << errors.back() / 1000 << "; " << missedFrames << " more than a frame late";
+    ALOGI("%s", report.str().c_str());
+    std::cout << report.str() << std::endl;
 }
 
 void Replayer::waitUntilDeferredTransactionLayerExists(
@@ -20,6 +20,7 @@
 #include "BufferQueueScheduler.h"
 #include "Color.h"
 #include "Event.h"
+#include "TraceReader.h"
 
 #include <frameworks/native/cmds/surfacereplayer/proto/src/trace.pb.h>
 
@@ -30,13 +31,16 @@
 #include <utils/StrongPointer.h>
 
 #include <stdatomic.h>
+#include <chrono>
 #include <condition_variable>
+#include <deque>
 #include <memory>
 #include <mutex>
 #include <queue>
 #include <thread>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 using namespace android::surfaceflinger;
 
@@ -45,6 +49,8 @@ namespace android {
 const auto DEFAULT_PATH = "/data/local/tmp/SurfaceTrace.dat";
 const auto RAND_COLOR_SEED = 700;
 const auto DEFAULT_THREADS = 3;
+// Increments executed later than this after their timestamp are counted as missed frames
+const auto FRAME_DURATION_NS = 16666667;
 
 typedef int32_t layer_id;
 typedef int32_t display_id;
@@ -67,7 +73,8 @@ class Replayer {
     void waitForConsoleCommmand();
     static void stopAutoReplayHandler(int signal);
 
-    status_t dispatchEvent(int index);
+    // Reads the next increment of the trace and starts setting it up, if there is one.
+    status_t dispatchNextEvent();
 
     status_t doTransaction(const Transaction& transaction, const std::shared_ptr<Event>& event);
     status_t createSurfaceControl(const SurfaceCreation& create,
@@ -132,15 +139,24 @@ class Replayer {
     void setDisplayProjection(SurfaceComposerClient::Transaction& t,
             display_id id, const ProjectionChange& pc);
 
-    void waitUntilTimestamp(int64_t timestamp);
+    // Sleeps until the given trace timestamp, measured from the point where timed replay started
+    // (or resumed after a manual pause) so that oversleeping doesn't accumulate. Returns the
+    // target time.
+    std::chrono::steady_clock::time_point waitUntilTimestamp(int64_t timestamp);
+    void reportTimingErrors();
     void waitUntilDeferredTransactionLayerExists(
             const DeferredTransactionChange& dtc, std::unique_lock<std::mutex>& lock);
     status_t loadSurfaceComposerClient();
 
-    Trace mTrace;
-    bool mLoaded = false;
-    int32_t mIncrementIndex = 0;
+    std::unique_ptr<TraceReader> mTraceReader;
     int64_t mCurrentTime = 0;
+
+    // Trace timestamp that corresponds to mReplayAnchorTime, valid while mReplayAnchored
+    int64_t mTraceAnchorTime = 0;
+    std::chrono::steady_clock::time_point mReplayAnchorTime;
+    bool mReplayAnchored = false;
+    // How late each increment was executed compared to the trace, in nanoseconds
+    std::vector<int64_t> mTimingErrors;
     int32_t mNumThreads = DEFAULT_THREADS;
 
     Increment mCurrentIncrement;
@@ -170,6 +186,8 @@ class Replayer {
 
     sp<SurfaceComposerClient> mComposerClient;
     std::queue<std::shared_ptr<Event>> mPendingIncrements;
+    // The increments of the events in mPendingIncrements
+    std::deque<Increment> mDispatchedIncrements;
 };
 
 }  // namespace android
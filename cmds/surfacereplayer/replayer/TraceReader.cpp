@@ -0,0 +1,98 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "TraceReader.h"
+
+#include <google/protobuf/io/coded_stream.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace android;
+using Increment = surfaceflinger::Increment;
+using Trace = surfaceflinger::Trace;
+
+// Field 1 (increment) of Trace, length-delimited.
+static constexpr uint32_t INCREMENT_TAG = (1 << 3) | 2;
+static constexpr int READ_BLOCK_SIZE = 64 * 1024;
+
+class TraceReader::FdInputStream : public google::protobuf::io::CopyingInputStream {
+  public:
+    explicit FdInputStream(base::unique_fd fd) : mFd(std::move(fd)) {}
+
+    int Read(void* buffer, int size) override {
+        return TEMP_FAILURE_RETRY(read(mFd.get(), buffer, size));
+    }
+
+  private:
+    base::unique_fd mFd;
+};
+
+TraceReader::TraceReader(const Trace& trace) : mTrace(trace) {}
+
+TraceReader::TraceReader(base::unique_fd fd)
+      : mFdStream(std::make_unique<FdInputStream>(std::move(fd))),
+        mStream(std::make_unique<google::protobuf::io::CopyingInputStreamAdaptor>(
+                mFdStream.get(), READ_BLOCK_SIZE)) {}
+
+TraceReader::~TraceReader() = default;
+
+std::unique_ptr<TraceReader> TraceReader::open(const std::string& filename) {
+    base::unique_fd fd(::open(filename.c_str(), O_RDONLY | O_CLOEXEC));
+    if (!fd.ok()) {
+        return nullptr;
+    }
+    return std::unique_ptr<TraceReader>(new TraceReader(std::move(fd)));
+}
+
+bool TraceReader::next(Increment* increment) {
+    if (mTrace.has_value()) {
+        if (mIndex >= mTrace->increment_size()) {
+            return false;
+        }
+        *increment = mTrace->increment(mIndex++);
+        return true;
+    }
+
+    if (mError) {
+        return false;
+    }
+
+    // A CodedInputStream per increment keeps its byte limit from ever being reached. It returns
+    // whatever it buffered past the increment to mStream when it goes away.
+    google::protobuf::io::CodedInputStream input(mStream.get());
+    const uint32_t tag = input.ReadTag();
+    if (tag == 0) {
+        // End of the trace, unless it stopped in the middle of the tag.
+        mError = !input.ConsumedEntireMessage();
+        return false;
+    }
+
+    uint32_t length;
+    if (tag != INCREMENT_TAG || !input.ReadVarint32(&length)) {
+        mError = true;
+        return false;
+    }
+
+    const auto limit = input.PushLimit(length);
+    increment->Clear();
+    if (!increment->MergeFromCodedStream(&input) || !input.ConsumedEntireMessage()) {
+        mError = true;
+        return false;
+    }
+    input.PopLimit(limit);
+    return true;
+}
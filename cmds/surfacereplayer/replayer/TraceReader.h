@@ -0,0 +1,64 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SURFACEREPLAYER_TRACEREADER_H
+#define ANDROID_SURFACEREPLAYER_TRACEREADER_H
+
+#include <frameworks/native/cmds/surfacereplayer/proto/src/trace.pb.h>
+
+#include <android-base/unique_fd.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+
+#include <memory>
+#include <optional>
+#include <string>
+
+namespace android {
+
+/*
+ * Reads the increments of a trace one at a time, so that replaying a trace doesn't need all of it
+ * in memory. SurfaceInterceptor streams a trace out as a series of serialized Traces, which
+ * concatenate into a single Trace, so a file is read as the repeated increment field of a Trace.
+ */
+class TraceReader {
+  public:
+    // Reads the increments of a trace already in memory.
+    explicit TraceReader(const surfaceflinger::Trace& trace);
+    ~TraceReader();
+
+    // Returns nullptr if the file can't be opened.
+    static std::unique_ptr<TraceReader> open(const std::string& filename);
+
+    // Reads the next increment. Returns false at the end of the trace, or if the rest of the
+    // trace can't be parsed, in which case hasError() returns true.
+    bool next(surfaceflinger::Increment* increment);
+    bool hasError() const { return mError; }
+
+  private:
+    class FdInputStream;
+
+    explicit TraceReader(base::unique_fd fd);
+
+    std::optional<surfaceflinger::Trace> mTrace;
+    int mIndex = 0;
+
+    std::unique_ptr<FdInputStream> mFdStream;
+    std::unique_ptr<google::protobuf::io::CopyingInputStreamAdaptor> mStream;
+    bool mError = false;
+};
+
+}  // namespace android
+#endif
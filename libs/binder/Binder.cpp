@@ -34,6 +34,7 @@
 #include <linux/sched.h>
 #include <stdio.h>
 
+#include "InterfaceToken.h"
 #include "RpcState.h"
 
 namespace android {
@@ -586,6 +587,9 @@ status_t BBinder::onTransact(
     switch (code) {
         case INTERFACE_TRANSACTION:
             reply->writeString16(getInterfaceDescriptor());
+            // Advertise that Parcel::enforceInterface accepts compact interface
+            // tokens. Clients which don't know about them ignore this.
+            reply->writeInt32(kCompactInterfaceTokenHeader);
             return NO_ERROR;
 
         case DUMP_TRANSACTION: {
@@ -28,6 +28,8 @@
 
 #include <stdio.h>
 
+#include "InterfaceToken.h"
+
 //#undef ALOGV
 //#define ALOGV(...) fprintf(stderr, __VA_ARGS__)
 
@@ -36,16 +38,18 @@ namespace android {
 // ---------------------------------------------------------------------------
 
 Mutex BpBinder::sTrackingLock;
-std::unordered_map<int32_t,uint32_t> BpBinder::sTrackingMap;
+std::shared_mutex BpBinder::sTrackingMapLock;
+std::unordered_map<int32_t,std::atomic<uint32_t>> BpBinder::sTrackingMap;
 int BpBinder::sNumTrackedUids = 0;
 std::atomic_bool BpBinder::sCountByUidEnabled(false);
+std::atomic_bool BpBinder::sCompactInterfaceTokensEnabled(false);
 binder_proxy_limit_callback BpBinder::sLimitCallback;
 bool BpBinder::sBinderProxyThrottleCreate = false;
 
 // Arbitrarily high value that probably distinguishes a bad behaving app
-uint32_t BpBinder::sBinderProxyCountHighWatermark = 2500;
+std::atomic<uint32_t> BpBinder::sBinderProxyCountHighWatermark = 2500;
 // Another arbitrary value a binder count needs to drop below before another callback will be called
-uint32_t BpBinder::sBinderProxyCountLowWatermark = 2000;
+std::atomic<uint32_t> BpBinder::sBinderProxyCountLowWatermark = 2000;
 
 enum {
     LIMIT_REACHED_MASK = 0x80000000,        // A flag denoting that the limit has been reached
@@ -61,80 +65,155 @@ BpBinder::ObjectManager::~ObjectManager()
     kill();
 }
 
+BpBinder::ObjectManager::entry_t* BpBinder::ObjectManager::findEntry(const void* objectID) {
+    for (size_t i = 0; i < mInlineCount; i++) {
+        if (mInlineObjects[i].id == objectID) return &mInlineObjects[i];
+    }
+    for (entry_t& e : mOverflowObjects) {
+        if (e.id == objectID) return &e;
+    }
+    return nullptr;
+}
+
 void* BpBinder::ObjectManager::attach(const void* objectID, void* object, void* cleanupCookie,
                                       IBinder::object_cleanup_func func) {
-    entry_t e;
-    e.object = object;
-    e.cleanupCookie = cleanupCookie;
-    e.func = func;
-
-    if (ssize_t idx = mObjects.indexOfKey(objectID); idx >= 0) {
+    if (entry_t* e = findEntry(objectID); e != nullptr) {
         ALOGI("Trying to attach object ID %p to binder ObjectManager %p with object %p, but object "
               "ID already in use",
               objectID, this, object);
-        return mObjects[idx].object;
+        return e->object;
     }
 
-    mObjects.add(objectID, e);
+    const entry_t e = {objectID, object, cleanupCookie, func};
+    if (mInlineCount < kInlineObjects) {
+        mInlineObjects[mInlineCount++] = e;
+    } else {
+        mOverflowObjects.push_back(e);
+    }
     return nullptr;
 }
 
 void* BpBinder::ObjectManager::find(const void* objectID) const
 {
-    const ssize_t i = mObjects.indexOfKey(objectID);
-    if (i < 0) return nullptr;
-    return mObjects.valueAt(i).object;
+    const entry_t* e = const_cast<ObjectManager*>(this)->findEntry(objectID);
+    return e != nullptr ? e->object : nullptr;
 }
 
 void* BpBinder::ObjectManager::detach(const void* objectID) {
-    ssize_t idx = mObjects.indexOfKey(objectID);
-    if (idx < 0) return nullptr;
-    void* value = mObjects[idx].object;
-    mObjects.removeItemsAt(idx, 1);
+    entry_t* e = findEntry(objectID);
+    if (e == nullptr) return nullptr;
+    void* value = e->object;
+
+    // Fill the hole with the last entry, keeping the inline slots in use first.
+    entry_t* last = mOverflowObjects.empty() ? &mInlineObjects[mInlineCount - 1]
+                                             : &mOverflowObjects.back();
+    *e = *last;
+    if (mOverflowObjects.empty()) {
+        mInlineCount--;
+    } else {
+        mOverflowObjects.pop_back();
+    }
     return value;
 }
 
 void BpBinder::ObjectManager::kill()
 {
-    const size_t N = mObjects.size();
+    const size_t N = mInlineCount + mOverflowObjects.size();
     ALOGV("Killing %zu objects in manager %p", N, this);
-    for (size_t i=0; i<N; i++) {
-        const entry_t& e = mObjects.valueAt(i);
-        if (e.func != nullptr) {
-            e.func(mObjects.keyAt(i), e.object, e.cleanupCookie);
-        }
+    for (size_t i = 0; i < mInlineCount; i++) {
+        const entry_t& e = mInlineObjects[i];
+        if (e.func != nullptr) e.func(e.id, e.object, e.cleanupCookie);
+    }
+    for (const entry_t& e : mOverflowObjects) {
+        if (e.func != nullptr) e.func(e.id, e.object, e.cleanupCookie);
     }
 
-    mObjects.clear();
+    mInlineCount = 0;
+    mOverflowObjects.clear();
 }
 
 // ---------------------------------------------------------------------------
 
+bool BpBinder::trackProxyCreate(int32_t uid) {
+    uint32_t trackedValue = 0;
+    bool limitReached = false;
+    bool throttled = false;
+    while (true) {
+        {
+            std::shared_lock<std::shared_mutex> _l(sTrackingMapLock);
+            auto it = sTrackingMap.find(uid);
+            if (it != sTrackingMap.end()) {
+                std::atomic<uint32_t>& counter = it->second;
+                trackedValue = counter.load(std::memory_order_relaxed);
+                if (CC_UNLIKELY(trackedValue & LIMIT_REACHED_MASK)) {
+                    throttled = sBinderProxyThrottleCreate;
+                } else if ((trackedValue & COUNTING_VALUE_MASK) >=
+                           sBinderProxyCountHighWatermark.load(std::memory_order_relaxed)) {
+                    // Only the thread that sets the flag reports the limit.
+                    limitReached = !(counter.fetch_or(LIMIT_REACHED_MASK) & LIMIT_REACHED_MASK);
+                    throttled = sBinderProxyThrottleCreate;
+                }
+                if (!throttled) counter.fetch_add(1, std::memory_order_relaxed);
+                break;
+            }
+        }
+        std::unique_lock<std::shared_mutex> _l(sTrackingMapLock);
+        sTrackingMap.try_emplace(uid, 0);
+    }
+
+    if (CC_UNLIKELY(limitReached)) {
+        ALOGE("Too many binder proxy objects sent to uid %d from uid %d (%d proxies held)",
+              getuid(), uid, trackedValue);
+        binder_proxy_limit_callback limitCallback;
+        {
+            AutoMutex _l(sTrackingLock);
+            limitCallback = sLimitCallback;
+        }
+        if (limitCallback) limitCallback(uid);
+        if (throttled) {
+            ALOGI("Throttling binder proxy creates from uid %d in uid %d until binder proxy"
+                  " count drops below %d",
+                  uid, getuid(), sBinderProxyCountLowWatermark.load());
+        }
+    }
+    return !throttled;
+}
+
+void BpBinder::trackProxyDestroy(int32_t uid) {
+    bool erase = false;
+    {
+        std::shared_lock<std::shared_mutex> _l(sTrackingMapLock);
+        auto it = sTrackingMap.find(uid);
+        uint32_t trackedValue = it != sTrackingMap.end() ? it->second.load() : 0;
+        if (CC_UNLIKELY((trackedValue & COUNTING_VALUE_MASK) == 0)) {
+            ALOGE("Unexpected Binder Proxy tracking decrement for uid %d\n", uid);
+            return;
+        }
+        std::atomic<uint32_t>& counter = it->second;
+        const uint32_t lowWatermark = sBinderProxyCountLowWatermark.load(std::memory_order_relaxed);
+        if (CC_UNLIKELY((trackedValue & LIMIT_REACHED_MASK) &&
+                        ((trackedValue & COUNTING_VALUE_MASK) <= lowWatermark))) {
+            if (counter.fetch_and(~LIMIT_REACHED_MASK) & LIMIT_REACHED_MASK) {
+                ALOGI("Limit reached bit reset for uid %d (fewer than %d proxies from uid %d held)",
+                      getuid(), lowWatermark, uid);
+            }
+        }
+        erase = counter.fetch_sub(1) == 1;
+    }
+
+    if (erase) {
+        std::unique_lock<std::shared_mutex> _l(sTrackingMapLock);
+        // A proxy may have been created since the count dropped to 0.
+        auto it = sTrackingMap.find(uid);
+        if (it != sTrackingMap.end() && it->second.load() == 0) sTrackingMap.erase(it);
+    }
+}
+
 sp<BpBinder> BpBinder::create(int32_t handle) {
     int32_t trackedUid = -1;
     if (sCountByUidEnabled) {
         trackedUid = IPCThreadState::self()->getCallingUid();
-        AutoMutex _l(sTrackingLock);
-        uint32_t trackedValue = sTrackingMap[trackedUid];
-        if (CC_UNLIKELY(trackedValue & LIMIT_REACHED_MASK)) {
-            if (sBinderProxyThrottleCreate) {
-                return nullptr;
-            }
-        } else {
-            if ((trackedValue & COUNTING_VALUE_MASK) >= sBinderProxyCountHighWatermark) {
-                ALOGE("Too many binder proxy objects sent to uid %d from uid %d (%d proxies held)",
-                      getuid(), trackedUid, trackedValue);
-                sTrackingMap[trackedUid] |= LIMIT_REACHED_MASK;
-                if (sLimitCallback) sLimitCallback(trackedUid);
-                if (sBinderProxyThrottleCreate) {
-                    ALOGI("Throttling binder proxy creates from uid %d in uid %d until binder proxy"
-                          " count drops below %d",
-                          trackedUid, getuid(), sBinderProxyCountLowWatermark);
-                    return nullptr;
-                }
-            }
-        }
-        sTrackingMap[trackedUid]++;
+        if (!trackProxyCreate(trackedUid)) return nullptr;
     }
     return sp<BpBinder>::make(BinderHandle{handle}, trackedUid);
 }
@@ -156,7 +235,9 @@ BpBinder::BpBinder(Handle&& handle)
         mAlive(true),
         mObitsSent(false),
         mObituaries(nullptr),
-        mTrackedUid(-1) {
+        mTrackedUid(-1),
+        mCompactTokenState(COMPACT_TOKEN_UNKNOWN),
+        mDescriptorHash(0) {
     extendObjectLifetime(OBJECT_LIFETIME_WEAK);
 }
 
@@ -213,6 +294,7 @@ const String16& BpBinder::getInterfaceDescriptor() const
         status_t err = thiz->transact(INTERFACE_TRANSACTION, data, &reply);
         if (err == NO_ERROR) {
             String16 res(reply.readString16());
+            if (!isRpcBinder()) readCompactInterfaceTokenSupport(res, reply);
             Mutex::Autolock _l(mLock);
             // mDescriptorCache could have been assigned while the lock was
             // released.
@@ -228,6 +310,37 @@ const String16& BpBinder::getInterfaceDescriptor() const
     return mDescriptorCache;
 }
 
+bool BpBinder::compactInterfaceTokenHash(uint64_t* outHash) const
+{
+    if (!sCompactInterfaceTokensEnabled.load(std::memory_order_relaxed)) return false;
+
+    // Support is only learned from the INTERFACE_TRANSACTION reply fetched by
+    // getInterfaceDescriptor(). Until then the full descriptor is sent, so that
+    // writing a transaction never blocks on a call of its own.
+    if (mCompactTokenState.load(std::memory_order_acquire) != COMPACT_TOKEN_SUPPORTED) {
+        return false;
+    }
+    *outHash = mDescriptorHash;
+    return true;
+}
+
+void BpBinder::readCompactInterfaceTokenSupport(const String16& descriptor,
+                                                const Parcel& reply) const
+{
+    // Only one thread records the result, so that mDescriptorHash is written once.
+    uint8_t state = COMPACT_TOKEN_UNKNOWN;
+    if (!mCompactTokenState.compare_exchange_strong(state, COMPACT_TOKEN_PENDING)) return;
+
+    // Processes which accept compact tokens append their header to the reply.
+    int32_t header;
+    if (reply.readInt32(&header) != NO_ERROR || header != kCompactInterfaceTokenHeader) {
+        mCompactTokenState.store(COMPACT_TOKEN_UNSUPPORTED, std::memory_order_release);
+        return;
+    }
+    mDescriptorHash = interfaceTokenHash(descriptor.string(), descriptor.size());
+    mCompactTokenState.store(COMPACT_TOKEN_SUPPORTED, std::memory_order_release);
+}
+
 bool BpBinder::isBinderAlive() const
 {
     return mAlive != 0;
@@ -454,24 +567,7 @@ BpBinder::~BpBinder()
     IPCThreadState* ipc = IPCThreadState::self();
 
     if (mTrackedUid >= 0) {
-        AutoMutex _l(sTrackingLock);
-        uint32_t trackedValue = sTrackingMap[mTrackedUid];
-        if (CC_UNLIKELY((trackedValue & COUNTING_VALUE_MASK) == 0)) {
-            ALOGE("Unexpected Binder Proxy tracking decrement in %p handle %d\n", this,
-                  binderHandle());
-        } else {
-            if (CC_UNLIKELY(
-                (trackedValue & LIMIT_REACHED_MASK) &&
-                ((trackedValue & COUNTING_VALUE_MASK) <= sBinderProxyCountLowWatermark)
-                )) {
-                ALOGI("Limit reached bit reset for uid %d (fewer than %d proxies from uid %d held)",
-                                   getuid(), mTrackedUid, sBinderProxyCountLowWatermark);
-                sTrackingMap[mTrackedUid] &= ~LIMIT_REACHED_MASK;
-            }
-            if (--sTrackingMap[mTrackedUid] == 0) {
-                sTrackingMap.erase(mTrackedUid);
-            }
-        }
+        trackProxyDestroy(mTrackedUid);
     }
 
     if (ipc) {
@@ -534,7 +630,7 @@ bool BpBinder::onIncStrongAttempted(uint32_t /*flags*/, const void* /*id*/)
 
 uint32_t BpBinder::getBinderProxyCount(uint32_t uid)
 {
-    AutoMutex _l(sTrackingLock);
+    std::shared_lock<std::shared_mutex> _l(sTrackingMapLock);
     auto it = sTrackingMap.find(uid);
     if (it != sTrackingMap.end()) {
         return it->second & COUNTING_VALUE_MASK;
@@ -544,7 +640,7 @@ uint32_t BpBinder::getBinderProxyCount(uint32_t uid)
 
 void BpBinder::getCountByUid(Vector<uint32_t>& uids, Vector<uint32_t>& counts)
 {
-    AutoMutex _l(sTrackingLock);
+    std::shared_lock<std::shared_mutex> _l(sTrackingMapLock);
     uids.setCapacity(sTrackingMap.size());
     counts.setCapacity(sTrackingMap.size());
     for (const auto& it : sTrackingMap) {
@@ -557,13 +653,16 @@ void BpBinder::enableCountByUid() { sCountByUidEnabled.store(true); }
 void BpBinder::disableCountByUid() { sCountByUidEnabled.store(false); }
 void BpBinder::setCountByUidEnabled(bool enable) { sCountByUidEnabled.store(enable); }
 
+void BpBinder::setCompactInterfaceTokensEnabled(bool enable) {
+    sCompactInterfaceTokensEnabled.store(enable);
+}
+
 void BpBinder::setLimitCallback(binder_proxy_limit_callback cb) {
     AutoMutex _l(sTrackingLock);
     sLimitCallback = cb;
 }
 
 void BpBinder::setBinderProxyCountWatermarks(int high, int low) {
-    AutoMutex _l(sTrackingLock);
     sBinderProxyCountHighWatermark = high;
     sBinderProxyCountLowWatermark = low;
 }
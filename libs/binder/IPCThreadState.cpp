@@ -728,6 +728,20 @@ status_t IPCThreadState::transact(int32_t handle,
 
     LOG_ONEWAY(">>>> SEND from pid %d uid %d %s", getpid(), getuid(),
         (flags & TF_ONE_WAY) == 0 ? "READ REPLY" : "ONE WAY");
+
+    if (mOnewayBatchDepth > 0) {
+        if (flags & TF_ONE_WAY) {
+            return queueOnewayTransaction(handle, code, data, flags);
+        }
+        // Keep the queued calls ahead of this one, and don't let their
+        // BR_TRANSACTION_COMPLETEs be mistaken for this call's. Their errors
+        // don't belong to this call, so endOnewayBatch() reports them.
+        status_t flushErr = flushOnewayBatch();
+        if (flushErr != NO_ERROR && mOnewayBatchError == NO_ERROR) {
+            mOnewayBatchError = flushErr;
+        }
+    }
+
     err = writeTransactionData(BC_TRANSACTION, flags, handle, code, data, nullptr);
 
     if (err != NO_ERROR) {
@@ -781,6 +795,58 @@ status_t IPCThreadState::transact(int32_t handle,
     return err;
 }
 
+void IPCThreadState::beginOnewayBatch()
+{
+    mOnewayBatchDepth++;
+}
+
+status_t IPCThreadState::flushOnewayBatch()
+{
+    status_t result = NO_ERROR;
+    // The driver acknowledges each BC_TRANSACTION with its own
+    // BR_TRANSACTION_COMPLETE (or a failure), so wait once per queued call.
+    for (size_t i = 0; i < mOnewayBatch.size(); i++) {
+        status_t err = waitForResponse(nullptr, nullptr);
+        if (err != NO_ERROR && result == NO_ERROR) result = err;
+    }
+    mOnewayBatch.clear();
+    return result;
+}
+
+status_t IPCThreadState::endOnewayBatch()
+{
+    LOG_ALWAYS_FATAL_IF(mOnewayBatchDepth <= 0,
+                        "endOnewayBatch() called without beginOnewayBatch()");
+    if (--mOnewayBatchDepth > 0) return NO_ERROR;
+    status_t err = flushOnewayBatch();
+    if (mOnewayBatchError != NO_ERROR) {
+        err = mOnewayBatchError;
+        mOnewayBatchError = NO_ERROR;
+    }
+    return err;
+}
+
+status_t IPCThreadState::queueOnewayTransaction(int32_t handle, uint32_t code,
+                                                const Parcel& data, uint32_t flags)
+{
+    // writeTransactionData() only records pointers to the parcel's buffers,
+    // and the caller may destroy data as soon as we return.
+    auto copy = std::make_unique<Parcel>();
+    status_t err = copy->appendFrom(&data, 0, data.dataSize());
+    if (err == NO_ERROR) {
+        err = writeTransactionData(BC_TRANSACTION, flags, handle, code, *copy, nullptr);
+    }
+    if (err != NO_ERROR) {
+        return (mLastError = err);
+    }
+    mOnewayBatch.push_back(std::move(copy));
+
+    if (mOnewayBatch.size() >= kMaxOnewayBatchSize) {
+        return flushOnewayBatch();
+    }
+    return NO_ERROR;
+}
+
 void IPCThreadState::incStrongHandle(int32_t handle, BpBinder *proxy)
 {
     LOG_REMOTEREFS("IPCThreadState::incStrongHandle(%d)\n", handle);
@@ -879,7 +945,9 @@ IPCThreadState::IPCThreadState()
         mIsFlushing(false),
         mStrictModePolicy(0),
         mLastTransactionBinderFlags(0),
-        mCallRestriction(mProcess->mCallRestriction) {
+        mCallRestriction(mProcess->mCallRestriction),
+        mOnewayBatchDepth(0),
+        mOnewayBatchError(NO_ERROR) {
     pthread_setspecific(gTLS, this);
     clearCaller();
     mIn.setDataCapacity(256);
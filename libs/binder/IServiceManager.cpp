@@ -23,8 +23,10 @@
 
 #include <android/os/BnServiceCallback.h>
 #include <android/os/IServiceManager.h>
+#include <android/os/IServiceRegistrationTable.h>
 #include <binder/IPCThreadState.h>
 #include <binder/Parcel.h>
+#include <binder/ServiceRegistrationTable.h>
 #include <utils/Log.h>
 #include <utils/String8.h>
 #include <utils/SystemClock.h>
@@ -99,8 +101,27 @@ protected:
     virtual Status realGetService(const std::string& name, sp<IBinder>* _aidl_return) {
         return mTheRealServiceManager->getService(name, _aidl_return);
     }
+
+private:
+    // The table of registered services published by servicemanager, or nullptr if it is disabled
+    // (see kUseRegistrationTable), this process may not read it, or servicemanager doesn't
+    // publish one.
+    const ServiceRegistrationTable* registrationTable() const;
+
+    mutable std::once_flag mRegistrationTableOnce;
+    mutable std::unique_ptr<ServiceRegistrationTable> mRegistrationTable;
 };
 
+// Whether checkService() consults servicemanager's registration table. Fetching it requires the
+// service_manager read_registration_table permission, which system/sepolicy doesn't define yet;
+// until it does, every process would make an extra call that is denied and audited. Build with
+// BINDER_SERVICE_REGISTRATION_TABLE once the policy is in place.
+#ifdef BINDER_SERVICE_REGISTRATION_TABLE
+static constexpr bool kUseRegistrationTable = true;
+#else
+static constexpr bool kUseRegistrationTable = false;
+#endif
+
 [[clang::no_destroy]] static std::once_flag gSmOnce;
 [[clang::no_destroy]] static sp<IServiceManager> gDefaultServiceManager;
 
@@ -270,10 +291,41 @@ sp<IBinder> ServiceManagerShim::getService(const String16& name) const
     return nullptr;
 }
 
+const ServiceRegistrationTable* ServiceManagerShim::registrationTable() const {
+    if (!kUseRegistrationTable) return nullptr;
+
+    std::call_once(mRegistrationTableOnce, [&]() {
+        sp<IBinder> extension;
+        if (IInterface::asBinder(mTheRealServiceManager)->getExtension(&extension) != OK ||
+            extension == nullptr) {
+            return;
+        }
+        sp<os::IServiceRegistrationTable> source =
+                interface_cast<os::IServiceRegistrationTable>(extension);
+        std::optional<os::ParcelFileDescriptor> pfd;
+        if (Status status = source->getTable(&pfd); !status.isOk() || !pfd.has_value()) {
+            return;
+        }
+        mRegistrationTable = ServiceRegistrationTable::fromFd(pfd->release());
+    });
+    return mRegistrationTable.get();
+}
+
 sp<IBinder> ServiceManagerShim::checkService(const String16& name) const
 {
+    const String8 name8(name);
+    // Skip the transaction if servicemanager has already told us that nothing is registered
+    // under this name. Notably, this makes the polling in getService free until the service
+    // shows up.
+    if (const ServiceRegistrationTable* table = registrationTable(); table != nullptr) {
+        if (auto registration = table->lookup(std::string_view(name8.c_str(), name8.size()));
+            registration.has_value() && !registration->maybeRegistered) {
+            return nullptr;
+        }
+    }
+
     sp<IBinder> ret;
-    if (!mTheRealServiceManager->checkService(String8(name).c_str(), &ret).isOk()) {
+    if (!mTheRealServiceManager->checkService(name8.c_str(), &ret).isOk()) {
         return nullptr;
     }
     return ret;
@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <binder/IBinder.h>
+
+namespace android {
+
+// Compact interface tokens replace the interface descriptor string after the
+// request headers with a 64-bit hash of it. They are only written to binders
+// whose process advertised that it accepts them, by appending this value to its
+// INTERFACE_TRANSACTION reply. Like the full header, the value differs between
+// the system and vendor copies of libbinder so that they never mix.
+#if defined(__ANDROID_VNDK__) && !defined(__ANDROID_APEX__)
+constexpr int32_t kCompactInterfaceTokenHeader = B_PACK_CHARS('V', 'N', 'D', 'C');
+#else
+constexpr int32_t kCompactInterfaceTokenHeader = B_PACK_CHARS('S', 'Y', 'S', 'C');
+#endif
+
+// FNV-1a over the UTF-16 code units of an interface descriptor.
+inline uint64_t interfaceTokenHash(const char16_t* str, size_t len) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= static_cast<uint16_t>(str[i]);
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+} // namespace android
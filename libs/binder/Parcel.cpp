@@ -48,6 +48,7 @@
 #include <utils/String8.h>
 #include <utils/misc.h>
 
+#include "InterfaceToken.h"
 #include "RpcState.h"
 #include "Static.h"
 #include "Utils.h"
@@ -571,8 +572,12 @@ void Parcel::markSensitive() const
 void Parcel::markForBinder(const sp<IBinder>& binder) {
     LOG_ALWAYS_FATAL_IF(mData != nullptr, "format must be set before data is written");
 
-    if (binder && binder->remoteBinder() && binder->remoteBinder()->isRpcBinder()) {
-        markForRpc(binder->remoteBinder()->getPrivateAccessorForId().rpcSession());
+    BpBinder* remote = binder ? binder->remoteBinder() : nullptr;
+    if (remote && remote->isRpcBinder()) {
+        markForRpc(remote->getPrivateAccessorForId().rpcSession());
+    } else if (remote) {
+        mCompactInterfaceToken = remote->getPrivateAccessorForId().compactInterfaceTokenHash(
+                &mCompactInterfaceTokenHash);
     }
 }
 
@@ -616,6 +621,12 @@ status_t Parcel::writeInterfaceToken(const char16_t* str, size_t len) {
         updateWorkSourceRequestHeaderPosition();
         writeInt32(threadState->shouldPropagateWorkSource() ? threadState->getCallingWorkSourceUid()
                                                             : IPCThreadState::kUnsetWorkSource);
+        // If the interface isn't the target's, the full name is sent so that
+        // the receiver can report the mismatch.
+        if (mCompactInterfaceToken && interfaceTokenHash(str, len) == mCompactInterfaceTokenHash) {
+            writeInt32(kCompactInterfaceTokenHeader);
+            return writeUint64(mCompactInterfaceTokenHash);
+        }
         writeInt32(kHeader);
     }
 
@@ -685,6 +696,13 @@ bool Parcel::enforceInterface(const char16_t* interface,
         threadState->setCallingWorkSourceUidWithoutPropagation(workSource);
         // vendor header
         int32_t header = readInt32();
+        if (header == kCompactInterfaceTokenHeader) {
+            uint64_t hash = readUint64();
+            if (hash == interfaceTokenHash(interface, len)) return true;
+            ALOGW("**** enforceInterface() expected '%s' but read token 0x%" PRIx64,
+                  String8(interface, len).string(), hash);
+            return false;
+        }
         if (header != kHeader) {
             ALOGE("Expecting header 0x%x but found 0x%x. Mixing copies of libbinder?", kHeader,
                   header);
@@ -2527,6 +2545,8 @@ void Parcel::initState()
     ALOGV("initState Setting data size of %p to %zu", this, mDataSize);
     ALOGV("initState Setting data pos of %p to %zu", this, mDataPos);
     mSession = nullptr;
+    mCompactInterfaceToken = false;
+    mCompactInterfaceTokenHash = 0;
     mObjects = nullptr;
     mObjectsSize = 0;
     mObjectsCapacity = 0;
@@ -234,32 +234,35 @@ void ProcessState::setCallRestriction(CallRestriction restriction) {
     mCallRestriction = restriction;
 }
 
-ProcessState::handle_entry* ProcessState::lookupHandleLocked(int32_t handle)
+ProcessState::HandleShard& ProcessState::handleShard(int32_t handle)
 {
-    const size_t N=mHandleToObject.size();
-    if (N <= (size_t)handle) {
-        handle_entry e;
-        e.binder = nullptr;
-        e.refs = nullptr;
-        status_t err = mHandleToObject.insertAt(e, N, handle+1-N);
-        if (err < NO_ERROR) return nullptr;
+    return mHandleShards[static_cast<uint32_t>(handle) % kHandleShardCount];
+}
+
+ProcessState::handle_entry* ProcessState::lookupHandleLocked(HandleShard& shard, int32_t handle)
+{
+    if (handle < 0) return nullptr;
+    const size_t index = static_cast<size_t>(handle) / kHandleShardCount;
+    if (shard.entries.size() <= index) {
+        shard.entries.resize(index + 1, handle_entry{nullptr, nullptr});
     }
-    return &mHandleToObject.editItemAt(handle);
+    return &shard.entries[index];
 }
 
 sp<IBinder> ProcessState::getStrongProxyForHandle(int32_t handle)
 {
     sp<IBinder> result;
 
-    AutoMutex _l(mLock);
+    HandleShard& shard = handleShard(handle);
+    AutoMutex _l(shard.lock);
 
-    handle_entry* e = lookupHandleLocked(handle);
+    handle_entry* e = lookupHandleLocked(shard, handle);
 
     if (e != nullptr) {
         // We need to create a new BpBinder if there isn't currently one, OR we
         // are unable to acquire a weak reference on this current one.  The
         // attemptIncWeak() is safe because we know the BpBinder destructor will always
-        // call expungeHandle(), which acquires the same lock we are holding now.
+        // call expungeHandle(), which acquires the same shard lock we are holding now.
         // We need to do this because there is a race condition between someone
         // releasing a reference on this BpBinder, and a new reference on its handle
         // arriving from the driver.
@@ -318,9 +321,10 @@ sp<IBinder> ProcessState::getStrongProxyForHandle(int32_t handle)
 
 void ProcessState::expungeHandle(int32_t handle, IBinder* binder)
 {
-    AutoMutex _l(mLock);
+    HandleShard& shard = handleShard(handle);
+    AutoMutex _l(shard.lock);
 
-    handle_entry* e = lookupHandleLocked(handle);
+    handle_entry* e = lookupHandleLocked(shard, handle);
 
     // This handle may have already been replaced with a new BpBinder
     // (if someone failed the AttemptIncWeak() above); we don't want
@@ -24,6 +24,7 @@
 #include <pthread.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <string_view>
 
 #include <android-base/macros.h>
@@ -143,8 +144,12 @@ status_t RpcSession::setupInetClient(const char* addr, unsigned int port) {
 }
 
 status_t RpcSession::setupPreconnectedClient(unique_fd fd, std::function<unique_fd()>&& request) {
-    return setupClient([&](const RpcAddress& sessionId, bool incoming) -> status_t {
+    // shared so that the callback stays copyable
+    auto firstFd = std::make_shared<unique_fd>(std::move(fd));
+    return setupClient([this, firstFd, request = std::move(request)](const RpcAddress& sessionId,
+                                                                     bool incoming) -> status_t {
         // std::move'd from fd becomes -1 (!ok())
+        unique_fd fd = std::move(*firstFd);
         if (!fd.ok()) {
             fd = request();
             if (!fd.ok()) return BAD_VALUE;
@@ -185,6 +190,21 @@ sp<IBinder> RpcSession::getRootObject() {
     return state()->getRootObject(connection.get(), sp<RpcSession>::fromExisting(this));
 }
 
+std::vector<RpcSession::OutgoingConnectionStats> RpcSession::getOutgoingConnectionStats() {
+    std::lock_guard<std::mutex> _l(mMutex);
+    std::vector<OutgoingConnectionStats> stats;
+    stats.reserve(mOutgoingConnections.size());
+    for (const auto& connection : mOutgoingConnections) {
+        stats.push_back({
+                .transactions = connection->transactions,
+                .asyncTransactions = connection->asyncTransactions,
+                .averageLatency = connection->averageLatency,
+                .inUse = connection->exclusiveTid.has_value(),
+        });
+    }
+    return stats;
+}
+
 status_t RpcSession::getRemoteMaxThreads(size_t* maxThreads) {
     ExclusiveConnection connection;
     status_t status = ExclusiveConnection::find(sp<RpcSession>::fromExisting(this),
@@ -225,6 +245,31 @@ status_t RpcSession::transact(const sp<IBinder>& binder, uint32_t code, const Pa
                              sp<RpcSession>::fromExisting(this), reply, flags);
 }
 
+status_t RpcSession::transactAsync(const sp<IBinder>& binder, uint32_t code, const Parcel& data,
+                                   TransactCallback callback) {
+    ExclusiveConnection connection;
+    status_t status = ExclusiveConnection::find(sp<RpcSession>::fromExisting(this),
+                                                ConnectionUse::CLIENT_PIPELINED, &connection);
+    if (status != OK) return status;
+    return state()->transactAsync(connection.get(), binder, code, data,
+                                  sp<RpcSession>::fromExisting(this), std::move(callback),
+                                  kMaxPendingAsyncTransactions);
+}
+
+status_t RpcSession::waitForAsyncReplies(size_t maxPending) {
+    {
+        std::lock_guard<std::mutex> _l(mMutex);
+        if (mPipelinedConnection == nullptr) return OK;
+    }
+
+    ExclusiveConnection connection;
+    status_t status = ExclusiveConnection::find(sp<RpcSession>::fromExisting(this),
+                                                ConnectionUse::CLIENT_PIPELINED, &connection);
+    if (status != OK) return status;
+    return state()->waitForPendingReplies(connection.get(), sp<RpcSession>::fromExisting(this),
+                                          maxPending);
+}
+
 status_t RpcSession::sendDecStrong(const RpcAddress& address) {
     ExclusiveConnection connection;
     status_t status = ExclusiveConnection::find(sp<RpcSession>::fromExisting(this),
@@ -408,8 +453,7 @@ sp<RpcServer> RpcSession::server() {
     return server;
 }
 
-status_t RpcSession::setupClient(
-        const std::function<status_t(const RpcAddress& sessionId, bool incoming)>& connectAndInit) {
+status_t RpcSession::setupClient(ConnectAndInit connectAndInit) {
     {
         std::lock_guard<std::mutex> _l(mMutex);
         LOG_ALWAYS_FATAL_IF(mOutgoingConnections.size() != 0,
@@ -437,8 +481,6 @@ status_t RpcSession::setupClient(
         if (!setProtocolVersion(version)) return BAD_VALUE;
     }
 
-    // TODO(b/189955605): we should add additional sessions dynamically
-    // instead of all at once.
     size_t numThreadsAvailable;
     if (status_t status = getRemoteMaxThreads(&numThreadsAvailable); status != OK) {
         ALOGE("Could not get max threads after initial session setup: %s",
@@ -452,29 +494,28 @@ status_t RpcSession::setupClient(
         return status;
     }
 
-    // TODO(b/189955605): we should add additional sessions dynamically
-    // instead of all at once - the other side should be responsible for setting
-    // up additional connections. We need to create at least one (unless 0 are
+    // We need to create at least one incoming connection (unless 0 are
     // requested to be set) in order to allow the other side to reliably make
     // any requests at all.
-
-    // we've already setup one client
-    for (size_t i = 0; i + 1 < numThreadsAvailable; i++) {
-        if (status_t status = connectAndInit(mId.value(), false /*incoming*/); status != OK)
-            return status;
-    }
-
     for (size_t i = 0; i < mMaxThreads; i++) {
         if (status_t status = connectAndInit(mId.value(), true /*incoming*/); status != OK)
             return status;
     }
 
+    // We've already setup one outgoing connection. More are opened by
+    // ExclusiveConnection::find when all of them are busy, so that sessions
+    // which never make concurrent calls only use one thread on the other side.
+    std::lock_guard<std::mutex> _l(mMutex);
+    mMaxOutgoingConnections = std::max<size_t>(numThreadsAvailable, 1);
+    mConnectOutgoing = std::move(connectAndInit);
+
     return OK;
 }
 
 status_t RpcSession::setupSocketClient(const RpcSocketAddress& addr) {
-    return setupClient([&](const RpcAddress& sessionId, bool incoming) {
-        return setupOneSocketConnection(addr, sessionId, incoming);
+    auto copiedAddr = std::make_shared<CopiedSocketAddress>(addr);
+    return setupClient([this, copiedAddr](const RpcAddress& sessionId, bool incoming) {
+        return setupOneSocketConnection(*copiedAddr, sessionId, incoming);
     });
 }
 
@@ -706,6 +747,7 @@ status_t RpcSession::ExclusiveConnection::find(const sp<RpcSession>& session, Co
     connection->mSession = session;
     connection->mConnection = nullptr;
     connection->mReentrant = false;
+    connection->mUse = use;
 
     pid_t tid = gettid();
     std::unique_lock<std::mutex> _l(session->mMutex);
@@ -715,12 +757,28 @@ status_t RpcSession::ExclusiveConnection::find(const sp<RpcSession>& session, Co
         sp<RpcConnection> exclusive;
         sp<RpcConnection> available;
 
+        // USE PIPELINED SOCKET, so that all pending replies are read from one
+        // connection
+        if (use == ConnectionUse::CLIENT_PIPELINED && session->mPipelinedConnection != nullptr) {
+            const sp<RpcConnection>& pipelined = session->mPipelinedConnection;
+            if (pipelined->exclusiveTid == tid) {
+                connection->mConnection = pipelined;
+                connection->mReentrant = true;
+                break;
+            } else if (pipelined->exclusiveTid == std::nullopt) {
+                connection->mConnection = pipelined;
+                connection->mConnection->exclusiveTid = tid;
+                connection->mStart = std::chrono::steady_clock::now();
+                break;
+            }
+            session->mAvailableConnectionCv.wait(_l);
+            continue;
+        }
+
         // CHECK FOR DEDICATED CLIENT SOCKET
         //
         // A server/looper should always use a dedicated connection if available
-        findConnection(tid, &exclusive, &available, session->mOutgoingConnections,
-                       session->mOutgoingConnectionsOffset);
-
+        //
         // WARNING: this assumes a server cannot request its client to send
         // a transaction, as mIncomingConnections is excluded below.
         //
@@ -729,19 +787,21 @@ status_t RpcSession::ExclusiveConnection::find(const sp<RpcSession>& session, Co
         // asynchronous command is sent on the first client connection. Then, if
         // we naively send a synchronous command to that same connection, the
         // thread on the far side might be busy processing the asynchronous
-        // command. So, we move to considering the second available thread
-        // for subsequent calls.
-        if (use == ConnectionUse::CLIENT_ASYNC && (exclusive != nullptr || available != nullptr)) {
-            session->mOutgoingConnectionsOffset = (session->mOutgoingConnectionsOffset + 1) %
-                    session->mOutgoingConnections.size();
-        }
+        // command. findConnection avoids this by sending synchronous commands
+        // to connections without asynchronous commands sent since their last
+        // synchronous one, and asynchronous commands to those with some.
+        findConnection(tid, use, &exclusive, &available, session->mOutgoingConnections,
+                       session->mPipelinedConnection);
 
         // USE SERVING SOCKET (e.g. nested transaction)
-        if (use != ConnectionUse::CLIENT_ASYNC) {
+        //
+        // Replies to pipelined transactions are read after the nested
+        // transaction returns, so those always use an outgoing connection.
+        if (use != ConnectionUse::CLIENT_ASYNC && use != ConnectionUse::CLIENT_PIPELINED) {
             sp<RpcConnection> exclusiveIncoming;
             // server connections are always assigned to a thread
-            findConnection(tid, &exclusiveIncoming, nullptr /*available*/,
-                           session->mIncomingConnections, 0 /* index hint */);
+            findConnection(tid, use, &exclusiveIncoming, nullptr /*available*/,
+                           session->mIncomingConnections, nullptr /*pipelined*/);
 
             // asynchronous calls cannot be nested, we currently allow ref count
             // calls to be nested (so that you can use this without having extra
@@ -759,14 +819,33 @@ status_t RpcSession::ExclusiveConnection::find(const sp<RpcSession>& session, Co
             }
         }
 
+        bool canOpenOutgoing = session->mConnectOutgoing &&
+                !session->mOpeningOutgoingConnection &&
+                session->mOutgoingConnections.size() < session->mMaxOutgoingConnections;
+
+        // A synchronous call on a connection with oneway transactions still
+        // queued on the other side, or with pipelined transactions still
+        // waiting for their replies, waits for all of them, so rather open a
+        // fresh connection while there is room for one.
+        if (exclusive == nullptr && available != nullptr && use == ConnectionUse::CLIENT &&
+            (available->asyncBacklog > 0 || !available->pendingReplies.empty()) &&
+            canOpenOutgoing) {
+            available = nullptr;
+        }
+
         // if our thread is already using a connection, prioritize using that
         if (exclusive != nullptr) {
             connection->mConnection = exclusive;
             connection->mReentrant = true;
-            break;
         } else if (available != nullptr) {
             connection->mConnection = available;
             connection->mConnection->exclusiveTid = tid;
+            connection->mStart = std::chrono::steady_clock::now();
+        }
+        if (connection->mConnection != nullptr) {
+            if (use == ConnectionUse::CLIENT_PIPELINED) {
+                session->mPipelinedConnection = connection->mConnection;
+            }
             break;
         }
 
@@ -778,6 +857,23 @@ status_t RpcSession::ExclusiveConnection::find(const sp<RpcSession>& session, Co
             return WOULD_BLOCK;
         }
 
+        // OPEN ANOTHER CONNECTION, if the other side has threads to spare
+        if (canOpenOutgoing) {
+            session->mOpeningOutgoingConnection = true;
+            _l.unlock();
+            status_t status = session->mConnectOutgoing(session->mId.value(), false /*incoming*/);
+            _l.lock();
+            session->mOpeningOutgoingConnection = false;
+            if (status != OK) {
+                ALOGW("Could not open another outgoing connection, staying at %zu: %s",
+                      session->mOutgoingConnections.size(), statusToString(status).c_str());
+                session->mMaxOutgoingConnections = session->mOutgoingConnections.size();
+            }
+            // other waiting threads may want to open a connection too
+            session->mAvailableConnectionCv.notify_all();
+            continue;
+        }
+
         LOG_RPC_DETAIL("No available connections (have %zu clients and %zu servers). Waiting...",
                        session->mOutgoingConnections.size(), session->mIncomingConnections.size());
         session->mAvailableConnectionCv.wait(_l);
@@ -787,21 +883,42 @@ status_t RpcSession::ExclusiveConnection::find(const sp<RpcSession>& session, Co
     return OK;
 }
 
-void RpcSession::ExclusiveConnection::findConnection(pid_t tid, sp<RpcConnection>* exclusive,
+void RpcSession::ExclusiveConnection::findConnection(pid_t tid, ConnectionUse use,
+                                                     sp<RpcConnection>* exclusive,
                                                      sp<RpcConnection>* available,
                                                      std::vector<sp<RpcConnection>>& sockets,
-                                                     size_t socketsIndexHint) {
-    LOG_ALWAYS_FATAL_IF(sockets.size() > 0 && socketsIndexHint >= sockets.size(),
-                        "Bad index %zu >= %zu", socketsIndexHint, sockets.size());
-
+                                                     const sp<RpcConnection>& pipelined) {
     if (*exclusive != nullptr) return; // consistent with break below
 
-    for (size_t i = 0; i < sockets.size(); i++) {
-        sp<RpcConnection>& socket = sockets[(i + socketsIndexHint) % sockets.size()];
+    // Whether a is a better pick than b. Anything but a oneway transaction
+    // waits for the oneway transactions still queued on a connection, so
+    // those go where the other side is least behind, and oneway transactions
+    // join the queue on a connection that is already behind, keeping the
+    // others free. The latency of recent synchronous transactions only breaks
+    // ties, and only between connections which have had any.
+    auto better = [use](const sp<RpcConnection>& a, const sp<RpcConnection>& b) {
+        if (use == ConnectionUse::CLIENT_ASYNC) {
+            if ((a->asyncBacklog > 0) != (b->asyncBacklog > 0)) return a->asyncBacklog > 0;
+        } else if (a->asyncBacklog != b->asyncBacklog) {
+            return a->asyncBacklog < b->asyncBacklog;
+        }
+        if (a->transactions == 0 || b->transactions == 0) return false;
+        return a->averageLatency < b->averageLatency;
+    };
 
-        // take first available connection (intuition = caching)
-        if (available && *available == nullptr && socket->exclusiveTid == std::nullopt) {
-            *available = socket;
+    // The pipelined connection is only used when nothing else is free. Other
+    // uses read the replies to pipelined transactions sent before them while
+    // waiting for their own (they arrive in order), so it can't deadlock, but
+    // they have to wait for all of them.
+    bool pipelinedAvailable = false;
+    for (sp<RpcConnection>& socket : sockets) {
+        if (available && socket->exclusiveTid == std::nullopt) {
+            if (socket == pipelined) {
+                pipelinedAvailable = true;
+                continue;
+            }
+            // ties go to the earliest connection (intuition = caching)
+            if (*available == nullptr || better(socket, *available)) *available = socket;
             continue;
         }
 
@@ -812,6 +929,8 @@ void RpcSession::ExclusiveConnection::findConnection(pid_t tid, sp<RpcConnection
             break; // consistent with return above
         }
     }
+
+    if (available && *available == nullptr && pipelinedAvailable) *available = pipelined;
 }
 
 RpcSession::ExclusiveConnection::~ExclusiveConnection() {
@@ -819,11 +938,40 @@ RpcSession::ExclusiveConnection::~ExclusiveConnection() {
     // is using this fd, and it retains the right to it. So, we don't give up
     // exclusive ownership, and no thread is freed.
     if (!mReentrant && mConnection != nullptr) {
+        auto latency = std::chrono::steady_clock::now() - mStart;
         std::unique_lock<std::mutex> _l(mSession->mMutex);
         mConnection->exclusiveTid = std::nullopt;
+        switch (mUse) {
+            case ConnectionUse::CLIENT:
+                mConnection->transactions++;
+                // the reply was sent after anything sent before it was processed
+                mConnection->asyncBacklog = 0;
+                // moving average over roughly the last 8 transactions
+                mConnection->averageLatency += (latency - mConnection->averageLatency) / 8;
+                break;
+            case ConnectionUse::CLIENT_ASYNC:
+                mConnection->asyncTransactions++;
+                mConnection->asyncBacklog++;
+                break;
+            case ConnectionUse::CLIENT_REFCOUNT:
+            case ConnectionUse::CLIENT_PIPELINED:
+                break;
+        }
+
+        // While there is a pipelined connection, waiting threads may not be
+        // able to use it, or may only be able to use it, so wake them all.
+        bool notifyAll = mSession->mPipelinedConnection != nullptr;
+        if (mSession->mPipelinedConnection == mConnection && mConnection->pendingReplies.empty()) {
+            mSession->mPipelinedConnection = nullptr;
+        }
+
         if (mSession->mWaitingThreads > 0) {
             _l.unlock();
-            mSession->mAvailableConnectionCv.notify_one();
+            if (notifyAll) {
+                mSession->mAvailableConnectionCv.notify_all();
+            } else {
+                mSession->mAvailableConnectionCv.notify_one();
+            }
         }
     }
 }
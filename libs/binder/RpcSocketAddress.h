@@ -113,4 +113,23 @@ private:
     unsigned int mPort;
 };
 
+// A copy of another address, which unlike InetSocketAddress does not reference
+// memory it doesn't own, so that it can be connected to again later.
+class CopiedSocketAddress : public RpcSocketAddress {
+public:
+    explicit CopiedSocketAddress(const RpcSocketAddress& other)
+          : mString(other.toString()), mSize(other.addrSize()) {
+        LOG_ALWAYS_FATAL_IF(mSize > sizeof(mAddr), "Socket address is too long: %zu", mSize);
+        memcpy(&mAddr, other.addr(), mSize);
+    }
+    std::string toString() const override { return mString; }
+    const sockaddr* addr() const override { return reinterpret_cast<const sockaddr*>(&mAddr); }
+    size_t addrSize() const override { return mSize; }
+
+private:
+    std::string mString;
+    sockaddr_storage mAddr;
+    size_t mSize;
+};
+
 } // namespace android
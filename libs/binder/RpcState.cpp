@@ -413,9 +413,8 @@ status_t RpcState::getSessionId(const sp<RpcSession::RpcConnection>& connection,
     return sessionIdOut->readFromParcel(reply);
 }
 
-status_t RpcState::transact(const sp<RpcSession::RpcConnection>& connection,
-                            const sp<IBinder>& binder, uint32_t code, const Parcel& data,
-                            const sp<RpcSession>& session, Parcel* reply, uint32_t flags) {
+status_t RpcState::prepareTransaction(const sp<IBinder>& binder, const Parcel& data,
+                                      const sp<RpcSession>& session, RpcAddress* outAddress) {
     if (!data.isForRpc()) {
         ALOGE("Refusing to send RPC with parcel not crafted for RPC");
         return BAD_TYPE;
@@ -426,15 +425,100 @@ status_t RpcState::transact(const sp<RpcSession::RpcConnection>& connection,
         return BAD_TYPE;
     }
 
+    return onBinderLeaving(session, binder, outAddress);
+}
+
+status_t RpcState::transact(const sp<RpcSession::RpcConnection>& connection,
+                            const sp<IBinder>& binder, uint32_t code, const Parcel& data,
+                            const sp<RpcSession>& session, Parcel* reply, uint32_t flags) {
     RpcAddress address = RpcAddress::zero();
-    if (status_t status = onBinderLeaving(session, binder, &address); status != OK) return status;
+    if (status_t status = prepareTransaction(binder, data, session, &address); status != OK)
+        return status;
 
     return transactAddress(connection, address, code, data, session, reply, flags);
 }
 
+status_t RpcState::transactAsync(const sp<RpcSession::RpcConnection>& connection,
+                                 const sp<IBinder>& binder, uint32_t code, const Parcel& data,
+                                 const sp<RpcSession>& session,
+                                 RpcSession::TransactCallback callback, size_t maxPending) {
+    LOG_ALWAYS_FATAL_IF(maxPending == 0);
+
+    if (status_t status = waitForPendingReplies(connection, session, maxPending - 1);
+        status != OK)
+        return status;
+
+    RpcAddress address = RpcAddress::zero();
+    if (status_t status = prepareTransaction(binder, data, session, &address); status != OK)
+        return status;
+
+    uint64_t requestId = connection->nextRequestId++;
+    if (status_t status = sendTransaction(connection, address, code, data, session, 0 /*flags*/,
+                                          RPC_WIRE_TRANSACTION_FLAG_TAGGED_REPLY, requestId);
+        status != OK) {
+        abortPendingReplies(connection, status);
+        return status;
+    }
+    connection->pendingReplies.emplace(requestId, std::move(callback));
+
+    // Pick up replies which have already arrived, so that they don't build up
+    // while the caller keeps sending.
+    if (status_t status = drainCommands(connection, session, CommandType::ANY); status != OK) {
+        abortPendingReplies(connection, status);
+    }
+    return OK;
+}
+
+status_t RpcState::waitForPendingReplies(const sp<RpcSession::RpcConnection>& connection,
+                                         const sp<RpcSession>& session, size_t maxPending) {
+    while (connection->pendingReplies.size() > maxPending) {
+        if (status_t status = getAndExecuteCommand(connection, session, CommandType::ANY);
+            status != OK) {
+            abortPendingReplies(connection, status);
+            return status;
+        }
+    }
+    return OK;
+}
+
+void RpcState::abortPendingReplies(const sp<RpcSession::RpcConnection>& connection,
+                                   status_t status) {
+    // callbacks may send more transactions
+    auto pending = std::move(connection->pendingReplies);
+    connection->pendingReplies.clear();
+    for (auto& [requestId, callback] : pending) {
+        Parcel reply;
+        callback(status, &reply);
+    }
+}
+
 status_t RpcState::transactAddress(const sp<RpcSession::RpcConnection>& connection,
                                    const RpcAddress& address, uint32_t code, const Parcel& data,
                                    const sp<RpcSession>& session, Parcel* reply, uint32_t flags) {
+    if (status_t status = sendTransaction(connection, address, code, data, session, flags,
+                                          0 /*rpcFlags*/, 0 /*requestId*/);
+        status != OK)
+        return status;
+
+    if (flags & IBinder::FLAG_ONEWAY) {
+        LOG_RPC_DETAIL("Oneway command, so no longer waiting on RpcTransport %p",
+                       connection->rpcTransport.get());
+
+        // Do not wait on result.
+        // However, too many oneway calls may cause refcounts to build up and fill up the socket,
+        // so process those.
+        return drainCommands(connection, session, CommandType::CONTROL_ONLY);
+    }
+
+    LOG_ALWAYS_FATAL_IF(reply == nullptr, "Reply parcel must be used for synchronous transaction.");
+
+    return waitForReply(connection, session, reply);
+}
+
+status_t RpcState::sendTransaction(const sp<RpcSession::RpcConnection>& connection,
+                                   const RpcAddress& address, uint32_t code, const Parcel& data,
+                                   const sp<RpcSession>& session, uint32_t flags,
+                                   uint32_t rpcFlags, uint64_t requestId) {
     LOG_ALWAYS_FATAL_IF(!data.isForRpc());
     LOG_ALWAYS_FATAL_IF(data.objectsCount() != 0);
 
@@ -471,6 +555,8 @@ status_t RpcState::transactAddress(const sp<RpcSession::RpcConnection>& connecti
             .code = code,
             .flags = flags,
             .asyncNumber = asyncNumber,
+            .rpcFlags = rpcFlags,
+            .requestId = requestId,
     };
     CommandData transactionData(sizeof(RpcWireHeader) + sizeof(RpcWireTransaction) +
                                 data.dataSize());
@@ -484,26 +570,10 @@ status_t RpcState::transactAddress(const sp<RpcSession::RpcConnection>& connecti
     memcpy(transactionData.data() + sizeof(RpcWireHeader) + sizeof(RpcWireTransaction), data.data(),
            data.dataSize());
 
-    if (status_t status = rpcSend(connection, session, "transaction", transactionData.data(),
-                                  transactionData.size());
-        status != OK)
-        // TODO(b/167966510): need to undo onBinderLeaving - we know the
-        // refcount isn't successfully transferred.
-        return status;
-
-    if (flags & IBinder::FLAG_ONEWAY) {
-        LOG_RPC_DETAIL("Oneway command, so no longer waiting on RpcTransport %p",
-                       connection->rpcTransport.get());
-
-        // Do not wait on result.
-        // However, too many oneway calls may cause refcounts to build up and fill up the socket,
-        // so process those.
-        return drainCommands(connection, session, CommandType::CONTROL_ONLY);
-    }
-
-    LOG_ALWAYS_FATAL_IF(reply == nullptr, "Reply parcel must be used for synchronous transaction.");
-
-    return waitForReply(connection, session, reply);
+    // TODO(b/167966510): need to undo onBinderLeaving - we know the
+    // refcount isn't successfully transferred.
+    return rpcSend(connection, session, "transaction", transactionData.data(),
+                   transactionData.size());
 }
 
 static void cleanup_reply_data(Parcel* p, const uint8_t* data, size_t dataSize,
@@ -515,6 +585,15 @@ static void cleanup_reply_data(Parcel* p, const uint8_t* data, size_t dataSize,
     LOG_ALWAYS_FATAL_IF(objectsCount != 0, "%zu objects remaining", objectsCount);
 }
 
+static void cleanup_tagged_reply_data(Parcel* p, const uint8_t* data, size_t dataSize,
+                                      const binder_size_t* objects, size_t objectsCount) {
+    (void)p;
+    delete[] const_cast<uint8_t*>(data - offsetof(RpcWireTaggedReply, data));
+    (void)dataSize;
+    LOG_ALWAYS_FATAL_IF(objects != nullptr);
+    LOG_ALWAYS_FATAL_IF(objectsCount != 0, "%zu objects remaining", objectsCount);
+}
+
 status_t RpcState::waitForReply(const sp<RpcSession::RpcConnection>& connection,
                                 const sp<RpcSession>& session, Parcel* reply) {
     RpcWireHeader command;
@@ -632,6 +711,8 @@ status_t RpcState::processCommand(const sp<RpcSession::RpcConnection>& connectio
             return processTransact(connection, session, command);
         case RPC_COMMAND_DEC_STRONG:
             return processDecStrong(connection, session, command);
+        case RPC_COMMAND_TAGGED_REPLY:
+            return processTaggedReply(connection, session, command);
     }
 
     // We should always know the version of the opposing side, and since the
@@ -866,26 +947,37 @@ processTransactInternalTailCall:
         return OK;
     }
 
+    bool tagged = transaction->rpcFlags & RPC_WIRE_TRANSACTION_FLAG_TAGGED_REPLY;
+    size_t replyHeaderSize = tagged ? sizeof(RpcWireTaggedReply) : sizeof(RpcWireReply);
+
     LOG_ALWAYS_FATAL_IF(std::numeric_limits<int32_t>::max() - sizeof(RpcWireHeader) -
-                                        sizeof(RpcWireReply) <
+                                        replyHeaderSize <
                                 reply.dataSize(),
                         "Too much data for reply %zu", reply.dataSize());
 
     RpcWireHeader cmdReply{
-            .command = RPC_COMMAND_REPLY,
-            .bodySize = static_cast<uint32_t>(sizeof(RpcWireReply) + reply.dataSize()),
-    };
-    RpcWireReply rpcReply{
-            .status = replyStatus,
+            .command = tagged ? RPC_COMMAND_TAGGED_REPLY : RPC_COMMAND_REPLY,
+            .bodySize = static_cast<uint32_t>(replyHeaderSize + reply.dataSize()),
     };
 
-    CommandData replyData(sizeof(RpcWireHeader) + sizeof(RpcWireReply) + reply.dataSize());
+    CommandData replyData(sizeof(RpcWireHeader) + replyHeaderSize + reply.dataSize());
     if (!replyData.valid()) {
         return NO_MEMORY;
     }
     memcpy(replyData.data() + 0, &cmdReply, sizeof(RpcWireHeader));
-    memcpy(replyData.data() + sizeof(RpcWireHeader), &rpcReply, sizeof(RpcWireReply));
-    memcpy(replyData.data() + sizeof(RpcWireHeader) + sizeof(RpcWireReply), reply.data(),
+    if (tagged) {
+        RpcWireTaggedReply rpcReply{
+                .requestId = transaction->requestId,
+                .status = replyStatus,
+        };
+        memcpy(replyData.data() + sizeof(RpcWireHeader), &rpcReply, sizeof(RpcWireTaggedReply));
+    } else {
+        RpcWireReply rpcReply{
+                .status = replyStatus,
+        };
+        memcpy(replyData.data() + sizeof(RpcWireHeader), &rpcReply, sizeof(RpcWireReply));
+    }
+    memcpy(replyData.data() + sizeof(RpcWireHeader) + replyHeaderSize, reply.data(),
            reply.dataSize());
 
     return rpcSend(connection, session, "reply", replyData.data(), replyData.size());
@@ -946,6 +1038,51 @@ status_t RpcState::processDecStrong(const sp<RpcSession::RpcConnection>& connect
     return OK;
 }
 
+status_t RpcState::processTaggedReply(const sp<RpcSession::RpcConnection>& connection,
+                                      const sp<RpcSession>& session,
+                                      const RpcWireHeader& command) {
+    LOG_ALWAYS_FATAL_IF(command.command != RPC_COMMAND_TAGGED_REPLY, "command: %d",
+                        command.command);
+
+    CommandData data(command.bodySize);
+    if (!data.valid()) return NO_MEMORY;
+
+    if (status_t status = rpcRec(connection, session, "tagged reply body", data.data(),
+                                 command.bodySize);
+        status != OK)
+        return status;
+
+    if (command.bodySize < sizeof(RpcWireTaggedReply)) {
+        ALOGE("Expecting %zu but got %" PRId32 " bytes for RpcWireTaggedReply. Terminating!",
+              sizeof(RpcWireTaggedReply), command.bodySize);
+        (void)session->shutdownAndWait(false);
+        return BAD_VALUE;
+    }
+    RpcWireTaggedReply* rpcReply = reinterpret_cast<RpcWireTaggedReply*>(data.data());
+
+    auto it = connection->pendingReplies.find(rpcReply->requestId);
+    if (it == connection->pendingReplies.end()) {
+        ALOGE("Reply to unknown request %" PRIu64 ". Terminating!", rpcReply->requestId);
+        (void)session->shutdownAndWait(false);
+        return BAD_VALUE;
+    }
+    RpcSession::TransactCallback callback = std::move(it->second);
+    connection->pendingReplies.erase(it);
+
+    status_t replyStatus = rpcReply->status;
+    Parcel reply;
+    if (replyStatus == OK) {
+        data.release();
+        reply.ipcSetDataReference(rpcReply->data,
+                                  command.bodySize - offsetof(RpcWireTaggedReply, data), nullptr,
+                                  0, cleanup_tagged_reply_data);
+        reply.markForRpc(session);
+    }
+
+    callback(replyStatus, &reply);
+    return OK;
+}
+
 sp<IBinder> RpcState::tryEraseNode(std::map<RpcAddress, BinderNode>::iterator& it) {
     sp<IBinder> ref;
 
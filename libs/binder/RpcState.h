@@ -82,6 +82,15 @@ public:
                                            const RpcAddress& address, uint32_t code,
                                            const Parcel& data, const sp<RpcSession>& session,
                                            Parcel* reply, uint32_t flags);
+    // Sends a transaction whose reply is passed to |callback| when it is read
+    // from |connection|, after waiting for replies until fewer than
+    // |maxPending| are left. See RpcSession::transactAsync.
+    [[nodiscard]] status_t transactAsync(const sp<RpcSession::RpcConnection>& connection,
+                                         const sp<IBinder>& address, uint32_t code,
+                                         const Parcel& data, const sp<RpcSession>& session,
+                                         RpcSession::TransactCallback callback, size_t maxPending);
+    [[nodiscard]] status_t waitForPendingReplies(const sp<RpcSession::RpcConnection>& connection,
+                                                 const sp<RpcSession>& session, size_t maxPending);
     [[nodiscard]] status_t sendDecStrong(const sp<RpcSession::RpcConnection>& connection,
                                          const sp<RpcSession>& session, const RpcAddress& address);
 
@@ -154,8 +163,17 @@ private:
                                   const sp<RpcSession>& session, const char* what, void* data,
                                   size_t size);
 
+    [[nodiscard]] status_t prepareTransaction(const sp<IBinder>& binder, const Parcel& data,
+                                              const sp<RpcSession>& session,
+                                              RpcAddress* outAddress);
+    [[nodiscard]] status_t sendTransaction(const sp<RpcSession::RpcConnection>& connection,
+                                           const RpcAddress& address, uint32_t code,
+                                           const Parcel& data, const sp<RpcSession>& session,
+                                           uint32_t flags, uint32_t rpcFlags, uint64_t requestId);
     [[nodiscard]] status_t waitForReply(const sp<RpcSession::RpcConnection>& connection,
                                         const sp<RpcSession>& session, Parcel* reply);
+    // Fails the callbacks of all transactAsync calls waiting on |connection|.
+    void abortPendingReplies(const sp<RpcSession::RpcConnection>& connection, status_t status);
     [[nodiscard]] status_t processCommand(const sp<RpcSession::RpcConnection>& connection,
                                           const sp<RpcSession>& session,
                                           const RpcWireHeader& command, CommandType type);
@@ -168,6 +186,9 @@ private:
     [[nodiscard]] status_t processDecStrong(const sp<RpcSession::RpcConnection>& connection,
                                             const sp<RpcSession>& session,
                                             const RpcWireHeader& command);
+    [[nodiscard]] status_t processTaggedReply(const sp<RpcSession::RpcConnection>& connection,
+                                              const sp<RpcSession>& session,
+                                              const RpcWireHeader& command);
 
     struct BinderNode {
         // Two cases:
@@ -17,9 +17,20 @@
 #define LOG_TAG "RpcTransportTls"
 #include <log/log.h>
 
+#include <linux/tls.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include <mutex>
+#include <string>
+#include <vector>
 
 #include <openssl/bn.h>
+#include <openssl/hkdf.h>
+#include <openssl/mem.h>
 #include <openssl/ssl.h>
 
 #include <binder/RpcTransportTls.h>
@@ -43,6 +54,14 @@
         }                                       \
     } while (0)
 
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+
+#ifndef TCP_ULP
+#define TCP_ULP 31
+#endif
+
 using android::base::ErrnoError;
 using android::base::Error;
 using android::base::Result;
@@ -52,6 +71,9 @@ namespace {
 
 constexpr const int kCertValidDays = 30;
 
+// Allows connections of a client session to resume each other's TLS sessions.
+constexpr const char kSessionIdContext[] = "binder_rpc";
+
 // Implement BIO for socket that ignores SIGPIPE.
 int socketNew(BIO* bio) {
     BIO_set_data(bio, reinterpret_cast<void*>(-1));
@@ -314,10 +336,16 @@ private:
     bssl::UniquePtr<SSL> mSsl;
 };
 
+// Which directions of a connection have their records encrypted / decrypted by the kernel.
+struct KernelTls {
+    bool tx = false;
+    bool rx = false;
+};
+
 class RpcTransportTls : public RpcTransport {
 public:
-    RpcTransportTls(android::base::unique_fd socket, Ssl ssl)
-          : mSocket(std::move(socket)), mSsl(std::move(ssl)) {}
+    RpcTransportTls(android::base::unique_fd socket, Ssl ssl, KernelTls kernelTls)
+          : mSocket(std::move(socket)), mSsl(std::move(ssl)), mKernelTls(kernelTls) {}
     Result<size_t> peek(void* buf, size_t size) override;
     status_t interruptableWriteFully(FdTrigger* fdTrigger, const void* data, size_t size) override;
     status_t interruptableReadFully(FdTrigger* fdTrigger, void* data, size_t size) override;
@@ -325,12 +353,23 @@ public:
 private:
     android::base::unique_fd mSocket;
     Ssl mSsl;
+    KernelTls mKernelTls;
 
     static status_t isTriggered(FdTrigger* fdTrigger);
+    status_t kernelWriteFully(FdTrigger* fdTrigger, const uint8_t* buffer, const uint8_t* end);
+    status_t kernelReadFully(FdTrigger* fdTrigger, uint8_t* buffer, uint8_t* end);
 };
 
 // Error code is errno.
 Result<size_t> RpcTransportTls::peek(void* buf, size_t size) {
+    if (mKernelTls.rx) {
+        ssize_t ret = TEMP_FAILURE_RETRY(::recv(mSocket.get(), buf, size, MSG_PEEK));
+        if (ret < 0) {
+            return ErrnoError() << "recv(MSG_PEEK)";
+        }
+        return ret;
+    }
+
     size_t todo = std::min<size_t>(size, std::numeric_limits<int>::max());
     auto [ret, errorQueue] = mSsl.call(SSL_peek, buf, static_cast<int>(todo));
     if (ret < 0) {
@@ -367,6 +406,8 @@ status_t RpcTransportTls::interruptableWriteFully(FdTrigger* fdTrigger, const vo
     // once. The trigger is also checked via triggerablePoll() after every SSL_write().
     if (status_t status = isTriggered(fdTrigger); status != OK) return status;
 
+    if (mKernelTls.tx) return kernelWriteFully(fdTrigger, buffer, end);
+
     while (buffer < end) {
         size_t todo = std::min<size_t>(end - buffer, std::numeric_limits<int>::max());
         auto [writeSize, errorQueue] = mSsl.call(SSL_write, buffer, todo);
@@ -398,6 +439,8 @@ status_t RpcTransportTls::interruptableReadFully(FdTrigger* fdTrigger, void* dat
     // once. The trigger is also checked via triggerablePoll() after every SSL_write().
     if (status_t status = isTriggered(fdTrigger); status != OK) return status;
 
+    if (mKernelTls.rx) return kernelReadFully(fdTrigger, buffer, end);
+
     while (buffer < end) {
         size_t todo = std::min<size_t>(end - buffer, std::numeric_limits<int>::max());
         auto [readSize, errorQueue] = mSsl.call(SSL_read, buffer, todo);
@@ -421,6 +464,143 @@ status_t RpcTransportTls::interruptableReadFully(FdTrigger* fdTrigger, void* dat
     return OK;
 }
 
+// The kernel encrypts records, so this is like RpcTransportRaw.
+status_t RpcTransportTls::kernelWriteFully(FdTrigger* fdTrigger, const uint8_t* buffer,
+                                           const uint8_t* end) {
+    status_t status;
+    while ((status = fdTrigger->triggerablePoll(mSocket.get(), POLLOUT)) == OK) {
+        ssize_t writeSize =
+                TEMP_FAILURE_RETRY(::send(mSocket.get(), buffer, end - buffer, MSG_NOSIGNAL));
+        if (writeSize < 0) {
+            int savedErrno = errno;
+            if (savedErrno == EAGAIN || savedErrno == EWOULDBLOCK) continue;
+            LOG_TLS_DETAIL("kTLS send(): %s", strerror(savedErrno));
+            return -savedErrno;
+        }
+        if (writeSize == 0) return DEAD_OBJECT;
+
+        buffer += writeSize;
+        if (buffer == end) return OK;
+    }
+    return status;
+}
+
+// The kernel decrypts records. Anything other than application data (e.g. an alert) makes
+// recv() fail with EIO, which ends the connection.
+status_t RpcTransportTls::kernelReadFully(FdTrigger* fdTrigger, uint8_t* buffer, uint8_t* end) {
+    status_t status;
+    while ((status = fdTrigger->triggerablePoll(mSocket.get(), POLLIN)) == OK) {
+        ssize_t readSize =
+                TEMP_FAILURE_RETRY(::recv(mSocket.get(), buffer, end - buffer, MSG_NOSIGNAL));
+        if (readSize < 0) {
+            int savedErrno = errno;
+            if (savedErrno == EAGAIN || savedErrno == EWOULDBLOCK) continue;
+            LOG_TLS_DETAIL("kTLS recv(): %s", strerror(savedErrno));
+            return -savedErrno;
+        }
+        if (readSize == 0) return DEAD_OBJECT; // EOF
+
+        buffer += readSize;
+        if (buffer == end) return OK;
+    }
+    return status;
+}
+
+// HKDF-Expand-Label from RFC 8446 section 7.1, with an empty context.
+bool hkdfExpandLabel(const EVP_MD* digest, bssl::Span<const uint8_t> secret,
+                     std::string_view label, uint8_t* out, size_t outLen) {
+    std::string fullLabel = "tls13 " + std::string(label);
+    std::vector<uint8_t> info = {static_cast<uint8_t>(outLen >> 8),
+                                 static_cast<uint8_t>(outLen & 0xff),
+                                 static_cast<uint8_t>(fullLabel.size())};
+    info.insert(info.end(), fullLabel.begin(), fullLabel.end());
+    info.push_back(0); // context
+    return HKDF_expand(out, outLen, digest, secret.data(), secret.size(), info.data(), info.size());
+}
+
+// Installs the key and IV derived from a TLS 1.3 traffic |secret| for |direction| (TLS_TX or
+// TLS_RX) of |fd|, continuing at record |sequence|.
+template <typename CryptoInfo>
+bool setKernelTlsKey(android::base::borrowed_fd fd, int direction, uint16_t cipherType,
+                     const EVP_MD* digest, bssl::Span<const uint8_t> secret, uint64_t sequence) {
+    CryptoInfo info = {};
+    info.info.version = TLS_1_3_VERSION;
+    info.info.cipher_type = cipherType;
+    // The kernel takes the 12 byte TLS 1.3 IV as salt followed by iv.
+    uint8_t iv[sizeof(info.salt) + sizeof(info.iv)];
+    bool ok = hkdfExpandLabel(digest, secret, "key", info.key, sizeof(info.key)) &&
+            hkdfExpandLabel(digest, secret, "iv", iv, sizeof(iv));
+    if (ok) {
+        memcpy(info.salt, iv, sizeof(info.salt));
+        memcpy(info.iv, iv + sizeof(info.salt), sizeof(info.iv));
+        for (size_t i = 0; i < sizeof(info.rec_seq); i++) {
+            info.rec_seq[i] = static_cast<uint8_t>(sequence >> (8 * (sizeof(info.rec_seq) - 1 - i)));
+        }
+        ok = setsockopt(fd.get(), SOL_TLS, direction, &info, sizeof(info)) == 0;
+        if (!ok) LOG_TLS_DETAIL("setsockopt(SOL_TLS, %d): %s", direction, strerror(errno));
+    }
+    OPENSSL_cleanse(&info, sizeof(info));
+    OPENSSL_cleanse(iv, sizeof(iv));
+    return ok;
+}
+
+bool setKernelTlsKey(android::base::borrowed_fd fd, int direction, const SSL_CIPHER* cipher,
+                     bssl::Span<const uint8_t> secret, uint64_t sequence) {
+    switch (SSL_CIPHER_get_protocol_id(cipher)) {
+        case 0x1301: // TLS_AES_128_GCM_SHA256
+            return setKernelTlsKey<tls12_crypto_info_aes_gcm_128>(fd, direction,
+                                                                  TLS_CIPHER_AES_GCM_128,
+                                                                  EVP_sha256(), secret, sequence);
+        case 0x1302: // TLS_AES_256_GCM_SHA384
+            return setKernelTlsKey<tls12_crypto_info_aes_gcm_256>(fd, direction,
+                                                                  TLS_CIPHER_AES_GCM_256,
+                                                                  EVP_sha384(), secret, sequence);
+        default:
+            LOG_TLS_DETAIL("No kTLS support for cipher %s", SSL_CIPHER_get_name(cipher));
+            return false;
+    }
+}
+
+// After the handshake on |fd|, hands record encryption and, if |rx|, decryption over to the
+// kernel, so that data no longer goes through |ssl|. This only works for TCP sockets and AES-GCM
+// ciphers. Otherwise, the connection keeps using |ssl|.
+//
+// Once offloaded, |ssl| can't send anything anymore. This is fine since neither side sends
+// post-handshake messages other than the server's session tickets, which are sent as part of the
+// server's handshake. These are read by the client, so it keeps decrypting in userspace.
+KernelTls offloadToKernel(Ssl* ssl, android::base::borrowed_fd fd, bool rx) {
+    KernelTls ret;
+    if (setsockopt(fd.get(), SOL_TCP, TCP_ULP, "tls", sizeof("tls")) != 0) {
+        LOG_TLS_DETAIL("setsockopt(TCP_ULP): %s", strerror(errno));
+        return ret;
+    }
+
+    auto [cipher, cipherErrorQueue] = ssl->call(SSL_get_current_cipher);
+    cipherErrorQueue.clear();
+    bssl::Span<const uint8_t> readSecret, writeSecret;
+    auto [ok, errorQueue] = ssl->call(bssl::SSL_get_traffic_secrets, &readSecret, &writeSecret);
+    if (!ok || cipher == nullptr) {
+        ALOGE("Could not get TLS traffic secrets: %s", errorQueue.toString().c_str());
+        return ret;
+    }
+    errorQueue.clear();
+
+    auto [writeSequence, writeErrorQueue] = ssl->call(SSL_get_write_sequence);
+    writeErrorQueue.clear();
+    ret.tx = setKernelTlsKey(fd, TLS_TX, cipher, writeSecret, writeSequence);
+    if (!ret.tx || !rx) return ret;
+
+    // Data |ssl| has already read from the socket would be lost.
+    auto [hasPending, pendingErrorQueue] = ssl->call(SSL_has_pending);
+    pendingErrorQueue.clear();
+    if (hasPending) return ret;
+
+    auto [readSequence, readErrorQueue] = ssl->call(SSL_get_read_sequence);
+    readErrorQueue.clear();
+    ret.rx = setKernelTlsKey(fd, TLS_RX, cipher, readSecret, readSequence);
+    return ret;
+}
+
 // For |ssl|, set internal FD to |fd|, and do handshake. Handshake is triggerable by |fdTrigger|.
 bool setFdAndDoHandshake(Ssl* ssl, android::base::borrowed_fd fd, FdTrigger* fdTrigger) {
     bssl::UniquePtr<BIO> bio = newSocketBio(fd);
@@ -453,15 +633,19 @@ class RpcTransportCtxTls : public RpcTransportCtx {
 public:
     template <typename Impl,
               typename = std::enable_if_t<std::is_base_of_v<RpcTransportCtxTls, Impl>>>
-    static std::unique_ptr<RpcTransportCtxTls> create();
+    static std::unique_ptr<RpcTransportCtxTls> create(bool useKernelTls);
     std::unique_ptr<RpcTransport> newTransport(android::base::unique_fd fd,
                                                FdTrigger* fdTrigger) const override;
     std::string getCertificate(CertificateFormat) const override;
     status_t addTrustedPeerCertificate(CertificateFormat, std::string_view cert) override;
 
 protected:
+    virtual void initCtx(SSL_CTX*) {}
     virtual void preHandshake(Ssl* ssl) const = 0;
+    // Whether records received after the handshake may be decrypted by the kernel.
+    virtual bool canOffloadRx() const = 0;
     bssl::UniquePtr<SSL_CTX> mCtx;
+    bool mUseKernelTls = false;
 };
 
 std::string RpcTransportCtxTls::getCertificate(CertificateFormat) const {
@@ -477,7 +661,7 @@ status_t RpcTransportCtxTls::addTrustedPeerCertificate(CertificateFormat, std::s
 // Common implementation for creating server and client contexts. The child class, |Impl|, is
 // provided as a template argument so that this function can initialize an |Impl| object.
 template <typename Impl, typename>
-std::unique_ptr<RpcTransportCtxTls> RpcTransportCtxTls::create() {
+std::unique_ptr<RpcTransportCtxTls> RpcTransportCtxTls::create(bool useKernelTls) {
     bssl::UniquePtr<SSL_CTX> ctx(SSL_CTX_new(TLS_method()));
     TEST_AND_RETURN(nullptr, ctx != nullptr);
 
@@ -496,12 +680,20 @@ std::unique_ptr<RpcTransportCtxTls> RpcTransportCtxTls::create() {
     // Require at least TLS 1.3
     TEST_AND_RETURN(nullptr, SSL_CTX_set_min_proto_version(ctx.get(), TLS1_3_VERSION));
 
+    TEST_AND_RETURN(nullptr,
+                    SSL_CTX_set_session_id_context(ctx.get(),
+                                                   reinterpret_cast<const uint8_t*>(
+                                                           kSessionIdContext),
+                                                   sizeof(kSessionIdContext)));
+
     if constexpr (SHOULD_LOG_TLS_DETAIL) { // NOLINT
         SSL_CTX_set_info_callback(ctx.get(), sslDebugLog);
     }
 
     auto ret = std::make_unique<Impl>();
+    ret->initCtx(ctx.get());
     ret->mCtx = std::move(ctx);
+    ret->mUseKernelTls = useKernelTls;
     return ret;
 }
 
@@ -513,7 +705,12 @@ std::unique_ptr<RpcTransport> RpcTransportCtxTls::newTransport(android::base::un
 
     preHandshake(&wrapped);
     TEST_AND_RETURN(nullptr, setFdAndDoHandshake(&wrapped, fd, fdTrigger));
-    return std::make_unique<RpcTransportTls>(std::move(fd), std::move(wrapped));
+
+    KernelTls kernelTls;
+    if (mUseKernelTls) kernelTls = offloadToKernel(&wrapped, fd, canOffloadRx());
+    LOG_TLS_DETAIL("kTLS tx: %d rx: %d", kernelTls.tx, kernelTls.rx);
+
+    return std::make_unique<RpcTransportTls>(std::move(fd), std::move(wrapped), kernelTls);
 }
 
 class RpcTransportCtxTlsServer : public RpcTransportCtxTls {
@@ -521,31 +718,59 @@ protected:
     void preHandshake(Ssl* ssl) const override {
         ssl->call(SSL_set_accept_state).errorQueue.clear();
     }
+    bool canOffloadRx() const override { return true; }
 };
 
 class RpcTransportCtxTlsClient : public RpcTransportCtxTls {
 protected:
+    // All connections of a client session are created from the same context, so later
+    // connections resume the TLS session of an earlier one instead of doing a full handshake.
+    void initCtx(SSL_CTX* ctx) override {
+        SSL_CTX_set_app_data(ctx, this);
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL);
+        SSL_CTX_sess_set_new_cb(ctx, onNewSession);
+    }
     void preHandshake(Ssl* ssl) const override {
         ssl->call(SSL_set_connect_state).errorQueue.clear();
+        std::lock_guard<std::mutex> _l(mSessionMutex);
+        if (mSession != nullptr) ssl->call(SSL_set_session, mSession.get()).errorQueue.clear();
+    }
+    // Session tickets are received after the handshake.
+    bool canOffloadRx() const override { return false; }
+
+private:
+    static int onNewSession(SSL* ssl, SSL_SESSION* session) {
+        auto thiz = static_cast<RpcTransportCtxTlsClient*>(
+                SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl)));
+        std::lock_guard<std::mutex> _l(thiz->mSessionMutex);
+        thiz->mSession.reset(session);
+        return 1; // takes ownership of session
     }
+
+    mutable std::mutex mSessionMutex;
+    bssl::UniquePtr<SSL_SESSION> mSession; // most recent session to resume
 };
 
 } // namespace
 
 std::unique_ptr<RpcTransportCtx> RpcTransportCtxFactoryTls::newServerCtx() const {
-    return android::RpcTransportCtxTls::create<RpcTransportCtxTlsServer>();
+    return android::RpcTransportCtxTls::create<RpcTransportCtxTlsServer>(mUseKernelTls);
 }
 
 std::unique_ptr<RpcTransportCtx> RpcTransportCtxFactoryTls::newClientCtx() const {
-    return android::RpcTransportCtxTls::create<RpcTransportCtxTlsClient>();
+    return android::RpcTransportCtxTls::create<RpcTransportCtxTlsClient>(mUseKernelTls);
 }
 
 const char* RpcTransportCtxFactoryTls::toCString() const {
-    return "tls";
+    return mUseKernelTls ? "ktls" : "tls";
 }
 
 std::unique_ptr<RpcTransportCtxFactory> RpcTransportCtxFactoryTls::make() {
-    return std::unique_ptr<RpcTransportCtxFactoryTls>(new RpcTransportCtxFactoryTls());
+    return make(false /*useKernelTls*/);
+}
+
+std::unique_ptr<RpcTransportCtxFactory> RpcTransportCtxFactoryTls::make(bool useKernelTls) {
+    return std::unique_ptr<RpcTransportCtxFactoryTls>(new RpcTransportCtxFactoryTls(useKernelTls));
 }
 
 } // namespace android
@@ -82,6 +82,21 @@ enum : uint32_t {
      * want to create a 'Parcel' object for every decref)
      */
     RPC_COMMAND_DEC_STRONG,
+    /**
+     * follows is RpcWireTaggedReply, in response to an RpcWireTransaction with
+     * RPC_WIRE_TRANSACTION_FLAG_TAGGED_REPLY
+     */
+    RPC_COMMAND_TAGGED_REPLY,
+};
+
+enum : uint32_t {
+    /**
+     * The sender does not wait for this reply specifically, but may have many
+     * transactions outstanding on this connection, so the reply is sent as
+     * RPC_COMMAND_TAGGED_REPLY carrying RpcWireTransaction::requestId. Ignored
+     * for oneway transactions.
+     */
+    RPC_WIRE_TRANSACTION_FLAG_TAGGED_REPLY = 0x1,
 };
 
 /**
@@ -113,7 +128,9 @@ struct RpcWireTransaction {
 
     uint64_t asyncNumber;
 
-    uint32_t reserved[4];
+    uint32_t rpcFlags; // RPC_WIRE_TRANSACTION_FLAG_*
+    uint32_t reserved;
+    uint64_t requestId; // for RPC_WIRE_TRANSACTION_FLAG_TAGGED_REPLY
 
     uint8_t data[0];
 };
@@ -123,6 +140,13 @@ struct RpcWireReply {
     uint8_t data[0];
 };
 
+struct RpcWireTaggedReply {
+    uint64_t requestId; // RpcWireTransaction::requestId
+    int32_t status;     // transact return
+    uint8_t reserved[4];
+    uint8_t data[0];
+};
+
 #pragma clang diagnostic pop
 
 } // namespace android
@@ -0,0 +1,241 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "ServiceRegistrationTable"
+
+#include <binder/ServiceRegistrationTable.h>
+
+#include <errno.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <new>
+
+#include <cutils/ashmem.h>
+#include <log/log.h>
+
+namespace android {
+
+using base::unique_fd;
+
+static constexpr uint32_t kMagic = 0x53524754; // 'SRGT'
+static constexpr uint32_t kVersion = 1;
+
+// Readers give up after this many attempts to get a consistent snapshot, so that a writer that
+// died in the middle of an update doesn't make lookups spin forever.
+static constexpr size_t kMaxReadAttempts = 64;
+
+namespace {
+
+struct TableHeader {
+    uint32_t magic;
+    uint32_t version;
+    // number of entries, a power of two
+    uint32_t capacity;
+    // odd while an update is in progress
+    std::atomic<uint32_t> sequence;
+    // set once a name did not fit in the table, after which misses are inconclusive
+    std::atomic<uint32_t> full;
+    uint32_t reserved;
+};
+
+struct TableEntry {
+    // hash of the name, 0 if the entry is unused. Entries are never freed, so that probe
+    // sequences stay intact.
+    std::atomic<uint64_t> hash;
+    std::atomic<uint32_t> generation;
+    // number of registered services whose names have this hash
+    std::atomic<uint32_t> count;
+};
+
+} // namespace
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free);
+static_assert(std::atomic<uint64_t>::is_always_lock_free);
+static_assert(sizeof(TableHeader) == 24);
+static_assert(sizeof(TableEntry) == 16);
+
+// FNV-1a, never returning 0 so that it can't be confused with an unused entry.
+static uint64_t hashName(std::string_view name) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (char c : name) {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 0x100000001b3ULL;
+    }
+    return hash == 0 ? 1 : hash;
+}
+
+static size_t tableSize(uint32_t capacity) {
+    return sizeof(TableHeader) + capacity * sizeof(TableEntry);
+}
+
+static TableEntry* tableEntries(void* base) {
+    return reinterpret_cast<TableEntry*>(static_cast<TableHeader*>(base) + 1);
+}
+
+ServiceRegistrationTable::ServiceRegistrationTable(unique_fd fd, void* base, size_t size,
+                                                   bool writable)
+      : mFd(std::move(fd)), mBase(base), mSize(size), mWritable(writable) {}
+
+ServiceRegistrationTable::~ServiceRegistrationTable() {
+    munmap(mBase, mSize);
+}
+
+std::unique_ptr<ServiceRegistrationTable> ServiceRegistrationTable::create(size_t capacity) {
+    // keep the load factor at or below 1/2 so that probe sequences stay short
+    uint32_t entries = 1;
+    while (entries < capacity * 2) entries <<= 1;
+
+    const size_t pageSize = getpagesize();
+    const size_t size = (tableSize(entries) + pageSize - 1) & ~(pageSize - 1);
+    unique_fd fd(ashmem_create_region("service registrations", size));
+    if (!fd.ok()) {
+        ALOGE("Failed to create ashmem region: %s", strerror(errno));
+        return nullptr;
+    }
+    void* base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd.get(), 0);
+    if (base == MAP_FAILED) {
+        ALOGE("Failed to map ashmem region: %s", strerror(errno));
+        return nullptr;
+    }
+    // existing mappings are not affected, so only we can write to the table
+    if (ashmem_set_prot_region(fd.get(), PROT_READ) != 0) {
+        ALOGE("Failed to make ashmem region read-only: %s", strerror(errno));
+        munmap(base, size);
+        return nullptr;
+    }
+
+    // ashmem regions start zero-filled, which is an empty table
+    TableHeader* header = new (base) TableHeader{};
+    header->magic = kMagic;
+    header->version = kVersion;
+    header->capacity = entries;
+    return std::unique_ptr<ServiceRegistrationTable>(
+            new ServiceRegistrationTable(std::move(fd), base, size, true /*writable*/));
+}
+
+std::unique_ptr<ServiceRegistrationTable> ServiceRegistrationTable::fromFd(unique_fd fd) {
+    const int size = ashmem_get_size_region(fd.get());
+    if (size < static_cast<int>(sizeof(TableHeader))) {
+        ALOGE("Invalid table size %d", size);
+        return nullptr;
+    }
+    void* base = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd.get(), 0);
+    if (base == MAP_FAILED) {
+        ALOGE("Failed to map table: %s", strerror(errno));
+        return nullptr;
+    }
+    const TableHeader* header = static_cast<const TableHeader*>(base);
+    const uint32_t capacity = header->capacity;
+    if (header->magic != kMagic || header->version != kVersion || capacity == 0 ||
+        (capacity & (capacity - 1)) != 0 || tableSize(capacity) > static_cast<size_t>(size)) {
+        ALOGE("Unrecognized table (magic 0x%x, version %u, capacity %u)", header->magic,
+              header->version, capacity);
+        munmap(base, size);
+        return nullptr;
+    }
+    return std::unique_ptr<ServiceRegistrationTable>(
+            new ServiceRegistrationTable(std::move(fd), base, size, false /*writable*/));
+}
+
+void ServiceRegistrationTable::add(std::string_view name) {
+    update(name, true /*added*/);
+}
+
+void ServiceRegistrationTable::remove(std::string_view name) {
+    update(name, false /*added*/);
+}
+
+void ServiceRegistrationTable::update(std::string_view name, bool added) {
+    LOG_ALWAYS_FATAL_IF(!mWritable, "Table is read-only");
+
+    TableHeader* header = static_cast<TableHeader*>(mBase);
+    const uint32_t mask = header->capacity - 1;
+    const uint64_t hash = hashName(name);
+
+    TableEntry* entry = nullptr;
+    for (uint32_t i = 0; i < header->capacity; i++) {
+        TableEntry* candidate = &tableEntries(mBase)[(hash + i) & mask];
+        uint64_t candidateHash = candidate->hash.load(std::memory_order_relaxed);
+        if (candidateHash == hash || candidateHash == 0) {
+            entry = candidate;
+            break;
+        }
+    }
+
+    const uint32_t sequence = header->sequence.load(std::memory_order_relaxed);
+    header->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    if (entry == nullptr) {
+        ALOGW("Table is full, lookups of unregistered names will need servicemanager");
+        header->full.store(1, std::memory_order_relaxed);
+    } else {
+        const uint32_t count = entry->count.load(std::memory_order_relaxed);
+        if (added || count > 0) {
+            entry->hash.store(hash, std::memory_order_relaxed);
+            entry->count.store(added ? count + 1 : count - 1, std::memory_order_relaxed);
+            entry->generation.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            ALOGE("Removing unregistered name %.*s", static_cast<int>(name.size()), name.data());
+        }
+    }
+
+    header->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+std::optional<ServiceRegistrationTable::Registration> ServiceRegistrationTable::lookup(
+        std::string_view name) const {
+    const TableHeader* header = static_cast<const TableHeader*>(mBase);
+    const uint32_t mask = header->capacity - 1;
+    const uint64_t hash = hashName(name);
+
+    for (size_t attempt = 0; attempt < kMaxReadAttempts; attempt++) {
+        const uint32_t sequence = header->sequence.load(std::memory_order_acquire);
+        if (sequence & 1) {
+            sched_yield();
+            continue;
+        }
+
+        std::optional<Registration> result;
+        for (uint32_t i = 0; i < header->capacity; i++) {
+            const TableEntry& entry = tableEntries(mBase)[(hash + i) & mask];
+            uint64_t entryHash = entry.hash.load(std::memory_order_relaxed);
+            if (entryHash == hash) {
+                result = Registration{
+                        .maybeRegistered = entry.count.load(std::memory_order_relaxed) != 0,
+                        .generation = entry.generation.load(std::memory_order_relaxed),
+                };
+                break;
+            }
+            if (entryHash == 0) break;
+        }
+        const bool full = header->full.load(std::memory_order_relaxed) != 0;
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (header->sequence.load(std::memory_order_relaxed) != sequence) continue;
+
+        if (result.has_value()) return result;
+        if (full) return std::nullopt;
+        return Registration{.maybeRegistered = false, .generation = 0};
+    }
+    return std::nullopt;
+}
+
+} // namespace android
@@ -22,8 +22,11 @@
 #include <utils/Mutex.h>
 #include <utils/threads.h>
 
+#include <atomic>
+#include <shared_mutex>
 #include <unordered_map>
 #include <variant>
+#include <vector>
 
 // ---------------------------------------------------------------------------
 namespace android {
@@ -90,6 +93,14 @@ public:
     static void         setLimitCallback(binder_proxy_limit_callback cb);
     static void         setBinderProxyCountWatermarks(int high, int low);
 
+    // When enabled, transactions to a kernel binder whose process accepts them
+    // carry a hash of the interface descriptor instead of the full string (see
+    // Parcel::writeInterfaceToken). Whether the remote process accepts them is
+    // learned from the reply fetched by getInterfaceDescriptor(); proxies which
+    // have not fetched their descriptor keep sending the full string. Disabled
+    // by default.
+    static void         setCompactInterfaceTokensEnabled(bool enable);
+
     std::optional<int32_t> getDebugBinderHandle() const;
 
     class ObjectManager {
@@ -109,12 +120,21 @@ public:
         ObjectManager& operator=(const ObjectManager&);
 
         struct entry_t {
+            const void* id;
             void* object;
             void* cleanupCookie;
             IBinder::object_cleanup_func func;
         };
 
-        KeyedVector<const void*, entry_t> mObjects;
+        entry_t* findEntry(const void* objectID);
+
+        // Binders rarely carry more than a few objects (e.g. the NDK's AIBinder association), so
+        // the first kInlineObjects are stored inline and found with a linear scan. Only further
+        // objects go to the heap.
+        static constexpr size_t kInlineObjects = 3;
+        entry_t mInlineObjects[kInlineObjects];
+        size_t mInlineCount = 0;
+        std::vector<entry_t> mOverflowObjects;
     };
 
     class PrivateAccessorForId {
@@ -132,6 +152,11 @@ public:
         const RpcAddress& rpcAddress() const { return mBinder->rpcAddress(); }
         const sp<RpcSession>& rpcSession() const { return mBinder->rpcSession(); }
 
+        // valid if !isRpcBinder
+        bool compactInterfaceTokenHash(uint64_t* outHash) const {
+            return mBinder->compactInterfaceTokenHash(outHash);
+        }
+
         const BpBinder* mBinder;
     };
     const PrivateAccessorForId getPrivateAccessorForId() const {
@@ -155,6 +180,11 @@ private:
     const RpcAddress& rpcAddress() const;
     const sp<RpcSession>& rpcSession() const;
 
+    // Returns true and sets *outHash to the hash of the remote interface
+    // descriptor if compact interface tokens can be sent to this binder.
+    bool compactInterfaceTokenHash(uint64_t* outHash) const;
+    void readCompactInterfaceTokenSupport(const String16& descriptor, const Parcel& reply) const;
+
     explicit BpBinder(Handle&& handle);
     BpBinder(BinderHandle&& handle, int32_t trackedUid);
     explicit BpBinder(RpcHandle&& handle);
@@ -186,13 +216,32 @@ private:
     mutable String16            mDescriptorCache;
             int32_t             mTrackedUid;
 
+    enum CompactTokenState : uint8_t {
+        COMPACT_TOKEN_UNKNOWN,
+        COMPACT_TOKEN_PENDING,
+        COMPACT_TOKEN_SUPPORTED,
+        COMPACT_TOKEN_UNSUPPORTED,
+    };
+    mutable std::atomic<uint8_t> mCompactTokenState;
+    // Written before mCompactTokenState becomes COMPACT_TOKEN_SUPPORTED.
+    mutable uint64_t            mDescriptorHash;
+
+    // Counts a new proxy created for uid. Returns false if the proxy must not be created.
+    static  bool                trackProxyCreate(int32_t uid);
+    static  void                trackProxyDestroy(int32_t uid);
+
+    // Guards sLimitCallback.
     static Mutex                                sTrackingLock;
-    static std::unordered_map<int32_t,uint32_t> sTrackingMap;
+    // Existing counters are updated atomically under a shared lock; the exclusive lock is only
+    // taken to add or remove the counter of a uid.
+    static std::shared_mutex                    sTrackingMapLock;
+    static std::unordered_map<int32_t,std::atomic<uint32_t>> sTrackingMap;
     static int                                  sNumTrackedUids;
     static std::atomic_bool                     sCountByUidEnabled;
+    static std::atomic_bool                     sCompactInterfaceTokensEnabled;
     static binder_proxy_limit_callback          sLimitCallback;
-    static uint32_t                             sBinderProxyCountHighWatermark;
-    static uint32_t                             sBinderProxyCountLowWatermark;
+    static std::atomic<uint32_t>                sBinderProxyCountHighWatermark;
+    static std::atomic<uint32_t>                sBinderProxyCountLowWatermark;
     static bool                                 sBinderProxyThrottleCreate;
 };
 
@@ -21,6 +21,9 @@
 #include <binder/ProcessState.h>
 #include <utils/Vector.h>
 
+#include <memory>
+#include <vector>
+
 #if defined(_WIN32)
 typedef  int  uid_t;
 #endif
@@ -151,6 +154,26 @@ public:
                                          uint32_t code, const Parcel& data,
                                          Parcel* reply, uint32_t flags);
 
+            // Oneway batching. Between beginOnewayBatch() and the matching
+            // endOnewayBatch(), oneway transactions made from this thread are
+            // queued in mOut and sent to the driver together, so that a burst of
+            // N oneway calls costs one ioctl (plus one per kMaxOnewayBatchSize
+            // calls) instead of N. Calls nest; only the outermost
+            // endOnewayBatch() sends the queue. A synchronous transaction made
+            // while a batch is open sends the queued calls first, so ordering
+            // with respect to the same thread is unchanged.
+            //
+            // Since queued calls have not reached the driver yet, transact()
+            // returns NO_ERROR for them; errors are reported by the call that
+            // sends the queue (the first error wins). When a synchronous
+            // transaction sends it, the error is kept and reported by the
+            // outermost endOnewayBatch() instead, so that the synchronous call
+            // only reports its own result.
+            void                beginOnewayBatch();
+            // Sends the queued oneway transactions, leaving the batch open.
+            status_t            flushOnewayBatch();
+            status_t            endOnewayBatch();
+
             void                incStrongHandle(int32_t handle, BpBinder *proxy);
             void                decStrongHandle(int32_t handle);
             void                incWeakHandle(int32_t handle, BpBinder *proxy);
@@ -206,6 +229,10 @@ private:
                                                      uint32_t code,
                                                      const Parcel& data,
                                                      status_t* statusBuffer);
+            status_t            queueOnewayTransaction(int32_t handle,
+                                                       uint32_t code,
+                                                       const Parcel& data,
+                                                       uint32_t flags);
             status_t            getAndExecuteCommand();
             status_t            executeCommand(int32_t command);
             void                processPendingDerefs();
@@ -241,6 +268,16 @@ private:
             int32_t             mStrictModePolicy;
             int32_t             mLastTransactionBinderFlags;
             CallRestriction     mCallRestriction;
+
+            // Flush threshold for an open oneway batch.
+            static constexpr size_t kMaxOnewayBatchSize = 64;
+            int32_t             mOnewayBatchDepth;
+            // First error from queued calls sent ahead of a synchronous
+            // transaction, reported by endOnewayBatch().
+            status_t            mOnewayBatchError;
+            // BC_TRANSACTION commands in mOut point into these copies of the
+            // queued oneway transactions' data, so they must outlive the flush.
+            std::vector<std::unique_ptr<Parcel>> mOnewayBatch;
 };
 
 } // namespace android
@@ -109,12 +109,16 @@ public:
     // markForBinder or markForRpc).
     bool isForRpc() const;
 
-    // Writes the IPC/RPC header.
+    // Writes the IPC/RPC header. If the Parcel was marked for a binder which
+    // accepts compact interface tokens (see
+    // BpBinder::setCompactInterfaceTokensEnabled) and the interface matches
+    // its descriptor, a hash of the interface is written instead of its name.
     status_t            writeInterfaceToken(const String16& interface);
     status_t            writeInterfaceToken(const char16_t* str, size_t len);
 
-    // Parses the RPC header, returning true if the interface name
-    // in the header matches the expected interface from the caller.
+    // Parses the RPC header, returning true if the interface name (or, for
+    // compact interface tokens, its hash) in the header matches the expected
+    // interface from the caller.
     //
     // Additionally, enforceInterface does part of the work of
     // propagating the StrictMode policy mask, populating the current
@@ -1142,6 +1146,11 @@ private:
 
     sp<RpcSession> mSession;
 
+    // Set by markForBinder() when the target accepts compact interface tokens,
+    // along with the hash of its interface descriptor.
+    bool mCompactInterfaceToken;
+    uint64_t mCompactInterfaceTokenHash;
+
     class Blob {
     public:
         Blob();
@@ -25,6 +25,8 @@
 
 #include <pthread.h>
 
+#include <vector>
+
 // ---------------------------------------------------------------------------
 namespace android {
 
@@ -109,7 +111,18 @@ private:
         RefBase::weakref_type* refs;
     };
 
-    handle_entry* lookupHandleLocked(int32_t handle);
+    // Handles are spread over shards by their low bits, so that processes receiving binders
+    // from many threads don't serialize every unparcel on one lock. Entry i of a shard holds
+    // handle i * kHandleShardCount + <shard index>.
+    static constexpr size_t kHandleShardCount = 16;
+    struct alignas(64) HandleShard {
+        Mutex lock; // protects entries.
+        std::vector<handle_entry> entries;
+    };
+
+    HandleShard& handleShard(int32_t handle);
+    // The lock of shard, which must be handleShard(handle), must be held.
+    handle_entry* lookupHandleLocked(HandleShard& shard, int32_t handle);
 
     String8 mDriverName;
     int mDriverFD;
@@ -128,9 +141,9 @@ private:
     // Time when thread pool was emptied
     int64_t mStarvationStartTimeMs;
 
-    mutable Mutex mLock; // protects everything below.
+    HandleShard mHandleShards[kHandleShardCount];
 
-    Vector<handle_entry> mHandleToObject;
+    mutable Mutex mLock; // protects everything below.
 
     bool mThreadPoolStarted;
     volatile int32_t mThreadPoolSeq;
@@ -22,6 +22,8 @@
 #include <utils/Errors.h>
 #include <utils/RefBase.h>
 
+#include <chrono>
+#include <functional>
 #include <map>
 #include <optional>
 #include <thread>
@@ -131,6 +133,25 @@ public:
      */
     status_t getRemoteMaxThreads(size_t* maxThreads);
 
+    struct OutgoingConnectionStats {
+        // Synchronous and oneway transactions sent over this connection.
+        uint64_t transactions;
+        uint64_t asyncTransactions;
+        // Moving average of how long synchronous transactions held the connection.
+        std::chrono::nanoseconds averageLatency;
+        bool inUse;
+    };
+
+    /**
+     * For debugging!
+     *
+     * Returns the stats of each outgoing connection. Client sessions start
+     * with a single outgoing connection and open more when all of them are in
+     * use, up to the maximum number of threads of the other side (see
+     * getRemoteMaxThreads).
+     */
+    std::vector<OutgoingConnectionStats> getOutgoingConnectionStats();
+
     /**
      * See RpcTransportCtx::getCertificate
      */
@@ -154,6 +175,37 @@ public:
 
     [[nodiscard]] status_t transact(const sp<IBinder>& binder, uint32_t code, const Parcel& data,
                                     Parcel* reply, uint32_t flags);
+
+    /**
+     * Called with the result of transactAsync. |reply| is only valid during
+     * the call, and only has data if |status| is OK.
+     */
+    using TransactCallback = std::function<void(status_t status, Parcel* reply)>;
+
+    /**
+     * Sends a synchronous transaction without waiting for its reply, so that a
+     * few threads can keep many transactions in flight. These transactions
+     * are multiplexed over a single outgoing connection and tagged with a
+     * request ID. The other side processes them in order.
+     *
+     * |callback| is called on whichever thread reads the reply: a later call
+     * to transactAsync (which picks up replies that have already arrived, and
+     * waits for one if kMaxPendingAsyncTransactions are pending) or
+     * waitForAsyncReplies, or any other call on this session that has to
+     * share the connection. If this returns OK, |callback| is called exactly
+     * once, with an error if the session fails first.
+     */
+    [[nodiscard]] status_t transactAsync(const sp<IBinder>& binder, uint32_t code,
+                                         const Parcel& data, TransactCallback callback);
+
+    /**
+     * Reads replies to transactAsync until at most |maxPending| are left,
+     * calling their callbacks on this thread.
+     */
+    [[nodiscard]] status_t waitForAsyncReplies(size_t maxPending = 0);
+
+    static constexpr size_t kMaxPendingAsyncTransactions = 32;
+
     [[nodiscard]] status_t sendDecStrong(const RpcAddress& address);
 
     ~RpcSession();
@@ -198,6 +250,20 @@ private:
         std::optional<pid_t> exclusiveTid;
 
         bool allowNested = false;
+
+        // For outgoing connections, guarded by RpcSession::mMutex.
+        uint64_t transactions = 0;
+        uint64_t asyncTransactions = 0;
+        // Oneway transactions sent since the last synchronous one completed.
+        // The thread on the other side may still be busy with them.
+        size_t asyncBacklog = 0;
+        std::chrono::nanoseconds averageLatency{0};
+
+        // Callbacks of transactAsync calls waiting for a reply on this
+        // connection, by request ID. Only used by the thread with exclusive
+        // access to the connection.
+        std::map<uint64_t, TransactCallback> pendingReplies;
+        uint64_t nextRequestId = 0;
     };
 
     status_t readId();
@@ -221,9 +287,10 @@ private:
     // join on thread passed to preJoinThreadOwnership
     static void join(sp<RpcSession>&& session, PreJoinSetupResult&& result);
 
-    [[nodiscard]] status_t setupClient(
-            const std::function<status_t(const RpcAddress& sessionId, bool incoming)>&
-                    connectAndInit);
+    using ConnectAndInit = std::function<status_t(const RpcAddress& sessionId, bool incoming)>;
+    // connectAndInit is kept to open more outgoing connections later, so it
+    // must not reference any stack data.
+    [[nodiscard]] status_t setupClient(ConnectAndInit connectAndInit);
     [[nodiscard]] status_t setupSocketClient(const RpcSocketAddress& address);
     [[nodiscard]] status_t setupOneSocketConnection(const RpcSocketAddress& address,
                                                     const RpcAddress& sessionId, bool incoming);
@@ -245,6 +312,7 @@ private:
         CLIENT,
         CLIENT_ASYNC,
         CLIENT_REFCOUNT,
+        CLIENT_PIPELINED,
     };
 
     // Object representing exclusive access to a connection.
@@ -257,10 +325,12 @@ private:
         const sp<RpcConnection>& get() { return mConnection; }
 
     private:
-        static void findConnection(pid_t tid, sp<RpcConnection>* exclusive,
+        // Finds the connection used by tid and, if available is set, the free
+        // connection best suited for use, falling back to pipelined.
+        static void findConnection(pid_t tid, ConnectionUse use, sp<RpcConnection>* exclusive,
                                    sp<RpcConnection>* available,
                                    std::vector<sp<RpcConnection>>& sockets,
-                                   size_t socketsIndexHint);
+                                   const sp<RpcConnection>& pipelined);
 
         sp<RpcSession> mSession; // avoid deallocation
         sp<RpcConnection> mConnection;
@@ -269,6 +339,10 @@ private:
         // thread guarantees we won't write in the middle of a message, the way
         // the wire protocol is constructed guarantees this is safe).
         bool mReentrant = false;
+
+        // for the connection stats, if !mReentrant
+        ConnectionUse mUse = ConnectionUse::CLIENT;
+        std::chrono::steady_clock::time_point mStart;
     };
 
     const std::unique_ptr<RpcTransportCtx> mCtx;
@@ -304,9 +378,17 @@ private:
 
     std::condition_variable mAvailableConnectionCv; // for mWaitingThreads
     size_t mWaitingThreads = 0;
-    // hint index into clients, ++ when sending an async transaction
-    size_t mOutgoingConnectionsOffset = 0;
     std::vector<sp<RpcConnection>> mOutgoingConnections;
+    // For client sessions, opens another outgoing connection. At most
+    // mMaxOutgoingConnections are opened, one at a time.
+    ConnectAndInit mConnectOutgoing;
+    size_t mMaxOutgoingConnections = 0;
+    bool mOpeningOutgoingConnection = false;
+    // The outgoing connection transactAsync is using, while it has pending
+    // replies. Other uses prefer another connection, since the other side is
+    // busy with the pending transactions in order, and otherwise read those
+    // replies before their own.
+    sp<RpcConnection> mPipelinedConnection;
     size_t mMaxIncomingConnections = 0;
     std::vector<sp<RpcConnection>> mIncomingConnections;
     std::map<std::thread::id, std::thread> mThreads;
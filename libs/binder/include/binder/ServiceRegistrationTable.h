@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <android-base/unique_fd.h>
+
+#include <memory>
+#include <optional>
+#include <string_view>
+
+namespace android {
+
+/**
+ * Table of the service names registered with servicemanager, kept in shared memory.
+ *
+ * servicemanager creates the table and updates it as services come and go. Clients map it
+ * read-only so that they can find out that a name is not registered without a binder
+ * transaction. Names are stored as 64-bit hashes, so a lookup may report a name that is not
+ * registered as possibly registered, but never the other way around.
+ *
+ * Updates are sequence-locked: readers retry if they race with the writer, and give up (returning
+ * std::nullopt) if the writer appears to be stuck.
+ */
+class ServiceRegistrationTable {
+public:
+    struct Registration {
+        // False if no service with this name is registered.
+        bool maybeRegistered;
+        // Incremented every time a service with this name (or a colliding name) is added or
+        // removed. Zero if the name was never seen.
+        uint32_t generation;
+    };
+
+    /**
+     * Creates a writable table with room for at least capacity distinct names. Returns nullptr on
+     * error.
+     */
+    static std::unique_ptr<ServiceRegistrationTable> create(size_t capacity);
+
+    /**
+     * Maps a table created by create() in another process. Returns nullptr if fd does not refer
+     * to a compatible table.
+     */
+    static std::unique_ptr<ServiceRegistrationTable> fromFd(base::unique_fd fd);
+
+    ~ServiceRegistrationTable();
+
+    /**
+     * The file descriptor of the shared memory region, to be sent to clients. The region is
+     * read-only for anyone other than the creator.
+     */
+    const base::unique_fd& fd() const { return mFd; }
+
+    /**
+     * Records that a service called name was added or removed. Only valid on tables returned by
+     * create(), and must not be called concurrently.
+     */
+    void add(std::string_view name);
+    void remove(std::string_view name);
+
+    /**
+     * Returns the registration state of name, or std::nullopt if the table can't tell (because
+     * it ran out of space, or a concurrent update didn't finish).
+     */
+    std::optional<Registration> lookup(std::string_view name) const;
+
+private:
+    ServiceRegistrationTable(base::unique_fd fd, void* base, size_t size, bool writable);
+
+    void update(std::string_view name, bool added);
+
+    base::unique_fd mFd;
+    void* mBase;
+    size_t mSize;
+    bool mWritable;
+};
+
+} // namespace android
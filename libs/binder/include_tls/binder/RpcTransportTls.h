@@ -27,12 +27,19 @@ class RpcTransportCtxFactoryTls : public RpcTransportCtxFactory {
 public:
     static std::unique_ptr<RpcTransportCtxFactory> make();
 
+    // If |useKernelTls|, connections hand record encryption over to the kernel (kTLS) after the
+    // handshake, and on the server side decryption too. This only applies to TCP sockets with
+    // AES-GCM ciphers. Other connections are handled by BoringSSL as usual.
+    static std::unique_ptr<RpcTransportCtxFactory> make(bool useKernelTls);
+
     std::unique_ptr<RpcTransportCtx> newServerCtx() const override;
     std::unique_ptr<RpcTransportCtx> newClientCtx() const override;
     const char* toCString() const override;
 
 private:
-    RpcTransportCtxFactoryTls() = default;
+    explicit RpcTransportCtxFactoryTls(bool useKernelTls) : mUseKernelTls(useKernelTls) {}
+
+    bool mUseKernelTls;
 };
 
 } // namespace android
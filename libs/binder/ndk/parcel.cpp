@@ -68,18 +68,31 @@ static binder_status_t WriteAndValidateArraySize(AParcel* parcel, bool isNullArr
     return STATUS_OK;
 }
 
-static binder_status_t ReadAndValidateArraySize(const AParcel* parcel, int32_t* length) {
+// minElementSize is the least number of bytes an element can take up in the parcel, so that a
+// corrupt length is rejected before the caller's allocator is asked for a huge array.
+static binder_status_t ReadAndValidateArraySize(const AParcel* parcel, int32_t* length,
+                                                size_t minElementSize = 1) {
     if (status_t status = parcel->get()->readInt32(length); status != STATUS_OK) {
         return PruneStatusT(status);
     }
 
     if (*length < -1) return STATUS_BAD_VALUE;  // libbinder_ndk reserves these
     if (*length <= 0) return STATUS_OK;         // null
-    if (static_cast<size_t>(*length) > parcel->get()->dataAvail()) return STATUS_NO_MEMORY;
+    if (static_cast<size_t>(*length) > parcel->get()->dataAvail() / minElementSize) {
+        return STATUS_NO_MEMORY;
+    }
 
     return STATUS_OK;
 }
 
+// Reads length elements which are each written as an int32_t (char16_t and bool) with a single
+// bounds check. Returns nullptr if the parcel is too short.
+static const int32_t* ReadInt32ElementsInplace(const Parcel* rawParcel, int32_t length) {
+    int32_t size = 0;
+    if (__builtin_smul_overflow(sizeof(int32_t), length, &size)) return nullptr;
+    return static_cast<const int32_t*>(rawParcel->readInplace(size));
+}
+
 template <typename T>
 binder_status_t WriteArray(AParcel* parcel, const T* array, int32_t length) {
     binder_status_t status = WriteAndValidateArraySize(parcel, array == nullptr, length);
@@ -124,7 +137,8 @@ binder_status_t ReadArray(const AParcel* parcel, void* arrayData,
     const Parcel* rawParcel = parcel->get();
 
     int32_t length;
-    if (binder_status_t status = ReadAndValidateArraySize(parcel, &length); status != STATUS_OK) {
+    if (binder_status_t status = ReadAndValidateArraySize(parcel, &length, sizeof(T));
+        status != STATUS_OK) {
         return status;
     }
 
@@ -152,7 +166,8 @@ binder_status_t ReadArray<char16_t>(const AParcel* parcel, void* arrayData,
     const Parcel* rawParcel = parcel->get();
 
     int32_t length;
-    if (binder_status_t status = ReadAndValidateArraySize(parcel, &length); status != STATUS_OK) {
+    if (binder_status_t status = ReadAndValidateArraySize(parcel, &length, sizeof(int32_t));
+        status != STATUS_OK) {
         return status;
     }
 
@@ -162,13 +177,11 @@ binder_status_t ReadArray<char16_t>(const AParcel* parcel, void* arrayData,
     if (length <= 0) return STATUS_OK;
     if (array == nullptr) return STATUS_NO_MEMORY;
 
-    int32_t size = 0;
-    if (__builtin_smul_overflow(sizeof(char16_t), length, &size)) return STATUS_NO_MEMORY;
+    const int32_t* data = ReadInt32ElementsInplace(rawParcel, length);
+    if (data == nullptr) return STATUS_NO_MEMORY;
 
     for (int32_t i = 0; i < length; i++) {
-        status_t status = rawParcel->readChar(array + i);
-
-        if (status != STATUS_OK) return PruneStatusT(status);
+        array[i] = static_cast<char16_t>(data[i]);
     }
 
     return STATUS_OK;
@@ -194,13 +207,14 @@ binder_status_t WriteArray(AParcel* parcel, const void* arrayData, int32_t lengt
     return STATUS_OK;
 }
 
-template <typename T>
-binder_status_t ReadArray(const AParcel* parcel, void* arrayData, ArrayAllocator<T> allocator,
-                          ArraySetter<T> setter, status_t (Parcel::*read)(T*) const) {
+// Each element in a bool array is converted to an int32_t (not packed)
+static binder_status_t ReadBoolArray(const AParcel* parcel, void* arrayData,
+                                     ArrayAllocator<bool> allocator, ArraySetter<bool> setter) {
     const Parcel* rawParcel = parcel->get();
 
     int32_t length;
-    if (binder_status_t status = ReadAndValidateArraySize(parcel, &length); status != STATUS_OK) {
+    if (binder_status_t status = ReadAndValidateArraySize(parcel, &length, sizeof(int32_t));
+        status != STATUS_OK) {
         return status;
     }
 
@@ -208,17 +222,23 @@ binder_status_t ReadArray(const AParcel* parcel, void* arrayData, ArrayAllocator
 
     if (length <= 0) return STATUS_OK;
 
-    for (int32_t i = 0; i < length; i++) {
-        T readTarget;
-        status_t status = (rawParcel->*read)(&readTarget);
-        if (status != STATUS_OK) return PruneStatusT(status);
+    const int32_t* data = ReadInt32ElementsInplace(rawParcel, length);
+    if (data == nullptr) return STATUS_NO_MEMORY;
 
-        setter(arrayData, i, readTarget);
+    for (int32_t i = 0; i < length; i++) {
+        setter(arrayData, i, data[i] != 0);
     }
 
     return STATUS_OK;
 }
 
+// Returns true if str16 can be converted to UTF-8 by narrowing each character.
+static bool IsAscii(const char16_t* str16, size_t len16) {
+    char16_t bits = 0;
+    for (size_t i = 0; i < len16; i++) bits |= str16[i];
+    return bits < 0x80;
+}
+
 void AParcel_delete(AParcel* parcel) {
     delete parcel;
 }
@@ -350,9 +370,12 @@ binder_status_t AParcel_readString(const AParcel* parcel, void* stringData,
     }
 
     ssize_t len8;
+    // Most strings sent over binder are ASCII, which skips a pass over the string to measure the
+    // UTF-8 length and the full conversion below.
+    const bool ascii = IsAscii(str16, len16);
 
-    if (len16 == 0) {
-        len8 = 1;
+    if (ascii) {
+        len8 = len16 + 1;
     } else {
         len8 = utf16_to_utf8_length(str16, len16) + 1;
     }
@@ -370,7 +393,12 @@ binder_status_t AParcel_readString(const AParcel* parcel, void* stringData,
         return STATUS_NO_MEMORY;
     }
 
-    utf16_to_utf8(str16, len16, str8, len8);
+    if (ascii) {
+        for (size_t i = 0; i < len16; i++) str8[i] = static_cast<char>(str16[i]);
+        str8[len16] = '\0';
+    } else {
+        utf16_to_utf8(str16, len16, str8, len8);
+    }
 
     return STATUS_OK;
 }
@@ -412,8 +440,10 @@ struct StringArrayElementAllocationAdapter {
 binder_status_t AParcel_readStringArray(const AParcel* parcel, void* arrayData,
                                         AParcel_stringArrayAllocator allocator,
                                         AParcel_stringArrayElementAllocator elementAllocator) {
+    // Every element takes at least its int32_t length (-1 for null strings).
     int32_t length;
-    if (binder_status_t status = ReadAndValidateArraySize(parcel, &length); status != STATUS_OK) {
+    if (binder_status_t status = ReadAndValidateArraySize(parcel, &length, sizeof(int32_t));
+        status != STATUS_OK) {
         return status;
     }
 
@@ -638,7 +668,7 @@ binder_status_t AParcel_readDoubleArray(const AParcel* parcel, void* arrayData,
 binder_status_t AParcel_readBoolArray(const AParcel* parcel, void* arrayData,
                                       AParcel_boolArrayAllocator allocator,
                                       AParcel_boolArraySetter setter) {
-    return ReadArray<bool>(parcel, arrayData, allocator, setter, &Parcel::readBool);
+    return ReadBoolArray(parcel, arrayData, allocator, setter);
 }
 
 binder_status_t AParcel_readCharArray(const AParcel* parcel, void* arrayData,
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <android/binder_auto_utils.h>
+#include <android/binder_ibinder.h>
+#include <android/binder_libbinder.h>
+#include <android/binder_parcel_utils.h>
+#include <benchmark/benchmark.h>
+#include <binder/Binder.h>
+
+#include <string>
+#include <vector>
+
+// Usage: atest libbinder_ndk_benchmark
+
+using android::BBinder;
+using android::IBinder;
+using android::sp;
+
+// Attaches count objects other than the NDK's own association to binder, as other users of the
+// same binder (e.g. libbinder's interface cache) would.
+static void attachOtherObjects(const sp<IBinder>& binder, int64_t count) {
+    static char sIds[16];
+    for (int64_t i = 0; i < count; i++) {
+        (void)binder->attachObject(&sIds[i], nullptr, nullptr, nullptr);
+    }
+}
+
+// Wrapping a binder which already has an NDK proxy, as services do for every incoming binder
+// from a client they keep track of. This finds the existing association.
+static void BM_wrapKnownBinder(benchmark::State& state) {
+    sp<IBinder> binder = sp<BBinder>::make();
+    attachOtherObjects(binder, state.range(0));
+    AIBinder* held = AIBinder_fromPlatformBinder(binder);
+
+    for (auto _ : state) {
+        AIBinder* wrapped = AIBinder_fromPlatformBinder(binder);
+        benchmark::DoNotOptimize(wrapped);
+        AIBinder_decStrong(wrapped);
+    }
+
+    AIBinder_decStrong(held);
+}
+BENCHMARK(BM_wrapKnownBinder)->Arg(0)->Arg(2)->Arg(8);
+
+// Wrapping binders seen for the first time, which attaches the association.
+static void BM_wrapNewBinder(benchmark::State& state) {
+    for (auto _ : state) {
+        state.PauseTiming();
+        sp<IBinder> binder = sp<BBinder>::make();
+        attachOtherObjects(binder, state.range(0));
+        state.ResumeTiming();
+
+        AIBinder* wrapped = AIBinder_fromPlatformBinder(binder);
+        benchmark::DoNotOptimize(wrapped);
+        AIBinder_decStrong(wrapped);
+    }
+}
+BENCHMARK(BM_wrapNewBinder)->Arg(0)->Arg(2)->Arg(8);
+
+// Round trip of an NDK binder through the platform type, as in code mixing both APIs.
+static void BM_platformRoundTrip(benchmark::State& state) {
+    sp<IBinder> binder = sp<BBinder>::make();
+    AIBinder* held = AIBinder_fromPlatformBinder(binder);
+
+    for (auto _ : state) {
+        sp<IBinder> platform = AIBinder_toPlatformBinder(held);
+        AIBinder* wrapped = AIBinder_fromPlatformBinder(platform);
+        benchmark::DoNotOptimize(wrapped);
+        AIBinder_decStrong(wrapped);
+    }
+
+    AIBinder_decStrong(held);
+}
+BENCHMARK(BM_platformRoundTrip);
+
+// Reads back a vector written to a parcel, as the AIDL NDK backend does for array arguments.
+template <typename T>
+static void readVector(benchmark::State& state, const std::vector<T>& vec) {
+    ndk::ScopedAParcel parcel(AParcel_create());
+    if (::ndk::AParcel_writeVector(parcel.get(), vec) != STATUS_OK) {
+        state.SkipWithError("Failed to write vector");
+        return;
+    }
+
+    for (auto _ : state) {
+        AParcel_setDataPosition(parcel.get(), 0);
+        std::vector<T> read;
+        if (::ndk::AParcel_readVector(parcel.get(), &read) != STATUS_OK) {
+            state.SkipWithError("Failed to read vector");
+            return;
+        }
+        benchmark::DoNotOptimize(read);
+    }
+    state.SetItemsProcessed(state.iterations() * vec.size());
+}
+
+static void BM_readInt32Array(benchmark::State& state) {
+    readVector(state, std::vector<int32_t>(state.range(0), 42));
+}
+BENCHMARK(BM_readInt32Array)->Arg(16)->Arg(1024)->Arg(65536);
+
+static void BM_readCharArray(benchmark::State& state) {
+    readVector(state, std::vector<char16_t>(state.range(0), u'a'));
+}
+BENCHMARK(BM_readCharArray)->Arg(16)->Arg(1024)->Arg(65536);
+
+static void BM_readBoolArray(benchmark::State& state) {
+    readVector(state, std::vector<bool>(state.range(0), true));
+}
+BENCHMARK(BM_readBoolArray)->Arg(16)->Arg(1024)->Arg(65536);
+
+static void BM_readStringArray(benchmark::State& state) {
+    readVector(state, std::vector<std::string>(state.range(0), "android.hardware.example"));
+}
+BENCHMARK(BM_readStringArray)->Arg(16)->Arg(1024);
+
+static void BM_readNonAsciiStringArray(benchmark::State& state) {
+    readVector(state, std::vector<std::string>(state.range(0), "\u00e9t\u00e9 \u2603"));
+}
+BENCHMARK(BM_readNonAsciiStringArray)->Arg(16)->Arg(1024);
+
+BENCHMARK_MAIN();
@@ -680,6 +680,40 @@ TEST(NdkBinder, GetClassInterfaceDescriptor) {
     ASSERT_STREQ(IFoo::kIFooDescriptor, AIBinder_Class_getDescriptor(IFoo::kClass));
 }
 
+template <typename T>
+static void expectVectorRoundTrip(const std::vector<T>& vec) {
+    ndk::ScopedAParcel parcel(AParcel_create());
+    ASSERT_EQ(STATUS_OK, ::ndk::AParcel_writeVector(parcel.get(), vec));
+    ASSERT_EQ(STATUS_OK, AParcel_setDataPosition(parcel.get(), 0));
+    std::vector<T> read;
+    ASSERT_EQ(STATUS_OK, ::ndk::AParcel_readVector(parcel.get(), &read));
+    EXPECT_EQ(vec, read);
+}
+
+TEST(NdkBinder, ParcelArraysRoundTrip) {
+    expectVectorRoundTrip(std::vector<int32_t>{1, -2, 3});
+    expectVectorRoundTrip(std::vector<uint8_t>{1, 2, 3, 4, 5});
+    expectVectorRoundTrip(std::vector<char16_t>{u'a', u'\u00e9', u'\u2603'});
+    expectVectorRoundTrip(std::vector<bool>{true, false, true});
+    expectVectorRoundTrip(std::vector<std::string>{"", "ascii", "\u00e9t\u00e9 \u2603"});
+}
+
+TEST(NdkBinder, ParcelArrayWithCorruptLengthIsRejected) {
+    ndk::ScopedAParcel parcel(AParcel_create());
+    // Claims more elements than the parcel can hold, even at one int32_t each.
+    ASSERT_EQ(STATUS_OK, AParcel_writeInt32(parcel.get(), 3));
+    ASSERT_EQ(STATUS_OK, AParcel_writeInt32(parcel.get(), 1));
+    ASSERT_EQ(STATUS_OK, AParcel_writeInt32(parcel.get(), 1));
+    ASSERT_EQ(STATUS_OK, AParcel_setDataPosition(parcel.get(), 0));
+    std::vector<bool> bools;
+    EXPECT_EQ(STATUS_NO_MEMORY, ::ndk::AParcel_readVector(parcel.get(), &bools));
+
+    ASSERT_EQ(STATUS_OK, AParcel_setDataPosition(parcel.get(), 0));
+    std::vector<std::string> strings;
+    EXPECT_EQ(STATUS_NO_MEMORY, ::ndk::AParcel_readVector(parcel.get(), &strings));
+    EXPECT_TRUE(strings.empty());
+}
+
 int main(int argc, char* argv[]) {
     ::testing::InitGoogleTest(&argc, argv);
 
@@ -41,3 +41,37 @@ TEST(Binder, DetachObject) {
     EXPECT_EQ(kObject1, binder->detachObject(kObjectId1));
     EXPECT_EQ(nullptr, binder->attachObject(kObjectId1, kObject2, nullptr, nullptr));
 }
+
+TEST(Binder, AttachManyObjects) {
+    // More objects than the ObjectManager keeps inline.
+    constexpr uintptr_t kCount = 8;
+    auto binder = sp<BBinder>::make();
+    for (uintptr_t i = 1; i <= kCount; i++) {
+        EXPECT_EQ(nullptr,
+                  binder->attachObject(reinterpret_cast<const void*>(i),
+                                       reinterpret_cast<void*>(100 + i), nullptr, nullptr));
+    }
+    // Detaching from the inline slots moves later objects around.
+    EXPECT_EQ(reinterpret_cast<void*>(101), binder->detachObject(reinterpret_cast<const void*>(1)));
+    EXPECT_EQ(reinterpret_cast<void*>(102), binder->detachObject(reinterpret_cast<const void*>(2)));
+    EXPECT_EQ(nullptr, binder->findObject(reinterpret_cast<const void*>(1)));
+    for (uintptr_t i = 3; i <= kCount; i++) {
+        EXPECT_EQ(reinterpret_cast<void*>(100 + i),
+                  binder->findObject(reinterpret_cast<const void*>(i)));
+    }
+}
+
+TEST(Binder, CleanupAttachedObjects) {
+    static int sCleanups = 0;
+    auto cleanup = [](const void*, void*, void*) { sCleanups++; };
+    {
+        auto binder = sp<BBinder>::make();
+        for (uintptr_t i = 1; i <= 5; i++) {
+            EXPECT_EQ(nullptr,
+                      binder->attachObject(reinterpret_cast<const void*>(i), nullptr, nullptr,
+                                           cleanup));
+        }
+        EXPECT_EQ(nullptr, binder->detachObject(reinterpret_cast<const void*>(2)));
+    }
+    EXPECT_EQ(4, sCleanups);
+}
@@ -21,7 +21,10 @@
 #include <stdlib.h>
 
 #include <chrono>
+#include <condition_variable>
 #include <fstream>
+#include <mutex>
+#include <numeric>
 #include <thread>
 
 #include <gmock/gmock.h>
@@ -114,6 +117,9 @@ enum BinderLibTestTranscationCode {
     BINDER_LIB_TEST_ECHO_VECTOR,
     BINDER_LIB_TEST_REJECT_BUF,
     BINDER_LIB_TEST_CAN_GET_SID,
+    BINDER_LIB_TEST_CHECK_INTERFACE_TRANSACTION,
+    BINDER_LIB_TEST_RECORD_TRANSACTION,
+    BINDER_LIB_TEST_GET_RECORDED_TRANSACTION,
 };
 
 pid_t start_server_process(int arg2, bool usePoll = false)
@@ -991,6 +997,130 @@ TEST_F(BinderLibTest, WorkSourceUnsetByDefault)
     EXPECT_EQ(NO_ERROR, ret);
 }
 
+TEST_F(BinderLibTest, CompactInterfaceToken) {
+    // a fresh proxy, which has not fetched its descriptor yet
+    sp<IBinder> server = addServer();
+    ASSERT_TRUE(server != nullptr);
+
+    Parcel full;
+    full.markForBinder(server);
+    full.writeInterfaceToken(binderLibTestServiceName);
+
+    BpBinder::setCompactInterfaceTokensEnabled(true);
+
+    // writing a transaction never asks for the descriptor itself
+    Parcel beforeDescriptor;
+    beforeDescriptor.markForBinder(server);
+    beforeDescriptor.writeInterfaceToken(binderLibTestServiceName);
+    EXPECT_EQ(full.dataSize(), beforeDescriptor.dataSize());
+
+    EXPECT_EQ(binderLibTestServiceName, server->getInterfaceDescriptor());
+
+    for (const String16& interface : {binderLibTestServiceName, String16("wrong.interface")}) {
+        Parcel data, reply;
+        data.markForBinder(server);
+        data.writeInterfaceToken(interface);
+        if (interface == binderLibTestServiceName) {
+            EXPECT_LT(data.dataSize(), full.dataSize());
+        }
+        data.writeInt32(42);
+        EXPECT_THAT(server->transact(BINDER_LIB_TEST_CHECK_INTERFACE_TRANSACTION, data, &reply),
+                    StatusEq(NO_ERROR));
+        EXPECT_EQ(interface == binderLibTestServiceName, reply.readBool());
+        EXPECT_EQ(42, reply.readInt32());
+    }
+    BpBinder::setCompactInterfaceTokensEnabled(false);
+}
+
+TEST_F(BinderLibTest, OnewayBatchKeepsOrder) {
+    sp<IBinder> server = addServer();
+    ASSERT_TRUE(server != nullptr);
+    constexpr int32_t kNumCalls = 100; // more than one flush threshold
+
+    IPCThreadState::self()->beginOnewayBatch();
+    for (int32_t i = 0; i < kNumCalls; i++) {
+        Parcel data, reply;
+        data.writeInt32(i);
+        EXPECT_THAT(server->transact(BINDER_LIB_TEST_RECORD_TRANSACTION, data, &reply, TF_ONE_WAY),
+                    StatusEq(NO_ERROR));
+    }
+    EXPECT_THAT(IPCThreadState::self()->endOnewayBatch(), StatusEq(NO_ERROR));
+
+    Parcel data, reply;
+    data.writeInt32(kNumCalls);
+    EXPECT_THAT(server->transact(BINDER_LIB_TEST_GET_RECORDED_TRANSACTION, data, &reply),
+                StatusEq(NO_ERROR));
+    std::vector<int32_t> recorded;
+    EXPECT_THAT(reply.readInt32Vector(&recorded), StatusEq(NO_ERROR));
+    std::vector<int32_t> expected(kNumCalls);
+    std::iota(expected.begin(), expected.end(), 0);
+    EXPECT_EQ(expected, recorded);
+}
+
+TEST_F(BinderLibTest, OnewayBatchFlushedBySyncCall) {
+    sp<IBinder> server = addServer();
+    ASSERT_TRUE(server != nullptr);
+
+    IPCThreadState::self()->beginOnewayBatch();
+    for (int32_t i = 0; i < 3; i++) {
+        Parcel data, reply;
+        data.writeInt32(i);
+        EXPECT_THAT(server->transact(BINDER_LIB_TEST_RECORD_TRANSACTION, data, &reply, TF_ONE_WAY),
+                    StatusEq(NO_ERROR));
+    }
+    {
+        // the batch is still open, so the queued calls only arrive if this sends them
+        Parcel data, reply;
+        data.writeInt32(3);
+        EXPECT_THAT(server->transact(BINDER_LIB_TEST_GET_RECORDED_TRANSACTION, data, &reply),
+                    StatusEq(NO_ERROR));
+        std::vector<int32_t> recorded;
+        EXPECT_THAT(reply.readInt32Vector(&recorded), StatusEq(NO_ERROR));
+        EXPECT_EQ((std::vector<int32_t>{0, 1, 2}), recorded);
+    }
+    EXPECT_THAT(IPCThreadState::self()->endOnewayBatch(), StatusEq(NO_ERROR));
+}
+
+TEST_F(BinderLibTest, OnewayBatchReportsErrorOfQueuedCall) {
+    sp<TestDeathRecipient> testDeathRecipient = new TestDeathRecipient();
+    sp<IBinder> deadServer = addServer();
+    ASSERT_TRUE(deadServer != nullptr);
+    EXPECT_THAT(deadServer->linkToDeath(testDeathRecipient), StatusEq(NO_ERROR));
+    {
+        Parcel data, reply;
+        EXPECT_THAT(deadServer->transact(BINDER_LIB_TEST_EXIT_TRANSACTION, data, &reply,
+                                         TF_ONE_WAY),
+                    StatusEq(OK));
+    }
+    IPCThreadState::self()->flushCommands();
+    EXPECT_THAT(testDeathRecipient->waitEvent(5), StatusEq(NO_ERROR));
+
+    // The proxy knows its binder died and would fail the call right away, so
+    // go to the driver directly.
+    std::optional<int32_t> deadHandle = deadServer->remoteBinder()->getDebugBinderHandle();
+    ASSERT_TRUE(deadHandle.has_value());
+
+    IPCThreadState::self()->beginOnewayBatch();
+    {
+        // queued, so the failure is not known yet
+        Parcel data;
+        EXPECT_THAT(IPCThreadState::self()->transact(*deadHandle, BINDER_LIB_TEST_NOP_TRANSACTION,
+                                                     data, nullptr, TF_ONE_WAY),
+                    StatusEq(NO_ERROR));
+    }
+    {
+        // sends the queue, but only reports its own result
+        Parcel data, reply;
+        EXPECT_THAT(m_server->transact(BINDER_LIB_TEST_NOP_TRANSACTION, data, &reply),
+                    StatusEq(NO_ERROR));
+    }
+    EXPECT_THAT(IPCThreadState::self()->endOnewayBatch(), StatusEq(DEAD_OBJECT));
+
+    // the error is only reported once
+    IPCThreadState::self()->beginOnewayBatch();
+    EXPECT_THAT(IPCThreadState::self()->endOnewayBatch(), StatusEq(NO_ERROR));
+}
+
 TEST_F(BinderLibTest, WorkSourceSet)
 {
     status_t ret;
@@ -1270,6 +1400,8 @@ public:
         if (m_exitOnDestroy) exit(EXIT_SUCCESS);
     }
 
+    const String16& getInterfaceDescriptor() const override { return binderLibTestServiceName; }
+
     void processPendingCall() {
         if (m_callback != nullptr) {
             Parcel data;
@@ -1569,6 +1701,28 @@ public:
             case BINDER_LIB_TEST_CAN_GET_SID: {
                 return IPCThreadState::self()->getCallingSid() == nullptr ? BAD_VALUE : NO_ERROR;
             }
+            case BINDER_LIB_TEST_CHECK_INTERFACE_TRANSACTION: {
+                reply->writeBool(data.enforceInterface(binderLibTestServiceName));
+                reply->writeInt32(data.readInt32());
+                return NO_ERROR;
+            }
+            case BINDER_LIB_TEST_RECORD_TRANSACTION: {
+                std::lock_guard<std::mutex> lock(m_recordedMutex);
+                m_recorded.push_back(data.readInt32());
+                m_recordedCond.notify_all();
+                return NO_ERROR;
+            }
+            case BINDER_LIB_TEST_GET_RECORDED_TRANSACTION: {
+                // oneway calls are still being processed when this arrives
+                size_t count = static_cast<size_t>(data.readInt32());
+                std::unique_lock<std::mutex> lock(m_recordedMutex);
+                m_recordedCond.wait_for(lock, 5s, [&] { return m_recorded.size() >= count; });
+                reply->writeInt32Vector(m_recorded);
+                m_recorded.clear();
+                return NO_ERROR;
+            }
+            case INTERFACE_TRANSACTION:
+                return BBinder::onTransact(code, data, reply, flags);
             default:
                 return UNKNOWN_TRANSACTION;
         };
@@ -1584,6 +1738,9 @@ private:
     sp<IBinder> m_strongRef;
     sp<IBinder> m_callback;
     bool m_exitOnDestroy;
+    std::mutex m_recordedMutex;
+    std::condition_variable m_recordedCond;
+    std::vector<int32_t> m_recorded;
 };
 
 int run_server(int index, int readypipefd, bool usePoll)
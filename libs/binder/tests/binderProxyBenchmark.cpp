@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <android-base/logging.h>
+#include <benchmark/benchmark.h>
+#include <binder/Binder.h>
+#include <binder/BpBinder.h>
+#include <binder/IPCThreadState.h>
+#include <binder/IServiceManager.h>
+#include <binder/Parcel.h>
+#include <binder/ProcessState.h>
+
+#include <vector>
+
+#include <signal.h>
+#include <sys/prctl.h>
+#include <unistd.h>
+
+// Usage: atest binderProxyBenchmark
+//
+// Unparcels many binder objects from several threads at once, which is what processes
+// receiving binders from many clients spend their time on in ProcessState and BpBinder.
+
+using android::BBinder;
+using android::BpBinder;
+using android::defaultServiceManager;
+using android::IBinder;
+using android::IPCThreadState;
+using android::OK;
+using android::Parcel;
+using android::ProcessState;
+using android::sp;
+using android::status_t;
+using android::String16;
+
+static const String16 kServiceName("binderProxyBenchmark");
+static constexpr size_t kMaxBinders = 1024;
+
+// Replies to GET_BINDERS with the requested number of binders out of a fixed set, so that the
+// client looks up the same handles over and over.
+class BinderFactory : public BBinder {
+public:
+    enum { GET_BINDERS = IBinder::FIRST_CALL_TRANSACTION };
+
+    BinderFactory() {
+        for (size_t i = 0; i < kMaxBinders; i++) mBinders.push_back(sp<BBinder>::make());
+    }
+
+    status_t onTransact(uint32_t code, const Parcel& data, Parcel* reply,
+                        uint32_t flags) override {
+        if (code != GET_BINDERS) return BBinder::onTransact(code, data, reply, flags);
+        const int32_t count = data.readInt32();
+        if (count < 0 || static_cast<size_t>(count) > kMaxBinders) return android::BAD_VALUE;
+        for (int32_t i = 0; i < count; i++) {
+            status_t status = reply->writeStrongBinder(mBinders[i]);
+            if (status != OK) return status;
+        }
+        return OK;
+    }
+
+private:
+    std::vector<sp<IBinder>> mBinders;
+};
+
+static sp<IBinder> gFactory;
+
+static void BM_unparcelBinders(benchmark::State& state) {
+    const int32_t count = state.range(0);
+    Parcel data;
+    data.writeInt32(count);
+
+    // Keep the proxies alive across iterations, as a service holding on to its clients would.
+    std::vector<sp<IBinder>> binders(count);
+    while (state.KeepRunning()) {
+        Parcel reply;
+        CHECK_EQ(OK, gFactory->transact(BinderFactory::GET_BINDERS, data, &reply));
+        for (int32_t i = 0; i < count; i++) {
+            CHECK_EQ(OK, reply.readStrongBinder(&binders[i]));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_unparcelBinders)->Arg(64)->Arg(1024)->ThreadRange(1, 8)->UseRealTime();
+
+// Same as above, with per-uid proxy counting enabled as in system_server.
+static void BM_unparcelBindersCountByUid(benchmark::State& state) {
+    if (state.thread_index == 0) BpBinder::enableCountByUid();
+    BM_unparcelBinders(state);
+    if (state.thread_index == 0) BpBinder::disableCountByUid();
+}
+BENCHMARK(BM_unparcelBindersCountByUid)->Arg(1024)->ThreadRange(1, 8)->UseRealTime();
+
+int main(int argc, char** argv) {
+    ::benchmark::Initialize(&argc, argv);
+    if (::benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+
+    if (0 == fork()) {
+        prctl(PR_SET_PDEATHSIG, SIGHUP); // racey, okay
+        CHECK_EQ(OK, defaultServiceManager()->addService(kServiceName,
+                                                         sp<BinderFactory>::make()));
+        ProcessState::self()->setThreadPoolMaxThreadCount(8);
+        ProcessState::self()->startThreadPool();
+        IPCThreadState::self()->joinThreadPool();
+        exit(1);
+    }
+
+    gFactory = defaultServiceManager()->waitForService(kServiceName);
+    CHECK_NE(nullptr, gFactory.get());
+
+    ::benchmark::RunSpecifiedBenchmarks();
+    return 0;
+}
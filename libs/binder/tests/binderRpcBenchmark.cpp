@@ -23,8 +23,11 @@
 #include <binder/ProcessState.h>
 #include <binder/RpcServer.h>
 #include <binder/RpcSession.h>
+#include <binder/RpcTransportTls.h>
 
+#include <functional>
 #include <thread>
+#include <vector>
 
 #include <signal.h>
 #include <sys/prctl.h>
@@ -38,9 +41,11 @@ using android::interface_cast;
 using android::IPCThreadState;
 using android::IServiceManager;
 using android::OK;
+using android::Parcel;
 using android::ProcessState;
 using android::RpcServer;
 using android::RpcSession;
+using android::RpcTransportCtxFactoryTls;
 using android::sp;
 using android::status_t;
 using android::statusToString;
@@ -65,15 +70,23 @@ class MyBinderRpcBenchmark : public BnBinderRpcBenchmark {
 enum Transport {
     KERNEL,
     RPC,
+    RPC_TLS,
+    // TLS over TCP with record encryption done by the kernel where supported
+    RPC_KTLS,
 };
 
 static const std::initializer_list<int64_t> kTransportList = {
 #ifdef __BIONIC__
         Transport::KERNEL,
 #endif
-        Transport::RPC};
+        Transport::RPC, Transport::RPC_TLS, Transport::RPC_KTLS};
 
 static sp<RpcSession> gSession = RpcSession::make();
+static sp<RpcSession> gTlsSession =
+        RpcSession::make(RpcTransportCtxFactoryTls::make(), std::nullopt, std::nullopt);
+static sp<RpcSession> gKtlsSession =
+        RpcSession::make(RpcTransportCtxFactoryTls::make(true /*useKernelTls*/), std::nullopt,
+                         std::nullopt);
 #ifdef __BIONIC__
 static const String16 kKernelBinderInstance = String16(u"binderRpcBenchmark-control");
 static sp<IBinder> gKernelBinder;
@@ -88,6 +101,10 @@ static sp<IBinder> getBinderForOptions(benchmark::State& state) {
 #endif
         case RPC:
             return gSession->getRootObject();
+        case RPC_TLS:
+            return gTlsSession->getRootObject();
+        case RPC_KTLS:
+            return gKtlsSession->getRootObject();
         default:
             LOG(FATAL) << "Unknown transport value: " << transport;
             return nullptr;
@@ -103,6 +120,24 @@ void BM_pingTransaction(benchmark::State& state) {
 }
 BENCHMARK(BM_pingTransaction)->ArgsProduct({kTransportList});
 
+// Keeps up to state.range(0) pings in flight over a single RPC connection,
+// using RpcSession::transactAsync.
+void BM_pingTransactionPipelined(benchmark::State& state) {
+    size_t depth = state.range(0);
+    sp<IBinder> binder = gSession->getRootObject();
+
+    Parcel data;
+    data.markForBinder(binder);
+    auto onReply = [](status_t status, Parcel*) { CHECK_EQ(OK, status); };
+
+    while (state.KeepRunning()) {
+        CHECK_EQ(OK, gSession->transactAsync(binder, IBinder::PING_TRANSACTION, data, onReply));
+        CHECK_EQ(OK, gSession->waitForAsyncReplies(depth - 1));
+    }
+    CHECK_EQ(OK, gSession->waitForAsyncReplies());
+}
+BENCHMARK(BM_pingTransactionPipelined)->Arg(1)->Arg(4)->Arg(16)->Arg(32);
+
 void BM_repeatTwoPageString(benchmark::State& state) {
     sp<IBinder> binder = getBinderForOptions(state);
 
@@ -179,6 +214,13 @@ int main(int argc, char** argv) {
     std::cerr << "Tests suffixes:" << std::endl;
     std::cerr << "\t.../" << Transport::KERNEL << " is KERNEL" << std::endl;
     std::cerr << "\t.../" << Transport::RPC << " is RPC" << std::endl;
+    std::cerr << "\t.../" << Transport::RPC_TLS << " is RPC_TLS" << std::endl;
+    std::cerr << "\t.../" << Transport::RPC_KTLS << " is RPC_KTLS" << std::endl;
+
+    std::string tlsAddr = addr + "Tls";
+    (void)unlink(tlsAddr.c_str());
+    int ktlsPipe[2];
+    CHECK_EQ(0, pipe(ktlsPipe));
 
     if (0 == fork()) {
         prctl(PR_SET_PDEATHSIG, SIGHUP); // racey, okay
@@ -190,6 +232,30 @@ int main(int argc, char** argv) {
         exit(1);
     }
 
+    if (0 == fork()) {
+        prctl(PR_SET_PDEATHSIG, SIGHUP); // racey, okay
+        sp<RpcServer> server = RpcServer::make(RpcTransportCtxFactoryTls::make());
+        server->setRootObject(sp<MyBinderRpcBenchmark>::make());
+        server->iUnderstandThisCodeIsExperimentalAndIWillNotUseItInProduction();
+        CHECK_EQ(OK, server->setupUnixDomainServer(tlsAddr.c_str()));
+        server->join();
+        exit(1);
+    }
+
+    if (0 == fork()) {
+        prctl(PR_SET_PDEATHSIG, SIGHUP); // racey, okay
+        sp<RpcServer> server = RpcServer::make(RpcTransportCtxFactoryTls::make(true));
+        server->setRootObject(sp<MyBinderRpcBenchmark>::make());
+        server->iUnderstandThisCodeIsExperimentalAndIWillNotUseItInProduction();
+        unsigned int port;
+        CHECK_EQ(OK, server->setupInetServer("127.0.0.1", 0, &port));
+        CHECK_EQ(static_cast<ssize_t>(sizeof(port)), write(ktlsPipe[1], &port, sizeof(port)));
+        server->join();
+        exit(1);
+    }
+    unsigned int ktlsPort;
+    CHECK_EQ(static_cast<ssize_t>(sizeof(ktlsPort)), read(ktlsPipe[0], &ktlsPort, sizeof(ktlsPort)));
+
 #ifdef __BIONIC__
     if (0 == fork()) {
         prctl(PR_SET_PDEATHSIG, SIGHUP); // racey, okay
@@ -207,14 +273,20 @@ int main(int argc, char** argv) {
     CHECK_NE(nullptr, gKernelBinder.get());
 #endif
 
-    status_t status;
-    for (size_t tries = 0; tries < 5; tries++) {
-        usleep(10000);
-        status = gSession->setupUnixDomainClient(addr.c_str());
-        if (status == OK) goto success;
+    std::vector<std::function<status_t()>> setups = {
+            [&] { return gSession->setupUnixDomainClient(addr.c_str()); },
+            [&] { return gTlsSession->setupUnixDomainClient(tlsAddr.c_str()); },
+            [&] { return gKtlsSession->setupInetClient("127.0.0.1", ktlsPort); },
+    };
+    for (const auto& setup : setups) {
+        status_t status;
+        for (size_t tries = 0; tries < 5; tries++) {
+            usleep(10000);
+            status = setup();
+            if (status == OK) break;
+        }
+        CHECK_EQ(OK, status) << "Could not connect: " << statusToString(status).c_str();
     }
-    LOG(FATAL) << "Could not connect: " << statusToString(status).c_str();
-success:
 
     ::benchmark::RunSpecifiedBenchmarks();
     return 0;
@@ -55,10 +55,10 @@ static_assert(RPC_WIRE_PROTOCOL_VERSION + 1 == RPC_WIRE_PROTOCOL_VERSION_NEXT ||
               RPC_WIRE_PROTOCOL_VERSION == RPC_WIRE_PROTOCOL_VERSION_EXPERIMENTAL);
 const char* kLocalInetAddress = "127.0.0.1";
 
-enum class RpcSecurity { RAW, TLS };
+enum class RpcSecurity { RAW, TLS, KTLS };
 
 static inline std::vector<RpcSecurity> RpcSecurityValues() {
-    return {RpcSecurity::RAW, RpcSecurity::TLS};
+    return {RpcSecurity::RAW, RpcSecurity::TLS, RpcSecurity::KTLS};
 }
 
 static inline std::unique_ptr<RpcTransportCtxFactory> newFactory(RpcSecurity rpcSecurity) {
@@ -67,6 +67,8 @@ static inline std::unique_ptr<RpcTransportCtxFactory> newFactory(RpcSecurity rpc
             return RpcTransportCtxFactoryRaw::make();
         case RpcSecurity::TLS:
             return RpcTransportCtxFactoryTls::make();
+        case RpcSecurity::KTLS:
+            return RpcTransportCtxFactoryTls::make(true /*useKernelTls*/);
         default:
             LOG_ALWAYS_FATAL("Unknown RpcSecurity %d", rpcSecurity);
     }
@@ -936,6 +938,165 @@ TEST_P(BinderRpc, ThreadPoolOverSaturated) {
     EXPECT_LE(epochMsAfter, epochMsBefore + 3 * kSleepMs);
 }
 
+TEST_P(BinderRpc, OutgoingConnectionsOpenedOnDemand) {
+    constexpr size_t kNumThreads = 3;
+
+    auto proc = createRpcTestSocketServerProcess({.numThreads = kNumThreads});
+    const sp<RpcSession>& session = proc.proc.sessions.at(0).session;
+    EXPECT_EQ(1u, session->getOutgoingConnectionStats().size());
+
+    EXPECT_OK(proc.rootIface->lock());
+
+    // each blocked call needs its own connection
+    std::vector<std::thread> ts;
+    for (size_t i = 0; i < kNumThreads - 1; i++) {
+        ts.push_back(std::thread([&] { EXPECT_OK(proc.rootIface->lockUnlock()); }));
+    }
+
+    usleep(100000); // give chance for calls on other threads
+
+    // the last thread on the other side is still reachable
+    EXPECT_EQ(OK, proc.rootBinder->pingBinder());
+    EXPECT_OK(proc.rootIface->unlockInMsAsync(0));
+
+    for (auto& t : ts) t.join();
+
+    auto stats = session->getOutgoingConnectionStats();
+    ASSERT_EQ(kNumThreads, stats.size());
+    uint64_t transactions = 0;
+    for (const auto& connection : stats) {
+        EXPECT_FALSE(connection.inUse);
+        transactions += connection.transactions;
+    }
+    EXPECT_GE(transactions, kNumThreads + 1);
+}
+
+TEST_P(BinderRpc, TransactAsync) {
+    constexpr size_t kNumCalls = 3 * RpcSession::kMaxPendingAsyncTransactions;
+
+    auto proc = createRpcTestSocketServerProcess({});
+    const sp<RpcSession>& session = proc.proc.sessions.at(0).session;
+
+    std::vector<std::string> results(kNumCalls);
+    size_t numReplies = 0;
+    for (size_t i = 0; i < kNumCalls; i++) {
+        Parcel data;
+        data.markForBinder(proc.rootBinder);
+        ASSERT_EQ(OK, data.writeInterfaceToken(IBinderRpcTest::descriptor));
+        ASSERT_EQ(OK, data.writeUtf8AsUtf16(std::to_string(i)));
+        ASSERT_EQ(OK,
+                  session->transactAsync(proc.rootBinder,
+                                         BnBinderRpcTest::TRANSACTION_doubleString, data,
+                                         [&, i](status_t status, Parcel* reply) {
+                                             ASSERT_EQ(OK, status);
+                                             Status ret;
+                                             ASSERT_EQ(OK, ret.readFromParcel(*reply));
+                                             EXPECT_TRUE(ret.isOk()) << ret;
+                                             EXPECT_EQ(OK, reply->readUtf8FromUtf16(&results[i]));
+                                             numReplies++;
+                                         }));
+    }
+    // some replies are already read while sending
+    EXPECT_GT(numReplies, 0u);
+
+    EXPECT_EQ(OK, session->waitForAsyncReplies());
+    EXPECT_EQ(kNumCalls, numReplies);
+    for (size_t i = 0; i < kNumCalls; i++) {
+        EXPECT_EQ(std::to_string(i) + std::to_string(i), results[i]);
+    }
+
+    // the connection is free for synchronous calls again
+    EXPECT_EQ(OK, proc.rootBinder->pingBinder());
+    EXPECT_EQ(1u, session->getOutgoingConnectionStats().size());
+}
+
+TEST_P(BinderRpc, SyncCallSharesPipelinedConnection) {
+    constexpr size_t kNumCalls = 3;
+
+    auto proc = createRpcTestSocketServerProcess({.numThreads = 1});
+    const sp<RpcSession>& session = proc.proc.sessions.at(0).session;
+    ASSERT_EQ(1u, session->getOutgoingConnectionStats().size());
+
+    size_t numReplies = 0;
+    for (size_t i = 0; i < kNumCalls; i++) {
+        Parcel data;
+        data.markForBinder(proc.rootBinder);
+        ASSERT_EQ(OK, data.writeInterfaceToken(IBinderRpcTest::descriptor));
+        ASSERT_EQ(OK, data.writeUtf8AsUtf16(std::to_string(i)));
+        ASSERT_EQ(OK,
+                  session->transactAsync(proc.rootBinder,
+                                         BnBinderRpcTest::TRANSACTION_doubleString, data,
+                                         [&](status_t status, Parcel*) {
+                                             EXPECT_EQ(OK, status);
+                                             numReplies++;
+                                         }));
+    }
+
+    // there is no other connection to use, so these read the pending replies
+    // before their own instead of waiting for waitForAsyncReplies
+    EXPECT_EQ(OK, proc.rootBinder->pingBinder());
+    EXPECT_EQ(kNumCalls, numReplies);
+    sp<IBinder> out;
+    EXPECT_OK(proc.rootIface->repeatBinder(proc.rootBinder, &out));
+    EXPECT_EQ(proc.rootBinder, out);
+
+    EXPECT_EQ(OK, session->waitForAsyncReplies());
+    EXPECT_EQ(1u, session->getOutgoingConnectionStats().size());
+}
+
+TEST_P(BinderRpc, SyncCallAfterOnewayOpensConnection) {
+    constexpr size_t kSleepMs = 500;
+
+    auto proc = createRpcTestSocketServerProcess({.numThreads = 2});
+    const sp<RpcSession>& session = proc.proc.sessions.at(0).session;
+    ASSERT_EQ(1u, session->getOutgoingConnectionStats().size());
+
+    // the other side is still processing this when the next call is made
+    EXPECT_OK(proc.rootIface->sleepMsAsync(kSleepMs));
+
+    size_t epochMsBefore = epochMillis();
+    EXPECT_EQ(OK, proc.rootBinder->pingBinder());
+    size_t epochMsAfter = epochMillis();
+
+    // the sync call did not queue up behind the oneway call
+    EXPECT_LT(epochMsAfter, epochMsBefore + kSleepMs);
+
+    auto stats = session->getOutgoingConnectionStats();
+    ASSERT_EQ(2u, stats.size());
+    EXPECT_EQ(1u, stats[0].asyncTransactions + stats[1].asyncTransactions);
+}
+
+TEST_P(BinderRpc, AlternatingOnewayAndSyncCallsUseSeparateConnections) {
+    constexpr size_t kNumCalls = 10;
+    constexpr size_t kSleepMs = 50;
+
+    auto proc = createRpcTestSocketServerProcess({.numThreads = 4});
+    const sp<RpcSession>& session = proc.proc.sessions.at(0).session;
+
+    for (size_t i = 0; i < kNumCalls; i++) {
+        // oneway calls to the same binder are processed one after another, so
+        // the other side falls further behind with each of these
+        EXPECT_OK(proc.rootIface->sleepMsAsync(kSleepMs));
+
+        size_t epochMsBefore = epochMillis();
+        EXPECT_EQ(OK, proc.rootBinder->pingBinder());
+        size_t epochMsAfter = epochMillis();
+
+        // the sync call did not land on a connection with a backlog
+        EXPECT_LT(epochMsAfter, epochMsBefore + kSleepMs) << "call " << i;
+    }
+
+    // one connection for the oneway calls and one for the rest, rather than a
+    // new one for each sync call after a oneway call
+    auto stats = session->getOutgoingConnectionStats();
+    ASSERT_EQ(2u, stats.size());
+    const auto& async = stats[0].asyncTransactions > 0 ? stats[0] : stats[1];
+    const auto& sync = stats[0].asyncTransactions > 0 ? stats[1] : stats[0];
+    EXPECT_EQ(kNumCalls, async.asyncTransactions);
+    EXPECT_EQ(0u, sync.asyncTransactions);
+    EXPECT_GE(sync.transactions, kNumCalls);
+}
+
 TEST_P(BinderRpc, ThreadingStressTest) {
     constexpr size_t kNumClientThreads = 10;
     constexpr size_t kNumServerThreads = 10;
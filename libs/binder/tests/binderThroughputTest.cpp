@@ -181,6 +181,7 @@ void worker_fx(int num,
                int iterations,
                int payload_size,
                bool cs_pair,
+               int oneway_batch,
                Pipe p)
 {
     // Create BinderWorkerService and for go.
@@ -210,6 +211,10 @@ void worker_fx(int num,
     // Run the benchmark if client
     ProcResults results;
     chrono::time_point<chrono::high_resolution_clock> start, end;
+    // oneway_batch < 0 makes synchronous calls, 0 unbatched oneway calls, and N > 0 oneway
+    // calls batched N at a time by IPCThreadState.
+    IPCThreadState* ipc = IPCThreadState::self();
+    uint32_t flags = oneway_batch >= 0 ? IBinder::FLAG_ONEWAY : 0;
     for (int i = 0; (!cs_pair || num >= server_count) && i < iterations; i++) {
         Parcel data, reply;
         int target = cs_pair ? num % server_count : rand() % workers.size();
@@ -219,8 +224,16 @@ void worker_fx(int num,
             data.writeInt32(0);
             sz -= sizeof(uint32_t);
         }
+        bool batch_start = oneway_batch > 0 && i % oneway_batch == 0;
+        bool batch_end = oneway_batch > 0 &&
+                (i % oneway_batch == oneway_batch - 1 || i == iterations - 1);
         start = chrono::high_resolution_clock::now();
-        status_t ret = workers[target]->transact(BINDER_NOP, data, &reply);
+        if (batch_start) ipc->beginOnewayBatch();
+        status_t ret = workers[target]->transact(BINDER_NOP, data, &reply, flags);
+        if (batch_end) {
+            status_t batch_ret = ipc->endOnewayBatch();
+            if (ret == NO_ERROR) ret = batch_ret;
+        }
         end = chrono::high_resolution_clock::now();
 
         uint64_t cur_time = uint64_t(chrono::duration_cast<chrono::nanoseconds>(end - start).count());
@@ -243,7 +256,8 @@ void worker_fx(int num,
     exit(EXIT_SUCCESS);
 }
 
-Pipe make_worker(int num, int iterations, int worker_count, int payload_size, bool cs_pair)
+Pipe make_worker(int num, int iterations, int worker_count, int payload_size, bool cs_pair,
+                 int oneway_batch)
 {
     auto pipe_pair = Pipe::createPipePair();
     pid_t pid = fork();
@@ -252,7 +266,8 @@ Pipe make_worker(int num, int iterations, int worker_count, int payload_size, bo
         return move(get<0>(pipe_pair));
     } else {
         /* child */
-        worker_fx(num, worker_count, iterations, payload_size, cs_pair, move(get<1>(pipe_pair)));
+        worker_fx(num, worker_count, iterations, payload_size, cs_pair, oneway_batch,
+                  move(get<1>(pipe_pair)));
         /* never get here */
         return move(get<0>(pipe_pair));
     }
@@ -277,12 +292,14 @@ void run_main(int iterations,
               int workers,
               int payload_size,
               int cs_pair,
+              int oneway_batch,
               bool training_round=false)
 {
     vector<Pipe> pipes;
     // Create all the workers and wait for them to spawn.
     for (int i = 0; i < workers; i++) {
-        pipes.push_back(make_worker(i, iterations, workers, payload_size, cs_pair));
+        pipes.push_back(make_worker(i, iterations, workers, payload_size, cs_pair,
+                                    oneway_batch));
     }
     wait_all(pipes);
 
@@ -336,6 +353,7 @@ int main(int argc, char *argv[])
     int payload_size = 0;
     bool cs_pair = false;
     bool training_round = false;
+    int oneway_batch = -1;
     (void)argc;
     (void)argv;
 
@@ -343,8 +361,10 @@ int main(int argc, char *argv[])
     for (int i = 1; i < argc; i++) {
         if (string(argv[i]) == "--help") {
             cout << "Usage: binderThroughputTest [OPTIONS]" << endl;
+            cout << "\t-b N    : Make oneway calls, batched N at a time." << endl;
             cout << "\t-i N    : Specify number of iterations." << endl;
             cout << "\t-m N    : Specify expected max latency in microseconds." << endl;
+            cout << "\t-o      : Make oneway calls." << endl;
             cout << "\t-p      : Split workers into client/server pairs." << endl;
             cout << "\t-s N    : Specify payload size." << endl;
             cout << "\t-t N    : Run training round." << endl;
@@ -365,6 +385,20 @@ int main(int argc, char *argv[])
             payload_size = atoi(argv[i+1]);
             i++;
         }
+        if (string(argv[i]) == "-o") {
+            if (oneway_batch < 0) oneway_batch = 0;
+        }
+        if (string(argv[i]) == "-b") {
+            // Oneway calls return once the driver has queued them, so the
+            // latencies reported in this mode only cover the sending side.
+            if (atoi(argv[i+1]) > 0) {
+                oneway_batch = atoi(argv[i+1]);
+                i++;
+            } else {
+                cout << "Batch size -b must be positive." << endl;
+                exit(EXIT_FAILURE);
+            }
+        }
         if (string(argv[i]) == "-p") {
             // client/server pairs instead of spreading
             // requests to all workers. If true, half
@@ -392,10 +426,10 @@ int main(int argc, char *argv[])
 
     if (training_round) {
         cout << "Start training round" << endl;
-        run_main(iterations, workers, payload_size, cs_pair, training_round=true);
+        run_main(iterations, workers, payload_size, cs_pair, oneway_batch, training_round=true);
         cout << "Completed training round" << endl << endl;
     }
 
-    run_main(iterations, workers, payload_size, cs_pair);
+    run_main(iterations, workers, payload_size, cs_pair, oneway_batch);
     return 0;
 }
@@ -15,17 +15,27 @@
  */
 
 #include <android-base/logging.h>
-#include <android-base/parseint.h>
 #include <android-base/strings.h>
+#include <android-base/unique_fd.h>
 #include <binder/Binder.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <string.h>
 #include <sys/types.h>
-#include <fstream>
-#include <regex>
+#include <unistd.h>
+#include <charconv>
+#include <optional>
+#include <set>
 
 #include <binderdebug/BinderDebug.h>
 
 namespace android {
 
+using base::unique_fd;
+
+// Binder logs are read in chunks of this size. Lines longer than this grow the buffer.
+static constexpr size_t kReadChunkSize = 64 * 1024;
+
 static std::string contextToString(BinderDebugContext context) {
     switch (context) {
         case BinderDebugContext::BINDER:
@@ -39,138 +49,255 @@ static std::string contextToString(BinderDebugContext context) {
     }
 }
 
-static status_t scanBinderContext(pid_t pid, const std::string& contextName,
-                                  std::function<void(const std::string&)> eachLine) {
-    std::ifstream ifs("/dev/binderfs/binder_logs/proc/" + std::to_string(pid));
-    if (!ifs.is_open()) {
-        ifs.open("/d/binder/proc/" + std::to_string(pid));
-        if (!ifs.is_open()) {
-            return -errno;
+static unique_fd openBinderLog(const std::string& name) {
+    unique_fd fd(TEMP_FAILURE_RETRY(
+            open(("/dev/binderfs/binder_logs/" + name).c_str(), O_RDONLY | O_CLOEXEC)));
+    if (!fd.ok()) {
+        fd.reset(TEMP_FAILURE_RETRY(open(("/d/binder/" + name).c_str(), O_RDONLY | O_CLOEXEC)));
+    }
+    return fd;
+}
+
+// Calls eachLine with every line of contents, without the trailing newline.
+template <typename F>
+static void forEachLine(std::string_view contents, F& eachLine) {
+    while (!contents.empty()) {
+        size_t end = contents.find('\n');
+        if (end == std::string_view::npos) {
+            eachLine(contents);
+            return;
         }
+        eachLine(contents.substr(0, end));
+        contents.remove_prefix(end + 1);
     }
-    static const std::regex kContextLine("^context (\\w+)$");
+}
 
-    bool isDesiredContext = false;
-    std::string line;
-    std::smatch match;
-    while (getline(ifs, line)) {
-        if (std::regex_search(line, match, kContextLine)) {
-            isDesiredContext = match.str(1) == contextName;
-            continue;
+// Like forEachLine, for the contents of fd. The lines passed to eachLine are only valid for the
+// duration of the call.
+template <typename F>
+static status_t forEachLineInFile(const unique_fd& fd, F& eachLine) {
+    // Reused across calls, since binder logs are typically read for many processes in a row.
+    thread_local std::vector<char> buffer;
+    if (buffer.size() < kReadChunkSize) {
+        buffer.resize(kReadChunkSize);
+    }
+
+    size_t used = 0;
+    while (true) {
+        if (used == buffer.size()) {
+            buffer.resize(buffer.size() * 2);
         }
-        if (!isDesiredContext) {
+        ssize_t n = TEMP_FAILURE_RETRY(read(fd.get(), buffer.data() + used, buffer.size() - used));
+        if (n < 0) {
+            return -errno;
+        }
+        if (n == 0) {
+            break;
+        }
+        used += n;
+
+        // Only pass on complete lines, and keep the rest for the next read.
+        std::string_view data(buffer.data(), used);
+        size_t end = data.rfind('\n');
+        if (end == std::string_view::npos) {
             continue;
         }
-        eachLine(line);
+        forEachLine(data.substr(0, end), eachLine);
+        used -= end + 1;
+        memmove(buffer.data(), buffer.data() + end + 1, used);
     }
+    forEachLine(std::string_view(buffer.data(), used), eachLine);
     return OK;
 }
 
-status_t getBinderPidInfo(BinderDebugContext context, pid_t pid, BinderPidInfo* pidInfo) {
-    std::smatch match;
-    static const std::regex kReferencePrefix("^\\s*node \\d+:\\s+u([0-9a-f]+)\\s+c([0-9a-f]+)\\s+");
-    static const std::regex kThreadPrefix("^\\s*thread \\d+:\\s+l\\s+(\\d)(\\d)");
-    std::string contextStr = contextToString(context);
-    status_t ret = scanBinderContext(pid, contextStr, [&](const std::string& line) {
-        if (std::regex_search(line, match, kReferencePrefix)) {
-            const std::string& ptrString = "0x" + match.str(2); // use number after c
-            uint64_t ptr;
-            if (!::android::base::ParseUint(ptrString.c_str(), &ptr)) {
-                // Should not reach here, but just be tolerant.
-                return;
-            }
-            const std::string proc = " proc ";
-            auto pos = line.rfind(proc);
-            if (pos != std::string::npos) {
-                for (const std::string& pidStr : base::Split(line.substr(pos + proc.size()), " ")) {
-                    int32_t pid;
-                    if (!::android::base::ParseInt(pidStr, &pid)) {
-                        return;
-                    }
-                    pidInfo->refPids[ptr].push_back(pid);
-                }
+template <typename T>
+static bool consumeNumber(std::string_view* s, T* value, int base = 10) {
+    auto [end, error] = std::from_chars(s->data(), s->data() + s->size(), *value, base);
+    if (error != std::errc()) {
+        return false;
+    }
+    s->remove_prefix(end - s->data());
+    return true;
+}
+
+static bool consumeSpaces(std::string_view* s) {
+    size_t end = s->find_first_not_of(" \t");
+    if (end == 0) {
+        return false;
+    }
+    s->remove_prefix(end == std::string_view::npos ? s->size() : end);
+    return true;
+}
+
+// Binder logs consist of sections that start with "proc <pid>" and "context <name>" lines.
+// Returns a line handler that calls eachLine(pid, line) for the lines in the given context, with
+// leading whitespace removed.
+template <typename F>
+static auto linesInContext(BinderDebugContext context, F eachLine) {
+    return [contextName = contextToString(context), eachLine, pid = pid_t(-1),
+            isDesiredContext = false](std::string_view line) mutable {
+        if (base::ConsumePrefix(&line, "proc ")) {
+            if (!consumeNumber(&line, &pid)) {
+                pid = -1;
             }
+            isDesiredContext = false;
+            return;
+        }
+        if (base::ConsumePrefix(&line, "context ")) {
+            isDesiredContext = line == contextName;
+            return;
+        }
+        if (!isDesiredContext) {
+            return;
+        }
+        size_t start = line.find_first_not_of(" \t");
+        if (start == std::string_view::npos) {
+            return;
+        }
+        eachLine(pid, line.substr(start));
+    };
+}
+
+// Parses "node <id>: u<ptr> c<cookie> ...".
+static bool parseNodeLine(std::string_view line, int32_t* node, uint64_t* cookie) {
+    uint64_t ptr;
+    return base::ConsumePrefix(&line, "node ") && consumeNumber(&line, node) &&
+            base::ConsumePrefix(&line, ":") && consumeSpaces(&line) &&
+            base::ConsumePrefix(&line, "u") && consumeNumber(&line, &ptr, 16) &&
+            consumeSpaces(&line) && base::ConsumePrefix(&line, "c") &&
+            consumeNumber(&line, cookie, 16) && consumeSpaces(&line);
+}
+
+// Appends the PIDs after the last " proc " of a node line to pids. Returns false if there is none.
+static bool parseNodeRefPids(std::string_view line, std::vector<pid_t>* pids) {
+    static constexpr std::string_view kProc = " proc ";
+    size_t pos = line.rfind(kProc);
+    if (pos == std::string_view::npos) {
+        return false;
+    }
+    line.remove_prefix(pos + kProc.size());
+    pid_t pid;
+    while (consumeNumber(&line, &pid)) {
+        pids->push_back(pid);
+        consumeSpaces(&line);
+    }
+    return true;
+}
+
+static void parsePidInfoLine(std::string_view line, BinderPidInfo* pidInfo) {
+    int32_t node;
+    uint64_t cookie;
+    if (parseNodeLine(line, &node, &cookie)) {
+        std::vector<pid_t> pids;
+        if (parseNodeRefPids(line, &pids)) {
+            auto& refPids = pidInfo->refPids[cookie];
+            refPids.insert(refPids.end(), pids.begin(), pids.end());
+        }
+        return;
+    }
 
+    // "thread <id>: l <looper state, two hex digits> ..."
+    int32_t thread;
+    if (base::ConsumePrefix(&line, "thread ") && consumeNumber(&line, &thread) &&
+        base::ConsumePrefix(&line, ":") && consumeSpaces(&line) && base::ConsumePrefix(&line, "l") &&
+        consumeSpaces(&line) && line.size() >= 2 && isdigit(line[0]) && isdigit(line[1])) {
+        // "1" is waiting in binder driver
+        // "2" is poll. It's impossible to tell if these are in use.
+        //     and HIDL default code doesn't use it.
+        bool isInUse = line[0] != '1';
+        // "0" is a thread that has called into binder
+        // "1" is looper thread
+        // "2" is main looper thread
+        bool isBinderThread = line[1] != '0';
+        if (!isBinderThread) {
             return;
         }
-        if (std::regex_search(line, match, kThreadPrefix)) {
-            // "1" is waiting in binder driver
-            // "2" is poll. It's impossible to tell if these are in use.
-            //     and HIDL default code doesn't use it.
-            bool isInUse = match.str(1) != "1";
-            // "0" is a thread that has called into binder
-            // "1" is looper thread
-            // "2" is main looper thread
-            bool isBinderThread = match.str(2) != "0";
-            if (!isBinderThread) {
-                return;
-            }
-            if (isInUse) {
-                pidInfo->threadUsage++;
-            }
+        if (isInUse) {
+            pidInfo->threadUsage++;
+        }
 
-            pidInfo->threadCount++;
+        pidInfo->threadCount++;
+    }
+}
+
+status_t getBinderPidInfo(BinderDebugContext context, pid_t pid, BinderPidInfo* pidInfo) {
+    unique_fd fd = openBinderLog("proc/" + std::to_string(pid));
+    if (!fd.ok()) {
+        return -errno;
+    }
+    auto eachLine = linesInContext(context, [&](pid_t, std::string_view line) {
+        parsePidInfoLine(line, pidInfo);
+    });
+    return forEachLineInFile(fd, eachLine);
+}
+
+// Returns a line callback filling pidInfos for the processes in wanted, or all processes if
+// wanted is empty.
+static auto pidInfoLines(BinderDebugContext context, const std::set<pid_t>& wanted,
+                         std::map<pid_t, BinderPidInfo>* pidInfos) {
+    return linesInContext(context, [&wanted, pidInfos](pid_t pid, std::string_view line) {
+        if (!wanted.empty() && wanted.count(pid) == 0) {
             return;
         }
-        return;
+        parsePidInfoLine(line, &(*pidInfos)[pid]);
     });
-    return ret;
+}
+
+void parseBinderPidInfos(BinderDebugContext context, std::string_view contents,
+                         const std::vector<pid_t>& pids,
+                         std::map<pid_t, BinderPidInfo>* pidInfos) {
+    const std::set<pid_t> wanted(pids.begin(), pids.end());
+    auto eachLine = pidInfoLines(context, wanted, pidInfos);
+    forEachLine(contents, eachLine);
+}
+
+status_t getBinderPidInfos(BinderDebugContext context, const std::vector<pid_t>& pids,
+                           std::map<pid_t, BinderPidInfo>* pidInfos) {
+    unique_fd fd = openBinderLog("state");
+    if (!fd.ok()) {
+        return -errno;
+    }
+    const std::set<pid_t> wanted(pids.begin(), pids.end());
+    auto eachLine = pidInfoLines(context, wanted, pidInfos);
+    return forEachLineInFile(fd, eachLine);
 }
 
 status_t getBinderClientPids(BinderDebugContext context, pid_t pid, pid_t servicePid,
                              int32_t handle, std::vector<pid_t>* pids) {
-    std::smatch match;
-    static const std::regex kNodeNumber("^\\s+ref \\d+:\\s+desc\\s+(\\d+)\\s+node\\s+(\\d+).*");
-    std::string contextStr = contextToString(context);
-    int32_t node;
-    status_t ret = scanBinderContext(pid, contextStr, [&](const std::string& line) {
-        if (std::regex_search(line, match, kNodeNumber)) {
-            const std::string& descString = match.str(1);
-            int32_t desc;
-            if (!::android::base::ParseInt(descString.c_str(), &desc)) {
-                LOG(ERROR) << "Failed to parse desc int: " << descString;
-                return;
-            }
-            if (handle != desc) {
-                return;
-            }
-            const std::string& nodeString = match.str(2);
-            if (!::android::base::ParseInt(nodeString.c_str(), &node)) {
-                LOG(ERROR) << "Failed to parse node int: " << nodeString;
-                return;
-            }
-            return;
+    unique_fd fd = openBinderLog("proc/" + std::to_string(pid));
+    if (!fd.ok()) {
+        return -errno;
+    }
+    // "ref <id>: desc <handle> node <node> ..."
+    std::optional<int32_t> node;
+    auto findNode = linesInContext(context, [&](pid_t, std::string_view line) {
+        int32_t ref, desc, refNode;
+        if (base::ConsumePrefix(&line, "ref ") && consumeNumber(&line, &ref) &&
+            base::ConsumePrefix(&line, ":") && consumeSpaces(&line) &&
+            base::ConsumePrefix(&line, "desc") && consumeSpaces(&line) &&
+            consumeNumber(&line, &desc) && consumeSpaces(&line) &&
+            base::ConsumePrefix(&line, "node") && consumeSpaces(&line) &&
+            consumeNumber(&line, &refNode) && desc == handle) {
+            node = refNode;
         }
-        return;
     });
-    if (ret != OK) {
+    status_t ret = forEachLineInFile(fd, findNode);
+    if (ret != OK || !node.has_value()) {
         return ret;
     }
-    static const std::regex kClients("^\\s+node\\s+(\\d+).*proc\\s+([\\d+\\s*]*)");
-    ret = scanBinderContext(servicePid, contextStr, [&](const std::string& line) {
-        if (std::regex_search(line, match, kClients)) {
-            const std::string nodeString = match.str(1);
-            int32_t matchedNode;
-            if (!::android::base::ParseInt(nodeString.c_str(), &matchedNode)) {
-                LOG(ERROR) << "Failed to parse node int: " << nodeString;
-                return;
-            }
-            if (node != matchedNode) {
-                return;
-            }
-            const std::string clients = match.str(2);
-            for (const std::string& pidStr : base::Split(clients, " ")) {
-                int32_t pid;
-                if (!::android::base::ParseInt(pidStr, &pid)) {
-                    return;
-                }
-                pids->push_back(pid);
-            }
-            return;
+
+    fd = openBinderLog("proc/" + std::to_string(servicePid));
+    if (!fd.ok()) {
+        return -errno;
+    }
+    auto findClients = linesInContext(context, [&](pid_t, std::string_view line) {
+        int32_t matchedNode;
+        uint64_t cookie;
+        if (parseNodeLine(line, &matchedNode, &cookie) && matchedNode == *node) {
+            parseNodeRefPids(line, pids);
         }
-        return;
     });
-    return ret;
+    return forEachLineInFile(fd, findClients);
 }
 
 } // namespace  android
@@ -15,7 +15,10 @@
  */
 #pragma once
 
+#include <sys/types.h>
+
 #include <map>
+#include <string_view>
 #include <vector>
 
 namespace android {
@@ -36,6 +39,18 @@ enum class BinderDebugContext {
  * pid is the pid of the service
  */
 status_t getBinderPidInfo(BinderDebugContext context, pid_t pid, BinderPidInfo* pidInfo);
+
+// Like getBinderPidInfo for the processes in pids, or all processes if pids is empty, reading the
+// binder state of all processes once instead of a file per process. Processes without binder
+// state in context are left out of pidInfos.
+status_t getBinderPidInfos(BinderDebugContext context, const std::vector<pid_t>& pids,
+                           std::map<pid_t, BinderPidInfo>* pidInfos);
+
+// Parses the contents of a binder log (a proc file or the state file) like getBinderPidInfos,
+// including the meaning of an empty pids. Used for testing and benchmarking.
+void parseBinderPidInfos(BinderDebugContext context, std::string_view contents,
+                         const std::vector<pid_t>& pids,
+                         std::map<pid_t, BinderPidInfo>* pidInfos);
 /**
  * pid is typically the pid of this process that is making the query
  */
@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Parses binder logs in the format of /dev/binderfs/binder_logs/{state,proc/<pid>}, either
+// generated to resemble a busy device or read from the device when running as root.
+
+#include <binder/Binder.h>
+#include <binderdebug/BinderDebug.h>
+
+#include <android-base/stringprintf.h>
+#include <benchmark/benchmark.h>
+#include <dirent.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+using android::BinderDebugContext;
+using android::BinderPidInfo;
+using android::OK;
+using android::base::StringAppendF;
+
+// Roughly what system_server has: many nodes with a few references each, and a full thread pool.
+static std::string makeProcLog(pid_t pid, int nodes, int threads) {
+    std::string log;
+    StringAppendF(&log, "proc %d\ncontext binder\n", pid);
+    for (int i = 0; i < threads; i++) {
+        StringAppendF(&log, "  thread %d: l %02x need_return 0 tr 0\n", pid + i,
+                      i % 3 ? 0x12 : 0x11);
+    }
+    for (int i = 0; i < nodes; i++) {
+        StringAppendF(&log,
+                      "  node %d: u%016x c%016x hs 1 hw 1 ls 0 lw 0 is 3 iw 3 tr 1 proc %d %d %d\n",
+                      1000 + i, 0x7000000 + i * 0x40, 0x7100000 + i * 0x40, 1000 + i % 50,
+                      2000 + i % 70, 3000 + i % 90);
+        StringAppendF(&log, "  ref %d: desc %d node %d s 1 w 1 d 0000000000000000\n", 5000 + i, i,
+                      9000 + i);
+    }
+    StringAppendF(&log, "  buffer %d: 0000000000000000 size 0:0:0 delivered\n", pid);
+    return log;
+}
+
+static std::string makeStateLog(int processes) {
+    std::string log = "binder state:\ndead nodes:\n";
+    for (int i = 0; i < processes; i++) {
+        log += makeProcLog(1000 + i, 64, 8);
+    }
+    return log;
+}
+
+static std::vector<pid_t> getAllPids() {
+    std::vector<pid_t> pids;
+    std::unique_ptr<DIR, decltype(&closedir)> dir(opendir("/proc"), closedir);
+    while (dirent* entry = readdir(dir.get())) {
+        pid_t pid = atoi(entry->d_name);
+        if (pid > 0) pids.push_back(pid);
+    }
+    return pids;
+}
+
+static void BM_parseProcLog(benchmark::State& state) {
+    const std::string log = makeProcLog(1000, state.range(0), 32);
+    for (auto _ : state) {
+        std::map<pid_t, BinderPidInfo> pidInfos;
+        android::parseBinderPidInfos(BinderDebugContext::BINDER, log, {}, &pidInfos);
+        benchmark::DoNotOptimize(pidInfos);
+    }
+    state.SetBytesProcessed(state.iterations() * log.size());
+}
+BENCHMARK(BM_parseProcLog)->Arg(100)->Arg(2000);
+
+// Picking a few processes out of the state of the whole device.
+static void BM_parseStateLog(benchmark::State& state) {
+    const std::string log = makeStateLog(300);
+    const std::vector<pid_t> pids = {1000, 1100, 1200};
+    for (auto _ : state) {
+        std::map<pid_t, BinderPidInfo> pidInfos;
+        android::parseBinderPidInfos(BinderDebugContext::BINDER, log, pids, &pidInfos);
+        benchmark::DoNotOptimize(pidInfos);
+    }
+    state.SetBytesProcessed(state.iterations() * log.size());
+}
+BENCHMARK(BM_parseStateLog);
+
+// What lshal and dumpsys do: one getBinderPidInfo call per process.
+static void BM_getBinderPidInfoAll(benchmark::State& state) {
+    const std::vector<pid_t> pids = getAllPids();
+    for (auto _ : state) {
+        for (pid_t pid : pids) {
+            BinderPidInfo pidInfo{};
+            android::getBinderPidInfo(BinderDebugContext::BINDER, pid, &pidInfo);
+            benchmark::DoNotOptimize(pidInfo);
+        }
+    }
+}
+BENCHMARK(BM_getBinderPidInfoAll);
+
+static void BM_getBinderPidInfosAll(benchmark::State& state) {
+    const std::vector<pid_t> pids = getAllPids();
+    for (auto _ : state) {
+        std::map<pid_t, BinderPidInfo> pidInfos;
+        if (android::getBinderPidInfos(BinderDebugContext::BINDER, pids, &pidInfos) != OK) {
+            state.SkipWithError("Cannot read binder state, are you root?");
+            break;
+        }
+        benchmark::DoNotOptimize(pidInfos);
+    }
+}
+BENCHMARK(BM_getBinderPidInfosAll);
+
+BENCHMARK_MAIN();
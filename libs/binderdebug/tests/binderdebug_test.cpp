@@ -60,6 +60,55 @@ TEST(BinderDebugTests, BinderThreads) {
     EXPECT_GE(pidInfo.threadCount, 1);
 }
 
+TEST(BinderDebugTests, BinderPidBatch) {
+    BinderPidInfo pidInfo{};
+    ASSERT_EQ(OK, getBinderPidInfo(BinderDebugContext::BINDER, getpid(), &pidInfo));
+
+    std::map<pid_t, BinderPidInfo> pidInfos;
+    const auto& status = getBinderPidInfos(BinderDebugContext::BINDER, {getpid()}, &pidInfos);
+    ASSERT_EQ(status, OK);
+    ASSERT_EQ(1u, pidInfos.size());
+    EXPECT_EQ(pidInfo.refPids, pidInfos[getpid()].refPids);
+    EXPECT_EQ(pidInfo.threadCount, pidInfos[getpid()].threadCount);
+
+    // no pids means all of them
+    pidInfos.clear();
+    ASSERT_EQ(OK, getBinderPidInfos(BinderDebugContext::BINDER, {}, &pidInfos));
+    EXPECT_EQ(1u, pidInfos.count(getpid()));
+}
+
+TEST(BinderDebugTests, ParseState) {
+    const std::string state =
+            "binder state:\n"
+            "proc 100\n"
+            "context binder\n"
+            "  thread 100: l 12 need_return 0 tr 0\n"
+            "  thread 101: l 01 need_return 0 tr 0\n"
+            "  thread 102: l 00 need_return 0 tr 0\n"
+            "  node 5: u00000070c0001000 c00000070c0002000 hs 1 hw 1 ls 0 lw 0 is 2 iw 2 tr 1 "
+            "proc 200 300\n"
+            "proc 100\n"
+            "context hwbinder\n"
+            "  thread 103: l 12 need_return 0 tr 0\n"
+            "proc 200\n"
+            "context binder\n"
+            "  thread 200: l 12 need_return 0 tr 0\n";
+
+    std::map<pid_t, BinderPidInfo> pidInfos;
+    parseBinderPidInfos(BinderDebugContext::BINDER, state, {100}, &pidInfos);
+    ASSERT_EQ(1u, pidInfos.size());
+    const BinderPidInfo& pidInfo = pidInfos[100];
+    EXPECT_EQ(2u, pidInfo.threadCount);
+    EXPECT_EQ(1u, pidInfo.threadUsage);
+    EXPECT_EQ((std::map<uint64_t, std::vector<pid_t>>{{0x70c0002000, {200, 300}}}),
+              pidInfo.refPids);
+
+    pidInfos.clear();
+    parseBinderPidInfos(BinderDebugContext::HWBINDER, state, {}, &pidInfos);
+    ASSERT_EQ(1u, pidInfos.size());
+    EXPECT_EQ(1u, pidInfos[100].threadCount);
+}
+
 extern "C" {
 int main(int argc, char** argv) {
     ::testing::InitGoogleTest(&argc, argv);
@@ -17,19 +17,24 @@
 #define LOG_TAG "libtimeinstate"
 
 #include "cputimeinstate.h"
+#include "timeinstatetable.h"
 #include <bpf_timeinstate.h>
 
 #include <dirent.h>
 #include <errno.h>
 #include <inttypes.h>
+#include <sys/syscall.h>
 #include <sys/sysinfo.h>
+#include <unistd.h>
 
+#include <atomic>
 #include <mutex>
 #include <numeric>
 #include <optional>
 #include <set>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include <android-base/file.h>
@@ -56,6 +61,7 @@ static uint32_t gNCpus = 0;
 static std::vector<std::vector<uint32_t>> gPolicyFreqs;
 static std::vector<std::vector<uint32_t>> gPolicyCpus;
 static std::set<uint32_t> gAllFreqs;
+static TimeInStateLayout gLayout;
 static unique_fd gTisTotalMapFd;
 static unique_fd gTisMapFd;
 static unique_fd gConcurrentMapFd;
@@ -129,6 +135,7 @@ static bool initGlobals() {
         if (!cpus) return false;
         gPolicyCpus.emplace_back(*cpus);
     }
+    gLayout = TimeInStateLayout(gNCpus, gPolicyFreqs, gPolicyCpus);
 
     gTisTotalMapFd =
             unique_fd{bpf_obj_get(BPF_FS_PATH "map_time_in_state_total_time_in_state_map")};
@@ -155,6 +162,88 @@ static bool initGlobals() {
     return true;
 }
 
+// Cleared once the kernel rejects BPF_MAP_LOOKUP_BATCH, which is only available since Linux 5.6.
+static std::atomic_bool gBatchLookupSupported = true;
+
+// Reads all entries of a BPF map with as few syscalls as possible.
+class BpfMapReader : public MapReader {
+  public:
+    BpfMapReader(const unique_fd &fd, size_t keySize, size_t valueSize)
+          : mFd(fd), mKeySize(keySize), mValueSize(valueSize) {}
+
+    bool readAll(std::vector<uint8_t> *keys, std::vector<uint8_t> *values) override {
+        if (gBatchLookupSupported) {
+            auto ret = readAllBatched(keys, values);
+            if (ret.has_value()) return *ret;
+        }
+        return readAllIterated(keys, values);
+    }
+
+  private:
+    // Returns no value if the kernel does not support batched lookups on this map.
+    std::optional<bool> readAllBatched(std::vector<uint8_t> *keys, std::vector<uint8_t> *values) {
+        // Hash maps are read one hash bucket at a time, so the batch size is doubled whenever a
+        // bucket has more entries than fit.
+        uint32_t batchSize = 256;
+        uint64_t token = 0;
+        bool first = true;
+        size_t count = 0;
+        while (true) {
+            keys->resize((count + batchSize) * mKeySize);
+            values->resize((count + batchSize) * mValueSize);
+
+            union bpf_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.batch.in_batch = first ? 0 : reinterpret_cast<uintptr_t>(&token);
+            attr.batch.out_batch = reinterpret_cast<uintptr_t>(&token);
+            attr.batch.keys = reinterpret_cast<uintptr_t>(keys->data() + count * mKeySize);
+            attr.batch.values = reinterpret_cast<uintptr_t>(values->data() + count * mValueSize);
+            attr.batch.count = batchSize;
+            attr.batch.map_fd = mFd.get();
+            int ret = syscall(__NR_bpf, BPF_MAP_LOOKUP_BATCH, &attr, sizeof(attr));
+            if (ret == 0 || errno == ENOENT) count += attr.batch.count;
+            if (ret == 0) {
+                first = false;
+                continue;
+            }
+            if (errno == ENOENT) break;
+            if (errno == ENOSPC) {
+                first = false;
+                batchSize *= 2;
+                continue;
+            }
+            // EINVAL on kernels without the command, ENOTSUPP (524) for unsupported map types.
+            if (first && (errno == EINVAL || errno == EOPNOTSUPP || errno == 524)) {
+                gBatchLookupSupported = false;
+                return {};
+            }
+            return false;
+        }
+        keys->resize(count * mKeySize);
+        values->resize(count * mValueSize);
+        return true;
+    }
+
+    bool readAllIterated(std::vector<uint8_t> *keys, std::vector<uint8_t> *values) {
+        keys->clear();
+        values->clear();
+        std::vector<uint8_t> key(mKeySize), prevKey(mKeySize);
+        if (getFirstMapKey(mFd, key.data())) return errno == ENOENT;
+        do {
+            size_t count = keys->size() / mKeySize;
+            keys->insert(keys->end(), key.begin(), key.end());
+            values->resize((count + 1) * mValueSize);
+            if (findMapEntry(mFd, key.data(), values->data() + count * mValueSize)) return false;
+            prevKey = key;
+        } while (!getNextMapKey(mFd, prevKey.data(), key.data()));
+        return errno == ENOENT;
+    }
+
+    const unique_fd &mFd;
+    size_t mKeySize;
+    size_t mValueSize;
+};
+
 static int retrieveProgramFd(const std::string &eventType, const std::string &eventName) {
     std::string path = StringPrintf(BPF_FS_PATH "prog_time_in_state_tracepoint_%s_%s",
                                     eventType.c_str(), eventName.c_str());
@@ -324,18 +413,6 @@ std::optional<std::vector<std::vector<uint64_t>>> getUidCpuFreqTimes(uint32_t ui
     return out;
 }
 
-static std::optional<bool> uidUpdatedSince(uint32_t uid, uint64_t lastUpdate,
-                                           uint64_t *newLastUpdate) {
-    uint64_t uidLastUpdate;
-    if (findMapEntry(gUidLastUpdateMapFd, &uid, &uidLastUpdate)) return {};
-    // Updates that occurred during the previous read may have been missed. To mitigate
-    // this, don't ignore entries updated up to 1s before *lastUpdate
-    constexpr uint64_t NSEC_PER_SEC = 1000000000;
-    if (uidLastUpdate + NSEC_PER_SEC < lastUpdate) return false;
-    if (uidLastUpdate > *newLastUpdate) *newLastUpdate = uidLastUpdate;
-    return true;
-}
-
 // Retrieve the times in ns that each uid spent running at each CPU freq.
 // Return contains no value on error, otherwise it contains a map from uids to vectors of vectors
 // using the format:
@@ -352,44 +429,50 @@ getUidsCpuFreqTimes() {
 // Return format is the same as getUidsCpuFreqTimes()
 std::optional<std::unordered_map<uint32_t, std::vector<std::vector<uint64_t>>>>
 getUidsUpdatedCpuFreqTimes(uint64_t *lastUpdate) {
-    if (!gInitialized && !initGlobals()) return {};
-    time_key_t key, prevKey;
-    std::unordered_map<uint32_t, std::vector<std::vector<uint64_t>>> map;
-    if (getFirstMapKey(gTisMapFd, &key)) {
-        if (errno == ENOENT) return map;
-        return std::nullopt;
+    UidTimeTable table;
+    if (!getUidsCpuFreqTimesTable(&table, lastUpdate)) return {};
+    return uidTimeInStateTableToMap(table);
+}
+
+// If lastUpdate is set, reads the UIDs that have run since *lastUpdate into updatedUids and sets
+// *filter to point to them. Returns false on error.
+static bool readUpdatedUids(const uint64_t *lastUpdate, uint64_t *newLastUpdate,
+                            std::unordered_set<uint32_t> *updatedUids,
+                            const std::unordered_set<uint32_t> **filter) {
+    *filter = nullptr;
+    if (!lastUpdate) return true;
+    BpfMapReader lastUpdateMap(gUidLastUpdateMapFd, sizeof(uint32_t), sizeof(uint64_t));
+    if (!readUidsUpdatedSince(lastUpdateMap, *lastUpdate, newLastUpdate, updatedUids)) {
+        return false;
     }
+    *filter = updatedUids;
+    return true;
+}
 
-    std::vector<std::vector<uint64_t>> mapFormat;
-    for (const auto &freqList : gPolicyFreqs) mapFormat.emplace_back(freqList.size(), 0);
+// Retrieve the times in ns that each uid spent running at each CPU freq into a single contiguous
+// table, reusing the storage of table. If lastUpdate is set, UIDs that have not run since before
+// *lastUpdate are excluded and *lastUpdate is advanced as by getUidsUpdatedCpuFreqTimes().
+// Returns false on error. Otherwise row i of table holds the times of table->uids[i], in ascending
+// uid order, using the format:
+// [t_0_0, t_0_1, ..., t_1_0, t_1_1, ...]
+// where t_j_k is the ns the uid spent running on the jth cluster at the cluster's kth lowest freq,
+// and t_j_0 is at column table->policyOffsets[j].
+bool getUidsCpuFreqTimesTable(UidTimeTable *table, uint64_t *lastUpdate) {
+    if (!gInitialized && !initGlobals()) return false;
 
     uint64_t newLastUpdate = lastUpdate ? *lastUpdate : 0;
-    std::vector<tis_val_t> vals(gNCpus);
-    do {
-        if (lastUpdate) {
-            auto uidUpdated = uidUpdatedSince(key.uid, *lastUpdate, &newLastUpdate);
-            if (!uidUpdated.has_value()) return {};
-            if (!*uidUpdated) continue;
-        }
-        if (findMapEntry(gTisMapFd, &key, vals.data())) return {};
-        if (map.find(key.uid) == map.end()) map.emplace(key.uid, mapFormat);
-
-        auto offset = key.bucket * FREQS_PER_ENTRY;
-        auto nextOffset = (key.bucket + 1) * FREQS_PER_ENTRY;
-        for (uint32_t i = 0; i < gNPolicies; ++i) {
-            if (offset >= gPolicyFreqs[i].size()) continue;
-            auto begin = map[key.uid][i].begin() + offset;
-            auto end = nextOffset < gPolicyFreqs[i].size() ? begin + FREQS_PER_ENTRY :
-                map[key.uid][i].end();
-            for (const auto &cpu : gPolicyCpus[i]) {
-                std::transform(begin, end, std::begin(vals[cpu].ar), begin, std::plus<uint64_t>());
-            }
-        }
-        prevKey = key;
-    } while (prevKey = key, !getNextMapKey(gTisMapFd, &prevKey, &key));
-    if (errno != ENOENT) return {};
+    std::unordered_set<uint32_t> updatedUids;
+    const std::unordered_set<uint32_t> *filter;
+    if (!readUpdatedUids(lastUpdate, &newLastUpdate, &updatedUids, &filter)) return false;
+
+    std::vector<uint8_t> keys, values;
+    if (!filter || !filter->empty()) {
+        BpfMapReader tisMap(gTisMapFd, sizeof(time_key_t), gNCpus * sizeof(tis_val_t));
+        if (!tisMap.readAll(&keys, &values)) return false;
+    }
+    fillUidTimeInStateTable(gLayout, keys, values, filter, table);
     if (lastUpdate && newLastUpdate > *lastUpdate) *lastUpdate = newLastUpdate;
-    return map;
+    return true;
 }
 
 static bool verifyConcurrentTimes(const concurrent_time_t &ct) {
@@ -462,63 +545,57 @@ std::optional<std::unordered_map<uint32_t, concurrent_time_t>> getUidsConcurrent
 // Return format is the same as getUidsConcurrentTimes()
 std::optional<std::unordered_map<uint32_t, concurrent_time_t>> getUidsUpdatedConcurrentTimes(
         uint64_t *lastUpdate) {
-    if (!gInitialized && !initGlobals()) return {};
-    time_key_t key, prevKey;
+    UidTimeTable table;
+    if (!getUidsConcurrentTimesTable(&table, lastUpdate)) return {};
     std::unordered_map<uint32_t, concurrent_time_t> ret;
-    if (getFirstMapKey(gConcurrentMapFd, &key)) {
-        if (errno == ENOENT) return ret;
-        return {};
+    ret.reserve(table.size());
+    for (size_t i = 0; i < table.size(); ++i) {
+        ret.emplace(table.uids[i], uidConcurrentTimesTableRow(table, i));
     }
+    return ret;
+}
 
-    concurrent_time_t retFormat = {.active = std::vector<uint64_t>(gNCpus, 0)};
-    for (const auto &cpuList : gPolicyCpus) retFormat.policy.emplace_back(cpuList.size(), 0);
-
-    std::vector<concurrent_val_t> vals(gNCpus);
-    std::vector<uint64_t>::iterator activeBegin, activeEnd, policyBegin, policyEnd;
+// Retrieve the concurrent times of each uid into a single contiguous table, reusing the storage of
+// table. If lastUpdate is set, UIDs that have not run since before *lastUpdate are excluded and
+// *lastUpdate is advanced as by getUidsUpdatedConcurrentTimes().
+// Returns false on error. Otherwise row i of table holds the times of table->uids[i], in ascending
+// uid order, using the format:
+// [a0, a1, ..., p0_0, p0_1, ..., p1_0, p1_1, ...]
+// with the same ai and pi_j as getUidConcurrentTimes(), where pi_0 is at column
+// table->policyOffsets[i] and the active times take up the columns before table->policyOffsets[0].
+bool getUidsConcurrentTimesTable(UidTimeTable *table, uint64_t *lastUpdate) {
+    if (!gInitialized && !initGlobals()) return false;
 
     uint64_t newLastUpdate = lastUpdate ? *lastUpdate : 0;
-    do {
-        if (key.bucket > (gNCpus - 1) / CPUS_PER_ENTRY) return {};
-        if (lastUpdate) {
-            auto uidUpdated = uidUpdatedSince(key.uid, *lastUpdate, &newLastUpdate);
-            if (!uidUpdated.has_value()) return {};
-            if (!*uidUpdated) continue;
-        }
-        if (findMapEntry(gConcurrentMapFd, &key, vals.data())) return {};
-        if (ret.find(key.uid) == ret.end()) ret.emplace(key.uid, retFormat);
-
-        auto offset = key.bucket * CPUS_PER_ENTRY;
-        auto nextOffset = (key.bucket + 1) * CPUS_PER_ENTRY;
-
-        activeBegin = ret[key.uid].active.begin();
-        activeEnd = nextOffset < gNCpus ? activeBegin + CPUS_PER_ENTRY : ret[key.uid].active.end();
-
-        for (uint32_t cpu = 0; cpu < gNCpus; ++cpu) {
-            std::transform(activeBegin, activeEnd, std::begin(vals[cpu].active), activeBegin,
-                           std::plus<uint64_t>());
-        }
-
+    std::unordered_set<uint32_t> updatedUids;
+    const std::unordered_set<uint32_t> *filter;
+    if (!readUpdatedUids(lastUpdate, &newLastUpdate, &updatedUids, &filter)) return false;
+
+    std::vector<uint8_t> keys, values;
+    if (!filter || !filter->empty()) {
+        BpfMapReader concurrentMap(gConcurrentMapFd, sizeof(time_key_t),
+                                   gNCpus * sizeof(concurrent_val_t));
+        if (!concurrentMap.readAll(&keys, &values)) return false;
+    }
+    if (!fillUidConcurrentTimesTable(gLayout, keys, values, filter, table)) return false;
+
+    // Entries may have been updated while they were read; re-read the inconsistent UIDs.
+    for (size_t i = 0; i < table->size(); ++i) {
+        uint64_t *row = table->row(i);
+        uint64_t *activeEnd = row + gNCpus;
+        uint64_t activeSum = std::accumulate(row, activeEnd, (uint64_t)0);
+        uint64_t policySum = std::accumulate(activeEnd, row + table->columns, (uint64_t)0);
+        if (activeSum == policySum) continue;
+        auto val = getUidConcurrentTimes(table->uids[i], false);
+        if (!val.has_value()) continue;
+        std::copy(val->active.begin(), val->active.end(), row);
         for (uint32_t policy = 0; policy < gNPolicies; ++policy) {
-            if (offset >= gPolicyCpus[policy].size()) continue;
-            policyBegin = ret[key.uid].policy[policy].begin() + offset;
-            policyEnd = nextOffset < gPolicyCpus[policy].size() ? policyBegin + CPUS_PER_ENTRY
-                                                                : ret[key.uid].policy[policy].end();
-
-            for (const auto &cpu : gPolicyCpus[policy]) {
-                std::transform(policyBegin, policyEnd, std::begin(vals[cpu].policy), policyBegin,
-                               std::plus<uint64_t>());
-            }
-        }
-    } while (prevKey = key, !getNextMapKey(gConcurrentMapFd, &prevKey, &key));
-    if (errno != ENOENT) return {};
-    for (const auto &[key, value] : ret) {
-        if (!verifyConcurrentTimes(value)) {
-            auto val = getUidConcurrentTimes(key, false);
-            if (val.has_value()) ret[key] = val.value();
+            std::copy(val->policy[policy].begin(), val->policy[policy].end(),
+                      row + gLayout.policyCpuOffsets[policy]);
         }
     }
     if (lastUpdate && newLastUpdate > *lastUpdate) *lastUpdate = newLastUpdate;
-    return ret;
+    return true;
 }
 
 // Clear all time in state data for a given uid. Returns false on error, true otherwise.
@@ -16,12 +16,36 @@
 
 #pragma once
 
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <optional>
 #include <unordered_map>
 #include <vector>
 
 namespace android {
 namespace bpf {
 
+// Times of many UIDs in one contiguous allocation: row i holds the columns values of uids[i].
+// The values of policy j start at column policyOffsets[j] and end where those of the next policy
+// (or the row) start. Passing the same table to successive reads reuses its storage.
+struct UidTimeTable {
+    uint32_t columns = 0;
+    std::vector<uint32_t> policyOffsets;
+    std::vector<uint32_t> uids;
+    std::vector<uint64_t> times;
+
+    size_t size() const { return uids.size(); }
+    const uint64_t *row(size_t i) const { return times.data() + i * columns; }
+    uint64_t *row(size_t i) { return times.data() + i * columns; }
+    void clear(uint32_t newColumns, const std::vector<uint32_t> &newPolicyOffsets) {
+        columns = newColumns;
+        policyOffsets = newPolicyOffsets;
+        uids.clear();
+        times.clear();
+    }
+};
+
 bool isTrackingUidTimesSupported();
 bool startTrackingUidTimes();
 std::optional<std::vector<std::vector<uint64_t>>> getTotalCpuFreqTimes();
@@ -31,6 +55,7 @@ std::optional<std::unordered_map<uint32_t, std::vector<std::vector<uint64_t>>>>
 std::optional<std::unordered_map<uint32_t, std::vector<std::vector<uint64_t>>>>
     getUidsUpdatedCpuFreqTimes(uint64_t *lastUpdate);
 std::optional<std::vector<std::vector<uint32_t>>> getCpuFreqs();
+bool getUidsCpuFreqTimesTable(UidTimeTable *table, uint64_t *lastUpdate = nullptr);
 
 struct concurrent_time_t {
     std::vector<uint64_t> active;
@@ -41,6 +66,7 @@ std::optional<concurrent_time_t> getUidConcurrentTimes(uint32_t uid, bool retry
 std::optional<std::unordered_map<uint32_t, concurrent_time_t>> getUidsConcurrentTimes();
 std::optional<std::unordered_map<uint32_t, concurrent_time_t>>
     getUidsUpdatedConcurrentTimes(uint64_t *lastUpdate);
+bool getUidsConcurrentTimesTable(UidTimeTable *table, uint64_t *lastUpdate = nullptr);
 bool clearUidTimes(unsigned int uid);
 
 bool startTrackingProcessCpuTimes(pid_t pid);
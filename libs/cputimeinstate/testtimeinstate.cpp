@@ -21,6 +21,7 @@
 
 #include <pthread.h>
 #include <semaphore.h>
+#include <algorithm>
 #include <numeric>
 #include <unordered_map>
 #include <vector>
@@ -197,6 +198,53 @@ TEST(TimeInStateTest, AllUidUpdatedTimeInState) {
     }
 }
 
+TEST(TimeInStateTest, AllUidTimeInStateTable) {
+    auto map = getUidsCpuFreqTimes();
+    ASSERT_TRUE(map.has_value());
+    UidTimeTable table;
+    ASSERT_TRUE(getUidsCpuFreqTimesTable(&table));
+    ASSERT_FALSE(table.uids.empty());
+    ASSERT_TRUE(std::is_sorted(table.uids.begin(), table.uids.end()));
+    ASSERT_EQ(table.times.size(), table.size() * table.columns);
+
+    for (size_t i = 0; i < table.size(); ++i) {
+        auto it = map->find(table.uids[i]);
+        ASSERT_NE(it, map->end());
+        ASSERT_EQ(it->second.size(), table.policyOffsets.size());
+        for (size_t policy = 0; policy < it->second.size(); ++policy) {
+            const auto &times = it->second[policy];
+            const uint64_t *row = table.row(i) + table.policyOffsets[policy];
+            for (size_t freqIdx = 0; freqIdx < times.size(); ++freqIdx) {
+                // Times should never decrease
+                ASSERT_LE(times[freqIdx], row[freqIdx]);
+            }
+        }
+    }
+
+    // Reusing the table should not leave stale rows behind.
+    uint64_t lastUpdate = 0;
+    ASSERT_TRUE(getUidsCpuFreqTimesTable(&table, &lastUpdate));
+    ASSERT_NE(lastUpdate, (uint64_t)0);
+    ASSERT_EQ(table.times.size(), table.size() * table.columns);
+}
+
+TEST(TimeInStateTest, AllUidConcurrentTimesTable) {
+    UidTimeTable table;
+    ASSERT_TRUE(getUidsConcurrentTimesTable(&table));
+    ASSERT_FALSE(table.uids.empty());
+    ASSERT_TRUE(std::is_sorted(table.uids.begin(), table.uids.end()));
+    ASSERT_EQ(table.times.size(), table.size() * table.columns);
+    ASSERT_FALSE(table.policyOffsets.empty());
+
+    for (size_t i = 0; i < table.size(); ++i) {
+        const uint64_t *row = table.row(i);
+        const uint64_t *policyBegin = row + table.policyOffsets[0];
+        uint64_t activeSum = std::accumulate(row, policyBegin, (uint64_t)0);
+        uint64_t policySum = std::accumulate(policyBegin, row + table.columns, (uint64_t)0);
+        ASSERT_EQ(activeSum, policySum);
+    }
+}
+
 TEST(TimeInStateTest, TotalAndAllUidTimeInStateConsistent) {
     auto allUid = getUidsCpuFreqTimes();
     auto total = getTotalCpuFreqTimes();
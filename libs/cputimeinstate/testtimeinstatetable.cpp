@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <bpf_timeinstate.h>
+
+#include <numeric>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "timeinstatetable.h"
+
+namespace android {
+namespace bpf {
+
+using std::vector;
+
+// Two policies: CPUs 0-1 with 3 freqs and CPUs 2-11 with 40 freqs, so that the second policy
+// spans two tis buckets and two concurrent buckets.
+static const uint32_t kNCpus = 12;
+
+static TimeInStateLayout makeLayout() {
+    vector<uint32_t> bigFreqs(40);
+    std::iota(bigFreqs.begin(), bigFreqs.end(), 1000);
+    vector<uint32_t> bigCpus(10);
+    std::iota(bigCpus.begin(), bigCpus.end(), 2);
+    return TimeInStateLayout(kNCpus, {{100, 200, 300}, bigFreqs}, {{0, 1}, bigCpus});
+}
+
+static void putTimeInState(FakeMapReader *map, uint32_t uid, uint32_t bucket, uint64_t time) {
+    time_key_t key = {.uid = uid, .bucket = bucket};
+    vector<tis_val_t> vals(kNCpus);
+    for (auto &val : vals) {
+        for (uint32_t i = 0; i < FREQS_PER_ENTRY; ++i) val.ar[i] = time;
+    }
+    map->put(&key, vals.data());
+}
+
+TEST(TimeInStateTableTest, Layout) {
+    TimeInStateLayout layout = makeLayout();
+    EXPECT_EQ(vector<uint32_t>({0, 3}), layout.freqOffsets);
+    EXPECT_EQ(43u, layout.freqColumns);
+    EXPECT_EQ(vector<uint32_t>({kNCpus, kNCpus + 2}), layout.policyCpuOffsets);
+    EXPECT_EQ(kNCpus + 12, layout.concurrentColumns);
+}
+
+TEST(TimeInStateTableTest, FillTimeInState) {
+    TimeInStateLayout layout = makeLayout();
+    FakeMapReader map(sizeof(time_key_t), kNCpus * sizeof(tis_val_t));
+    putTimeInState(&map, 10010, 1, 5);
+    putTimeInState(&map, 1000, 0, 1);
+    putTimeInState(&map, 10010, 0, 2);
+
+    vector<uint8_t> keys, values;
+    ASSERT_TRUE(map.readAll(&keys, &values));
+    UidTimeTable table;
+    fillUidTimeInStateTable(layout, keys, values, nullptr, &table);
+
+    ASSERT_EQ(vector<uint32_t>({1000, 10010}), table.uids);
+    ASSERT_EQ(layout.freqColumns, table.columns);
+    // Times are summed over the 2 CPUs of the first policy and the 10 CPUs of the second.
+    const uint64_t *row = table.row(0);
+    for (uint32_t i = 0; i < 3; ++i) EXPECT_EQ(2u, row[i]);
+    for (uint32_t i = 3; i < 3 + FREQS_PER_ENTRY; ++i) EXPECT_EQ(10u, row[i]);
+    for (uint32_t i = 3 + FREQS_PER_ENTRY; i < table.columns; ++i) EXPECT_EQ(0u, row[i]);
+    row = table.row(1);
+    for (uint32_t i = 0; i < 3; ++i) EXPECT_EQ(4u, row[i]);
+    for (uint32_t i = 3; i < 3 + FREQS_PER_ENTRY; ++i) EXPECT_EQ(20u, row[i]);
+    for (uint32_t i = 3 + FREQS_PER_ENTRY; i < table.columns; ++i) EXPECT_EQ(50u, row[i]);
+}
+
+TEST(TimeInStateTableTest, FillTimeInStateWithFilter) {
+    TimeInStateLayout layout = makeLayout();
+    FakeMapReader map(sizeof(time_key_t), kNCpus * sizeof(tis_val_t));
+    putTimeInState(&map, 1000, 0, 1);
+    putTimeInState(&map, 10010, 0, 2);
+
+    vector<uint8_t> keys, values;
+    ASSERT_TRUE(map.readAll(&keys, &values));
+    std::unordered_set<uint32_t> filter = {10010, 10020};
+    UidTimeTable table;
+    fillUidTimeInStateTable(layout, keys, values, &filter, &table);
+    EXPECT_EQ(vector<uint32_t>({10010}), table.uids);
+    EXPECT_EQ(table.columns, table.times.size());
+}
+
+TEST(TimeInStateTableTest, FillConcurrentTimes) {
+    TimeInStateLayout layout = makeLayout();
+    FakeMapReader map(sizeof(time_key_t), kNCpus * sizeof(concurrent_val_t));
+    vector<concurrent_val_t> vals(kNCpus);
+    for (auto &val : vals) {
+        for (uint32_t i = 0; i < CPUS_PER_ENTRY; ++i) val.active[i] = val.policy[i] = 1;
+    }
+    for (uint32_t bucket = 0; bucket <= (kNCpus - 1) / CPUS_PER_ENTRY; ++bucket) {
+        time_key_t key = {.uid = 1000, .bucket = bucket};
+        map.put(&key, vals.data());
+    }
+
+    vector<uint8_t> keys, values;
+    ASSERT_TRUE(map.readAll(&keys, &values));
+    UidTimeTable table;
+    ASSERT_TRUE(fillUidConcurrentTimesTable(layout, keys, values, nullptr, &table));
+    ASSERT_EQ(1u, table.size());
+    const uint64_t *row = table.row(0);
+    for (uint32_t i = 0; i < kNCpus; ++i) EXPECT_EQ(kNCpus, row[i]);
+    for (uint32_t i = kNCpus; i < kNCpus + 2; ++i) EXPECT_EQ(2u, row[i]);
+    for (uint32_t i = kNCpus + 2; i < table.columns; ++i) EXPECT_EQ(10u, row[i]);
+}
+
+TEST(TimeInStateTableTest, TableToMap) {
+    TimeInStateLayout layout = makeLayout();
+    FakeMapReader map(sizeof(time_key_t), kNCpus * sizeof(tis_val_t));
+    putTimeInState(&map, 1000, 0, 1);
+    putTimeInState(&map, 10010, 1, 2);
+
+    vector<uint8_t> keys, values;
+    ASSERT_TRUE(map.readAll(&keys, &values));
+    UidTimeTable table;
+    fillUidTimeInStateTable(layout, keys, values, nullptr, &table);
+    auto uidMap = uidTimeInStateTableToMap(table);
+
+    ASSERT_EQ(2u, uidMap.size());
+    EXPECT_EQ(vector<uint64_t>(3, 2), uidMap[1000][0]);
+    ASSERT_EQ(40u, uidMap[10010][1].size());
+    EXPECT_EQ(0u, uidMap[10010][1][FREQS_PER_ENTRY - 1]);
+    EXPECT_EQ(20u, uidMap[10010][1][FREQS_PER_ENTRY]);
+}
+
+TEST(TimeInStateTableTest, ConcurrentTimesTableRow) {
+    TimeInStateLayout layout = makeLayout();
+    FakeMapReader map(sizeof(time_key_t), kNCpus * sizeof(concurrent_val_t));
+    vector<concurrent_val_t> vals(kNCpus);
+    for (auto &val : vals) {
+        for (uint32_t i = 0; i < CPUS_PER_ENTRY; ++i) val.active[i] = val.policy[i] = 1;
+    }
+    time_key_t key = {.uid = 1000, .bucket = 0};
+    map.put(&key, vals.data());
+
+    vector<uint8_t> keys, values;
+    ASSERT_TRUE(map.readAll(&keys, &values));
+    UidTimeTable table;
+    ASSERT_TRUE(fillUidConcurrentTimesTable(layout, keys, values, nullptr, &table));
+    concurrent_time_t times = uidConcurrentTimesTableRow(table, 0);
+    ASSERT_EQ(kNCpus, times.active.size());
+    ASSERT_EQ(2u, times.policy.size());
+    EXPECT_EQ(vector<uint64_t>(2, 2), times.policy[0]);
+    ASSERT_EQ(10u, times.policy[1].size());
+    EXPECT_EQ(10u, times.policy[1][CPUS_PER_ENTRY - 1]);
+    EXPECT_EQ(0u, times.policy[1][CPUS_PER_ENTRY]);
+}
+
+TEST(TimeInStateTableTest, FillConcurrentTimesFailsOnInvalidBucket) {
+    TimeInStateLayout layout = makeLayout();
+    FakeMapReader map(sizeof(time_key_t), kNCpus * sizeof(concurrent_val_t));
+    vector<concurrent_val_t> vals(kNCpus);
+    time_key_t key = {.uid = 1000, .bucket = (kNCpus - 1) / CPUS_PER_ENTRY + 1};
+    map.put(&key, vals.data());
+
+    vector<uint8_t> keys, values;
+    ASSERT_TRUE(map.readAll(&keys, &values));
+    UidTimeTable table;
+    EXPECT_FALSE(fillUidConcurrentTimesTable(layout, keys, values, nullptr, &table));
+}
+
+TEST(TimeInStateTableTest, ReadUidsUpdatedSince) {
+    static constexpr uint64_t NSEC_PER_SEC = 1000000000;
+    FakeMapReader map(sizeof(uint32_t), sizeof(uint64_t));
+    uint32_t uid = 1000;
+    uint64_t time = 10 * NSEC_PER_SEC;
+    map.put(&uid, &time);
+    uid = 10010;
+    time = 20 * NSEC_PER_SEC;
+    map.put(&uid, &time);
+    uid = 10020;
+    time = 30 * NSEC_PER_SEC;
+    map.put(&uid, &time);
+
+    std::unordered_set<uint32_t> uids;
+    uint64_t lastUpdate = 20 * NSEC_PER_SEC + 1;
+    ASSERT_TRUE(readUidsUpdatedSince(map, lastUpdate, &lastUpdate, &uids));
+    EXPECT_EQ(std::unordered_set<uint32_t>({10010, 10020}), uids);
+    EXPECT_EQ(30 * NSEC_PER_SEC, lastUpdate);
+}
+
+} // namespace bpf
+} // namespace android
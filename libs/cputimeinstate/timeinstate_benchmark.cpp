@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Compares a full-device snapshot of per-UID time in state in the nested format returned by
+// getUidsCpuFreqTimes() with the flat UidTimeTable format, using in-memory maps so that only the
+// userspace cost is measured.
+
+#include <bpf_timeinstate.h>
+
+#include <stdlib.h>
+
+#include <atomic>
+#include <new>
+#include <numeric>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "timeinstatetable.h"
+
+using namespace android::bpf;
+
+static std::atomic<size_t> gAllocations = 0;
+
+void *operator new(size_t size) {
+    gAllocations++;
+    if (void *p = malloc(size)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    free(p);
+}
+
+// A typical big.LITTLE device: 4 little, 3 big and 1 prime CPUs.
+static constexpr uint32_t kNCpus = 8;
+
+static TimeInStateLayout makeLayout() {
+    std::vector<std::vector<uint32_t>> freqs;
+    for (uint32_t count : {18, 20, 22}) {
+        freqs.emplace_back(count);
+        std::iota(freqs.back().begin(), freqs.back().end(), 300000);
+    }
+    return TimeInStateLayout(kNCpus, freqs, {{0, 1, 2, 3}, {4, 5, 6}, {7}});
+}
+
+static void fillTimeInStateMap(FakeMapReader *map, uint32_t uidCount) {
+    std::vector<tis_val_t> vals(kNCpus);
+    for (auto &val : vals) {
+        for (uint32_t i = 0; i < FREQS_PER_ENTRY; ++i) val.ar[i] = i * 1000;
+    }
+    for (uint32_t i = 0; i < uidCount; ++i) {
+        time_key_t key = {.uid = 10000 + i, .bucket = 0};
+        map->put(&key, vals.data());
+    }
+}
+
+static void reportAllocations(benchmark::State &state, size_t allocations) {
+    state.counters["allocs"] =
+            benchmark::Counter(allocations, benchmark::Counter::kAvgIterations);
+}
+
+// The path taken by getUidsCpuFreqTimes(): fill a table, then convert it to nested vectors.
+static void BM_snapshotNested(benchmark::State &state) {
+    TimeInStateLayout layout = makeLayout();
+    FakeMapReader map(sizeof(time_key_t), kNCpus * sizeof(tis_val_t));
+    fillTimeInStateMap(&map, state.range(0));
+
+    size_t allocations = gAllocations;
+    for (auto _ : state) {
+        std::vector<uint8_t> keys, values;
+        map.readAll(&keys, &values);
+        UidTimeTable table;
+        fillUidTimeInStateTable(layout, keys, values, nullptr, &table);
+        auto uidMap = uidTimeInStateTableToMap(table);
+        benchmark::DoNotOptimize(uidMap);
+    }
+    reportAllocations(state, gAllocations - allocations);
+}
+BENCHMARK(BM_snapshotNested)->Arg(500)->Arg(5000);
+
+// The path taken by getUidsCpuFreqTimesTable() with a table reused across polls.
+static void BM_snapshotTable(benchmark::State &state) {
+    TimeInStateLayout layout = makeLayout();
+    FakeMapReader map(sizeof(time_key_t), kNCpus * sizeof(tis_val_t));
+    fillTimeInStateMap(&map, state.range(0));
+
+    UidTimeTable table;
+    size_t allocations = gAllocations;
+    for (auto _ : state) {
+        std::vector<uint8_t> keys, values;
+        map.readAll(&keys, &values);
+        fillUidTimeInStateTable(layout, keys, values, nullptr, &table);
+        benchmark::DoNotOptimize(table.times.data());
+    }
+    reportAllocations(state, gAllocations - allocations);
+}
+BENCHMARK(BM_snapshotTable)->Arg(500)->Arg(5000);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "timeinstatetable.h"
+#include <bpf_timeinstate.h>
+
+#include <algorithm>
+#include <utility>
+
+namespace android {
+namespace bpf {
+
+TimeInStateLayout::TimeInStateLayout(uint32_t nCpus,
+                                     const std::vector<std::vector<uint32_t>> &policyFreqs,
+                                     const std::vector<std::vector<uint32_t>> &policyCpus)
+      : nCpus(nCpus), policyCpus(policyCpus), concurrentColumns(nCpus) {
+    for (const auto &freqs : policyFreqs) {
+        policyFreqCounts.push_back(freqs.size());
+        freqOffsets.push_back(freqColumns);
+        freqColumns += freqs.size();
+    }
+    for (const auto &cpus : policyCpus) {
+        policyCpuOffsets.push_back(concurrentColumns);
+        concurrentColumns += cpus.size();
+    }
+}
+
+bool readUidsUpdatedSince(MapReader &lastUpdateMap, uint64_t lastUpdate, uint64_t *newLastUpdate,
+                          std::unordered_set<uint32_t> *uids) {
+    std::vector<uint8_t> keys, values;
+    if (!lastUpdateMap.readAll(&keys, &values)) return false;
+
+    const size_t count = keys.size() / sizeof(uint32_t);
+    uids->reserve(count);
+    // Updates that occurred during the previous read may have been missed. To mitigate
+    // this, don't ignore entries updated up to 1s before lastUpdate
+    constexpr uint64_t NSEC_PER_SEC = 1000000000;
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t uid;
+        uint64_t uidLastUpdate;
+        memcpy(&uid, keys.data() + i * sizeof(uid), sizeof(uid));
+        memcpy(&uidLastUpdate, values.data() + i * sizeof(uidLastUpdate), sizeof(uidLastUpdate));
+        if (uidLastUpdate + NSEC_PER_SEC < lastUpdate) continue;
+        if (uidLastUpdate > *newLastUpdate) *newLastUpdate = uidLastUpdate;
+        uids->insert(uid);
+    }
+    return true;
+}
+
+// Returns the (uid, entry index) pairs of the keys that pass uidFilter, sorted by uid so that all
+// buckets of a UID can be summed into a single table row. The returned vector is reused by the
+// next call on the same thread.
+static const std::vector<std::pair<uint32_t, uint32_t>> &sortEntriesByUid(
+        const std::vector<uint8_t> &keys, const std::unordered_set<uint32_t> *uidFilter) {
+    const size_t count = keys.size() / sizeof(time_key_t);
+    thread_local std::vector<std::pair<uint32_t, uint32_t>> entries;
+    entries.clear();
+    entries.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        time_key_t key;
+        memcpy(&key, keys.data() + i * sizeof(key), sizeof(key));
+        if (uidFilter && uidFilter->find(key.uid) == uidFilter->end()) continue;
+        entries.emplace_back(key.uid, i);
+    }
+    std::sort(entries.begin(), entries.end());
+    return entries;
+}
+
+// Returns the row of uid, appending a zeroed one if uid is not the last UID of the table.
+static uint64_t *rowForUid(UidTimeTable *table, uint32_t uid) {
+    if (table->uids.empty() || table->uids.back() != uid) {
+        table->uids.push_back(uid);
+        table->times.resize(table->times.size() + table->columns, 0);
+    }
+    return table->row(table->size() - 1);
+}
+
+void fillUidTimeInStateTable(const TimeInStateLayout &layout, const std::vector<uint8_t> &keys,
+                             const std::vector<uint8_t> &values,
+                             const std::unordered_set<uint32_t> *uidFilter, UidTimeTable *table) {
+    table->clear(layout.freqColumns, layout.freqOffsets);
+    const size_t valueSize = layout.nCpus * sizeof(tis_val_t);
+    for (const auto &[uid, index] : sortEntriesByUid(keys, uidFilter)) {
+        uint64_t *row = rowForUid(table, uid);
+        time_key_t key;
+        memcpy(&key, keys.data() + index * sizeof(key), sizeof(key));
+        auto vals = reinterpret_cast<const tis_val_t *>(values.data() + index * valueSize);
+
+        const uint32_t offset = key.bucket * FREQS_PER_ENTRY;
+        for (uint32_t policy = 0; policy < layout.policyFreqCounts.size(); ++policy) {
+            const uint32_t freqCount = layout.policyFreqCounts[policy];
+            if (offset >= freqCount) continue;
+            const uint32_t n = std::min<uint32_t>(FREQS_PER_ENTRY, freqCount - offset);
+            uint64_t *dst = row + layout.freqOffsets[policy] + offset;
+            for (const auto &cpu : layout.policyCpus[policy]) {
+                for (uint32_t i = 0; i < n; ++i) dst[i] += vals[cpu].ar[i];
+            }
+        }
+    }
+}
+
+bool fillUidConcurrentTimesTable(const TimeInStateLayout &layout, const std::vector<uint8_t> &keys,
+                                 const std::vector<uint8_t> &values,
+                                 const std::unordered_set<uint32_t> *uidFilter,
+                                 UidTimeTable *table) {
+    table->clear(layout.concurrentColumns, layout.policyCpuOffsets);
+    const size_t valueSize = layout.nCpus * sizeof(concurrent_val_t);
+    for (const auto &[uid, index] : sortEntriesByUid(keys, uidFilter)) {
+        time_key_t key;
+        memcpy(&key, keys.data() + index * sizeof(key), sizeof(key));
+        if (key.bucket > (layout.nCpus - 1) / CPUS_PER_ENTRY) return false;
+        uint64_t *row = rowForUid(table, uid);
+        auto vals = reinterpret_cast<const concurrent_val_t *>(values.data() + index * valueSize);
+
+        const uint32_t offset = key.bucket * CPUS_PER_ENTRY;
+        const uint32_t activeCount = std::min<uint32_t>(CPUS_PER_ENTRY, layout.nCpus - offset);
+        for (uint32_t cpu = 0; cpu < layout.nCpus; ++cpu) {
+            for (uint32_t i = 0; i < activeCount; ++i) row[offset + i] += vals[cpu].active[i];
+        }
+
+        for (uint32_t policy = 0; policy < layout.policyCpus.size(); ++policy) {
+            const uint32_t cpuCount = layout.policyCpus[policy].size();
+            if (offset >= cpuCount) continue;
+            const uint32_t n = std::min<uint32_t>(CPUS_PER_ENTRY, cpuCount - offset);
+            uint64_t *dst = row + layout.policyCpuOffsets[policy] + offset;
+            for (const auto &cpu : layout.policyCpus[policy]) {
+                for (uint32_t i = 0; i < n; ++i) dst[i] += vals[cpu].policy[i];
+            }
+        }
+    }
+    return true;
+}
+
+// Returns the end column of the given policy in table.
+static uint32_t policyEnd(const UidTimeTable &table, size_t policy) {
+    return policy + 1 < table.policyOffsets.size() ? table.policyOffsets[policy + 1]
+                                                   : table.columns;
+}
+
+std::unordered_map<uint32_t, std::vector<std::vector<uint64_t>>> uidTimeInStateTableToMap(
+        const UidTimeTable &table) {
+    std::unordered_map<uint32_t, std::vector<std::vector<uint64_t>>> map;
+    map.reserve(table.size());
+    for (size_t i = 0; i < table.size(); ++i) {
+        const uint64_t *row = table.row(i);
+        auto &times = map[table.uids[i]];
+        times.reserve(table.policyOffsets.size());
+        for (size_t policy = 0; policy < table.policyOffsets.size(); ++policy) {
+            times.emplace_back(row + table.policyOffsets[policy], row + policyEnd(table, policy));
+        }
+    }
+    return map;
+}
+
+concurrent_time_t uidConcurrentTimesTableRow(const UidTimeTable &table, size_t i) {
+    const uint64_t *row = table.row(i);
+    concurrent_time_t times;
+    times.active.assign(row, row + (table.policyOffsets.empty() ? table.columns
+                                                                : table.policyOffsets[0]));
+    times.policy.reserve(table.policyOffsets.size());
+    for (size_t policy = 0; policy < table.policyOffsets.size(); ++policy) {
+        times.policy.emplace_back(row + table.policyOffsets[policy], row + policyEnd(table, policy));
+    }
+    return times;
+}
+
+} // namespace bpf
+} // namespace android
@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "cputimeinstate.h"
+
+namespace android {
+namespace bpf {
+
+// Reads the entries of a BPF map in bulk. The device implementation in cputimeinstate.cpp uses
+// BPF_MAP_LOOKUP_BATCH where the kernel supports it; FakeMapReader serves entries from memory so
+// that the table code below can be tested and benchmarked on host.
+class MapReader {
+  public:
+    virtual ~MapReader() = default;
+
+    // Replaces the contents of keys and values with every entry of the map, packed back to back
+    // with keySize and valueSize bytes per entry respectively. Returns false on error.
+    virtual bool readAll(std::vector<uint8_t> *keys, std::vector<uint8_t> *values) = 0;
+};
+
+class FakeMapReader : public MapReader {
+  public:
+    FakeMapReader(size_t keySize, size_t valueSize) : mKeySize(keySize), mValueSize(valueSize) {}
+
+    // Inserts or replaces an entry. key must point to keySize bytes and value to valueSize bytes.
+    void put(const void *key, const void *value) {
+        auto k = static_cast<const uint8_t *>(key);
+        auto v = static_cast<const uint8_t *>(value);
+        mEntries[std::vector<uint8_t>(k, k + mKeySize)].assign(v, v + mValueSize);
+    }
+
+    void erase(const void *key) {
+        auto k = static_cast<const uint8_t *>(key);
+        mEntries.erase(std::vector<uint8_t>(k, k + mKeySize));
+    }
+
+    bool readAll(std::vector<uint8_t> *keys, std::vector<uint8_t> *values) override {
+        keys->resize(mEntries.size() * mKeySize);
+        values->resize(mEntries.size() * mValueSize);
+        size_t i = 0;
+        for (const auto &[key, value] : mEntries) {
+            memcpy(keys->data() + i * mKeySize, key.data(), mKeySize);
+            memcpy(values->data() + i * mValueSize, value.data(), mValueSize);
+            ++i;
+        }
+        return true;
+    }
+
+  private:
+    size_t mKeySize;
+    size_t mValueSize;
+    std::map<std::vector<uint8_t>, std::vector<uint8_t>> mEntries;
+};
+
+// CPU topology the time_in_state maps are laid out for.
+struct TimeInStateLayout {
+    TimeInStateLayout() = default;
+    TimeInStateLayout(uint32_t nCpus, const std::vector<std::vector<uint32_t>> &policyFreqs,
+                      const std::vector<std::vector<uint32_t>> &policyCpus);
+
+    uint32_t nCpus = 0;
+    std::vector<std::vector<uint32_t>> policyCpus;
+    // Number of frequencies of each policy.
+    std::vector<uint32_t> policyFreqCounts;
+    // Column of the lowest frequency of each policy in a time in state table row.
+    std::vector<uint32_t> freqOffsets;
+    uint32_t freqColumns = 0;
+    // Column of the first policy time of each policy in a concurrent times table row. Active
+    // times take up the first nCpus columns.
+    std::vector<uint32_t> policyCpuOffsets;
+    uint32_t concurrentColumns = 0;
+};
+
+// Reads the UIDs in uid_last_update_map that ran at or after lastUpdate (with one second of slack
+// for updates racing with the previous read) into uids, and raises *newLastUpdate to the latest
+// update time seen. Returns false on error.
+bool readUidsUpdatedSince(MapReader &lastUpdateMap, uint64_t lastUpdate, uint64_t *newLastUpdate,
+                          std::unordered_set<uint32_t> *uids);
+
+// Sums packed uid_time_in_state_map entries (time_key_t keys, per-CPU tis_val_t values) into a
+// table with layout.freqColumns columns and layout.freqOffsets policy offsets. If uidFilter is set,
+// other UIDs are skipped.
+void fillUidTimeInStateTable(const TimeInStateLayout &layout, const std::vector<uint8_t> &keys,
+                             const std::vector<uint8_t> &values,
+                             const std::unordered_set<uint32_t> *uidFilter, UidTimeTable *table);
+
+// Sums packed uid_concurrent_times_map entries (time_key_t keys, per-CPU concurrent_val_t values)
+// into a table with layout.concurrentColumns columns and layout.policyCpuOffsets policy offsets;
+// the active times come before the first policy. If uidFilter is set, other UIDs are skipped.
+// Returns false if an entry has an invalid bucket.
+bool fillUidConcurrentTimesTable(const TimeInStateLayout &layout, const std::vector<uint8_t> &keys,
+                                 const std::vector<uint8_t> &values,
+                                 const std::unordered_set<uint32_t> *uidFilter,
+                                 UidTimeTable *table);
+
+// Converts a table filled by fillUidTimeInStateTable() to the format of getUidsCpuFreqTimes().
+std::unordered_map<uint32_t, std::vector<std::vector<uint64_t>>> uidTimeInStateTableToMap(
+        const UidTimeTable &table);
+
+// Returns row i of a table filled by fillUidConcurrentTimesTable() in the format of
+// getUidConcurrentTimes().
+concurrent_time_t uidConcurrentTimesTableRow(const UidTimeTable &table, size_t i);
+
+} // namespace bpf
+} // namespace android
@@ -0,0 +1,121 @@
+#include "libbroadcastring/broadcast_ring.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+namespace android {
+namespace dvr {
+namespace {
+
+// A typical telemetry sample.
+struct alignas(8) Sample {
+  uint64_t sequence;
+  uint64_t timestamp_ns;
+  uint64_t values[6];
+};
+
+template <bool WakeReaders>
+struct BenchmarkTraits : public DefaultRingTraits {
+  static constexpr bool kWakeReaders = WakeReaders;
+};
+
+constexpr uint32_t kRecordCount = 1024;
+
+// The writer puts a sample every microsecond, well above typical telemetry
+// rates, since the ring is not meant to be written in a tight loop.
+constexpr std::chrono::nanoseconds kPutInterval(1000);
+
+int64_t NowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// One writer (the benchmark thread) and range(0) readers copying samples out
+// range(1) at a time, either polling or blocking in Wait(). Reports the
+// fraction of samples that were overwritten before a reader got to them, and
+// the average time from Put() to a reader having copied the sample.
+template <bool WakeReaders>
+void BM_PutGet(benchmark::State& state) {
+  using Ring = BroadcastRing<Sample, BenchmarkTraits<WakeReaders>>;
+  const int reader_count = state.range(0);
+  const uint32_t batch_size = state.range(1);
+
+  std::unique_ptr<uint64_t[]> memory(
+      new uint64_t[Ring::MemorySize(kRecordCount) / sizeof(uint64_t) + 1]);
+  Ring ring = Ring::Create(memory.get(), Ring::MemorySize(kRecordCount),
+                           kRecordCount);
+
+  std::atomic<bool> quit(false);
+  std::atomic<uint64_t> records_read(0);
+  std::atomic<uint64_t> records_lost(0);
+  std::atomic<int64_t> total_latency_ns(0);
+  std::vector<std::thread> readers;
+  for (int i = 0; i < reader_count; ++i) {
+    readers.emplace_back([&]() {
+      std::vector<Sample> samples(batch_size);
+      uint32_t sequence = ring.GetNextSequence();
+      uint64_t read = 0;
+      uint64_t lost = 0;
+      int64_t latency_ns = 0;
+      while (!quit.load(std::memory_order_relaxed)) {
+        uint32_t requested_sequence = sequence;
+        uint32_t count = ring.Get(&sequence, samples.data(), batch_size);
+        if (count == 0) {
+          if constexpr (WakeReaders) ring.Wait(sequence, 1000000);
+          continue;
+        }
+        const int64_t now_ns = NowNs();
+        for (uint32_t i = 0; i < count; ++i)
+          latency_ns += now_ns - samples[i].timestamp_ns;
+        lost += sequence - requested_sequence;
+        read += count;
+        sequence += count;
+      }
+      records_read += read;
+      records_lost += lost;
+      total_latency_ns += latency_ns;
+    });
+  }
+
+  Sample sample = {};
+  auto next_put = std::chrono::steady_clock::now();
+  for (auto _ : state) {
+    while (std::chrono::steady_clock::now() < next_put) {
+      // Busy wait to keep the put rate steady.
+    }
+    next_put += kPutInterval;
+    sample.timestamp_ns = NowNs();
+    ring.Put(sample);
+    sample.sequence++;
+  }
+
+  quit = true;
+  for (auto& reader : readers) reader.join();
+
+  state.counters["lost"] =
+      static_cast<double>(records_lost) / (records_lost + records_read);
+  state.counters["latency_ns"] =
+      static_cast<double>(total_latency_ns) / records_read;
+}
+
+void ReaderArgs(benchmark::internal::Benchmark* b) {
+  for (int readers : {1, 2, 4}) {
+    for (int batch : {1, 16}) b->Args({readers, batch});
+  }
+  b->UseRealTime();
+}
+
+BENCHMARK_TEMPLATE(BM_PutGet, false)->Apply(ReaderArgs);
+BENCHMARK_TEMPLATE(BM_PutGet, true)->Apply(ReaderArgs);
+
+}  // namespace
+}  // namespace dvr
+}  // namespace android
+
+BENCHMARK_MAIN();
@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include <memory>
 #include <thread>  // NOLINT
+#include <vector>
 #include <sys/mman.h>
 
 #include <gtest/gtest.h>
@@ -96,6 +97,12 @@ using Dynamic_16_NxM_1plus1 = TraitsDynamic<Sized<16>, false, 1, 1>;
 using Dynamic_16_NxM_5plus11 = TraitsDynamic<Sized<16>, false, 5, 11>;
 using Dynamic_256_NxM_1plus0 = TraitsDynamic<Sized<256>, false, 1, 0>;
 
+struct Waking_16_NxM : public Traits<Sized<16>, false, 0, 1, 7> {
+  using Ring = BroadcastRing<Record, Waking_16_NxM>;
+  static constexpr bool kWakeReaders = true;
+  static uint32_t MinCount() { return 8; }
+};
+
 using Static_8_8x1 = TraitsStatic<Sized<8>, 1>;
 using Static_8_8x16 = TraitsStatic<Sized<8>, 16>;
 using Static_16_16x8 = TraitsStatic<Sized<16>, 8>;
@@ -192,6 +199,37 @@ TYPED_TEST(BroadcastRingTest, FillOnce) {
   }
 }
 
+TYPED_TEST(BroadcastRingTest, FillOnceGetBatch) {
+  using Record = typename TypeParam::Record;
+  using Ring = typename TypeParam::Ring;
+  Ring ring;
+  auto mmap = CreateRing(&ring, Ring::Traits::MinCount());
+  const uint32_t next_sequence_at_start = ring.GetNextSequence();
+  for (uint32_t i = 0; i < ring.record_count(); ++i)
+    ring.Put(Record(FillChar(i)));
+  {
+    uint32_t sequence = ring.GetOldestSequence();
+    std::vector<Record> records(ring.record_count() + 1);
+    EXPECT_EQ(ring.record_count(),
+              ring.Get(&sequence, records.data(), records.size()));
+    EXPECT_EQ(next_sequence_at_start, sequence);
+    for (uint32_t i = 0; i < ring.record_count(); ++i)
+      EXPECT_EQ(Record(FillChar(i)), records[i]);
+    EXPECT_EQ(Record(), records[ring.record_count()]);
+  }
+  {
+    uint32_t sequence = ring.GetNewestSequence();
+    Record records[2];
+    EXPECT_EQ(1U, ring.Get(&sequence, records, 2));
+    EXPECT_EQ(Record(FillChar(ring.record_count() - 1)), records[0]);
+  }
+  {
+    uint32_t sequence = ring.GetNextSequence();
+    Record record;
+    EXPECT_EQ(0U, ring.Get(&sequence, &record, 1));
+  }
+}
+
 TYPED_TEST(BroadcastRingTest, FillTwice) {
   using Record = typename TypeParam::Record;
   using Ring = typename TypeParam::Ring;
@@ -325,6 +363,65 @@ TYPED_TEST(BroadcastRingTest, Import) {
   }
 }
 
+TEST(BroadcastRingTest, PutMultiple) {
+  using Ring = Dynamic_16_NxM_5plus11::Ring;
+  using Record = Ring::Record;
+  Ring ring;
+  auto mmap = CreateRing(&ring, Ring::Traits::MinCount());
+
+  // Wrap around the end of the ring a few times.
+  uint32_t sequence = ring.GetNextSequence();
+  for (int i = 0; i < 20; ++i) {
+    const Record out_records[] = {Record(FillChar(i)), Record(FillChar(i + 1)),
+                                  Record(FillChar(i + 2))};
+    ring.Put(out_records, 3);
+
+    Record in_records[5];
+    EXPECT_EQ(3U, ring.Get(&sequence, in_records, 5));
+    for (int j = 0; j < 3; ++j) EXPECT_EQ(out_records[j], in_records[j]);
+    sequence += 3;
+  }
+}
+
+TEST(BroadcastRingTest, WaitTimesOut) {
+  using Ring = Waking_16_NxM::Ring;
+  Ring ring;
+  auto mmap = CreateRing(&ring, Ring::Traits::MinCount());
+  EXPECT_FALSE(ring.Wait(ring.GetNextSequence(), 1000000));
+  EXPECT_TRUE(ring.Wait(ring.GetNextSequence() - 1, 0));
+}
+
+TEST(BroadcastRingTest, ThreadedWait) {
+  using Ring = Waking_16_NxM::Ring;
+  using Record = Ring::Record;
+  Ring ring;
+  auto mmap = CreateRing(&ring, Ring::Traits::MinCount());
+
+  constexpr uint32_t kRecordsToProcess = 1000;
+  std::atomic<uint32_t> records_read(0);
+  uint32_t sequence = ring.GetNextSequence();
+  std::thread reader([&ring, &records_read, sequence]() mutable {
+    while (records_read < kRecordsToProcess) {
+      ASSERT_TRUE(ring.Wait(sequence));
+      Record record;
+      ASSERT_TRUE(ring.Get(&sequence, &record));
+      EXPECT_EQ(Record(FillChar(records_read)), record);
+      sequence++;
+      records_read++;
+    }
+  });
+
+  // Put each record once the previous one was read, which is usually while
+  // the reader is blocked in Wait().
+  for (uint32_t i = 0; i < kRecordsToProcess; ++i) {
+    while (records_read < i) {
+      std::this_thread::yield();
+    }
+    ring.Put(Record(FillChar(i)));
+  }
+  reader.join();
+}
+
 TEST(BroadcastRingTest, ShouldFailImportIfStaticSizeMismatch) {
   using OriginalRing = typename Static_16_16x16::Ring;
   using RecordSizeMismatchRing = typename Static_8_8x16::Ring;
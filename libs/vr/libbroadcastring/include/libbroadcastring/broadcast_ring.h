@@ -1,9 +1,15 @@
 #ifndef ANDROID_DVR_BROADCAST_RING_H_
 #define ANDROID_DVR_BROADCAST_RING_H_
 
+#include <errno.h>
 #include <inttypes.h>
+#include <linux/futex.h>
 #include <stddef.h>
 #include <stdio.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
 #include <atomic>
 #include <limits>
 #include <tuple>
@@ -31,8 +37,20 @@ struct DefaultRingTraits {
 
   // Set this to the min number of records that must be readable.
   static constexpr uint32_t kMinAvailableRecords = 1;
+
+  // Set this to true to wake readers blocked in Wait() on every Put(). This
+  // costs the writer a syscall per Put(), even when nobody is waiting.
+  static constexpr bool kWakeReaders = false;
 };
 
+// Evaluates to Traits::kWakeReaders, or false for traits that predate it.
+template <typename Traits, typename = void>
+struct RingWakesReaders : std::false_type {};
+
+template <typename Traits>
+struct RingWakesReaders<Traits, decltype(void(Traits::kWakeReaders))>
+    : std::integral_constant<bool, Traits::kWakeReaders> {};
+
 // Nonblocking ring suitable for concurrent single-writer, multi-reader access.
 //
 // Readers never block the writer and thus this is a nondeterministically lossy
@@ -54,6 +72,11 @@ struct DefaultRingTraits {
 // header when indexing the ring, so that it is possible to extend the record
 // type without breaking the read-side ABI.
 //
+// Records have a fixed size. Variable-size messages can be written as a run of
+// up to kMaxReservedRecords consecutive records with a single Put(), which
+// makes them visible to readers all at once; readers can then copy the whole
+// run out with one batched Get().
+//
 // Avoid calling Put() in a tight loop; there should be significantly more time
 // between successive puts than it takes to read one record from memory to
 // ensure Get() completes quickly. This requirement should not be difficult to
@@ -123,6 +146,12 @@ struct DefaultRingTraits {
 //         ProcessRecord(sequence, record);
 //         sequence++;
 //       }
+//     } else if (you_want_to_copy_records_in_batches) {
+//       Record records[kBatchSize];
+//       while (uint32_t count = ring.Get(&sequence, records, kBatchSize)) {
+//         ProcessRecords(sequence, records, count);
+//         sequence += count;
+//       }
 //     } else if (you_want_to_skip_to_the_newest_record) {
 //       if (ring.GetNewest(&sequence, &record)) {
 //         ProcessRecord(sequence, record);
@@ -131,6 +160,10 @@ struct DefaultRingTraits {
 //     }
 //
 //     DoSomethingExpensiveOrBlocking();
+//
+//     // Or, if the ring was created with kWakeReaders, sleep until the next
+//     // record is published:
+//     ring.Wait(sequence);
 //   }
 //
 //   CHECK(!munmap(mmap_base, mmap_size));
@@ -151,6 +184,8 @@ class BroadcastRing {
     // If both record size and count are static then the overall size is too.
     static constexpr bool kIsStaticSize =
         BaseTraits::kUseStaticRecordSize && kUseStaticRecordCount;
+
+    static constexpr bool kWakeReaders = RingWakesReaders<BaseTraits>::value;
   };
 
   static constexpr bool IsPowerOfTwo(uint32_t size) {
@@ -257,12 +292,21 @@ class BroadcastRing {
   // Writes a record to the ring.
   //
   // The oldest record is overwritten unless the ring is not already full.
-  void Put(const Record& record) {
-    const int kRecordCount = 1;
-    Reserve(kRecordCount);
+  void Put(const Record& record) { Put(&record, 1); }
+
+  // Writes |count| consecutive records to the ring, publishing them together.
+  //
+  // |count| must not exceed Traits::kMaxReservedRecords. The oldest records
+  // are overwritten as necessary.
+  void Put(const Record* records, uint32_t count) {
+    Reserve(count);
     Geometry geometry = GetGeometry();
-    PutRecordInternal(&record, record_mmap_writer(geometry.tail_index));
-    Publish(kRecordCount);
+    for (uint32_t i = 0; i < count; ++i) {
+      PutRecordInternal(&records[i],
+                        record_mmap_writer(SequenceToIndex(
+                            geometry.tail + i, geometry.record_count)));
+    }
+    Publish(count);
   }
 
   // Gets sequence number of the oldest currently available record.
@@ -355,6 +399,90 @@ class BroadcastRing {
     }
   }
 
+  // Copies up to |max_count| consecutive records, starting with the oldest
+  // available record with sequence at least |*sequence|, to |records|.
+  //
+  // Returns the number of records copied, which is 0 if there is no recent
+  // enough record available.
+  //
+  // Updates |*sequence| with the sequence number of the first record returned.
+  // To get the records following the batch, increment this number by the
+  // returned count.
+  //
+  // This synchronizes with Put() in the same way as the single record Get(),
+  // but only needs to check |head| and |tail| once per batch.
+  uint32_t Get(uint32_t* sequence /*inout*/, Record* records /*out*/,
+               uint32_t max_count) const {
+    for (;;) {
+      uint32_t tail = std::atomic_load_explicit(&header_mmap()->tail,
+                                                std::memory_order_acquire);
+      uint32_t head = std::atomic_load_explicit(&header_mmap()->head,
+                                                std::memory_order_relaxed);
+
+      if (tail - head > record_count())
+        continue;  // Concurrent modification; re-try.
+
+      if (*sequence - head > tail - head)
+        *sequence = head;  // Out of window, skip forward to first available.
+
+      uint32_t count = std::min(tail - *sequence, max_count);
+      if (count == 0) return 0;  // No new records available.
+
+      for (uint32_t i = 0; i < count; ++i) {
+        GetRecordInternal(record_mmap_reader(SequenceToIndex(
+                              *sequence + i, record_count())),
+                          &records[i]);
+      }
+
+      // NB: It is not sufficient to change this to a load-acquire of |head|.
+      std::atomic_thread_fence(std::memory_order_acquire);
+
+      uint32_t final_head = std::atomic_load_explicit(
+          &header_mmap()->head, std::memory_order_relaxed);
+
+      // Records are overwritten in sequence order, so if the first record of
+      // the batch is intact then so are the others.
+      if (final_head - head > *sequence - head)
+        continue;  // Concurrent modification; re-try.
+
+      return count;
+    }
+  }
+
+  // Blocks until a record with sequence |sequence| is published, or a later
+  // one if |sequence| is no longer available, or until |timeout_ns| has
+  // elapsed if it is not negative.
+  //
+  // Returns false on timeout. Requires Traits::kWakeReaders, which makes the
+  // writer wake readers on every Put(). Works with a read-only mapping.
+  bool Wait(uint32_t sequence, int64_t timeout_ns = -1) const {
+    static_assert(Traits::kWakeReaders,
+                  "Wait() requires a ring with kWakeReaders");
+    struct timespec deadline;
+    if (timeout_ns >= 0) {
+      CHECK_EQ(0, clock_gettime(CLOCK_MONOTONIC, &deadline));
+      int64_t nsec = deadline.tv_nsec + timeout_ns % 1000000000;
+      deadline.tv_sec += timeout_ns / 1000000000 + nsec / 1000000000;
+      deadline.tv_nsec = nsec % 1000000000;
+    }
+    for (;;) {
+      uint32_t tail = std::atomic_load_explicit(&header_mmap()->tail,
+                                                std::memory_order_acquire);
+      if (tail != sequence) return true;
+
+      // Sleeps only if |tail| still equals |sequence|, so a Put() between the
+      // load above and the syscall is not missed.
+      if (syscall(SYS_futex, &header_mmap()->tail, FUTEX_WAIT_BITSET,
+                  sequence, timeout_ns >= 0 ? &deadline : nullptr, nullptr,
+                  FUTEX_BITSET_MATCH_ANY) != 0 &&
+          errno == ETIMEDOUT) {
+        return std::atomic_load_explicit(&header_mmap()->tail,
+                                         std::memory_order_acquire) !=
+               sequence;
+      }
+    }
+  }
+
   // Copies the newest available record with sequence at least |*sequence| to
   // |record|.
   //
@@ -594,6 +722,13 @@ class BroadcastRing {
     std::atomic_store_explicit(&header_mmap()->tail,
                                geometry.tail + publish_count,
                                std::memory_order_release);
+
+    // The futex word is |tail| itself, which keeps the mmap layout unchanged.
+    // Not private, since readers are usually in other processes.
+    if (Traits::kWakeReaders) {
+      syscall(SYS_futex, &header_mmap()->tail, FUTEX_WAKE,
+              std::numeric_limits<int>::max(), nullptr, nullptr, 0);
+    }
   }
 
   // Helpers to compute addresses in mmap area.
@@ -0,0 +1,341 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <new>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <pdx/rpc/argument_encoder.h>
+#include <pdx/rpc/buffer_wrapper.h>
+#include <pdx/rpc/message_buffer.h>
+#include <pdx/rpc/payload.h>
+#include <pdx/utility.h>
+
+using namespace android::pdx::rpc;
+using namespace android::pdx;
+
+// Counts heap allocations so that the benchmarks can report how many
+// allocations each operation makes.
+static std::atomic<size_t> gAllocations{0};
+
+void* operator new(size_t size) {
+  gAllocations++;
+  if (void* p = malloc(size))
+    return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { free(p); }
+
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+namespace {
+
+constexpr size_t kMaxStaticBufferSize = 20480;
+
+// Payload backed by the thread-local SendBuffer, as used by real clients and
+// services.
+class TestPayload : public MessagePayload<SendBuffer>,
+                    public MessageWriter,
+                    public MessageReader,
+                    public NoOpResourceMapper {
+ public:
+  // MessageWriter
+  void* GetNextWriteBufferSection(size_t size) override {
+    const size_t section_offset = Size();
+    Extend(size);
+    return Data() + section_offset;
+  }
+
+  OutputResourceMapper* GetOutputResourceMapper() override { return this; }
+
+  // MessageReader
+  BufferSection GetNextReadBufferSection() override {
+    return {&*ConstCursor(), &*ConstEnd()};
+  }
+
+  void ConsumeReadBufferSectionData(const void* new_start) override {
+    std::advance(ConstCursor(), PointerDistance(new_start, &*ConstCursor()));
+  }
+
+  InputResourceMapper* GetInputResourceMapper() override { return this; }
+};
+
+// Payload backed by a fixed array, as a lower bound for the cost of buffer
+// management.
+class StaticBuffer : public MessageWriter,
+                     public MessageReader,
+                     public NoOpResourceMapper {
+ public:
+  void Clear() {
+    read_ptr_ = buffer_;
+    write_ptr_ = 0;
+  }
+  void Rewind() { read_ptr_ = buffer_; }
+
+  // MessageWriter
+  void* GetNextWriteBufferSection(size_t size) override {
+    void* ptr = buffer_ + write_ptr_;
+    write_ptr_ += size;
+    return ptr;
+  }
+
+  OutputResourceMapper* GetOutputResourceMapper() override { return this; }
+
+  // MessageReader
+  BufferSection GetNextReadBufferSection() override {
+    return {read_ptr_, std::end(buffer_)};
+  }
+
+  void ConsumeReadBufferSectionData(const void* new_start) override {
+    read_ptr_ = static_cast<const uint8_t*>(new_start);
+  }
+
+  InputResourceMapper* GetInputResourceMapper() override { return this; }
+
+ private:
+  uint8_t buffer_[kMaxStaticBufferSize];
+  const uint8_t* read_ptr_{buffer_};
+  size_t write_ptr_{0};
+};
+
+void ReportAllocations(benchmark::State& state, size_t allocations) {
+  state.counters["allocs"] =
+      benchmark::Counter(allocations, benchmark::Counter::kAvgIterations);
+}
+
+template <typename T, typename U>
+bool Equals(const T& a, const U& b) {
+  return a == b;
+}
+
+template <typename T, typename U>
+bool Equals(const BufferWrapper<T>& a, const BufferWrapper<U>& b) {
+  return std::equal(a.begin(), a.end(), b.begin(), b.end());
+}
+
+// Moves |data_size| bytes into the output buffer without any serialization,
+// to measure the overhead of the buffer alone.
+template <typename Buffer>
+void BM_SerializeBaseline(benchmark::State& state) {
+  Buffer buffer;
+  std::vector<uint8_t> fake_data(state.range(0));
+  const size_t allocations = gAllocations;
+  for (auto _ : state) {
+    buffer.Clear();
+    memcpy(buffer.GetNextWriteBufferSection(fake_data.size()),
+           fake_data.data(), fake_data.size());
+  }
+  ReportAllocations(state, gAllocations - allocations);
+  state.SetBytesProcessed(state.iterations() * fake_data.size());
+}
+
+// Copies |data_size| bytes out of the input buffer without any
+// deserialization, to measure the overhead of the buffer alone.
+template <typename Buffer>
+void BM_DeserializeBaseline(benchmark::State& state) {
+  Buffer buffer;
+  std::vector<uint8_t> fake_data(state.range(0));
+  memcpy(buffer.GetNextWriteBufferSection(fake_data.size()), fake_data.data(),
+         fake_data.size());
+  const size_t allocations = gAllocations;
+  for (auto _ : state) {
+    buffer.Rewind();
+    auto section = buffer.GetNextReadBufferSection();
+    memcpy(fake_data.data(), section.first, fake_data.size());
+    buffer.ConsumeReadBufferSectionData(
+        AdvancePointer(section.first, fake_data.size()));
+  }
+  ReportAllocations(state, gAllocations - allocations);
+  state.SetBytesProcessed(state.iterations() * fake_data.size());
+}
+
+// Serializes |value| into the output buffer.
+template <typename Buffer, typename T>
+void BM_Serialize(benchmark::State& state, const T& value) {
+  Buffer buffer;
+  const size_t allocations = gAllocations;
+  for (auto _ : state) {
+    buffer.Clear();
+    Serialize(value, &buffer);
+  }
+  ReportAllocations(state, gAllocations - allocations);
+  state.SetBytesProcessed(state.iterations() * GetSerializedSize(value));
+}
+
+// Serializes |value| into the input buffer once, then repeatedly deserializes
+// it into an object of type Output, reused across iterations.
+template <typename Buffer, typename T, typename Output = T>
+void BM_Deserialize(benchmark::State& state, const T& value) {
+  Buffer buffer;
+  Serialize(value, &buffer);
+  Output output{};
+  const size_t allocations = gAllocations;
+  for (auto _ : state) {
+    buffer.Rewind();
+    if (Deserialize(&output, &buffer)) {
+      state.SkipWithError("Deserialization failed");
+      break;
+    }
+  }
+  ReportAllocations(state, gAllocations - allocations);
+  state.SetBytesProcessed(state.iterations() * GetSerializedSize(value));
+  if (!Equals(output, value))
+    state.SkipWithError("Deserialized value does not match");
+}
+
+// Each test is registered for each of the backing buffers: a plain vector,
+// the thread-local MessageBuffer used by clients and services, and a fixed
+// array.
+template <typename T>
+void AddSerializationTest(const std::string& name, const T& value) {
+  if (GetSerializedSize(value) > kMaxStaticBufferSize)
+    abort();  // Won't fit in StaticBuffer.
+  benchmark::RegisterBenchmark(("Serialize/" + name + "/NonTLS").c_str(),
+                               BM_Serialize<Payload, T>, value);
+  benchmark::RegisterBenchmark(("Serialize/" + name + "/TLS").c_str(),
+                               BM_Serialize<TestPayload, T>, value);
+  benchmark::RegisterBenchmark(("Serialize/" + name + "/Static").c_str(),
+                               BM_Serialize<StaticBuffer, T>, value);
+}
+
+template <typename T, typename Output = T>
+void AddDeserializationTest(const std::string& name, const T& value) {
+  if (GetSerializedSize(value) > kMaxStaticBufferSize)
+    abort();  // Won't fit in StaticBuffer.
+  benchmark::RegisterBenchmark(("Deserialize/" + name + "/NonTLS").c_str(),
+                               BM_Deserialize<Payload, T, Output>, value);
+  benchmark::RegisterBenchmark(("Deserialize/" + name + "/TLS").c_str(),
+                               BM_Deserialize<TestPayload, T, Output>, value);
+  benchmark::RegisterBenchmark(("Deserialize/" + name + "/Static").c_str(),
+                               BM_Deserialize<StaticBuffer, T, Output>, value);
+}
+
+template <typename T>
+void AddTest(const std::string& name, const T& value) {
+  AddSerializationTest(name, value);
+  AddDeserializationTest(name, value);
+}
+
+std::string GenerateContainerName(const std::string& type, size_t count) {
+  std::stringstream ss;
+  ss << type << "(" << count << ")";
+  return ss.str();
+}
+
+}  // anonymous namespace
+
+int main(int argc, char** argv) {
+  // Baseline tests to figure out the overhead of buffer resizing and data
+  // transfers.
+  for (int len : {0, 1, 9, 66, 259}) {
+    benchmark::RegisterBenchmark("SerializeBaseline/NonTLS",
+                                 BM_SerializeBaseline<Payload>)
+        ->Arg(len);
+    benchmark::RegisterBenchmark("SerializeBaseline/TLS",
+                                 BM_SerializeBaseline<TestPayload>)
+        ->Arg(len);
+    benchmark::RegisterBenchmark("SerializeBaseline/Static",
+                                 BM_SerializeBaseline<StaticBuffer>)
+        ->Arg(len);
+    benchmark::RegisterBenchmark("DeserializeBaseline/NonTLS",
+                                 BM_DeserializeBaseline<Payload>)
+        ->Arg(len);
+    benchmark::RegisterBenchmark("DeserializeBaseline/TLS",
+                                 BM_DeserializeBaseline<TestPayload>)
+        ->Arg(len);
+    benchmark::RegisterBenchmark("DeserializeBaseline/Static",
+                                 BM_DeserializeBaseline<StaticBuffer>)
+        ->Arg(len);
+  }
+
+  // Individual serialization/deserialization tests.
+  AddTest("bool", true);
+  AddTest("int32_t", 12);
+
+  for (size_t len : {0, 1, 8, 64, 256}) {
+    AddTest(GenerateContainerName("string", len), std::string(len, '*'));
+  }
+  // Serialization is too slow to handle such large strings, add this test for
+  // deserialization only.
+  AddDeserializationTest(GenerateContainerName("string", 10240),
+                         std::string(10240, '*'));
+
+  // Containers of trivially copyable types, encoded element by element and as
+  // a single block.
+  std::vector<std::vector<int32_t>> int_vectors;
+  for (size_t len : {0, 1, 8, 64, 256}) {
+    int_vectors.emplace_back(len);
+    std::iota(int_vectors.back().begin(), int_vectors.back().end(), 0);
+  }
+  for (const auto& int_vector : int_vectors) {
+    AddTest(GenerateContainerName("vector<int32_t>", int_vector.size()),
+            int_vector);
+    AddSerializationTest(
+        GenerateContainerName("WrapBuffer<int32_t>", int_vector.size()),
+        WrapBuffer(int_vector));
+    AddDeserializationTest<BufferWrapper<const int32_t*>,
+                           BufferWrapper<std::vector<int32_t>>>(
+        GenerateContainerName("WrapBuffer<int32_t>", int_vector.size()),
+        WrapBuffer(int_vector));
+  }
+
+  for (size_t len : {0, 1, 8, 64, 256}) {
+    std::vector<float> float_vector(len, 1.0f);
+    AddTest(GenerateContainerName("vector<float>", len),
+            std::move(float_vector));
+  }
+
+  std::vector<std::string> vector_of_strings = {
+      "012345678901234567890123456789", "012345678901234567890123456789",
+      "012345678901234567890123456789", "012345678901234567890123456789",
+      "012345678901234567890123456789",
+  };
+  AddTest(GenerateContainerName("vector<string>", vector_of_strings.size()),
+          std::move(vector_of_strings));
+
+  AddTest("tuple<int, bool, string, double>",
+          std::make_tuple(123, true, std::string{"foobar"}, 1.1));
+
+  for (size_t len : {0, 1, 8, 64}) {
+    std::map<int, std::string> test_map;
+    for (size_t i = 0; i < len; i++)
+      test_map.emplace(i, std::to_string(i));
+    AddTest(GenerateContainerName("map<int, string>", len),
+            std::move(test_map));
+  }
+
+  for (size_t len : {0, 1, 8, 64}) {
+    std::unordered_map<int, std::string> test_map;
+    for (size_t i = 0; i < len; i++)
+      test_map.emplace(i, std::to_string(i));
+    AddTest(GenerateContainerName("unordered_map<int, string>", len),
+            std::move(test_map));
+  }
+
+  std::vector<std::vector<uint8_t>> data_buffers;
+  for (size_t len : {0, 1, 8, 64, 256}) {
+    data_buffers.emplace_back(len);
+  }
+  for (auto& data_buffer : data_buffers) {
+    AddSerializationTest(
+        GenerateContainerName("BufferWrapper<uint8_t*>", data_buffer.size()),
+        BufferWrapper<uint8_t*>(data_buffer.data(), data_buffer.size()));
+    AddDeserializationTest<BufferWrapper<uint8_t*>,
+                           BufferWrapper<std::vector<uint8_t>>>(
+        GenerateContainerName("BufferWrapper<uint8_t*>", data_buffer.size()),
+        BufferWrapper<uint8_t*>(data_buffer.data(), data_buffer.size()));
+  }
+
+  benchmark::Initialize(&argc, argv);
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
@@ -1,6 +1,7 @@
 #ifndef ANDROID_PDX_RPC_BUFFER_WRAPPER_H_
 #define ANDROID_PDX_RPC_BUFFER_WRAPPER_H_
 
+#include <array>
 #include <cstddef>
 #include <memory>
 #include <type_traits>
@@ -13,6 +14,12 @@ namespace rpc {
 // Wrapper class for buffers, providing an interface suitable for
 // SerializeObject and DeserializeObject. This class supports serialization of
 // buffers as raw bytes.
+//
+// Buffers are encoded as a single contiguous block, which is much cheaper to
+// encode and decode than the element-by-element encoding of std::vector and
+// std::array. Use WrapBuffer() to send the contents of those containers as a
+// block without copying them; the receiving side must expect a BufferWrapper
+// of the same element type.
 template <typename T>
 class BufferWrapper;
 
@@ -170,6 +177,29 @@ BufferWrapper<std::vector<T, Allocator>> WrapBuffer(
       std::forward<std::vector<T, Allocator>>(buffer));
 }
 
+// Wraps the contents of |buffer| without copying them. The returned wrapper
+// refers to the storage of |buffer| and must not outlive it.
+template <typename T, typename Allocator>
+BufferWrapper<const T*> WrapBuffer(const std::vector<T, Allocator>& buffer) {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "Only trivially copyable types may be sent as raw bytes.");
+  return BufferWrapper<const T*>(buffer.data(), buffer.size());
+}
+
+template <typename T, std::size_t Size>
+BufferWrapper<T*> WrapBuffer(std::array<T, Size>& buffer) {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "Only trivially copyable types may be sent as raw bytes.");
+  return BufferWrapper<T*>(buffer.data(), Size);
+}
+
+template <typename T, std::size_t Size>
+BufferWrapper<const T*> WrapBuffer(const std::array<T, Size>& buffer) {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "Only trivially copyable types may be sent as raw bytes.");
+  return BufferWrapper<const T*>(buffer.data(), Size);
+}
+
 }  // namespace rpc
 }  // namespace pdx
 }  // namespace android
@@ -106,6 +106,14 @@ template <typename T>
 using EnableIfHasSerializableMembers =
     typename std::enable_if<HasSerializableMembers<T>::value>::type;
 
+// Determines whether the serialized size of type T is independent of its
+// value, in which case the size of a sequence of T can be computed from its
+// length alone.
+template <typename T>
+struct HasFixedSerializedSize
+    : std::integral_constant<bool, std::is_same<T, bool>::value ||
+                                       std::is_floating_point<T>::value> {};
+
 // Utility to simplify overload enable expressions for enum types.
 template <typename T, typename ReturnType = void>
 using EnableIfEnum =
@@ -343,15 +351,28 @@ inline constexpr std::size_t GetSerializedSize(
   return GetEncodingSize(EncodeType(channel_handle)) + sizeof(std::int32_t);
 }
 
-// Overload for standard vector types.
-template <typename T, typename Allocator>
-inline std::size_t GetSerializedSize(const std::vector<T, Allocator>& v) {
-  return std::accumulate(v.begin(), v.end(), GetEncodingSize(EncodeType(v)),
+// Returns the combined serialized size of the elements of array types. Sizes
+// of fixed size elements are computed without visiting each element.
+template <typename T, typename ArrayType>
+inline std::enable_if_t<HasFixedSerializedSize<T>::value, std::size_t>
+GetElementsSerializedSize(const ArrayType& v) {
+  return v.size() * GetSerializedSize(T{});
+}
+template <typename T, typename ArrayType>
+inline std::enable_if_t<!HasFixedSerializedSize<T>::value, std::size_t>
+GetElementsSerializedSize(const ArrayType& v) {
+  return std::accumulate(v.begin(), v.end(), std::size_t{0},
                          [](const std::size_t& sum, const T& object) {
                            return sum + GetSerializedSize(object);
                          });
 }
 
+// Overload for standard vector types.
+template <typename T, typename Allocator>
+inline std::size_t GetSerializedSize(const std::vector<T, Allocator>& v) {
+  return GetEncodingSize(EncodeType(v)) + GetElementsSerializedSize<T>(v);
+}
+
 // Overload for standard map types.
 template <typename Key, typename T, typename Compare, typename Allocator>
 inline std::size_t GetSerializedSize(
@@ -380,19 +401,13 @@ inline std::size_t GetSerializedSize(
 // Overload for ArrayWrapper types.
 template <typename T>
 inline std::size_t GetSerializedSize(const ArrayWrapper<T>& v) {
-  return std::accumulate(v.begin(), v.end(), GetEncodingSize(EncodeType(v)),
-                         [](const std::size_t& sum, const T& object) {
-                           return sum + GetSerializedSize(object);
-                         });
+  return GetEncodingSize(EncodeType(v)) + GetElementsSerializedSize<T>(v);
 }
 
 // Overload for std::array types.
 template <typename T, std::size_t Size>
 inline std::size_t GetSerializedSize(const std::array<T, Size>& v) {
-  return std::accumulate(v.begin(), v.end(), GetEncodingSize(EncodeType(v)),
-                         [](const std::size_t& sum, const T& object) {
-                           return sum + GetSerializedSize(object);
-                         });
+  return GetEncodingSize(EncodeType(v)) + GetElementsSerializedSize<T>(v);
 }
 
 // Overload for std::pair.
@@ -1094,6 +1094,49 @@ TEST(SerializationTest, ArrayWrapper) {
   result.Clear();
 }
 
+TEST(SerializationTest, FixedSizeElements) {
+  Payload result;
+
+  std::vector<float> floats((1 << 4), 1.0f);
+  EXPECT_EQ(3u + (1 << 4) * 5u, GetSerializedSize(floats));
+  Serialize(floats, &result);
+  EXPECT_EQ(GetSerializedSize(floats), result.Size());
+  result.Clear();
+
+  std::array<double, 3> doubles = {{0.0, 1.0, 2.0}};
+  EXPECT_EQ(1u + 3u * 9u, GetSerializedSize(doubles));
+  Serialize(doubles, &result);
+  EXPECT_EQ(GetSerializedSize(doubles), result.Size());
+  result.Clear();
+
+  std::vector<bool> bools = {true, false, true};
+  EXPECT_EQ(1u + 3u, GetSerializedSize(bools));
+  Serialize(bools, &result);
+  EXPECT_EQ(GetSerializedSize(bools), result.Size());
+  result.Clear();
+}
+
+TEST(SerializationTest, WrapBuffer) {
+  Payload result;
+  Payload expected;
+
+  // Contents of containers are sent as a single BIN block.
+  const std::vector<std::uint16_t> value = {0x0201, 0x0403};
+  Serialize(WrapBuffer(value), &result);
+  expected = {ENCODING_TYPE_BIN8, 4, 0x01, 0x02, 0x03, 0x04};
+  EXPECT_EQ(expected, result);
+  result.Clear();
+
+  std::array<std::uint16_t, 2> array = {{0x0201, 0x0403}};
+  Serialize(WrapBuffer(array), &result);
+  EXPECT_EQ(expected, result);
+  result.Clear();
+
+  // The wrappers refer to the containers instead of copying them.
+  EXPECT_EQ(value.data(), WrapBuffer(value).data());
+  EXPECT_EQ(array.data(), WrapBuffer(array).data());
+}
+
 TEST(SerializationTest, pair) {
   Payload result;
   Payload expected;
@@ -2277,6 +2320,24 @@ TEST(DeserializationTest, ArrayWrapper) {
   EXPECT_EQ(expected, result);
 }
 
+TEST(DeserializationTest, WrapBuffer) {
+  Payload buffer;
+  ErrorType error;
+
+  // BIN blocks are copied straight into the wrapped container.
+  buffer = {ENCODING_TYPE_BIN8, 4, 0x01, 0x02, 0x03, 0x04};
+  std::array<std::uint16_t, 2> array = {};
+  auto wrapper = WrapBuffer(array);
+  error = Deserialize(&wrapper, &buffer);
+  EXPECT_EQ(ErrorCode::NO_ERROR, error);
+  EXPECT_EQ((std::array<std::uint16_t, 2>{{0x0201, 0x0403}}), array);
+
+  // Blocks that don't fit are rejected.
+  buffer = {ENCODING_TYPE_BIN8, 6, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06};
+  error = Deserialize(&wrapper, &buffer);
+  EXPECT_EQ(ErrorCode::INSUFFICIENT_DESTINATION_SIZE, error);
+}
+
 TEST(DeserializationTest, pair) {
   Payload buffer;
   ErrorType error;
@@ -21,6 +21,7 @@
 #include "gpumem/GpuMem.h"
 
 #include <android-base/stringprintf.h>
+#include <errno.h>
 #include <libbpf.h>
 #include <libbpf_android.h>
 #include <log/log.h>
@@ -35,6 +36,43 @@ namespace android {
 
 using base::StringAppendF;
 
+namespace {
+
+// Reads the gpu memory total map with the usual key walk.
+class BpfGpuMemTotalReader : public GpuMemTotalReader {
+public:
+    explicit BpfGpuMemTotalReader(const bpf::BpfMap<uint64_t, uint64_t>& map) : mMap(map) {}
+
+    bool readAll(std::vector<GpuMemTotalEntry>* entries) override {
+        entries->clear();
+        if (!mMap.isValid()) return false;
+        auto res = mMap.getFirstKey();
+        // An empty map has no first key.
+        if (!res.ok()) return true;
+        uint64_t key = res.value();
+        while (true) {
+            // A key removed by the kernel since it was walked has no value; skip it rather than
+            // treating the rest of the map as gone.
+            auto value = mMap.readValue(key);
+            if (value.ok()) entries->emplace_back(key, value.value());
+
+            res = mMap.getNextKey(key);
+            if (!res.ok()) {
+                // ENOENT marks the end of the map; anything else leaves the walk incomplete.
+                if (res.error().code() == ENOENT) return true;
+                ALOGE("Failed to walk gpu memory total map: %s", res.error().message().c_str());
+                return false;
+            }
+            key = res.value();
+        }
+    }
+
+private:
+    const bpf::BpfMap<uint64_t, uint64_t>& mMap;
+};
+
+} // namespace
+
 GpuMem::~GpuMem() {
     bpf_detach_tracepoint(kGpuMemTraceGroup, kGpuMemTotalTracepoint);
 }
@@ -79,6 +117,7 @@ void GpuMem::initialize() {
 
 void GpuMem::setGpuMemTotalMap(bpf::BpfMap<uint64_t, uint64_t>& map) {
     mGpuMemTotalMap = std::move(map);
+    resetGpuMemTotalsDelta();
 }
 
 // Dump the snapshots of global and per process memory usage on all gpus
@@ -154,4 +193,17 @@ void GpuMem::traverseGpuMemTotals(const std::function<void(int64_t ts, uint32_t
     }
 }
 
+void GpuMem::traverseGpuMemTotalsDelta(const GpuMemTotalCallback& callback) {
+    ATRACE_CALL();
+
+    BpfGpuMemTotalReader reader(mGpuMemTotalMap);
+    std::lock_guard<std::mutex> lock(mDeltaLock);
+    mDeltaSnapshot.update(systemTime(), reader, callback);
+}
+
+void GpuMem::resetGpuMemTotalsDelta() {
+    std::lock_guard<std::mutex> lock(mDeltaLock);
+    mDeltaSnapshot.clear();
+}
+
 } // namespace android
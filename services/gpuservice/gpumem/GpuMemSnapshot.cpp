@@ -0,0 +1,60 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "gpumem/GpuMemSnapshot.h"
+
+#include <algorithm>
+
+namespace android {
+
+int GpuMemSnapshot::update(int64_t ts, GpuMemTotalReader& reader,
+                           const GpuMemTotalCallback& callback) {
+    if (!reader.readAll(&mNextEntries)) return -1;
+    std::sort(mNextEntries.begin(), mNextEntries.end());
+    // A map walk that lost its place restarts from the first key, so drop repeated keys.
+    mNextEntries.erase(std::unique(mNextEntries.begin(), mNextEntries.end(),
+                                   [](const GpuMemTotalEntry& a, const GpuMemTotalEntry& b) {
+                                       return a.first == b.first;
+                                   }),
+                       mNextEntries.end());
+
+    // Merge the two sorted samples.
+    int count = 0;
+    auto report = [&](uint64_t key, uint64_t size) {
+        callback(ts, key >> 32, static_cast<uint32_t>(key), size);
+        count++;
+    };
+    auto prev = mEntries.cbegin();
+    auto next = mNextEntries.cbegin();
+    while (prev != mEntries.cend() || next != mNextEntries.cend()) {
+        if (next == mNextEntries.cend() || (prev != mEntries.cend() && prev->first < next->first)) {
+            report(prev->first, 0);
+            ++prev;
+        } else if (prev == mEntries.cend() || next->first < prev->first) {
+            report(next->first, next->second);
+            ++next;
+        } else {
+            if (prev->second != next->second) report(next->first, next->second);
+            ++prev;
+            ++next;
+        }
+    }
+
+    mEntries.swap(mNextEntries);
+    return count;
+}
+
+} // namespace android
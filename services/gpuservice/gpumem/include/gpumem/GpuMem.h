@@ -16,11 +16,14 @@
 
 #pragma once
 
+#include <android-base/thread_annotations.h>
 #include <bpf/BpfMap.h>
+#include <gpumem/GpuMemSnapshot.h>
 #include <utils/String16.h>
 #include <utils/Vector.h>
 
 #include <functional>
+#include <mutex>
 
 namespace android {
 
@@ -38,6 +41,12 @@ public:
     // Traverse the gpu memory total map to feed the callback function.
     void traverseGpuMemTotals(const std::function<void(int64_t ts, uint32_t gpuId, uint32_t pid,
                                                        uint64_t size)>& callback);
+    // Traverse only the entries of the gpu memory total map that changed since the previous call,
+    // feeding a size of 0 for entries that went away. The first call, and the first call after
+    // resetGpuMemTotalsDelta(), feeds every entry. All entries of a call share one timestamp.
+    void traverseGpuMemTotalsDelta(const GpuMemTotalCallback& callback);
+    // Drop the snapshot kept by traverseGpuMemTotalsDelta().
+    void resetGpuMemTotalsDelta();
 
 private:
     // Friend class for testing.
@@ -50,6 +59,9 @@ private:
     std::atomic<bool> mInitialized = false;
     // bpf map for GPU memory total data
     android::bpf::BpfMap<uint64_t, uint64_t> mGpuMemTotalMap;
+    // last snapshot reported by traverseGpuMemTotalsDelta
+    std::mutex mDeltaLock;
+    GpuMemSnapshot mDeltaSnapshot GUARDED_BY(mDeltaLock);
 
     // gpu memory tracepoint event category
     static constexpr char kGpuMemTraceGroup[] = "gpu_mem";
@@ -0,0 +1,84 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace android {
+
+// An entry of the gpu memory total map: the key is (gpuId << 32 | pid), the value the size.
+using GpuMemTotalEntry = std::pair<uint64_t, uint64_t>;
+
+using GpuMemTotalCallback =
+        std::function<void(int64_t ts, uint32_t gpuId, uint32_t pid, uint64_t size)>;
+
+// Reads every entry of the gpu memory total map. GpuMem reads the eBPF map; FakeGpuMemTotalReader
+// serves entries from memory so that GpuMemSnapshot can be tested on host.
+class GpuMemTotalReader {
+public:
+    virtual ~GpuMemTotalReader() = default;
+
+    // Replaces the contents of entries with the entries of the map, in any order. Returns false
+    // if the map could not be read completely, in which case entries must not be used.
+    virtual bool readAll(std::vector<GpuMemTotalEntry>* entries) = 0;
+};
+
+class FakeGpuMemTotalReader : public GpuMemTotalReader {
+public:
+    void put(uint32_t gpuId, uint32_t pid, uint64_t size) {
+        mEntries[(static_cast<uint64_t>(gpuId) << 32) | pid] = size;
+    }
+    void erase(uint32_t gpuId, uint32_t pid) {
+        mEntries.erase((static_cast<uint64_t>(gpuId) << 32) | pid);
+    }
+
+    bool readAll(std::vector<GpuMemTotalEntry>* entries) override {
+        entries->assign(mEntries.begin(), mEntries.end());
+        return true;
+    }
+
+private:
+    std::map<uint64_t, uint64_t> mEntries;
+};
+
+// Keeps the last sampled contents of the gpu memory total map so that periodic samples only
+// report the (gpuId, pid) entries that changed. Not thread safe.
+class GpuMemSnapshot {
+public:
+    // Reads the map and calls callback with timestamp ts for every entry that is new or whose size
+    // changed since the previous update, and with a size of 0 for every entry that went away. The
+    // first update, and the first one after clear(), reports every entry. Returns the number of
+    // reported entries, or -1 if the map could not be read, in which case the snapshot is kept.
+    int update(int64_t ts, GpuMemTotalReader& reader, const GpuMemTotalCallback& callback);
+    // Forgets the snapshot.
+    void clear() { mEntries.clear(); }
+    // Number of entries in the snapshot.
+    size_t size() const { return mEntries.size(); }
+
+private:
+    // Sorted by key.
+    std::vector<GpuMemTotalEntry> mEntries;
+    // Scratch buffer for the next sample, swapped with mEntries so that steady state updates
+    // don't allocate.
+    std::vector<GpuMemTotalEntry> mNextEntries;
+};
+
+} // namespace android
@@ -37,51 +37,129 @@ GpuStats::~GpuStats() {
     }
 }
 
-static void addLoadingCount(GpuStatsInfo::Driver driver, bool isDriverLoaded,
-                            GpuStatsGlobalInfo* const outGlobalInfo) {
+// Applies update to the record of key under a shared lock of shard. If there is no such record,
+// one is made by create under an exclusive lock first; create may return nullptr to drop the
+// update.
+template <typename ShardT, typename Key, typename Create, typename Update>
+static void updateRecord(ShardT& shard, const Key& key, Create&& create, Update&& update) {
+    {
+        std::shared_lock<std::shared_mutex> lock(shard.lock);
+        const auto it = shard.records.find(key);
+        if (it != shard.records.end()) {
+            update(*it->second);
+            return;
+        }
+    }
+
+    std::unique_lock<std::shared_mutex> lock(shard.lock);
+    auto it = shard.records.find(key);
+    if (it == shard.records.end()) {
+        auto record = create();
+        if (!record) return;
+        it = shard.records.emplace(key, std::move(record)).first;
+    }
+    update(*it->second);
+}
+
+// Calls fn on every record of shard. If clear is true, the records are taken out of the shard
+// first so that fn runs without holding the shard lock. Returns the number of removed records.
+template <typename ShardT, typename Fn>
+static size_t forEachRecord(ShardT& shard, bool clear, Fn&& fn) {
+    if (!clear) {
+        std::shared_lock<std::shared_mutex> lock(shard.lock);
+        for (const auto& ele : shard.records) fn(*ele.second);
+        return 0;
+    }
+
+    decltype(shard.records) records;
+    {
+        std::unique_lock<std::shared_mutex> lock(shard.lock);
+        records.swap(shard.records);
+    }
+    for (const auto& ele : records) fn(*ele.second);
+    return records.size();
+}
+
+void GpuStats::GlobalRecord::addLoadingCount(GpuStatsInfo::Driver driver, bool isDriverLoaded) {
     switch (driver) {
         case GpuStatsInfo::Driver::GL:
         case GpuStatsInfo::Driver::GL_UPDATED:
-            outGlobalInfo->glLoadingCount++;
-            if (!isDriverLoaded) outGlobalInfo->glLoadingFailureCount++;
+            glLoadingCount++;
+            if (!isDriverLoaded) glLoadingFailureCount++;
             break;
         case GpuStatsInfo::Driver::VULKAN:
         case GpuStatsInfo::Driver::VULKAN_UPDATED:
-            outGlobalInfo->vkLoadingCount++;
-            if (!isDriverLoaded) outGlobalInfo->vkLoadingFailureCount++;
+            vkLoadingCount++;
+            if (!isDriverLoaded) vkLoadingFailureCount++;
             break;
         case GpuStatsInfo::Driver::ANGLE:
-            outGlobalInfo->angleLoadingCount++;
-            if (!isDriverLoaded) outGlobalInfo->angleLoadingFailureCount++;
+            angleLoadingCount++;
+            if (!isDriverLoaded) angleLoadingFailureCount++;
             break;
         default:
             break;
     }
 }
 
-static void addLoadingTime(GpuStatsInfo::Driver driver, int64_t driverLoadingTime,
-                           GpuStatsAppInfo* const outAppInfo) {
+GpuStatsGlobalInfo GpuStats::GlobalRecord::toInfo() const {
+    GpuStatsGlobalInfo info;
+    info.driverPackageName = driverPackageName;
+    info.driverVersionName = driverVersionName;
+    info.driverVersionCode = driverVersionCode;
+    info.driverBuildTime = driverBuildTime;
+    info.vulkanVersion = vulkanVersion;
+    info.glLoadingCount = glLoadingCount;
+    info.glLoadingFailureCount = glLoadingFailureCount;
+    info.vkLoadingCount = vkLoadingCount;
+    info.vkLoadingFailureCount = vkLoadingFailureCount;
+    info.angleLoadingCount = angleLoadingCount;
+    info.angleLoadingFailureCount = angleLoadingFailureCount;
+    return info;
+}
+
+void GpuStats::AppRecord::addLoadingTime(GpuStatsInfo::Driver driver, int64_t driverLoadingTime) {
+    std::vector<int64_t>* loadingTimes = nullptr;
     switch (driver) {
         case GpuStatsInfo::Driver::GL:
         case GpuStatsInfo::Driver::GL_UPDATED:
-            if (outAppInfo->glDriverLoadingTime.size() < GpuStats::MAX_NUM_LOADING_TIMES) {
-                outAppInfo->glDriverLoadingTime.emplace_back(driverLoadingTime);
-            }
+            loadingTimes = &glDriverLoadingTime;
             break;
         case GpuStatsInfo::Driver::VULKAN:
         case GpuStatsInfo::Driver::VULKAN_UPDATED:
-            if (outAppInfo->vkDriverLoadingTime.size() < GpuStats::MAX_NUM_LOADING_TIMES) {
-                outAppInfo->vkDriverLoadingTime.emplace_back(driverLoadingTime);
-            }
+            loadingTimes = &vkDriverLoadingTime;
             break;
         case GpuStatsInfo::Driver::ANGLE:
-            if (outAppInfo->angleDriverLoadingTime.size() < GpuStats::MAX_NUM_LOADING_TIMES) {
-                outAppInfo->angleDriverLoadingTime.emplace_back(driverLoadingTime);
-            }
+            loadingTimes = &angleDriverLoadingTime;
             break;
         default:
-            break;
+            return;
     }
+
+    std::lock_guard<std::mutex> lock(loadingTimeLock);
+    if (loadingTimes->size() < GpuStats::MAX_NUM_LOADING_TIMES) {
+        loadingTimes->emplace_back(driverLoadingTime);
+    }
+}
+
+GpuStatsAppInfo GpuStats::AppRecord::toInfo() const {
+    GpuStatsAppInfo info;
+    info.appPackageName = appPackageName;
+    info.driverVersionCode = driverVersionCode;
+    {
+        std::lock_guard<std::mutex> lock(loadingTimeLock);
+        info.glDriverLoadingTime = glDriverLoadingTime;
+        info.vkDriverLoadingTime = vkDriverLoadingTime;
+        info.angleDriverLoadingTime = angleDriverLoadingTime;
+    }
+    info.cpuVulkanInUse = cpuVulkanInUse;
+    info.falsePrerotation = falsePrerotation;
+    info.gles1InUse = gles1InUse;
+    return info;
+}
+
+GpuStats::Shard<std::string, GpuStats::AppRecord>& GpuStats::appShard(
+        const std::string& appStatsKey) {
+    return mAppStats[std::hash<std::string>()(appStatsKey) % NUM_APP_SHARDS];
 }
 
 void GpuStats::insertDriverStats(const std::string& driverPackageName,
@@ -91,7 +169,6 @@ void GpuStats::insertDriverStats(const std::string& driverPackageName,
                                  bool isDriverLoaded, int64_t driverLoadingTime) {
     ATRACE_CALL();
 
-    std::lock_guard<std::mutex> lock(mLock);
     registerStatsdCallbacksIfNeeded();
     ALOGV("Received:\n"
           "\tdriverPackageName[%s]\n"
@@ -107,35 +184,34 @@ void GpuStats::insertDriverStats(const std::string& driverPackageName,
           appPackageName.c_str(), vulkanVersion, static_cast<int32_t>(driver), isDriverLoaded,
           driverLoadingTime);
 
-    if (!mGlobalStats.count(driverVersionCode)) {
-        GpuStatsGlobalInfo globalInfo;
-        addLoadingCount(driver, isDriverLoaded, &globalInfo);
-        globalInfo.driverPackageName = driverPackageName;
-        globalInfo.driverVersionName = driverVersionName;
-        globalInfo.driverVersionCode = driverVersionCode;
-        globalInfo.driverBuildTime = driverBuildTime;
-        globalInfo.vulkanVersion = vulkanVersion;
-        mGlobalStats.insert({driverVersionCode, globalInfo});
-    } else {
-        addLoadingCount(driver, isDriverLoaded, &mGlobalStats[driverVersionCode]);
-    }
+    updateRecord(
+            mGlobalStats, driverVersionCode,
+            [&] {
+                auto record = std::make_unique<GlobalRecord>();
+                record->driverPackageName = driverPackageName;
+                record->driverVersionName = driverVersionName;
+                record->driverVersionCode = driverVersionCode;
+                record->driverBuildTime = driverBuildTime;
+                record->vulkanVersion = vulkanVersion;
+                return record;
+            },
+            [&](GlobalRecord& record) { record.addLoadingCount(driver, isDriverLoaded); });
 
     const std::string appStatsKey = appPackageName + std::to_string(driverVersionCode);
-    if (!mAppStats.count(appStatsKey)) {
-        if (mAppStats.size() >= MAX_NUM_APP_RECORDS) {
-            ALOGV("GpuStatsAppInfo has reached maximum size. Ignore new stats.");
-            return;
-        }
-
-        GpuStatsAppInfo appInfo;
-        addLoadingTime(driver, driverLoadingTime, &appInfo);
-        appInfo.appPackageName = appPackageName;
-        appInfo.driverVersionCode = driverVersionCode;
-        mAppStats.insert({appStatsKey, appInfo});
-        return;
-    }
-
-    addLoadingTime(driver, driverLoadingTime, &mAppStats[appStatsKey]);
+    updateRecord(
+            appShard(appStatsKey), appStatsKey,
+            [&]() -> std::unique_ptr<AppRecord> {
+                if (mAppRecordCount.fetch_add(1) >= MAX_NUM_APP_RECORDS) {
+                    mAppRecordCount--;
+                    ALOGV("GpuStatsAppInfo has reached maximum size. Ignore new stats.");
+                    return nullptr;
+                }
+                auto record = std::make_unique<AppRecord>();
+                record->appPackageName = appPackageName;
+                record->driverVersionCode = driverVersionCode;
+                return record;
+            },
+            [&](AppRecord& record) { record.addLoadingTime(driver, driverLoadingTime); });
 }
 
 void GpuStats::insertTargetStats(const std::string& appPackageName,
@@ -145,45 +221,58 @@ void GpuStats::insertTargetStats(const std::string& appPackageName,
 
     const std::string appStatsKey = appPackageName + std::to_string(driverVersionCode);
 
-    std::lock_guard<std::mutex> lock(mLock);
     registerStatsdCallbacksIfNeeded();
-    if (!mAppStats.count(appStatsKey)) {
-        return;
-    }
-
-    switch (stats) {
-        case GpuStatsInfo::Stats::CPU_VULKAN_IN_USE:
-            mAppStats[appStatsKey].cpuVulkanInUse = true;
-            break;
-        case GpuStatsInfo::Stats::FALSE_PREROTATION:
-            mAppStats[appStatsKey].falsePrerotation = true;
-            break;
-        case GpuStatsInfo::Stats::GLES_1_IN_USE:
-            mAppStats[appStatsKey].gles1InUse = true;
-            break;
-        default:
-            break;
-    }
+    updateRecord(
+            appShard(appStatsKey), appStatsKey, [] { return std::unique_ptr<AppRecord>(); },
+            [&](AppRecord& record) {
+                switch (stats) {
+                    case GpuStatsInfo::Stats::CPU_VULKAN_IN_USE:
+                        record.cpuVulkanInUse = true;
+                        break;
+                    case GpuStatsInfo::Stats::FALSE_PREROTATION:
+                        record.falsePrerotation = true;
+                        break;
+                    case GpuStatsInfo::Stats::GLES_1_IN_USE:
+                        record.gles1InUse = true;
+                        break;
+                    default:
+                        break;
+                }
+            });
 }
 
-void GpuStats::interceptSystemDriverStatsLocked() {
+std::vector<GpuStatsGlobalInfo> GpuStats::snapshotGlobalStats(bool clear) {
+    std::vector<GpuStatsGlobalInfo> infos;
+    forEachRecord(mGlobalStats, clear,
+                  [&](const GlobalRecord& record) { infos.push_back(record.toInfo()); });
+
     // Append cpuVulkanVersion and glesVersion to system driver stats
-    if (!mGlobalStats.count(0) || mGlobalStats[0].glesVersion) {
-        return;
+    for (auto& info : infos) {
+        if (info.driverVersionCode != 0) continue;
+        info.cpuVulkanVersion = property_get_int32("ro.cpuvulkan.version", 0);
+        info.glesVersion = property_get_int32("ro.opengles.version", 0);
     }
+    return infos;
+}
 
-    mGlobalStats[0].cpuVulkanVersion = property_get_int32("ro.cpuvulkan.version", 0);
-    mGlobalStats[0].glesVersion = property_get_int32("ro.opengles.version", 0);
+std::vector<GpuStatsAppInfo> GpuStats::snapshotAppStats(bool clear) {
+    std::vector<GpuStatsAppInfo> infos;
+    for (auto& shard : mAppStats) {
+        mAppRecordCount -= forEachRecord(shard, clear, [&](const AppRecord& record) {
+            infos.push_back(record.toInfo());
+        });
+    }
+    return infos;
 }
 
 void GpuStats::registerStatsdCallbacksIfNeeded() {
-    if (!mStatsdRegistered) {
+    std::call_once(mStatsdRegisterFlag, [this] {
         AStatsManager_setPullAtomCallback(android::util::GPU_STATS_GLOBAL_INFO, nullptr,
                                          GpuStats::pullAtomCallback, this);
         AStatsManager_setPullAtomCallback(android::util::GPU_STATS_APP_INFO, nullptr,
                                          GpuStats::pullAtomCallback, this);
         mStatsdRegistered = true;
-    }
+    });
 }
 
 void GpuStats::dump(const Vector<String16>& args, std::string* result) {
@@ -194,64 +283,29 @@ void GpuStats::dump(const Vector<String16>& args, std::string* result) {
         return;
     }
 
-    std::lock_guard<std::mutex> lock(mLock);
-    bool dumpAll = true;
-
     std::unordered_set<std::string> argsSet;
     for (size_t i = 0; i < args.size(); i++) {
         argsSet.insert(String8(args[i]).c_str());
     }
 
     const bool dumpGlobal = argsSet.count("--global") != 0;
-    if (dumpGlobal) {
-        dumpGlobalLocked(result);
-        dumpAll = false;
-    }
-
     const bool dumpApp = argsSet.count("--app") != 0;
-    if (dumpApp) {
-        dumpAppLocked(result);
-        dumpAll = false;
-    }
-
-    if (dumpAll) {
-        dumpGlobalLocked(result);
-        dumpAppLocked(result);
-    }
-
-    if (argsSet.count("--clear")) {
-        bool clearAll = true;
-
-        if (dumpGlobal) {
-            mGlobalStats.clear();
-            clearAll = false;
-        }
-
-        if (dumpApp) {
-            mAppStats.clear();
-            clearAll = false;
-        }
-
-        if (clearAll) {
-            mGlobalStats.clear();
-            mAppStats.clear();
+    const bool dumpAll = !dumpGlobal && !dumpApp;
+    // Dumped stats are cleared along with the dump.
+    const bool clear = argsSet.count("--clear") != 0;
+
+    if (dumpGlobal || dumpAll) {
+        for (const auto& info : snapshotGlobalStats(clear)) {
+            result->append(info.toString());
+            result->append("\n");
         }
     }
-}
-
-void GpuStats::dumpGlobalLocked(std::string* result) {
-    interceptSystemDriverStatsLocked();
-
-    for (const auto& ele : mGlobalStats) {
-        result->append(ele.second.toString());
-        result->append("\n");
-    }
-}
 
-void GpuStats::dumpAppLocked(std::string* result) {
-    for (const auto& ele : mAppStats) {
-        result->append(ele.second.toString());
-        result->append("\n");
+    if (dumpApp || dumpAll) {
+        for (const auto& info : snapshotAppStats(clear)) {
+            result->append(info.toString());
+            result->append("\n");
+        }
     }
 }
 
@@ -287,66 +341,60 @@ static std::string int64VectorToProtoByteString(const std::vector<int64_t>& valu
 AStatsManager_PullAtomCallbackReturn GpuStats::pullAppInfoAtom(AStatsEventList* data) {
     ATRACE_CALL();
 
-    std::lock_guard<std::mutex> lock(mLock);
+    const std::vector<GpuStatsAppInfo> appStats = snapshotAppStats(true /* clear */);
 
     if (data) {
-        for (const auto& ele : mAppStats) {
+        for (const auto& info : appStats) {
             AStatsEvent* event = AStatsEventList_addStatsEvent(data);
             AStatsEvent_setAtomId(event, android::util::GPU_STATS_APP_INFO);
-            AStatsEvent_writeString(event, ele.second.appPackageName.c_str());
-            AStatsEvent_writeInt64(event, ele.second.driverVersionCode);
+            AStatsEvent_writeString(event, info.appPackageName.c_str());
+            AStatsEvent_writeInt64(event, info.driverVersionCode);
 
-            std::string bytes = int64VectorToProtoByteString(ele.second.glDriverLoadingTime);
+            std::string bytes = int64VectorToProtoByteString(info.glDriverLoadingTime);
             AStatsEvent_writeByteArray(event, (const uint8_t*)bytes.c_str(), bytes.length());
 
-            bytes = int64VectorToProtoByteString(ele.second.vkDriverLoadingTime);
+            bytes = int64VectorToProtoByteString(info.vkDriverLoadingTime);
             AStatsEvent_writeByteArray(event, (const uint8_t*)bytes.c_str(), bytes.length());
 
-            bytes = int64VectorToProtoByteString(ele.second.angleDriverLoadingTime);
+            bytes = int64VectorToProtoByteString(info.angleDriverLoadingTime);
             AStatsEvent_writeByteArray(event, (const uint8_t*)bytes.c_str(), bytes.length());
 
-            AStatsEvent_writeBool(event, ele.second.cpuVulkanInUse);
-            AStatsEvent_writeBool(event, ele.second.falsePrerotation);
-            AStatsEvent_writeBool(event, ele.second.gles1InUse);
+            AStatsEvent_writeBool(event, info.cpuVulkanInUse);
+            AStatsEvent_writeBool(event, info.falsePrerotation);
+            AStatsEvent_writeBool(event, info.gles1InUse);
             AStatsEvent_build(event);
         }
     }
 
-    mAppStats.clear();
-
     return AStatsManager_PULL_SUCCESS;
 }
 
 AStatsManager_PullAtomCallbackReturn GpuStats::pullGlobalInfoAtom(AStatsEventList* data) {
     ATRACE_CALL();
 
-    std::lock_guard<std::mutex> lock(mLock);
-    // flush cpuVulkanVersion and glesVersion to builtin driver stats
-    interceptSystemDriverStatsLocked();
+    const std::vector<GpuStatsGlobalInfo> globalStats = snapshotGlobalStats(true /* clear */);
 
     if (data) {
-        for (const auto& ele : mGlobalStats) {
+        for (const auto& info : globalStats) {
             AStatsEvent* event = AStatsEventList_addStatsEvent(data);
             AStatsEvent_setAtomId(event, android::util::GPU_STATS_GLOBAL_INFO);
-            AStatsEvent_writeString(event, ele.second.driverPackageName.c_str());
-            AStatsEvent_writeString(event, ele.second.driverVersionName.c_str());
-            AStatsEvent_writeInt64(event, ele.second.driverVersionCode);
-            AStatsEvent_writeInt64(event, ele.second.driverBuildTime);
-            AStatsEvent_writeInt64(event, ele.second.glLoadingCount);
-            AStatsEvent_writeInt64(event, ele.second.glLoadingFailureCount);
-            AStatsEvent_writeInt64(event, ele.second.vkLoadingCount);
-            AStatsEvent_writeInt64(event, ele.second.vkLoadingFailureCount);
-            AStatsEvent_writeInt32(event, ele.second.vulkanVersion);
-            AStatsEvent_writeInt32(event, ele.second.cpuVulkanVersion);
-            AStatsEvent_writeInt32(event, ele.second.glesVersion);
-            AStatsEvent_writeInt64(event, ele.second.angleLoadingCount);
-            AStatsEvent_writeInt64(event, ele.second.angleLoadingFailureCount);
+            AStatsEvent_writeString(event, info.driverPackageName.c_str());
+            AStatsEvent_writeString(event, info.driverVersionName.c_str());
+            AStatsEvent_writeInt64(event, info.driverVersionCode);
+            AStatsEvent_writeInt64(event, info.driverBuildTime);
+            AStatsEvent_writeInt64(event, info.glLoadingCount);
+            AStatsEvent_writeInt64(event, info.glLoadingFailureCount);
+            AStatsEvent_writeInt64(event, info.vkLoadingCount);
+            AStatsEvent_writeInt64(event, info.vkLoadingFailureCount);
+            AStatsEvent_writeInt32(event, info.vulkanVersion);
+            AStatsEvent_writeInt32(event, info.cpuVulkanVersion);
+            AStatsEvent_writeInt32(event, info.glesVersion);
+            AStatsEvent_writeInt64(event, info.angleLoadingCount);
+            AStatsEvent_writeInt64(event, info.angleLoadingFailureCount);
             AStatsEvent_build(event);
         }
     }
 
-    mGlobalStats.clear();
-
     return AStatsManager_PULL_SUCCESS;
 }
 
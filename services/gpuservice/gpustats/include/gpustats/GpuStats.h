@@ -22,7 +22,11 @@
 #include <utils/String16.h>
 #include <utils/Vector.h>
 
+#include <array>
+#include <atomic>
+#include <memory>
 #include <mutex>
+#include <shared_mutex>
 #include <unordered_map>
 #include <vector>
 
@@ -51,6 +55,50 @@ private:
     // Friend class for testing.
     friend class TestableGpuStats;
 
+    // Global stats of a driver version. The identifying fields are set when the record is created
+    // and the counters are updated without taking an exclusive lock.
+    struct GlobalRecord {
+        std::string driverPackageName;
+        std::string driverVersionName;
+        uint64_t driverVersionCode = 0;
+        int64_t driverBuildTime = 0;
+        int32_t vulkanVersion = 0;
+        std::atomic<int32_t> glLoadingCount = 0;
+        std::atomic<int32_t> glLoadingFailureCount = 0;
+        std::atomic<int32_t> vkLoadingCount = 0;
+        std::atomic<int32_t> vkLoadingFailureCount = 0;
+        std::atomic<int32_t> angleLoadingCount = 0;
+        std::atomic<int32_t> angleLoadingFailureCount = 0;
+
+        void addLoadingCount(GpuStatsInfo::Driver driver, bool isDriverLoaded);
+        GpuStatsGlobalInfo toInfo() const;
+    };
+
+    // Stats of an app on a driver version. Loading times only contend with other loads of the
+    // same app, so they get a lock of their own.
+    struct AppRecord {
+        std::string appPackageName;
+        uint64_t driverVersionCode = 0;
+        mutable std::mutex loadingTimeLock;
+        std::vector<int64_t> glDriverLoadingTime;
+        std::vector<int64_t> vkDriverLoadingTime;
+        std::vector<int64_t> angleDriverLoadingTime;
+        std::atomic<bool> cpuVulkanInUse = false;
+        std::atomic<bool> falsePrerotation = false;
+        std::atomic<bool> gles1InUse = false;
+
+        void addLoadingTime(GpuStatsInfo::Driver driver, int64_t driverLoadingTime);
+        GpuStatsAppInfo toInfo() const;
+    };
+
+    // A slice of the stats. Records are updated under a shared lock and only created, removed or
+    // snapshotted under an exclusive one, so reports for different records don't serialize.
+    template <typename Key, typename Record>
+    struct Shard {
+        std::shared_mutex lock;
+        std::unordered_map<Key, std::unique_ptr<Record>> records;
+    };
+
     // Native atom puller callback registered in statsd.
     static AStatsManager_PullAtomCallbackReturn pullAtomCallback(int32_t atomTag,
                                                                  AStatsEventList* data,
@@ -59,26 +107,32 @@ private:
     AStatsManager_PullAtomCallbackReturn pullGlobalInfoAtom(AStatsEventList* data);
     // Pull app into into app atom.
     AStatsManager_PullAtomCallbackReturn pullAppInfoAtom(AStatsEventList* data);
-    // Dump global stats
-    void dumpGlobalLocked(std::string* result);
-    // Dump app stats
-    void dumpAppLocked(std::string* result);
-    // Append cpuVulkanVersion and glesVersion to system driver stats
-    void interceptSystemDriverStatsLocked();
+    // Copy the global stats, removing them from GpuStats if clear is true. cpuVulkanVersion and
+    // glesVersion are appended to the system driver stats.
+    std::vector<GpuStatsGlobalInfo> snapshotGlobalStats(bool clear);
+    // Copy the app stats, removing them from GpuStats if clear is true.
+    std::vector<GpuStatsAppInfo> snapshotAppStats(bool clear);
     // Registers statsd callbacks if they have not already been registered
     void registerStatsdCallbacksIfNeeded();
+    // Returns the shard holding the app stats of appStatsKey.
+    Shard<std::string, AppRecord>& appShard(const std::string& appStatsKey);
 
     // Below limits the memory usage of GpuStats to be less than 10KB. This is
     // the preferred number for statsd while maintaining nice data quality.
     static const size_t MAX_NUM_APP_RECORDS = 100;
-    // GpuStats access should be guarded by mLock.
-    std::mutex mLock;
+    // Number of app stats shards. Apps report concurrently as they start, while driver versions
+    // are few, so the global stats are a single shard.
+    static const size_t NUM_APP_SHARDS = 8;
+    // Guards the statsd callback registration.
+    std::once_flag mStatsdRegisterFlag;
     // True if statsd callbacks have been registered.
-    bool mStatsdRegistered = false;
+    std::atomic<bool> mStatsdRegistered = false;
     // Key is driver version code.
-    std::unordered_map<uint64_t, GpuStatsGlobalInfo> mGlobalStats;
+    Shard<uint64_t, GlobalRecord> mGlobalStats;
     // Key is <app package name>+<driver version code>.
-    std::unordered_map<std::string, GpuStatsAppInfo> mAppStats;
+    std::array<Shard<std::string, AppRecord>, NUM_APP_SHARDS> mAppStats;
+    // Number of app records across all shards, bounded by MAX_NUM_APP_RECORDS.
+    std::atomic<size_t> mAppRecordCount = 0;
 };
 
 } // namespace android
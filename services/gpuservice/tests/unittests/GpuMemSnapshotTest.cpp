@@ -0,0 +1,153 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gmock/gmock.h>
+#include <gpumem/GpuMemSnapshot.h>
+#include <gtest/gtest.h>
+
+#include <tuple>
+#include <vector>
+
+namespace android {
+namespace {
+
+using testing::UnorderedElementsAre;
+
+// (gpuId, pid, size)
+using Change = std::tuple<uint32_t, uint32_t, uint64_t>;
+
+constexpr int64_t TEST_TS = 42;
+
+class GpuMemSnapshotTest : public testing::Test {
+public:
+    std::vector<Change> update() {
+        std::vector<Change> changes;
+        mSnapshot.update(TEST_TS, mReader, [&](int64_t ts, uint32_t gpuId, uint32_t pid,
+                                               uint64_t size) {
+            EXPECT_EQ(TEST_TS, ts);
+            changes.emplace_back(gpuId, pid, size);
+        });
+        return changes;
+    }
+
+    FakeGpuMemTotalReader mReader;
+    GpuMemSnapshot mSnapshot;
+};
+
+class FailingGpuMemTotalReader : public GpuMemTotalReader {
+public:
+    bool readAll(std::vector<GpuMemTotalEntry>*) override { return false; }
+};
+
+// Returns the first entries of the map and then fails, as a map walk that breaks off would.
+class PartialGpuMemTotalReader : public GpuMemTotalReader {
+public:
+    bool readAll(std::vector<GpuMemTotalEntry>* entries) override {
+        entries->assign({{0, 123}});
+        return false;
+    }
+};
+
+class RepeatingGpuMemTotalReader : public FakeGpuMemTotalReader {
+public:
+    bool readAll(std::vector<GpuMemTotalEntry>* entries) override {
+        FakeGpuMemTotalReader::readAll(entries);
+        std::vector<GpuMemTotalEntry> again = *entries;
+        entries->insert(entries->end(), again.begin(), again.end());
+        return true;
+    }
+};
+
+TEST_F(GpuMemSnapshotTest, firstUpdateReportsAllEntries) {
+    mReader.put(0, 0, 123);
+    mReader.put(0, 1, 234);
+    mReader.put(1, 2, 345);
+
+    EXPECT_THAT(update(), UnorderedElementsAre(Change(0, 0, 123), Change(0, 1, 234),
+                                               Change(1, 2, 345)));
+    EXPECT_EQ(3u, mSnapshot.size());
+}
+
+TEST_F(GpuMemSnapshotTest, unchangedEntriesAreNotReported) {
+    mReader.put(0, 0, 123);
+    mReader.put(0, 1, 234);
+    update();
+
+    EXPECT_TRUE(update().empty());
+}
+
+TEST_F(GpuMemSnapshotTest, reportsChangedAddedAndRemovedEntries) {
+    mReader.put(0, 0, 123);
+    mReader.put(0, 1, 234);
+    mReader.put(1, 2, 345);
+    update();
+
+    mReader.put(0, 0, 456);
+    mReader.erase(0, 1);
+    mReader.put(1, 3, 567);
+
+    EXPECT_THAT(update(), UnorderedElementsAre(Change(0, 0, 456), Change(0, 1, 0),
+                                               Change(1, 3, 567)));
+    EXPECT_EQ(3u, mSnapshot.size());
+}
+
+TEST_F(GpuMemSnapshotTest, clearReportsAllEntriesAgain) {
+    mReader.put(0, 0, 123);
+    update();
+    mSnapshot.clear();
+
+    EXPECT_THAT(update(), UnorderedElementsAre(Change(0, 0, 123)));
+}
+
+TEST_F(GpuMemSnapshotTest, failedReadKeepsSnapshot) {
+    mReader.put(0, 0, 123);
+    update();
+
+    FailingGpuMemTotalReader failingReader;
+    EXPECT_EQ(-1, mSnapshot.update(TEST_TS, failingReader, [](int64_t, uint32_t, uint32_t,
+                                                                uint64_t) { FAIL(); }));
+    EXPECT_EQ(1u, mSnapshot.size());
+    EXPECT_TRUE(update().empty());
+}
+
+TEST_F(GpuMemSnapshotTest, partialReadKeepsSnapshot) {
+    mReader.put(0, 0, 123);
+    mReader.put(0, 1, 234);
+    update();
+
+    PartialGpuMemTotalReader partialReader;
+    EXPECT_EQ(-1, mSnapshot.update(TEST_TS, partialReader, [](int64_t, uint32_t, uint32_t,
+                                                                uint64_t) { FAIL(); }));
+    EXPECT_EQ(2u, mSnapshot.size());
+    EXPECT_TRUE(update().empty());
+}
+
+TEST_F(GpuMemSnapshotTest, repeatedKeysAreReportedOnce) {
+    RepeatingGpuMemTotalReader reader;
+    reader.put(0, 0, 123);
+    reader.put(1, 2, 345);
+
+    std::vector<Change> changes;
+    EXPECT_EQ(2, mSnapshot.update(TEST_TS, reader,
+                                  [&](int64_t, uint32_t gpuId, uint32_t pid, uint64_t size) {
+                                      changes.emplace_back(gpuId, pid, size);
+                                  }));
+    EXPECT_THAT(changes, UnorderedElementsAre(Change(0, 0, 123), Change(1, 2, 345)));
+    EXPECT_EQ(2u, mSnapshot.size());
+}
+
+} // namespace
+} // namespace android
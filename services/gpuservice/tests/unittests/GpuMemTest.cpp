@@ -33,6 +33,8 @@ namespace {
 
 using base::StringPrintf;
 using testing::HasSubstr;
+using testing::Pair;
+using testing::UnorderedElementsAre;
 
 constexpr uint32_t TEST_MAP_SIZE = 10;
 constexpr uint64_t TEST_GLOBAL_KEY = 0;
@@ -167,5 +169,34 @@ TEST_F(GpuMemTest, traverseGpuMemTotals) {
     EXPECT_EQ(sCount, TEST_KEY_COUNT);
 }
 
+TEST_F(GpuMemTest, traverseGpuMemTotalsDelta) {
+    ASSERT_RESULT_OK(mTestMap.writeValue(TEST_GLOBAL_KEY, TEST_GLOBAL_VAL, BPF_ANY));
+    ASSERT_RESULT_OK(mTestMap.writeValue(TEST_PROC_KEY_1, TEST_PROC_VAL_1, BPF_ANY));
+    mTestableGpuMem.setGpuMemTotalMap(mTestMap);
+
+    std::vector<std::pair<uint64_t, uint64_t>> changes;
+    auto collect = [&](int64_t, uint32_t gpuId, uint32_t pid, uint64_t size) {
+        changes.emplace_back(((uint64_t)gpuId << 32) | pid, size);
+    };
+    mGpuMem->traverseGpuMemTotalsDelta(collect);
+    EXPECT_EQ(changes.size(), 2u);
+
+    changes.clear();
+    mGpuMem->traverseGpuMemTotalsDelta(collect);
+    EXPECT_TRUE(changes.empty());
+
+    // setGpuMemTotalMap() moved the map out of mTestMap, so update it through GpuMem.
+    auto& map = mTestableGpuMem.getGpuMemTotalMap();
+    ASSERT_RESULT_OK(map.writeValue(TEST_PROC_KEY_1, TEST_PROC_VAL_2, BPF_ANY));
+    ASSERT_RESULT_OK(map.deleteValue(TEST_GLOBAL_KEY));
+    ASSERT_RESULT_OK(map.writeValue(TEST_PROC_KEY_2, TEST_PROC_VAL_2, BPF_ANY));
+    changes.clear();
+    mGpuMem->traverseGpuMemTotalsDelta(collect);
+    EXPECT_THAT(changes,
+                UnorderedElementsAre(Pair(TEST_GLOBAL_KEY, 0u),
+                                     Pair(TEST_PROC_KEY_1, TEST_PROC_VAL_2),
+                                     Pair(TEST_PROC_KEY_2, TEST_PROC_VAL_2)));
+}
+
 } // namespace
 } // namespace android
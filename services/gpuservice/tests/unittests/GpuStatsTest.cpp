@@ -26,6 +26,9 @@
 #include <utils/String16.h>
 #include <utils/Vector.h>
 
+#include <thread>
+#include <vector>
+
 #include "TestableGpuStats.h"
 
 namespace android {
@@ -303,5 +306,36 @@ TEST_F(GpuStatsTest, canPullAppAtom) {
     EXPECT_TRUE(inputCommand(InputCommand::DUMP_APP).empty());
 }
 
+TEST_F(GpuStatsTest, canInsertDriverStatsConcurrently) {
+    constexpr int kThreads = 8;
+    constexpr int kLoadsPerThread = 100;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < kThreads; i++) {
+        threads.emplace_back([this, i] {
+            const std::string appPackageName = i % 2 ? APP_PKG_NAME_1 : APP_PKG_NAME_2;
+            for (int j = 0; j < kLoadsPerThread; j++) {
+                mGpuStats->insertDriverStats(BUILTIN_DRIVER_PKG_NAME, BUILTIN_DRIVER_VER_NAME,
+                                             BUILTIN_DRIVER_VER_CODE, BUILTIN_DRIVER_BUILD_TIME,
+                                             appPackageName, VULKAN_VERSION,
+                                             GpuStatsInfo::Driver::GL, true,
+                                             DRIVER_LOADING_TIME_1);
+                mGpuStats->insertTargetStats(appPackageName, BUILTIN_DRIVER_VER_CODE,
+                                             GpuStatsInfo::Stats::GLES_1_IN_USE, 0);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    EXPECT_THAT(inputCommand(InputCommand::DUMP_GLOBAL),
+                HasSubstr("glLoadingCount = " + std::to_string(kThreads * kLoadsPerThread)));
+    const std::string appDump = inputCommand(InputCommand::DUMP_APP);
+    EXPECT_THAT(appDump, HasSubstr("appPackageName = " + std::string(APP_PKG_NAME_1)));
+    EXPECT_THAT(appDump, HasSubstr("appPackageName = " + std::string(APP_PKG_NAME_2)));
+    EXPECT_THAT(appDump, HasSubstr("gles1InUse = 1"));
+    EXPECT_THAT(appDump, testing::Not(HasSubstr("gles1InUse = 0")));
+}
+
 } // namespace
 } // namespace android
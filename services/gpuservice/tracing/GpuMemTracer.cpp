@@ -20,6 +20,7 @@
 
 #include "tracing/GpuMemTracer.h"
 
+#include <android-base/properties.h>
 #include <gpumem/GpuMem.h>
 #include <perfetto/trace/android/gpu_mem_event.pbzero.h>
 #include <unistd.h>
@@ -33,6 +34,7 @@ namespace android {
 std::mutex GpuMemTracer::sTraceMutex;
 std::condition_variable GpuMemTracer::sCondition;
 bool GpuMemTracer::sTraceStarted;
+int GpuMemTracer::sActiveSessions;
 
 void GpuMemTracer::initialize(std::shared_ptr<GpuMem> gpuMem) {
     if (!gpuMem->isInitialized()) {
@@ -40,6 +42,8 @@ void GpuMemTracer::initialize(std::shared_ptr<GpuMem> gpuMem) {
         return;
     }
     mGpuMem = gpuMem;
+    mSamplePeriod = std::chrono::milliseconds(
+            base::GetUintProperty<uint64_t>(kGpuMemSamplePeriodProperty, 0));
     perfetto::TracingInitArgs args;
     args.backends = perfetto::kSystemBackend;
     perfetto::Tracing::Initialize(args);
@@ -91,8 +95,17 @@ void GpuMemTracer::threadLoop(bool infiniteLoop) {
         }
         traceInitialCounters();
         {
-            std::lock_guard<std::mutex> lock(GpuMemTracer::sTraceMutex);
+            std::unique_lock<std::mutex> lock(GpuMemTracer::sTraceMutex);
             sTraceStarted = false;
+            // Trace the counters that changed until every session stopped, or until a new session
+            // started and needs the initial counters.
+            while (mSamplePeriod > std::chrono::milliseconds::zero() &&
+                   !sCondition.wait_for(lock, mSamplePeriod,
+                                        [] { return sActiveSessions <= 0 || sTraceStarted; })) {
+                lock.unlock();
+                traceChangedCounters();
+                lock.lock();
+            }
         }
     } while (infiniteLoop);
 
@@ -107,7 +120,14 @@ void GpuMemTracer::traceInitialCounters() {
         ALOGE("Cannot trace without GpuMem initialization");
         return;
     }
-    mGpuMem->traverseGpuMemTotals([](int64_t ts, uint32_t gpuId, uint32_t pid, uint64_t size) {
+    // Drop the snapshot of the previous session so that every counter is traced.
+    mGpuMem->resetGpuMemTotalsDelta();
+    traceChangedCounters();
+}
+
+void GpuMemTracer::traceChangedCounters() {
+    mGpuMem->traverseGpuMemTotalsDelta([](int64_t ts, uint32_t gpuId, uint32_t pid,
+                                          uint64_t size) {
         GpuMemDataSource::Trace([&](GpuMemDataSource::TraceContext ctx) {
             auto packet = ctx.NewTracePacket();
             packet->set_timestamp(ts);
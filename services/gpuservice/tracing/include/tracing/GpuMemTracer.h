@@ -18,6 +18,7 @@
 
 #include <perfetto/tracing.h>
 
+#include <chrono>
 #include <mutex>
 
 namespace perfetto::protos {
@@ -35,9 +36,14 @@ public:
         virtual void OnStart(const StartArgs&) override {
             std::unique_lock<std::mutex> lock(GpuMemTracer::sTraceMutex);
             sTraceStarted = true;
+            sActiveSessions++;
+            sCondition.notify_all();
+        }
+        virtual void OnStop(const StopArgs&) override {
+            std::unique_lock<std::mutex> lock(GpuMemTracer::sTraceMutex);
+            sActiveSessions--;
             sCondition.notify_all();
         }
-        virtual void OnStop(const StopArgs&) override{};
     };
 
     ~GpuMemTracer() = default;
@@ -70,6 +76,11 @@ public:
     static std::condition_variable sCondition;
     static std::mutex sTraceMutex;
     static bool sTraceStarted;
+    static int sActiveSessions;
+    // System property holding the period, in milliseconds, at which the gpu memory counters that
+    // changed are traced while a session is active. 0 or unset only traces the initial counters.
+    static constexpr char kGpuMemSamplePeriodProperty[] =
+            "debug.gpuservice.gpu_mem_sample_period_ms";
 
 private:
     // Friend class for testing
@@ -77,7 +88,9 @@ private:
 
     void threadLoop(bool infiniteLoop);
     void traceInitialCounters();
+    void traceChangedCounters();
     std::shared_ptr<GpuMem> mGpuMem;
+    std::chrono::milliseconds mSamplePeriod = std::chrono::milliseconds::zero();
     // Count of how many tracer threads are currently active. Useful for testing.
     std::atomic<int32_t> tracerThreadCount = 0;
 };
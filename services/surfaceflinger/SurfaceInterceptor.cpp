@@ -25,9 +25,15 @@
 #include "SurfaceFlinger.h"
 #include "SurfaceInterceptor.h"
 
+#include <fcntl.h>
+#include <pthread.h>
+
+#include <algorithm>
 #include <fstream>
+#include <iterator>
 
 #include <android-base/file.h>
+#include <cutils/properties.h>
 #include <log/log.h>
 #include <utils/Trace.h>
 
@@ -40,11 +46,39 @@ SurfaceInterceptor::~SurfaceInterceptor() = default;
 
 namespace impl {
 
-SurfaceInterceptor::SurfaceInterceptor(SurfaceFlinger* flinger)
-    :   mFlinger(flinger)
+// Increments are flushed in chunks of this many.
+static constexpr int kChunkIncrements = 256;
+// When streaming, chunks beyond this are cut down to their structural increments if the writer
+// falls behind.
+static constexpr size_t kMaxQueuedChunks = 64;
+
+// Copies the increments that create or destroy layers and displays. Without these, the layers and
+// displays referred to by the rest of a trace could not be recreated on replay.
+static void copyStructuralIncrements(const Trace& from, Trace* to) {
+    for (const Increment& increment : from.increment()) {
+        switch (increment.increment_case()) {
+            case Increment::kSurfaceCreation:
+            case Increment::kSurfaceDeletion:
+            case Increment::kDisplayCreation:
+            case Increment::kDisplayDeletion:
+                *to->add_increment() = increment;
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+SurfaceInterceptor::SurfaceInterceptor(SurfaceFlinger* flinger, std::string outputFileName)
+    :   mOutputFileName(std::move(outputFileName)),
+        mFlinger(flinger)
 {
 }
 
+SurfaceInterceptor::~SurfaceInterceptor() {
+    disable();
+}
+
 void SurfaceInterceptor::enable(const SortedVector<sp<Layer>>& layers,
         const DefaultKeyedVector< wp<IBinder>, DisplayDeviceState>& displays)
 {
@@ -52,10 +86,18 @@ void SurfaceInterceptor::enable(const SortedVector<sp<Layer>>& layers,
         return;
     }
     ATRACE_CALL();
-    mEnabled = true;
     std::lock_guard<std::mutex> protoGuard(mTraceMutex);
+    if (!startWriterLocked()) {
+        ALOGE("Could not open %s: %s", mOutputFileName.c_str(), strerror(errno));
+        return;
+    }
+    mEnabled = true;
+    // The snapshot is streamed out even in ring mode, so that the trace can always be replayed.
     saveExistingDisplaysLocked(displays);
     saveExistingSurfacesLocked(layers);
+    flushChunkLocked(elapsedRealtimeNano());
+    mRingDuration = seconds_to_nanoseconds(
+            property_get_int32("debug.sf.interceptor_ring_seconds", 0));
 }
 
 void SurfaceInterceptor::disable() {
@@ -65,10 +107,109 @@ void SurfaceInterceptor::disable() {
     ATRACE_CALL();
     std::lock_guard<std::mutex> protoGuard(mTraceMutex);
     mEnabled = false;
-    status_t err(writeProtoFileLocked());
-    ALOGE_IF(err == PERMISSION_DENIED, "Could not save the proto file! Permission denied");
-    ALOGE_IF(err == NOT_ENOUGH_DATA, "Could not save the proto file! There are missing fields");
-    mTrace.Clear();
+    flushChunkLocked(elapsedRealtimeNano());
+    if (mRingDuration > 0) {
+        // The ring is already bounded, so write all of it.
+        std::lock_guard<std::mutex> writerGuard(mWriterMutex);
+        mWriterQueue.push_back(std::move(mRingBase));
+        std::move(mRing.begin(), mRing.end(), std::back_inserter(mWriterQueue));
+        mRingBase.Clear();
+        mRing.clear();
+        mRingDuration = 0;
+    }
+    stopWriterLocked();
+}
+
+void SurfaceInterceptor::flushChunkLocked(nsecs_t now) {
+    if (mTrace.increment_size() == 0) {
+        return;
+    }
+    Trace chunk;
+    chunk.Swap(&mTrace);
+    if (mRingDuration > 0) {
+        mRing.push_back(std::move(chunk));
+        trimRingLocked(now);
+    } else {
+        queueChunkLocked(std::move(chunk));
+    }
+}
+
+void SurfaceInterceptor::trimRingLocked(nsecs_t now) {
+    while (!mRing.empty()) {
+        const Trace& oldest = mRing.front();
+        if (now - oldest.increment(oldest.increment_size() - 1).time_stamp() <= mRingDuration) {
+            break;
+        }
+        copyStructuralIncrements(oldest, &mRingBase);
+        mRing.pop_front();
+    }
+}
+
+void SurfaceInterceptor::queueChunkLocked(Trace&& chunk) {
+    std::lock_guard<std::mutex> writerGuard(mWriterMutex);
+    if (mWriterQueue.size() >= kMaxQueuedChunks) {
+        // Like ring mode, keep the trace replayable. These are rare, so the queue stays small.
+        Trace structural;
+        copyStructuralIncrements(chunk, &structural);
+        mDroppedChunks++;
+        if (structural.increment_size() == 0) {
+            return;
+        }
+        chunk.Swap(&structural);
+    }
+    mWriterQueue.push_back(std::move(chunk));
+    mWriterCondition.notify_one();
+}
+
+bool SurfaceInterceptor::startWriterLocked() {
+    mOutputFd.reset(open(mOutputFileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666));
+    if (!mOutputFd.ok()) {
+        return false;
+    }
+    mWriterDone = false;
+    mDroppedChunks = 0;
+    mWriterThread = std::thread(&SurfaceInterceptor::writerLoop, this);
+    return true;
+}
+
+void SurfaceInterceptor::stopWriterLocked() {
+    {
+        std::lock_guard<std::mutex> writerGuard(mWriterMutex);
+        mWriterDone = true;
+    }
+    mWriterCondition.notify_one();
+    mWriterThread.join();
+    ALOGE_IF(mDroppedChunks > 0,
+             "Dropped all but surface and display creations and deletions from %zu chunks of %d "
+             "increments, the writer fell behind",
+             mDroppedChunks, kChunkIncrements);
+    mOutputFd.reset();
+}
+
+void SurfaceInterceptor::writerLoop() {
+    pthread_setname_np(pthread_self(), "SFInterceptor");
+    std::unique_lock<std::mutex> lock(mWriterMutex);
+    while (true) {
+        mWriterCondition.wait(lock, [this] { return mWriterDone || !mWriterQueue.empty(); });
+        if (mWriterQueue.empty()) {
+            break;
+        }
+        Trace chunk(std::move(mWriterQueue.front()));
+        mWriterQueue.pop_front();
+        lock.unlock();
+
+        ATRACE_NAME("SurfaceInterceptor::writeChunk");
+        // Serialized Traces can be concatenated, so the file stays a valid Trace.
+        std::string output;
+        if (!chunk.IsInitialized()) {
+            ALOGE("Could not save the proto file! There are missing fields");
+        } else if (!chunk.SerializeToString(&output) ||
+                   !base::WriteFully(mOutputFd, output.data(), output.size())) {
+            ALOGE("Could not save the proto file! %s", strerror(errno));
+        }
+
+        lock.lock();
+    }
 }
 
 bool SurfaceInterceptor::isEnabled() {
@@ -146,23 +287,6 @@ void SurfaceInterceptor::addInitialDisplayStateLocked(Increment* increment,
                                display.viewport, display.frame);
 }
 
-status_t SurfaceInterceptor::writeProtoFileLocked() {
-    ATRACE_CALL();
-    std::string output;
-
-    if (!mTrace.IsInitialized()) {
-        return NOT_ENOUGH_DATA;
-    }
-    if (!mTrace.SerializeToString(&output)) {
-        return PERMISSION_DENIED;
-    }
-    if (!android::base::WriteStringToFile(output, mOutputFileName, true)) {
-        return PERMISSION_DENIED;
-    }
-
-    return NO_ERROR;
-}
-
 const sp<const Layer> SurfaceInterceptor::getLayer(const wp<const IBinder>& weakHandle) const {
     const sp<const IBinder>& handle(weakHandle.promote());
     const auto layerHandle(static_cast<const Layer::Handle*>(handle.get()));
@@ -193,8 +317,13 @@ int32_t SurfaceInterceptor::getLayerIdFromHandle(const sp<const IBinder>& handle
 }
 
 Increment* SurfaceInterceptor::createTraceIncrementLocked() {
+    const nsecs_t now = elapsedRealtimeNano();
+    // Every increment but the one being created is complete, so this is a safe point to flush.
+    if (mTrace.increment_size() >= kChunkIncrements) {
+        flushChunkLocked(now);
+    }
     Increment* increment(mTrace.add_increment());
-    increment->set_time_stamp(elapsedRealtimeNano());
+    increment->set_time_stamp(now);
     return increment;
 }
 
@@ -19,8 +19,13 @@
 
 #include <frameworks/native/cmds/surfacereplayer/proto/src/trace.pb.h>
 
+#include <condition_variable>
+#include <deque>
 #include <mutex>
+#include <string>
+#include <thread>
 
+#include <android-base/unique_fd.h>
 #include <gui/LayerState.h>
 
 #include <utils/KeyedVector.h>
@@ -82,11 +87,20 @@ namespace impl {
 /*
  * SurfaceInterceptor intercepts and stores incoming streams of window
  * properties on SurfaceFlinger.
+ *
+ * Increments are collected in chunks that a background thread appends to the output file while
+ * recording, so memory use stays bounded. Each chunk is written as a serialized Trace, so the
+ * file as a whole is still a valid Trace. If the writer falls behind, queued chunks are cut down
+ * to their surface and display creations and deletions, so the trace can still be replayed. If debug.sf.interceptor_ring_seconds is set when
+ * recording starts, chunks are instead kept in memory and only the last that many seconds of
+ * increments (plus the initial snapshot and any surface and display creations and deletions) are
+ * written when recording stops.
  */
 class SurfaceInterceptor final : public android::SurfaceInterceptor {
 public:
-    explicit SurfaceInterceptor(SurfaceFlinger* const flinger);
-    ~SurfaceInterceptor() override = default;
+    explicit SurfaceInterceptor(SurfaceFlinger* const flinger,
+                                std::string outputFileName = DEFAULT_FILENAME);
+    ~SurfaceInterceptor() override;
 
     // Both vectors are used to capture the current state of SF as the initial snapshot in the trace
     void enable(const SortedVector<sp<Layer>>& layers,
@@ -121,7 +135,14 @@ private:
     void addInitialSurfaceStateLocked(Increment* increment, const sp<const Layer>& layer);
     void addInitialDisplayStateLocked(Increment* increment, const DisplayDeviceState& display);
 
-    status_t writeProtoFileLocked();
+    // Hands the increments collected so far to the writer thread, or to the ring in ring mode.
+    void flushChunkLocked(nsecs_t now);
+    // Drops ring chunks that are older than mRingDuration, keeping their structural increments.
+    void trimRingLocked(nsecs_t now);
+    void queueChunkLocked(Trace&& chunk);
+    bool startWriterLocked();
+    void stopWriterLocked();
+    void writerLoop();
     const sp<const Layer> getLayer(const wp<const IBinder>& weakHandle) const;
     int32_t getLayerId(const sp<const Layer>& layer) const;
     int32_t getLayerIdFromWeakRef(const wp<const Layer>& layer) const;
@@ -184,10 +205,24 @@ private:
 
 
     bool mEnabled {false};
-    std::string mOutputFileName {DEFAULT_FILENAME};
+    const std::string mOutputFileName;
     std::mutex mTraceMutex {};
+    // Increments not yet flushed.
     Trace mTrace {};
+    // Ring mode state. mRingDuration is 0 when streaming.
+    nsecs_t mRingDuration {0};
+    Trace mRingBase {};
+    std::deque<Trace> mRing {};
     SurfaceFlinger* const mFlinger;
+
+    // Chunks waiting to be appended to mOutputFd by mWriterThread.
+    std::mutex mWriterMutex {};
+    std::condition_variable mWriterCondition {};
+    std::deque<Trace> mWriterQueue {};
+    bool mWriterDone {false};
+    size_t mDroppedChunks {0};
+    base::unique_fd mOutputFd {};
+    std::thread mWriterThread {};
 };
 
 } // namespace impl
@@ -0,0 +1,101 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#undef LOG_TAG
+#define LOG_TAG "LibSurfaceFlingerUnittests"
+
+#include <android-base/file.h>
+#include <android-base/unique_fd.h>
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+
+#include <set>
+#include <string>
+#include <thread>
+
+#include "Layer.h"
+#include "SurfaceInterceptor.h"
+
+namespace android {
+namespace {
+
+constexpr int kNumDisplays = 20;
+constexpr int kVSyncsPerDisplay = 5000;
+
+TEST(SurfaceInterceptorTest, laggingWriterKeepsTraceReplayable) {
+    // Nothing reads the fifo until recording is over, so the writer stalls once the pipe is full
+    // and the interceptor has to drop increments.
+    TemporaryDir dir;
+    const std::string fifo = std::string(dir.path) + "/trace";
+    ASSERT_EQ(0, mkfifo(fifo.c_str(), 0600));
+    base::unique_fd reader(open(fifo.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC));
+    ASSERT_TRUE(reader.ok());
+
+    impl::SurfaceInterceptor interceptor(nullptr, fifo);
+    SortedVector<sp<Layer>> layers;
+    DefaultKeyedVector<wp<IBinder>, DisplayDeviceState> displays;
+    interceptor.enable(layers, displays);
+    ASSERT_TRUE(interceptor.isEnabled());
+
+    std::vector<int32_t> sequenceIds;
+    for (int i = 0; i < kNumDisplays; i++) {
+        DisplayDeviceState display;
+        display.displayName = "display" + std::to_string(i);
+        sequenceIds.push_back(display.sequenceId);
+        interceptor.saveDisplayCreation(display);
+        for (int j = 0; j < kVSyncsPerDisplay; j++) {
+            interceptor.saveVSyncEvent(j);
+        }
+        interceptor.saveDisplayDeletion(display.sequenceId);
+    }
+
+    ASSERT_NE(-1, fcntl(reader, F_SETFL, 0));
+    std::string output;
+    std::thread readerThread([&] { base::ReadFdToString(reader, &output); });
+    interceptor.disable();
+    readerThread.join();
+
+    Trace trace;
+    ASSERT_TRUE(trace.ParseFromString(output));
+
+    int vsyncs = 0;
+    std::set<int32_t> created;
+    std::vector<int32_t> deleted;
+    for (const Increment& increment : trace.increment()) {
+        switch (increment.increment_case()) {
+            case Increment::kVsyncEvent:
+                vsyncs++;
+                break;
+            case Increment::kDisplayCreation:
+                EXPECT_TRUE(created.insert(increment.display_creation().id()).second);
+                break;
+            case Increment::kDisplayDeletion:
+                // a display that was never created can't be deleted on replay
+                EXPECT_EQ(1u, created.count(increment.display_deletion().id()));
+                deleted.push_back(increment.display_deletion().id());
+                break;
+            default:
+                break;
+        }
+    }
+    EXPECT_LT(vsyncs, kNumDisplays * kVSyncsPerDisplay) << "the writer never fell behind";
+    EXPECT_EQ(std::set<int32_t>(sequenceIds.begin(), sequenceIds.end()), created);
+    EXPECT_EQ(sequenceIds, deleted);
+}
+
+} // namespace
+} // namespace android